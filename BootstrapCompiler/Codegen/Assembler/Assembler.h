@@ -0,0 +1,54 @@
+#pragma once
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include "../Peephole/Peephole.h"
+
+// A flat binary laid out like `nasm -f bin`: .text starts at the org
+// address, .data follows it and .bss follows .data, each 4-byte aligned.
+// Only .text and .data are stored; .bss is address space past the end.
+typedef struct {
+    unsigned char* bytes;
+    size_t size;
+    unsigned int org;
+    unsigned int bss_size;
+    int instructions;     // Instructions encoded, for reports
+} FlatImage;
+
+typedef struct {
+    int line;             // 1-based index into the lines, 0 if none applies
+    char message[160];
+} AsmError;
+
+// Encodes NASM-syntax lines straight into a flat binary. The accepted
+// subset is what the code generator and its runtime emit, plus the usual
+// kernel instructions for inline asm:
+//
+//   directives   [BITS 32], [org N], section .text/.data/.bss, global,
+//                extern, align, alignb, NAME equ EXPR, times N ...
+//   data         db, dw, dd with numbers, symbols, '...', "..." and `...`
+//                strings (with C escapes); resb, resw, resd
+//   operands     8/16/32-bit general registers, cr0/cr2/cr3/cr4, segment
+//                registers, [base + index*scale + disp] memory with an
+//                optional segment override, byte/word/dword sizes, and
+//                expressions over numbers, characters, labels, $ and $$
+//   instructions mov movzx movsx lea xchg push pop, add or adc sbb and sub
+//                xor cmp test, inc dec neg not mul imul div idiv, rol ror
+//                rcl rcr shl sal shr sar, jmp jcc call ret loop loope
+//                loopne jecxz, setcc cmovcc, int in out lgdt lidt sgdt
+//                sidt, string instructions with rep/repe/repne, and the
+//                operand-less ones (cld cli sti hlt cdq iret pushad ...)
+//
+// Jumps are relaxed to their short form where the target is in reach and
+// immediates and displacements use 8 bits where they fit. Local labels
+// (.name) belong to the last label without a dot, as in NASM.
+// Returns 0 and fills error on the first problem.
+int assemble_flat(const AsmLine* lines, int count, FlatImage* image, AsmError* error);
+
+// The bytes each line takes in the layout assemble_flat settles on, into
+// sizes, which has count entries. Returns 0 and fills error as above.
+int assemble_line_sizes(const AsmLine* lines, int count, unsigned int* sizes, AsmError* error);
+
+void flat_image_free(FlatImage* image);
+
+#endif // !ASSEMBLER_H
@@ -0,0 +1,2064 @@
+#include "../Assembler.h"
+#include "../../../Memory/NameTable/NameTable.h"
+
+#define MAX_OPERANDS 3
+#define MAX_PASSES 64
+#define MAX_EQU_DEPTH 32
+#define MAX_WORD 16
+
+enum { SECTION_TEXT, SECTION_DATA, SECTION_BSS, SECTION_COUNT };
+
+/* ====================== Registers ====================== */
+
+typedef enum {
+    REG_GENERAL,
+    REG_CONTROL,
+    REG_SEGMENT
+} RegClass;
+
+typedef struct {
+    const char* name;
+    RegClass kind;
+    int number;           // ModRM encoding
+    int size;
+} Register;
+
+static const Register g_registers[] = {
+    { "eax", REG_GENERAL, 0, 4 }, { "ecx", REG_GENERAL, 1, 4 },
+    { "edx", REG_GENERAL, 2, 4 }, { "ebx", REG_GENERAL, 3, 4 },
+    { "esp", REG_GENERAL, 4, 4 }, { "ebp", REG_GENERAL, 5, 4 },
+    { "esi", REG_GENERAL, 6, 4 }, { "edi", REG_GENERAL, 7, 4 },
+    { "ax",  REG_GENERAL, 0, 2 }, { "cx",  REG_GENERAL, 1, 2 },
+    { "dx",  REG_GENERAL, 2, 2 }, { "bx",  REG_GENERAL, 3, 2 },
+    { "sp",  REG_GENERAL, 4, 2 }, { "bp",  REG_GENERAL, 5, 2 },
+    { "si",  REG_GENERAL, 6, 2 }, { "di",  REG_GENERAL, 7, 2 },
+    { "al",  REG_GENERAL, 0, 1 }, { "cl",  REG_GENERAL, 1, 1 },
+    { "dl",  REG_GENERAL, 2, 1 }, { "bl",  REG_GENERAL, 3, 1 },
+    { "ah",  REG_GENERAL, 4, 1 }, { "ch",  REG_GENERAL, 5, 1 },
+    { "dh",  REG_GENERAL, 6, 1 }, { "bh",  REG_GENERAL, 7, 1 },
+    { "cr0", REG_CONTROL, 0, 4 }, { "cr2", REG_CONTROL, 2, 4 },
+    { "cr3", REG_CONTROL, 3, 4 }, { "cr4", REG_CONTROL, 4, 4 },
+    { "es",  REG_SEGMENT, 0, 2 }, { "cs",  REG_SEGMENT, 1, 2 },
+    { "ss",  REG_SEGMENT, 2, 2 }, { "ds",  REG_SEGMENT, 3, 2 },
+    { "fs",  REG_SEGMENT, 4, 2 }, { "gs",  REG_SEGMENT, 5, 2 },
+};
+
+#define REGISTER_COUNT ((int)(sizeof(g_registers) / sizeof(g_registers[0])))
+
+// Segment override prefixes by segment register number
+static const unsigned char g_segment_prefix[] = { 0x26, 0x2E, 0x36, 0x3E, 0x64, 0x65 };
+
+/* ====================== Mnemonics ====================== */
+
+typedef enum {
+    ENC_FIXED,            // No operands; bytes holds the whole encoding
+    ENC_PREFIX,           // rep, repe, repne, lock
+    ENC_ALU,              // add or adc sbb and sub xor cmp; code is the group
+    ENC_MOV,
+    ENC_MOVX,             // movzx, movsx; code is the second opcode byte
+    ENC_LEA,
+    ENC_XCHG,
+    ENC_TEST,
+    ENC_INCDEC,           // code 0 inc, 1 dec
+    ENC_UNARY,            // F6/F7 group; code is the ModRM reg field
+    ENC_IMUL,
+    ENC_SHIFT,            // code is the ModRM reg field
+    ENC_PUSH,
+    ENC_POP,
+    ENC_JMP,
+    ENC_CALL,
+    ENC_JCC,              // code is the condition
+    ENC_LOOP,             // code is the opcode
+    ENC_RET,
+    ENC_SETCC,
+    ENC_CMOV,
+    ENC_INT,
+    ENC_IN,
+    ENC_OUT,
+    ENC_DESCRIPTOR        // 0F 01 group; code is the ModRM reg field
+} Encoding;
+
+typedef struct {
+    const char* name;
+    Encoding encoding;
+    int code;
+    unsigned char bytes[3];
+    int length;
+} Mnemonic;
+
+static const Mnemonic g_mnemonics[] = {
+    { "add",  ENC_ALU, 0 }, { "or",   ENC_ALU, 1 }, { "adc", ENC_ALU, 2 },
+    { "sbb",  ENC_ALU, 3 }, { "and",  ENC_ALU, 4 }, { "sub", ENC_ALU, 5 },
+    { "xor",  ENC_ALU, 6 }, { "cmp",  ENC_ALU, 7 },
+    { "mov",  ENC_MOV, 0 }, { "movzx", ENC_MOVX, 0xB6 }, { "movsx", ENC_MOVX, 0xBE },
+    { "lea",  ENC_LEA, 0 }, { "xchg", ENC_XCHG, 0 }, { "test", ENC_TEST, 0 },
+    { "inc",  ENC_INCDEC, 0 }, { "dec", ENC_INCDEC, 1 },
+    { "not",  ENC_UNARY, 2 }, { "neg", ENC_UNARY, 3 }, { "mul", ENC_UNARY, 4 },
+    { "div",  ENC_UNARY, 6 }, { "idiv", ENC_UNARY, 7 }, { "imul", ENC_IMUL, 5 },
+    { "rol",  ENC_SHIFT, 0 }, { "ror", ENC_SHIFT, 1 }, { "rcl", ENC_SHIFT, 2 },
+    { "rcr",  ENC_SHIFT, 3 }, { "shl", ENC_SHIFT, 4 }, { "sal", ENC_SHIFT, 4 },
+    { "shr",  ENC_SHIFT, 5 }, { "sar", ENC_SHIFT, 7 },
+    { "push", ENC_PUSH, 0 }, { "pop", ENC_POP, 0 },
+    { "jmp",  ENC_JMP, 0 }, { "call", ENC_CALL, 0 }, { "ret", ENC_RET, 0 },
+    { "loopne", ENC_LOOP, 0xE0 }, { "loopnz", ENC_LOOP, 0xE0 },
+    { "loope", ENC_LOOP, 0xE1 }, { "loopz", ENC_LOOP, 0xE1 },
+    { "loop", ENC_LOOP, 0xE2 }, { "jecxz", ENC_LOOP, 0xE3 },
+    { "int",  ENC_INT, 0 }, { "in", ENC_IN, 0 }, { "out", ENC_OUT, 0 },
+    { "sgdt", ENC_DESCRIPTOR, 0 }, { "sidt", ENC_DESCRIPTOR, 1 },
+    { "lgdt", ENC_DESCRIPTOR, 2 }, { "lidt", ENC_DESCRIPTOR, 3 },
+    { "rep",  ENC_PREFIX, 0xF3 }, { "repe", ENC_PREFIX, 0xF3 }, { "repz", ENC_PREFIX, 0xF3 },
+    { "repne", ENC_PREFIX, 0xF2 }, { "repnz", ENC_PREFIX, 0xF2 }, { "lock", ENC_PREFIX, 0xF0 },
+    { "nop",  ENC_FIXED, 0, { 0x90 }, 1 },       { "hlt",   ENC_FIXED, 0, { 0xF4 }, 1 },
+    { "cli",  ENC_FIXED, 0, { 0xFA }, 1 },       { "sti",   ENC_FIXED, 0, { 0xFB }, 1 },
+    { "cld",  ENC_FIXED, 0, { 0xFC }, 1 },       { "std",   ENC_FIXED, 0, { 0xFD }, 1 },
+    { "clc",  ENC_FIXED, 0, { 0xF8 }, 1 },       { "stc",   ENC_FIXED, 0, { 0xF9 }, 1 },
+    { "cmc",  ENC_FIXED, 0, { 0xF5 }, 1 },       { "cdq",   ENC_FIXED, 0, { 0x99 }, 1 },
+    { "cwde", ENC_FIXED, 0, { 0x98 }, 1 },       { "cbw",   ENC_FIXED, 0, { 0x66, 0x98 }, 2 },
+    { "cwd",  ENC_FIXED, 0, { 0x66, 0x99 }, 2 }, { "leave", ENC_FIXED, 0, { 0xC9 }, 1 },
+    { "pushad", ENC_FIXED, 0, { 0x60 }, 1 },     { "popad", ENC_FIXED, 0, { 0x61 }, 1 },
+    { "pusha", ENC_FIXED, 0, { 0x60 }, 1 },      { "popa",  ENC_FIXED, 0, { 0x61 }, 1 },
+    { "pushfd", ENC_FIXED, 0, { 0x9C }, 1 },     { "popfd", ENC_FIXED, 0, { 0x9D }, 1 },
+    { "pushf", ENC_FIXED, 0, { 0x9C }, 1 },      { "popf",  ENC_FIXED, 0, { 0x9D }, 1 },
+    { "iret", ENC_FIXED, 0, { 0xCF }, 1 },       { "iretd", ENC_FIXED, 0, { 0xCF }, 1 },
+    { "int3", ENC_FIXED, 0, { 0xCC }, 1 },       { "sahf",  ENC_FIXED, 0, { 0x9E }, 1 },
+    { "lahf", ENC_FIXED, 0, { 0x9F }, 1 },
+    { "lodsb", ENC_FIXED, 0, { 0xAC }, 1 },      { "lodsw", ENC_FIXED, 0, { 0x66, 0xAD }, 2 },
+    { "lodsd", ENC_FIXED, 0, { 0xAD }, 1 },      { "stosb", ENC_FIXED, 0, { 0xAA }, 1 },
+    { "stosw", ENC_FIXED, 0, { 0x66, 0xAB }, 2 }, { "stosd", ENC_FIXED, 0, { 0xAB }, 1 },
+    { "movsb", ENC_FIXED, 0, { 0xA4 }, 1 },      { "movsw", ENC_FIXED, 0, { 0x66, 0xA5 }, 2 },
+    { "movsd", ENC_FIXED, 0, { 0xA5 }, 1 },      { "cmpsb", ENC_FIXED, 0, { 0xA6 }, 1 },
+    { "cmpsw", ENC_FIXED, 0, { 0x66, 0xA7 }, 2 }, { "cmpsd", ENC_FIXED, 0, { 0xA7 }, 1 },
+    { "scasb", ENC_FIXED, 0, { 0xAE }, 1 },      { "scasw", ENC_FIXED, 0, { 0x66, 0xAF }, 2 },
+    { "scasd", ENC_FIXED, 0, { 0xAF }, 1 },
+};
+
+#define MNEMONIC_COUNT ((int)(sizeof(g_mnemonics) / sizeof(g_mnemonics[0])))
+
+// Condition suffixes shared by jcc, setcc and cmovcc
+static const struct { const char* suffix; int code; } g_conditions[] = {
+    { "o", 0 }, { "no", 1 }, { "b", 2 }, { "c", 2 }, { "nae", 2 }, { "nb", 3 },
+    { "ae", 3 }, { "nc", 3 }, { "e", 4 }, { "z", 4 }, { "ne", 5 }, { "nz", 5 },
+    { "be", 6 }, { "na", 6 }, { "a", 7 }, { "nbe", 7 }, { "s", 8 }, { "ns", 9 },
+    { "p", 10 }, { "pe", 10 }, { "np", 11 }, { "po", 11 }, { "l", 12 }, { "nge", 12 },
+    { "ge", 13 }, { "nl", 13 }, { "le", 14 }, { "ng", 14 }, { "g", 15 }, { "nle", 15 },
+};
+
+#define CONDITION_COUNT ((int)(sizeof(g_conditions) / sizeof(g_conditions[0])))
+
+/* ====================== Statements ====================== */
+
+typedef enum {
+    OPND_NONE,
+    OPND_REG,
+    OPND_MEM,
+    OPND_IMM
+} OperandKind;
+
+typedef enum {
+    JUMP_ANY,
+    JUMP_SHORT,
+    JUMP_NEAR
+} JumpForm;
+
+typedef struct {
+    OperandKind kind;
+    int size;             // 1, 2 or 4 bytes; 0 if nothing says
+    const Register* reg;  // OPND_REG
+    int base;             // OPND_MEM register numbers, -1 if absent
+    int index;
+    int scale;
+    int segment;          // Override prefix, -1 if none
+    const char* expr;     // Immediate or displacement, NULL if none
+    int relocatable;      // expr depends on layout, so it gets 32 bits
+    JumpForm jump;
+} Operand;
+
+typedef enum {
+    STMT_LABEL,
+    STMT_EQU,
+    STMT_INSTRUCTION,
+    STMT_DATA,            // db, dw, dd
+    STMT_RESERVE,         // resb, resw, resd
+    STMT_ALIGN            // align pads with nop, alignb with zeros
+} StmtKind;
+
+typedef struct {
+    StmtKind kind;
+    int line;
+    int section;
+    const char* scope;    // Label that .local names belong to
+    const char* times;    // Repeat count, NULL if once
+    unsigned int offset;  // In its section, from the latest layout
+    unsigned int size;
+
+    const Mnemonic* mnemonic;
+    unsigned char prefix;
+    Operand* operands;
+    int operand_count;
+    int variable;         // Size can change between layout passes
+    int long_jump;        // Relative jump uses its 32-bit form
+    int out_of_range;     // Short jump missed its target in this pass
+
+    int unit;             // Bytes per item of data, reserve and alignb
+    const char* text;     // Data items, reserve count, alignment or equ value
+    int symbol;           // STMT_LABEL and STMT_EQU
+} Stmt;
+
+typedef struct {
+    const char* name;
+    int stmt;
+    long long value;      // Labels: address from the latest layout
+} Symbol;
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} Bytes;
+
+typedef struct {
+    unsigned char bytes[16];
+    int length;
+} Code;
+
+typedef struct {
+    Arena* storage;
+    NameTable mnemonic_index;
+    Mnemonic* conditionals;
+    int conditional_count;
+
+    Stmt* stmts;
+    int stmt_count;
+    int stmt_capacity;
+    Operand no_operands[MAX_OPERANDS];   // All zero, shared by statements without any
+    Symbol* symbols;
+    int symbol_count;
+    int symbol_capacity;
+    NameTable symbol_index;
+
+    int section;          // Section being parsed
+    const char* scope;
+    unsigned int org;
+    unsigned int base[SECTION_COUNT];
+    unsigned int size[SECTION_COUNT];
+
+    int final;            // Values must resolve and short jumps must reach
+    int equ_depth;
+    AsmError* error;
+    int failed;
+} Assembler;
+
+static int fail(Assembler* as, int line, const char* fmt, ...) {
+    if (as->failed) return 0;
+    as->failed = 1;
+    as->error->line = line;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(as->error->message, sizeof(as->error->message), fmt, args);
+    va_end(args);
+    return 0;
+}
+
+/* ====================== Byte Buffers ====================== */
+
+static void bytes_reserve(Bytes* b, size_t extra) {
+    if (b->size + extra <= b->capacity) return;
+    while (b->size + extra > b->capacity) {
+        b->capacity = b->capacity == 0 ? 4096 : b->capacity * 2;
+    }
+    b->data = (unsigned char*)realloc(b->data, b->capacity);
+}
+
+static void bytes_put(Bytes* b, const void* src, size_t len) {
+    if (len == 0) return;
+    bytes_reserve(b, len);
+    memcpy(b->data + b->size, src, len);
+    b->size += len;
+}
+
+static void bytes_fill(Bytes* b, unsigned char value, size_t len) {
+    if (len == 0) return;
+    bytes_reserve(b, len);
+    memset(b->data + b->size, value, len);
+    b->size += len;
+}
+
+static void put8(Code* c, long long value) {
+    c->bytes[c->length++] = (unsigned char)value;
+}
+
+static void put16(Code* c, long long value) {
+    put8(c, value);
+    put8(c, value >> 8);
+}
+
+static void put32(Code* c, long long value) {
+    put16(c, value);
+    put16(c, value >> 16);
+}
+
+static void put_imm(Code* c, int size, long long value) {
+    if (size == 1) put8(c, value);
+    else if (size == 2) put16(c, value);
+    else put32(c, value);
+}
+
+/* ====================== Names ====================== */
+
+static int is_name_start(char c) {
+    return isalpha((unsigned char)c) || c == '_' || c == '.' || c == '?' || c == '@';
+}
+
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '?' || c == '@' ||
+        c == '$' || c == '#' || c == '~';
+}
+
+static char* skip_spaces(char* s) {
+    while (*s == ' ' || *s == '\t' || *s == '\r') s++;
+    return s;
+}
+
+static void trim_end(char* s) {
+    size_t len = strlen(s);
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t' || s[len - 1] == '\r')) s[--len] = '\0';
+}
+
+// Lower-cased copy of a word of at most MAX_WORD - 1 characters; 0 if longer
+static int lower_word(const char* s, size_t len, char* out) {
+    if (len == 0 || len >= MAX_WORD) return 0;
+    for (size_t i = 0; i < len; i++) out[i] = (char)tolower((unsigned char)s[i]);
+    out[len] = '\0';
+    return 1;
+}
+
+static const Register* find_register(const char* s, size_t len) {
+    char word[MAX_WORD];
+    if (!lower_word(s, len, word)) return NULL;
+    for (int i = 0; i < REGISTER_COUNT; i++) {
+        if (strcmp(word, g_registers[i].name) == 0) return &g_registers[i];
+    }
+    return NULL;
+}
+
+static const Mnemonic* find_mnemonic(Assembler* as, const char* s, size_t len) {
+    char word[MAX_WORD];
+    if (!lower_word(s, len, word)) return NULL;
+    int index = name_table_get(&as->mnemonic_index, word, -1);
+    if (index < 0) return NULL;
+    return index < MNEMONIC_COUNT ? &g_mnemonics[index] : &as->conditionals[index - MNEMONIC_COUNT];
+}
+
+static void index_mnemonics(Assembler* as) {
+    name_table_init(&as->mnemonic_index);
+    for (int i = 0; i < MNEMONIC_COUNT; i++) {
+        name_table_put(&as->mnemonic_index, g_mnemonics[i].name, i);
+    }
+
+    static const struct { const char* prefix; Encoding encoding; } families[] = {
+        { "j", ENC_JCC }, { "set", ENC_SETCC }, { "cmov", ENC_CMOV }
+    };
+    as->conditionals = (Mnemonic*)arena_alloc(as->storage, sizeof(Mnemonic) * 3 * CONDITION_COUNT);
+    as->conditional_count = 0;
+    for (int f = 0; f < 3; f++) {
+        for (int i = 0; i < CONDITION_COUNT; i++) {
+            char name[MAX_WORD];
+            snprintf(name, sizeof(name), "%s%s", families[f].prefix, g_conditions[i].suffix);
+            Mnemonic* m = &as->conditionals[as->conditional_count];
+            memset(m, 0, sizeof(Mnemonic));
+            m->name = arena_strdup(as->storage, name);
+            m->encoding = families[f].encoding;
+            m->code = g_conditions[i].code;
+            name_table_put(&as->mnemonic_index, m->name, MNEMONIC_COUNT + as->conditional_count++);
+        }
+    }
+}
+
+// Local names (.x) are qualified by the label they belong to
+static const char* qualify(const char* scope, const char* name, size_t len, char* buf, size_t size) {
+    if (name[0] == '.' && !(len > 1 && name[1] == '.') && scope) {
+        snprintf(buf, size, "%s%.*s", scope, (int)len, name);
+    }
+    else {
+        snprintf(buf, size, "%.*s", (int)len, name);
+    }
+    return buf;
+}
+
+static int find_symbol(Assembler* as, const char* scope, const char* name, size_t len) {
+    char buf[256];
+    return name_table_get(&as->symbol_index, qualify(scope, name, len, buf, sizeof(buf)), -1);
+}
+
+static Stmt* new_stmt(Assembler* as, StmtKind kind, int line) {
+    if (as->stmt_count >= as->stmt_capacity) {
+        as->stmt_capacity = as->stmt_capacity == 0 ? 1024 : as->stmt_capacity * 2;
+        as->stmts = (Stmt*)realloc(as->stmts, sizeof(Stmt) * as->stmt_capacity);
+    }
+    Stmt* st = &as->stmts[as->stmt_count++];
+    memset(st, 0, sizeof(Stmt));
+    st->operands = as->no_operands;
+    st->kind = kind;
+    st->line = line;
+    st->section = as->section;
+    st->scope = as->scope;
+    st->symbol = -1;
+    return st;
+}
+
+static int define_symbol(Assembler* as, const char* name, size_t len, int line, StmtKind kind) {
+    char buf[256];
+    int is_local = name[0] == '.' && !(len > 1 && name[1] == '.');
+    if (!is_local && kind == STMT_LABEL) as->scope = arena_strndup(as->storage, name, len);
+
+    qualify(as->scope, name, len, buf, sizeof(buf));
+    if (name_table_get(&as->symbol_index, buf, -1) >= 0) {
+        return fail(as, line, "symbol '%s' redefined", buf);
+    }
+
+    if (as->symbol_count >= as->symbol_capacity) {
+        as->symbol_capacity = as->symbol_capacity == 0 ? 256 : as->symbol_capacity * 2;
+        as->symbols = (Symbol*)realloc(as->symbols, sizeof(Symbol) * as->symbol_capacity);
+    }
+    Symbol* sym = &as->symbols[as->symbol_count];
+    sym->name = arena_strdup(as->storage, buf);
+    sym->value = 0;
+    name_table_put(&as->symbol_index, sym->name, as->symbol_count);
+
+    Stmt* st = new_stmt(as, kind, line);
+    st->symbol = as->symbol_count;
+    sym->stmt = as->stmt_count - 1;
+    as->symbol_count++;
+    return 1;
+}
+
+/* ====================== Expressions ====================== */
+
+typedef struct {
+    Assembler* as;
+    const Stmt* stmt;
+    const char* p;
+    int ok;
+} ExprParser;
+
+static long long expr_or(ExprParser* e);
+
+static void expr_skip(ExprParser* e) {
+    while (*e->p == ' ' || *e->p == '\t') e->p++;
+}
+
+static int expr_error(ExprParser* e, const char* message) {
+    if (e->ok) fail(e->as, e->stmt->line, "%s", message);
+    e->ok = 0;
+    return 0;
+}
+
+// Characters of a quoted constant, first character in the lowest byte
+static long long expr_chars(ExprParser* e) {
+    char quote = *e->p++;
+    long long value = 0;
+    int shift = 0;
+    while (*e->p && *e->p != quote) {
+        if (shift < 64) value |= (long long)(unsigned char)*e->p << shift;
+        shift += 8;
+        e->p++;
+    }
+    if (*e->p != quote) return expr_error(e, "unterminated character constant");
+    e->p++;
+    return value;
+}
+
+static long long expr_number(ExprParser* e) {
+    const char* start = e->p;
+    while (isalnum((unsigned char)*e->p) || *e->p == '_') e->p++;
+    size_t len = (size_t)(e->p - start);
+    char digits[64];
+    if (len >= sizeof(digits)) return expr_error(e, "number too long");
+
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (start[i] != '_') digits[n++] = start[i];
+    }
+    digits[n] = '\0';
+
+    int base = 10;
+    char* text = digits;
+    char last = (char)tolower((unsigned char)digits[n - 1]);
+    if (n > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) { base = 16; text += 2; }
+    else if (n > 2 && digits[0] == '0' && (digits[1] == 'b' || digits[1] == 'B')) { base = 2; text += 2; }
+    else if (last == 'h') { base = 16; digits[n - 1] = '\0'; }
+    else if (last == 'b' && strspn(digits, "01") == n - 1) { base = 2; digits[n - 1] = '\0'; }
+
+    char* end;
+    long long value = (long long)strtoull(text, &end, base);
+    if (*end || end == text) return expr_error(e, "invalid number");
+    return value;
+}
+
+static long long symbol_value(Assembler* as, const Stmt* stmt, int index, int* ok);
+
+static long long expr_primary(ExprParser* e) {
+    expr_skip(e);
+    char c = *e->p;
+
+    if (c == '(') {
+        e->p++;
+        long long value = expr_or(e);
+        expr_skip(e);
+        if (*e->p != ')') return expr_error(e, "expected ')'");
+        e->p++;
+        return value;
+    }
+    if (c == '\'' || c == '"' || c == '`') return expr_chars(e);
+    if (isdigit((unsigned char)c)) return expr_number(e);
+    if (c == '$' && !is_name_char(e->p[1])) {
+        e->p++;
+        unsigned int base = e->as->base[e->stmt->section];
+        return base + e->stmt->offset;
+    }
+    if (c == '$' && e->p[1] == '$') {
+        e->p += 2;
+        return e->as->base[e->stmt->section];
+    }
+    if (is_name_start(c)) {
+        const char* name = e->p;
+        while (is_name_char(*e->p)) e->p++;
+        size_t len = (size_t)(e->p - name);
+        if (find_register(name, len)) return expr_error(e, "register in an expression");
+
+        int index = find_symbol(e->as, e->stmt->scope, name, len);
+        if (index < 0) {
+            if (e->as->final) {
+                char buf[256];
+                fail(e->as, e->stmt->line, "undefined symbol '%s'",
+                    qualify(e->stmt->scope, name, len, buf, sizeof(buf)));
+                e->ok = 0;
+            }
+            return 0;
+        }
+        return symbol_value(e->as, e->stmt, index, &e->ok);
+    }
+    return expr_error(e, "expected an expression");
+}
+
+static long long expr_unary(ExprParser* e) {
+    expr_skip(e);
+    if (*e->p == '-') { e->p++; return -expr_unary(e); }
+    if (*e->p == '+') { e->p++; return expr_unary(e); }
+    if (*e->p == '~') { e->p++; return ~expr_unary(e); }
+    return expr_primary(e);
+}
+
+static long long expr_mul(ExprParser* e) {
+    long long value = expr_unary(e);
+    while (e->ok) {
+        expr_skip(e);
+        char op = *e->p;
+        if (op != '*' && op != '/' && op != '%') break;
+        e->p++;
+        long long right = expr_unary(e);
+        if (op == '*') value *= right;
+        else if (right == 0) value = e->as->final ? expr_error(e, "division by zero") : 0;
+        else value = op == '/' ? value / right : value % right;
+    }
+    return value;
+}
+
+static long long expr_add(ExprParser* e) {
+    long long value = expr_mul(e);
+    while (e->ok) {
+        expr_skip(e);
+        char op = *e->p;
+        if (op != '+' && op != '-') break;
+        e->p++;
+        long long right = expr_mul(e);
+        value = op == '+' ? value + right : value - right;
+    }
+    return value;
+}
+
+static long long expr_shift(ExprParser* e) {
+    long long value = expr_add(e);
+    while (e->ok) {
+        expr_skip(e);
+        if (!((e->p[0] == '<' && e->p[1] == '<') || (e->p[0] == '>' && e->p[1] == '>'))) break;
+        int left = e->p[0] == '<';
+        e->p += 2;
+        long long right = expr_add(e) & 63;
+        value = left ? value << right : value >> right;
+    }
+    return value;
+}
+
+static long long expr_and(ExprParser* e) {
+    long long value = expr_shift(e);
+    while (e->ok) {
+        expr_skip(e);
+        if (*e->p != '&') break;
+        e->p++;
+        value &= expr_shift(e);
+    }
+    return value;
+}
+
+static long long expr_xor(ExprParser* e) {
+    long long value = expr_and(e);
+    while (e->ok) {
+        expr_skip(e);
+        if (*e->p != '^') break;
+        e->p++;
+        value ^= expr_and(e);
+    }
+    return value;
+}
+
+static long long expr_or(ExprParser* e) {
+    long long value = expr_xor(e);
+    while (e->ok) {
+        expr_skip(e);
+        if (*e->p != '|') break;
+        e->p++;
+        value |= expr_xor(e);
+    }
+    return value;
+}
+
+// Values are only final once layout has settled; until then an undefined
+// name reads as 0
+static int eval(Assembler* as, const Stmt* stmt, const char* text, long long* value) {
+    ExprParser e = { as, stmt, text, 1 };
+    *value = expr_or(&e);
+    expr_skip(&e);
+    if (e.ok && *e.p) expr_error(&e, "unexpected text in expression");
+    return e.ok;
+}
+
+static long long symbol_value(Assembler* as, const Stmt* stmt, int index, int* ok) {
+    Symbol* sym = &as->symbols[index];
+    const Stmt* def = &as->stmts[sym->stmt];
+    if (def->kind != STMT_EQU) return sym->value;
+
+    if (as->equ_depth >= MAX_EQU_DEPTH) {
+        *ok = 0;
+        return fail(as, stmt->line, "equ '%s' refers to itself", sym->name);
+    }
+    as->equ_depth++;
+    long long value;
+    if (!eval(as, def, def->text, &value)) *ok = 0;
+    as->equ_depth--;
+    return value;
+}
+
+// Whether text refers to $ or a label, directly or through equ, so its
+// value depends on layout and always gets 32 bits. Names not defined yet
+// count as labels.
+static int is_relocatable(Assembler* as, const char* scope, const char* text, int depth) {
+    if (depth >= MAX_EQU_DEPTH) return 1;
+    for (const char* p = text; *p; ) {
+        if (*p == '\'' || *p == '"' || *p == '`') {
+            char quote = *p++;
+            while (*p && *p != quote) p++;
+            if (*p) p++;
+        }
+        else if (isdigit((unsigned char)*p)) {
+            while (isalnum((unsigned char)*p) || *p == '_') p++;
+        }
+        else if (*p == '$' && !is_name_char(p[1])) {
+            return 1;
+        }
+        else if (*p == '$' && p[1] == '$') {
+            return 1;
+        }
+        else if (is_name_start(*p)) {
+            const char* name = p;
+            while (is_name_char(*p)) p++;
+            int index = find_symbol(as, scope, name, (size_t)(p - name));
+            if (index < 0) return 1;
+            const Stmt* def = &as->stmts[as->symbols[index].stmt];
+            if (def->kind != STMT_EQU || is_relocatable(as, def->scope, def->text, depth + 1)) return 1;
+        }
+        else p++;
+    }
+    return 0;
+}
+
+// Run once every symbol is known. Operand encodings depend on it, and so
+// does which statements layout has to measure again on every pass.
+static void classify_statements(Assembler* as) {
+    for (int i = 0; i < as->stmt_count; i++) {
+        Stmt* st = &as->stmts[i];
+        for (int j = 0; j < st->operand_count; j++) {
+            Operand* op = &st->operands[j];
+            if (op->expr) op->relocatable = is_relocatable(as, st->scope, op->expr, 0);
+        }
+
+        // Layout-dependent values otherwise take their 32-bit form, so only
+        // relative jumps, alignment and counts can change size
+        Encoding encoding = st->mnemonic ? st->mnemonic->encoding : ENC_FIXED;
+        st->variable = st->kind == STMT_ALIGN ||
+            (st->times && is_relocatable(as, st->scope, st->times, 0)) ||
+            (st->kind == STMT_RESERVE && is_relocatable(as, st->scope, st->text, 0)) ||
+            ((encoding == ENC_JMP || encoding == ENC_JCC || encoding == ENC_LOOP) &&
+                st->operand_count == 1 && st->operands[0].kind == OPND_IMM);
+    }
+}
+
+/* ====================== Operand Parsing ====================== */
+
+static int keyword_at(const char* s, const char* word) {
+    size_t len = strlen(word);
+    for (size_t i = 0; i < len; i++) {
+        if (tolower((unsigned char)s[i]) != word[i]) return 0;
+    }
+    return !is_name_char(s[len]);
+}
+
+static int add_address_register(Assembler* as, int line, Operand* op, const Register* reg, int scale) {
+    if (reg->kind != REG_GENERAL || reg->size != 4) {
+        return fail(as, line, "'%s' cannot address memory", reg->name);
+    }
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+        return fail(as, line, "scale must be 1, 2, 4 or 8");
+    }
+
+    if (scale == 1 && op->base < 0) {
+        op->base = reg->number;
+    }
+    else if (op->index < 0) {
+        op->index = reg->number;
+        op->scale = scale;
+    }
+    else {
+        return fail(as, line, "too many registers in address");
+    }
+
+    // esp can only be a base
+    if (op->index == 4) {
+        if (op->scale != 1 || op->base == 4) return fail(as, line, "esp cannot be an index");
+        op->index = op->base;
+        op->base = 4;
+    }
+    return 1;
+}
+
+// Splits [seg: a + b*4 - 8] into registers and a displacement expression
+static int parse_memory(Assembler* as, int line, char* inner, Operand* op) {
+    op->kind = OPND_MEM;
+    op->base = -1;
+    op->index = -1;
+    op->scale = 1;
+
+    char* colon = strchr(inner, ':');
+    if (colon) {
+        char* seg = skip_spaces(inner);
+        char* seg_end = colon;
+        while (seg_end > seg && (seg_end[-1] == ' ' || seg_end[-1] == '\t')) seg_end--;
+        const Register* reg = find_register(seg, (size_t)(seg_end - seg));
+        if (!reg || reg->kind != REG_SEGMENT) return fail(as, line, "bad segment override");
+        op->segment = reg->number;
+        inner = colon + 1;
+    }
+
+    size_t capacity = strlen(inner) * 2 + 8;
+    char* disp = (char*)arena_alloc(as->storage, capacity);
+    size_t disp_len = 0;
+    disp[0] = '\0';
+
+    char* p = inner;
+    while (*p) {
+        p = skip_spaces(p);
+        char sign = '+';
+        if (*p == '+' || *p == '-') {
+            sign = *p++;
+            p = skip_spaces(p);
+        }
+
+        // The term runs to the next + or - outside parentheses
+        char* start = p;
+        int depth = 0;
+        while (*p) {
+            if (*p == '(') depth++;
+            else if (*p == ')') depth--;
+            else if (*p == '\'' || *p == '"' || *p == '`') {
+                char quote = *p++;
+                while (*p && *p != quote) p++;
+                if (!*p) break;
+            }
+            else if ((*p == '+' || *p == '-') && depth == 0 && p > start) break;
+            p++;
+        }
+        char saved = *p;
+        *p = '\0';
+        trim_end(start);
+        if (*start == '\0') return fail(as, line, "empty term in address");
+
+        // reg, reg*n or n*reg
+        const Register* reg = NULL;
+        int scale = 1;
+        char* star = strchr(start, '*');
+        if (!star) {
+            reg = find_register(start, strlen(start));
+        }
+        else if (!strchr(star + 1, '*')) {
+            char* left = start;
+            char* right = skip_spaces(star + 1);
+            char* left_end = star;
+            while (left_end > left && (left_end[-1] == ' ' || left_end[-1] == '\t')) left_end--;
+            const Register* lreg = find_register(left, (size_t)(left_end - left));
+            const Register* rreg = find_register(right, strlen(right));
+            if (lreg && isdigit((unsigned char)*right)) { reg = lreg; scale = atoi(right); }
+            else if (rreg && isdigit((unsigned char)*left)) { reg = rreg; scale = atoi(left); }
+        }
+
+        if (reg) {
+            if (sign == '-') return fail(as, line, "registers cannot be subtracted");
+            if (!add_address_register(as, line, op, reg, scale)) return 0;
+        }
+        else {
+            disp_len += (size_t)snprintf(disp + disp_len, capacity - disp_len, "%c(%s)", sign, start);
+        }
+        *p = saved;
+    }
+
+    if (disp_len > 0) {
+        op->expr = disp;
+    }
+    return 1;
+}
+
+static int parse_operand(Assembler* as, int line, char* text, Operand* op) {
+    memset(op, 0, sizeof(Operand));
+    op->segment = -1;
+    char* s = skip_spaces(text);
+    trim_end(s);
+
+    // Size and distance keywords
+    while (1) {
+        if (keyword_at(s, "byte")) { op->size = 1; s = skip_spaces(s + 4); }
+        else if (keyword_at(s, "word")) { op->size = 2; s = skip_spaces(s + 4); }
+        else if (keyword_at(s, "dword")) { op->size = 4; s = skip_spaces(s + 5); }
+        else if (keyword_at(s, "short")) { op->jump = JUMP_SHORT; s = skip_spaces(s + 5); }
+        else if (keyword_at(s, "near")) { op->jump = JUMP_NEAR; s = skip_spaces(s + 4); }
+        else break;
+    }
+    if (*s == '\0') return fail(as, line, "missing operand");
+
+    if (*s == '[') {
+        size_t len = strlen(s);
+        if (s[len - 1] != ']') return fail(as, line, "expected ']'");
+        s[len - 1] = '\0';
+        return parse_memory(as, line, s + 1, op);
+    }
+
+    const Register* reg = find_register(s, strlen(s));
+    if (reg) {
+        if (op->size && op->size != reg->size) return fail(as, line, "mismatch in operand sizes");
+        op->kind = OPND_REG;
+        op->reg = reg;
+        op->size = reg->size;
+        return 1;
+    }
+
+    op->kind = OPND_IMM;
+    op->expr = s;
+    return 1;
+}
+
+// Splits on commas outside brackets, parentheses and quotes; -1 on error
+static int split_operands(Assembler* as, int line, char* s, char** parts) {
+    int count = 0;
+    int depth = 0;
+    char* start = s;
+    for (char* p = s; ; p++) {
+        if (*p == '\'' || *p == '"' || *p == '`') {
+            char quote = *p++;
+            while (*p && *p != quote) p++;
+            if (!*p) {
+                fail(as, line, "unterminated string");
+                return -1;
+            }
+        }
+        else if (*p == '[' || *p == '(') depth++;
+        else if (*p == ']' || *p == ')') depth--;
+        else if ((*p == ',' && depth == 0) || *p == '\0') {
+            int end = *p == '\0';
+            *p = '\0';
+            if (count >= MAX_OPERANDS) {
+                fail(as, line, "too many operands");
+                return -1;
+            }
+            parts[count++] = start;
+            start = p + 1;
+            if (end) break;
+        }
+    }
+    return count;
+}
+
+/* ====================== Instruction Encoding ====================== */
+
+static int bad_operands(Assembler* as, const Stmt* st) {
+    return fail(as, st->line, "invalid operands for '%s'", st->mnemonic->name);
+}
+
+static int is_reg(const Operand* op, RegClass kind) {
+    return op->kind == OPND_REG && op->reg->kind == kind;
+}
+
+static int is_rm(const Operand* op) {
+    return op->kind == OPND_MEM || is_reg(op, REG_GENERAL);
+}
+
+static int is_accumulator(const Operand* op) {
+    return is_reg(op, REG_GENERAL) && op->reg->number == 0;
+}
+
+static int fits8(const Operand* op, long long value) {
+    return !op->relocatable && op->size != 4 && value >= -128 && value <= 127;
+}
+
+// Operand size from the registers, else from a size keyword; 0 if neither
+static int operation_size(const Stmt* st) {
+    for (int i = 0; i < st->operand_count; i++) {
+        if (is_reg(&st->operands[i], REG_GENERAL)) return st->operands[i].size;
+    }
+    for (int i = 0; i < st->operand_count; i++) {
+        if (st->operands[i].size) return st->operands[i].size;
+    }
+    return 0;
+}
+
+static int value_of(Assembler* as, const Stmt* st, const Operand* op, long long* value) {
+    *value = 0;
+    return !op->expr || eval(as, st, op->expr, value);
+}
+
+static int put_modrm(Assembler* as, const Stmt* st, Code* c, int reg, const Operand* rm) {
+    if (rm->kind == OPND_REG) {
+        put8(c, 0xC0 | (reg << 3) | rm->reg->number);
+        return 1;
+    }
+
+    long long disp;
+    if (!value_of(as, st, rm, &disp)) return 0;
+    int base = rm->base;
+    int index = rm->index;
+
+    if (base < 0 && index < 0) {
+        put8(c, 0x05 | (reg << 3));
+        put32(c, disp);
+        return 1;
+    }
+
+    int mod;
+    if (base < 0) mod = 0;
+    else if (rm->relocatable) mod = 2;
+    else if (disp == 0 && base != 5) mod = 0;
+    else if (disp >= -128 && disp <= 127) mod = 1;
+    else mod = 2;
+
+    if (index >= 0 || base == 4 || base < 0) {
+        static const int scale_bits[] = { 0, 0, 1, 0, 2, 0, 0, 0, 3 };
+        put8(c, (mod << 6) | (reg << 3) | 4);
+        put8(c, (scale_bits[rm->scale] << 6) | ((index >= 0 ? index : 4) << 3) | (base >= 0 ? base : 5));
+    }
+    else {
+        put8(c, (mod << 6) | (reg << 3) | base);
+    }
+
+    if (mod == 1) put8(c, disp);
+    else if (mod == 2 || base < 0) put32(c, disp);
+    return 1;
+}
+
+// Relative jumps: the short form if it reaches or is forced, else the near one
+static int put_relative(Assembler* as, Stmt* st, Code* c, const Operand* target,
+    int short_op, const unsigned char* near_op, int near_len) {
+    if (target->kind != OPND_IMM) return bad_operands(as, st);
+
+    long long value;
+    if (!value_of(as, st, target, &value)) return 0;
+    long long here = (long long)as->base[st->section] + st->offset + c->length;
+
+    int use_short = short_op >= 0 && target->jump != JUMP_NEAR &&
+        (near_len == 0 || target->jump == JUMP_SHORT || !st->long_jump);
+    if (use_short) {
+        long long rel = value - (here + 2);
+        if (rel < -128 || rel > 127) {
+            if (as->final) return fail(as, st->line, "short jump out of range");
+            st->out_of_range = 1;
+        }
+        put8(c, short_op);
+        put8(c, rel);
+        return 1;
+    }
+
+    for (int i = 0; i < near_len; i++) put8(c, near_op[i]);
+    put32(c, value - (here + near_len + 4));
+    return 1;
+}
+
+static int encode_mov(Assembler* as, Stmt* st, Code* c) {
+    Operand* a = &st->operands[0];
+    Operand* b = &st->operands[1];
+
+    if (is_reg(a, REG_CONTROL) || is_reg(b, REG_CONTROL)) {
+        const Operand* cr = is_reg(a, REG_CONTROL) ? a : b;
+        const Operand* gpr = cr == a ? b : a;
+        if (!is_reg(gpr, REG_GENERAL) || gpr->size != 4) return bad_operands(as, st);
+        put8(c, 0x0F);
+        put8(c, cr == a ? 0x22 : 0x20);
+        put8(c, 0xC0 | (cr->reg->number << 3) | gpr->reg->number);
+        return 1;
+    }
+    if (is_reg(a, REG_SEGMENT)) {
+        if (!is_rm(b) || (b->kind == OPND_REG && b->size == 1)) return bad_operands(as, st);
+        put8(c, 0x8E);
+        return put_modrm(as, st, c, a->reg->number, b);
+    }
+    if (is_reg(b, REG_SEGMENT)) {
+        if (!is_rm(a) || (a->kind == OPND_REG && a->size == 1)) return bad_operands(as, st);
+        if (a->kind == OPND_REG && a->size == 2) put8(c, 0x66);
+        put8(c, 0x8C);
+        return put_modrm(as, st, c, b->reg->number, a);
+    }
+
+    int size = operation_size(st);
+    if (!size) return fail(as, st->line, "operation size not specified");
+    if (a->kind == OPND_REG && b->kind == OPND_REG && a->size != b->size) {
+        return fail(as, st->line, "mismatch in operand sizes");
+    }
+    if (size == 2) put8(c, 0x66);
+
+    long long value;
+    if (a->kind == OPND_REG && b->kind == OPND_IMM) {
+        if (!value_of(as, st, b, &value)) return 0;
+        put8(c, (size == 1 ? 0xB0 : 0xB8) + a->reg->number);
+        put_imm(c, size, value);
+        return 1;
+    }
+    if (a->kind == OPND_MEM && b->kind == OPND_IMM) {
+        if (!value_of(as, st, b, &value)) return 0;
+        put8(c, size == 1 ? 0xC6 : 0xC7);
+        if (!put_modrm(as, st, c, 0, a)) return 0;
+        put_imm(c, size, value);
+        return 1;
+    }
+
+    // Accumulator to or from a plain address has its own short form
+    const Operand* moffs = a->kind == OPND_MEM ? a : b;
+    const Operand* acc = moffs == a ? b : a;
+    if (moffs->kind == OPND_MEM && moffs->base < 0 && moffs->index < 0 && is_accumulator(acc)) {
+        if (!value_of(as, st, moffs, &value)) return 0;
+        put8(c, (size == 1 ? 0xA0 : 0xA1) + (moffs == a ? 2 : 0));
+        put32(c, value);
+        return 1;
+    }
+
+    if (is_reg(b, REG_GENERAL) && is_rm(a)) {
+        put8(c, size == 1 ? 0x88 : 0x89);
+        return put_modrm(as, st, c, b->reg->number, a);
+    }
+    if (is_reg(a, REG_GENERAL) && b->kind == OPND_MEM) {
+        put8(c, size == 1 ? 0x8A : 0x8B);
+        return put_modrm(as, st, c, a->reg->number, b);
+    }
+    return bad_operands(as, st);
+}
+
+static int encode_alu(Assembler* as, Stmt* st, Code* c, int group) {
+    Operand* a = &st->operands[0];
+    Operand* b = &st->operands[1];
+    if (st->operand_count != 2 || !is_rm(a)) return bad_operands(as, st);
+
+    int size = operation_size(st);
+    if (!size) return fail(as, st->line, "operation size not specified");
+    if (a->kind == OPND_REG && b->kind == OPND_REG && a->size != b->size) {
+        return fail(as, st->line, "mismatch in operand sizes");
+    }
+    if (size == 2) put8(c, 0x66);
+
+    if (is_reg(b, REG_GENERAL)) {
+        put8(c, group * 8 + (size == 1 ? 0 : 1));
+        return put_modrm(as, st, c, b->reg->number, a);
+    }
+    if (is_reg(a, REG_GENERAL) && b->kind == OPND_MEM) {
+        put8(c, group * 8 + (size == 1 ? 2 : 3));
+        return put_modrm(as, st, c, a->reg->number, b);
+    }
+    if (b->kind != OPND_IMM) return bad_operands(as, st);
+
+    long long value;
+    if (!value_of(as, st, b, &value)) return 0;
+    if (size == 1) {
+        if (is_accumulator(a)) {
+            put8(c, group * 8 + 4);
+        }
+        else {
+            put8(c, 0x80);
+            if (!put_modrm(as, st, c, group, a)) return 0;
+        }
+        put8(c, value);
+    }
+    else if (fits8(b, value)) {
+        put8(c, 0x83);
+        if (!put_modrm(as, st, c, group, a)) return 0;
+        put8(c, value);
+    }
+    else if (is_accumulator(a)) {
+        put8(c, group * 8 + 5);
+        put_imm(c, size, value);
+    }
+    else {
+        put8(c, 0x81);
+        if (!put_modrm(as, st, c, group, a)) return 0;
+        put_imm(c, size, value);
+    }
+    return 1;
+}
+
+static int encode_test(Assembler* as, Stmt* st, Code* c) {
+    Operand* a = &st->operands[0];
+    Operand* b = &st->operands[1];
+    if (st->operand_count != 2) return bad_operands(as, st);
+
+    // test is symmetric; keep the register second
+    if (a->kind == OPND_REG && b->kind == OPND_MEM) {
+        Operand* t = a;
+        a = b;
+        b = t;
+    }
+    if (!is_rm(a)) return bad_operands(as, st);
+
+    int size = operation_size(st);
+    if (!size) return fail(as, st->line, "operation size not specified");
+    if (size == 2) put8(c, 0x66);
+
+    if (is_reg(b, REG_GENERAL)) {
+        if (a->kind == OPND_REG && a->size != b->size) return fail(as, st->line, "mismatch in operand sizes");
+        put8(c, size == 1 ? 0x84 : 0x85);
+        return put_modrm(as, st, c, b->reg->number, a);
+    }
+    if (b->kind != OPND_IMM) return bad_operands(as, st);
+
+    long long value;
+    if (!value_of(as, st, b, &value)) return 0;
+    if (is_accumulator(a)) {
+        put8(c, size == 1 ? 0xA8 : 0xA9);
+    }
+    else {
+        put8(c, size == 1 ? 0xF6 : 0xF7);
+        if (!put_modrm(as, st, c, 0, a)) return 0;
+    }
+    put_imm(c, size, value);
+    return 1;
+}
+
+static int encode_imul(Assembler* as, Stmt* st, Code* c) {
+    Operand* a = &st->operands[0];
+    Operand* b = &st->operands[1];
+    int n = st->operand_count;
+
+    if (n == 1) {
+        int size = operation_size(st);
+        if (!size || !is_rm(a)) return size ? bad_operands(as, st) : fail(as, st->line, "operation size not specified");
+        if (size == 2) put8(c, 0x66);
+        put8(c, size == 1 ? 0xF6 : 0xF7);
+        return put_modrm(as, st, c, 5, a);
+    }
+
+    // imul r, imm is imul r, r, imm
+    const Operand* source = b;
+    const Operand* imm = n == 3 ? &st->operands[2] : NULL;
+    if (n == 2 && b->kind == OPND_IMM) {
+        source = a;
+        imm = b;
+    }
+    if (!is_reg(a, REG_GENERAL) || a->size == 1 || !is_rm(source) ||
+        (source->kind == OPND_REG && source->size != a->size)) {
+        return bad_operands(as, st);
+    }
+    if (a->size == 2) put8(c, 0x66);
+
+    if (!imm) {
+        put8(c, 0x0F);
+        put8(c, 0xAF);
+        return put_modrm(as, st, c, a->reg->number, source);
+    }
+    if (imm->kind != OPND_IMM) return bad_operands(as, st);
+
+    long long value;
+    if (!value_of(as, st, imm, &value)) return 0;
+    int short_form = fits8(imm, value);
+    put8(c, short_form ? 0x6B : 0x69);
+    if (!put_modrm(as, st, c, a->reg->number, source)) return 0;
+    if (short_form) put8(c, value);
+    else put_imm(c, a->size, value);
+    return 1;
+}
+
+static int encode_shift(Assembler* as, Stmt* st, Code* c, int ext) {
+    Operand* a = &st->operands[0];
+    Operand* b = &st->operands[1];
+    if (st->operand_count != 2 || !is_rm(a)) return bad_operands(as, st);
+
+    int size = a->size;
+    if (!size) return fail(as, st->line, "operation size not specified");
+    if (size == 2) put8(c, 0x66);
+
+    int wide = size == 1 ? 0 : 1;
+    if (is_reg(b, REG_GENERAL) && b->reg->number == 1 && b->size == 1) {
+        put8(c, 0xD2 + wide);
+        return put_modrm(as, st, c, ext, a);
+    }
+    if (b->kind != OPND_IMM) return bad_operands(as, st);
+
+    long long value;
+    if (!value_of(as, st, b, &value)) return 0;
+    if (value == 1 && !b->relocatable) {
+        put8(c, 0xD0 + wide);
+        return put_modrm(as, st, c, ext, a);
+    }
+    put8(c, 0xC0 + wide);
+    if (!put_modrm(as, st, c, ext, a)) return 0;
+    put8(c, value);
+    return 1;
+}
+
+static int encode_push_pop(Assembler* as, Stmt* st, Code* c, int push) {
+    Operand* a = &st->operands[0];
+    if (st->operand_count != 1) return bad_operands(as, st);
+
+    if (is_reg(a, REG_SEGMENT)) {
+        static const unsigned char push_seg[] = { 0x06, 0x0E, 0x16, 0x1E };
+        int number = a->reg->number;
+        if (number >= 4) {
+            put8(c, 0x0F);
+            put8(c, (number == 4 ? 0xA0 : 0xA8) + (push ? 0 : 1));
+        }
+        else if (number == 1 && !push) {
+            return bad_operands(as, st);
+        }
+        else {
+            put8(c, push_seg[number] + (push ? 0 : 1));
+        }
+        return 1;
+    }
+    if (is_reg(a, REG_GENERAL)) {
+        if (a->size == 1) return bad_operands(as, st);
+        if (a->size == 2) put8(c, 0x66);
+        put8(c, (push ? 0x50 : 0x58) + a->reg->number);
+        return 1;
+    }
+    if (a->kind == OPND_MEM) {
+        if (a->size == 1) return bad_operands(as, st);
+        if (a->size == 2) put8(c, 0x66);
+        put8(c, push ? 0xFF : 0x8F);
+        return put_modrm(as, st, c, push ? 6 : 0, a);
+    }
+    if (!push || a->kind != OPND_IMM) return bad_operands(as, st);
+
+    long long value;
+    if (!value_of(as, st, a, &value)) return 0;
+    if (fits8(a, value)) {
+        put8(c, 0x6A);
+        put8(c, value);
+    }
+    else {
+        put8(c, 0x68);
+        put32(c, value);
+    }
+    return 1;
+}
+
+static int encode_io(Assembler* as, Stmt* st, Code* c, int out) {
+    if (st->operand_count != 2) return bad_operands(as, st);
+    Operand* port = &st->operands[out ? 0 : 1];
+    Operand* data = &st->operands[out ? 1 : 0];
+    if (!is_accumulator(data)) return bad_operands(as, st);
+
+    if (data->size == 2) put8(c, 0x66);
+    int wide = data->size == 1 ? 0 : 1;
+    if (is_reg(port, REG_GENERAL) && port->reg->number == 2 && port->size == 2) {
+        put8(c, (out ? 0xEE : 0xEC) + wide);
+        return 1;
+    }
+    if (port->kind != OPND_IMM) return bad_operands(as, st);
+
+    long long value;
+    if (!value_of(as, st, port, &value)) return 0;
+    put8(c, (out ? 0xE6 : 0xE4) + wide);
+    put8(c, value);
+    return 1;
+}
+
+static int encode_instruction(Assembler* as, Stmt* st, Code* c) {
+    const Mnemonic* m = st->mnemonic;
+    Operand* a = &st->operands[0];
+    Operand* b = &st->operands[1];
+    int n = st->operand_count;
+    long long value;
+
+    c->length = 0;
+    st->out_of_range = 0;
+    if (st->prefix) put8(c, st->prefix);
+    for (int i = 0; i < n; i++) {
+        if (st->operands[i].kind == OPND_MEM && st->operands[i].segment >= 0) {
+            put8(c, g_segment_prefix[st->operands[i].segment]);
+        }
+    }
+
+    switch (m->encoding) {
+    case ENC_FIXED:
+        if (n != 0) return bad_operands(as, st);
+        for (int i = 0; i < m->length; i++) put8(c, m->bytes[i]);
+        return 1;
+
+    case ENC_PREFIX:
+        return fail(as, st->line, "'%s' must precede an instruction", m->name);
+
+    case ENC_ALU:
+        return encode_alu(as, st, c, m->code);
+
+    case ENC_MOV:
+        if (n != 2) return bad_operands(as, st);
+        return encode_mov(as, st, c);
+
+    case ENC_MOVX:
+        if (n != 2 || !is_reg(a, REG_GENERAL) || a->size == 1 || !is_rm(b)) return bad_operands(as, st);
+        if (b->size != 1 && b->size != 2) return fail(as, st->line, "operation size not specified");
+        if (a->size == 2) put8(c, 0x66);
+        put8(c, 0x0F);
+        put8(c, m->code + (b->size == 2 ? 1 : 0));
+        return put_modrm(as, st, c, a->reg->number, b);
+
+    case ENC_LEA:
+        if (n != 2 || !is_reg(a, REG_GENERAL) || a->size == 1 || b->kind != OPND_MEM) return bad_operands(as, st);
+        if (a->size == 2) put8(c, 0x66);
+        put8(c, 0x8D);
+        return put_modrm(as, st, c, a->reg->number, b);
+
+    case ENC_XCHG: {
+        if (n != 2 || !is_rm(a) || !is_rm(b) || (a->kind == OPND_MEM && b->kind == OPND_MEM)) {
+            return bad_operands(as, st);
+        }
+        Operand* reg = is_reg(b, REG_GENERAL) ? b : a;
+        Operand* other = reg == b ? a : b;
+        if (other->kind == OPND_REG && other->size != reg->size) return fail(as, st->line, "mismatch in operand sizes");
+        if (reg->size == 2) put8(c, 0x66);
+        if (reg->size > 1 && other->kind == OPND_REG && (is_accumulator(reg) || is_accumulator(other))) {
+            put8(c, 0x90 + (is_accumulator(reg) ? other : reg)->reg->number);
+            return 1;
+        }
+        put8(c, reg->size == 1 ? 0x86 : 0x87);
+        return put_modrm(as, st, c, reg->reg->number, other);
+    }
+
+    case ENC_TEST:
+        return encode_test(as, st, c);
+
+    case ENC_INCDEC: {
+        int size = operation_size(st);
+        if (n != 1 || !is_rm(a)) return bad_operands(as, st);
+        if (!size) return fail(as, st->line, "operation size not specified");
+        if (size == 2) put8(c, 0x66);
+        if (a->kind == OPND_REG && size != 1) {
+            put8(c, 0x40 + m->code * 8 + a->reg->number);
+            return 1;
+        }
+        put8(c, size == 1 ? 0xFE : 0xFF);
+        return put_modrm(as, st, c, m->code, a);
+    }
+
+    case ENC_UNARY: {
+        int size = operation_size(st);
+        if (n != 1 || !is_rm(a)) return bad_operands(as, st);
+        if (!size) return fail(as, st->line, "operation size not specified");
+        if (size == 2) put8(c, 0x66);
+        put8(c, size == 1 ? 0xF6 : 0xF7);
+        return put_modrm(as, st, c, m->code, a);
+    }
+
+    case ENC_IMUL:
+        return encode_imul(as, st, c);
+
+    case ENC_SHIFT:
+        return encode_shift(as, st, c, m->code);
+
+    case ENC_PUSH:
+        return encode_push_pop(as, st, c, 1);
+
+    case ENC_POP:
+        return encode_push_pop(as, st, c, 0);
+
+    case ENC_JMP: {
+        static const unsigned char near_jmp[] = { 0xE9 };
+        if (n != 1) return bad_operands(as, st);
+        if (is_rm(a)) {
+            put8(c, 0xFF);
+            return put_modrm(as, st, c, 4, a);
+        }
+        return put_relative(as, st, c, a, 0xEB, near_jmp, 1);
+    }
+
+    case ENC_CALL: {
+        static const unsigned char near_call[] = { 0xE8 };
+        if (n != 1) return bad_operands(as, st);
+        if (is_rm(a)) {
+            put8(c, 0xFF);
+            return put_modrm(as, st, c, 2, a);
+        }
+        return put_relative(as, st, c, a, -1, near_call, 1);
+    }
+
+    case ENC_JCC: {
+        unsigned char near_jcc[] = { 0x0F, (unsigned char)(0x80 + m->code) };
+        if (n != 1) return bad_operands(as, st);
+        return put_relative(as, st, c, a, 0x70 + m->code, near_jcc, 2);
+    }
+
+    case ENC_LOOP:
+        if (n != 1) return bad_operands(as, st);
+        return put_relative(as, st, c, a, m->code, NULL, 0);
+
+    case ENC_RET:
+        if (n == 0) {
+            put8(c, 0xC3);
+            return 1;
+        }
+        if (n != 1 || a->kind != OPND_IMM || !value_of(as, st, a, &value)) return as->failed ? 0 : bad_operands(as, st);
+        put8(c, 0xC2);
+        put16(c, value);
+        return 1;
+
+    case ENC_SETCC:
+        if (n != 1 || !is_rm(a) || (a->size && a->size != 1)) return bad_operands(as, st);
+        put8(c, 0x0F);
+        put8(c, 0x90 + m->code);
+        return put_modrm(as, st, c, 0, a);
+
+    case ENC_CMOV:
+        if (n != 2 || !is_reg(a, REG_GENERAL) || a->size == 1 || !is_rm(b)) return bad_operands(as, st);
+        if (a->size == 2) put8(c, 0x66);
+        put8(c, 0x0F);
+        put8(c, 0x40 + m->code);
+        return put_modrm(as, st, c, a->reg->number, b);
+
+    case ENC_INT:
+        if (n != 1 || a->kind != OPND_IMM) return bad_operands(as, st);
+        if (!value_of(as, st, a, &value)) return 0;
+        put8(c, 0xCD);
+        put8(c, value);
+        return 1;
+
+    case ENC_IN:
+        return encode_io(as, st, c, 0);
+
+    case ENC_OUT:
+        return encode_io(as, st, c, 1);
+
+    case ENC_DESCRIPTOR:
+        if (n != 1 || a->kind != OPND_MEM) return bad_operands(as, st);
+        put8(c, 0x0F);
+        put8(c, 0x01);
+        return put_modrm(as, st, c, m->code, a);
+    }
+    return bad_operands(as, st);
+}
+
+/* ====================== Data ====================== */
+
+// Bytes of a string literal body, with escapes decoded for `...`
+static size_t decode_string(const char* s, size_t len, int escapes, unsigned char* out) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char)s[i];
+        if (escapes && ch == '\\' && i + 1 < len) {
+            char e = s[++i];
+            switch (e) {
+            case 'n': ch = '\n'; break;
+            case 't': ch = '\t'; break;
+            case 'r': ch = '\r'; break;
+            case 'a': ch = 7; break;
+            case 'b': ch = 8; break;
+            case 'f': ch = 12; break;
+            case 'v': ch = 11; break;
+            case 'e': ch = 27; break;
+            case 'x': {
+                int value = 0, digits = 0;
+                while (digits < 2 && i + 1 < len && isxdigit((unsigned char)s[i + 1])) {
+                    char d = s[++i];
+                    value = value * 16 + (isdigit((unsigned char)d) ? d - '0' : tolower((unsigned char)d) - 'a' + 10);
+                    digits++;
+                }
+                ch = (unsigned char)value;
+                break;
+            }
+            default:
+                if (e >= '0' && e <= '7') {
+                    int value = e - '0', digits = 1;
+                    while (digits < 3 && i + 1 < len && s[i + 1] >= '0' && s[i + 1] <= '7') {
+                        value = value * 8 + (s[++i] - '0');
+                        digits++;
+                    }
+                    ch = (unsigned char)value;
+                }
+                else {
+                    ch = (unsigned char)e;   // \\ \' \" \` and unknown escapes
+                }
+                break;
+            }
+        }
+        if (out) out[n] = ch;
+        n++;
+    }
+    return n;
+}
+
+// Encodes the items of a db/dw/dd once; out may be NULL to only measure
+static int emit_data_items(Assembler* as, Stmt* st, Bytes* out, unsigned int* size) {
+    const char* p = st->text;
+    *size = 0;
+
+    while (1) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0') return fail(as, st->line, "expected a data item");
+
+        const char* start = p;
+        int depth = 0;
+        int quoted_only = *p == '\'' || *p == '"' || *p == '`';
+        while (*p && !(*p == ',' && depth == 0)) {
+            if (*p == '\'' || *p == '"' || *p == '`') {
+                char quote = *p++;
+                while (*p && *p != quote) {
+                    if (quote == '`' && *p == '\\' && p[1]) p++;
+                    p++;
+                }
+                if (*p) p++;
+                continue;
+            }
+            if (*p == '(') depth++;
+            else if (*p == ')') depth--;
+            p++;
+        }
+        const char* end = p;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+
+        // A lone string of more than a unit is stored byte by byte, padded
+        // to a whole unit
+        size_t body = quoted_only && end - start >= 2 ? (size_t)(end - start - 2) : 0;
+        if (quoted_only && end - start >= 2 && end[-1] == start[0] &&
+            (st->unit == 1 || decode_string(start + 1, body, *start == '`', NULL) > (size_t)st->unit)) {
+            size_t n = decode_string(start + 1, body, *start == '`', NULL);
+            size_t padded = (n + st->unit - 1) / st->unit * st->unit;
+            if (out) {
+                bytes_reserve(out, padded);
+                decode_string(start + 1, body, *start == '`', out->data + out->size);
+                memset(out->data + out->size + n, 0, padded - n);
+                out->size += padded;
+            }
+            *size += (unsigned int)padded;
+        }
+        else {
+            if (out) {
+                char* expr = arena_strndup(as->storage, start, (size_t)(end - start));
+                long long value;
+                if (!eval(as, st, expr, &value)) return 0;
+                unsigned char le[4] = {
+                    (unsigned char)value, (unsigned char)(value >> 8),
+                    (unsigned char)(value >> 16), (unsigned char)(value >> 24)
+                };
+                bytes_put(out, le, (size_t)st->unit);
+            }
+            *size += (unsigned int)st->unit;
+        }
+
+        if (*p != ',') break;
+        p++;
+    }
+    return 1;
+}
+
+/* ====================== Layout ====================== */
+
+static int repeat_count(Assembler* as, Stmt* st, long long* count) {
+    *count = 1;
+    if (!st->times) return 1;
+    if (!eval(as, st, st->times, count)) return 0;
+    if (*count < 0) {
+        if (as->final) return fail(as, st->line, "negative repeat count");
+        *count = 0;
+    }
+    return 1;
+}
+
+// Size of one statement at its current offset; with out set, also writes
+// its bytes. Sizes must not depend on out, so layout and output agree.
+static int place(Assembler* as, Stmt* st, Bytes* out, unsigned int* size) {
+    *size = 0;
+    long long count;
+    if (!repeat_count(as, st, &count)) return 0;
+
+    switch (st->kind) {
+    case STMT_LABEL:
+    case STMT_EQU:
+        return 1;
+
+    case STMT_INSTRUCTION: {
+        Code code;
+        if (!encode_instruction(as, st, &code)) return 0;
+        if (out) {
+            for (long long i = 0; i < count; i++) bytes_put(out, code.bytes, (size_t)code.length);
+        }
+        *size = (unsigned int)(code.length * count);
+        return 1;
+    }
+
+    case STMT_DATA: {
+        unsigned int one;
+        if (!emit_data_items(as, st, NULL, &one)) return 0;
+        if (out) {
+            for (long long i = 0; i < count; i++) {
+                if (!emit_data_items(as, st, out, &one)) return 0;
+            }
+        }
+        *size = (unsigned int)(one * count);
+        return 1;
+    }
+
+    case STMT_RESERVE: {
+        long long items;
+        if (!eval(as, st, st->text, &items)) return 0;
+        if (items < 0) return fail(as, st->line, "negative reserve size");
+        *size = (unsigned int)(items * st->unit * count);
+        if (out) bytes_fill(out, 0, *size);
+        return 1;
+    }
+
+    case STMT_ALIGN: {
+        long long alignment;
+        if (!eval(as, st, st->text, &alignment)) return 0;
+        if (alignment <= 0 || (alignment & (alignment - 1))) return fail(as, st->line, "alignment must be a power of two");
+        unsigned int address = as->base[st->section] + st->offset;
+        *size = (unsigned int)((alignment - address % alignment) % alignment);
+        if (out) bytes_fill(out, st->unit ? 0x00 : 0x90, *size);
+        return 1;
+    }
+    }
+    return 1;
+}
+
+static unsigned int align4(unsigned int value) {
+    return (value + 3) & ~3u;
+}
+
+// One pass over every statement. Returns 1 if any address or jump form
+// changed, 0 once stable, -1 on error. Every jump starts short; the first
+// pass only places labels, later ones lengthen the jumps that miss.
+static int layout(Assembler* as, int pass) {
+    unsigned int offset[SECTION_COUNT] = { 0 };
+    int changed = 0;
+
+    for (int i = 0; i < as->stmt_count; i++) {
+        Stmt* st = &as->stmts[i];
+        st->offset = offset[st->section];
+
+        unsigned int size = st->size;
+        if ((pass == 0 || st->variable) && !place(as, st, NULL, &size)) return -1;
+
+        if (st->kind == STMT_LABEL) {
+            long long address = (long long)as->base[st->section] + st->offset;
+            if (as->symbols[st->symbol].value != address) {
+                as->symbols[st->symbol].value = address;
+                changed = 1;
+            }
+        }
+
+        // Jumps only ever grow, so layout converges
+        if (pass > 0 && st->out_of_range && !st->long_jump && st->mnemonic &&
+            (st->mnemonic->encoding == ENC_JMP || st->mnemonic->encoding == ENC_JCC) &&
+            st->operands[0].jump != JUMP_SHORT) {
+            st->long_jump = 1;
+            changed = 1;
+        }
+        if (st->size != size) {
+            st->size = size;
+            changed = 1;
+        }
+        offset[st->section] += size;
+    }
+
+    unsigned int base[SECTION_COUNT];
+    base[SECTION_TEXT] = as->org;
+    base[SECTION_DATA] = align4(base[SECTION_TEXT] + offset[SECTION_TEXT]);
+    base[SECTION_BSS] = align4(base[SECTION_DATA] + offset[SECTION_DATA]);
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        if (as->base[s] != base[s]) changed = 1;
+        as->base[s] = base[s];
+        as->size[s] = offset[s];
+    }
+    return changed;
+}
+
+static int write_image(Assembler* as, FlatImage* image) {
+    Bytes sections[SECTION_COUNT];
+    memset(sections, 0, sizeof(sections));
+
+    as->final = 1;
+    int ok = 1;
+    for (int i = 0; i < as->stmt_count && ok; i++) {
+        Stmt* st = &as->stmts[i];
+        if (st->section == SECTION_BSS && st->kind != STMT_LABEL && st->kind != STMT_EQU &&
+            st->kind != STMT_RESERVE && st->kind != STMT_ALIGN) {
+            ok = fail(as, st->line, "only reservations belong in .bss");
+            break;
+        }
+
+        Bytes* out = &sections[st->section];
+        unsigned int size;
+        ok = place(as, st, st->section == SECTION_BSS ? NULL : out, &size);
+        if (ok && size != st->size) ok = fail(as, st->line, "internal error: statement changed size");
+        if (ok && st->kind == STMT_INSTRUCTION) image->instructions++;
+    }
+
+    if (ok) {
+        size_t text = sections[SECTION_TEXT].size;
+        size_t gap = sections[SECTION_DATA].size ? as->base[SECTION_DATA] - as->base[SECTION_TEXT] - text : 0;
+        image->size = text + gap + sections[SECTION_DATA].size;
+        image->bytes = (unsigned char*)malloc(image->size ? image->size : 1);
+        if (text) memcpy(image->bytes, sections[SECTION_TEXT].data, text);
+        memset(image->bytes + text, 0, gap);
+        if (sections[SECTION_DATA].size) {
+            memcpy(image->bytes + text + gap, sections[SECTION_DATA].data, sections[SECTION_DATA].size);
+        }
+        image->org = as->org;
+        image->bss_size = as->size[SECTION_BSS];
+    }
+
+    for (int s = 0; s < SECTION_COUNT; s++) free(sections[s].data);
+    return ok;
+}
+
+/* ====================== Line Parsing ====================== */
+
+// Cuts the comment off, leaving ; inside quotes alone
+static void strip_comment(char* s) {
+    for (char* p = s; *p; p++) {
+        if (*p == '\'' || *p == '"' || *p == '`') {
+            char quote = *p++;
+            while (*p && *p != quote) {
+                if (quote == '`' && *p == '\\' && p[1]) p++;
+                p++;
+            }
+            if (!*p) return;
+        }
+        else if (*p == ';') {
+            *p = '\0';
+            return;
+        }
+    }
+}
+
+static int data_unit(const char* word) {
+    if (strcmp(word, "db") == 0 || strcmp(word, "resb") == 0) return 1;
+    if (strcmp(word, "dw") == 0 || strcmp(word, "resw") == 0) return 2;
+    if (strcmp(word, "dd") == 0 || strcmp(word, "resd") == 0) return 4;
+    return 0;
+}
+
+static int is_data_word(const char* word) {
+    return data_unit(word) || strcmp(word, "times") == 0 || strcmp(word, "equ") == 0;
+}
+
+static int is_directive_word(const char* word) {
+    static const char* directives[] = {
+        "bits", "org", "section", "segment", "global", "extern", "default", "cpu", "align", "alignb"
+    };
+    for (size_t i = 0; i < sizeof(directives) / sizeof(directives[0]); i++) {
+        if (strcmp(word, directives[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int select_section(Assembler* as, int line, char* name) {
+    name = skip_spaces(name);
+    char* end = name;
+    while (*end && *end != ' ' && *end != '\t') end++;
+    *end = '\0';
+
+    if (strcmp(name, ".text") == 0) as->section = SECTION_TEXT;
+    else if (strcmp(name, ".data") == 0 || strcmp(name, ".rodata") == 0) as->section = SECTION_DATA;
+    else if (strcmp(name, ".bss") == 0) as->section = SECTION_BSS;
+    else return fail(as, line, "unknown section '%s'", name);
+    return 1;
+}
+
+// Directives that may also appear in [brackets]; returns -1 if word is not one
+static int parse_directive(Assembler* as, int line, const char* word, char* rest) {
+    rest = skip_spaces(rest);
+    if (strcmp(word, "bits") == 0) {
+        if (atoi(rest) != 32) return fail(as, line, "only 32-bit code is supported");
+        return 1;
+    }
+    if (strcmp(word, "org") == 0) {
+        Stmt probe;
+        memset(&probe, 0, sizeof(probe));
+        probe.line = line;
+        long long value;
+        if (is_relocatable(as, as->scope, rest, 0) || !eval(as, &probe, rest, &value)) {
+            return as->failed ? 0 : fail(as, line, "org needs a constant");
+        }
+        as->org = (unsigned int)value;
+        return 1;
+    }
+    if (strcmp(word, "section") == 0 || strcmp(word, "segment") == 0) {
+        return select_section(as, line, rest);
+    }
+    if (strcmp(word, "global") == 0 || strcmp(word, "extern") == 0 ||
+        strcmp(word, "default") == 0 || strcmp(word, "cpu") == 0) {
+        return 1;
+    }
+    return -1;
+}
+
+static int parse_statement(Assembler* as, int line, char* s, const char* times);
+
+static int parse_instruction(Assembler* as, int line, const Mnemonic* m, char* rest, const char* times) {
+    unsigned char prefix = 0;
+    if (m->encoding == ENC_PREFIX) {
+        prefix = (unsigned char)m->code;
+        rest = skip_spaces(rest);
+        char* word = rest;
+        while (is_name_char(*rest)) rest++;
+        m = find_mnemonic(as, word, (size_t)(rest - word));
+        if (!m || m->encoding == ENC_PREFIX) return fail(as, line, "expected an instruction after the prefix");
+    }
+
+    Stmt* st = new_stmt(as, STMT_INSTRUCTION, line);
+    st->mnemonic = m;
+    st->prefix = prefix;
+    st->times = times;
+
+    rest = skip_spaces(rest);
+    if (*rest == '\0') return 1;
+
+    char* parts[MAX_OPERANDS];
+    int count = split_operands(as, line, rest, parts);
+    if (count < 0) return 0;
+
+    Operand* operands = (Operand*)arena_alloc(as->storage, sizeof(Operand) * count);
+    for (int i = 0; i < count; i++) {
+        if (!parse_operand(as, line, parts[i], &operands[i])) return 0;
+    }
+    st = &as->stmts[as->stmt_count - 1];
+    st->operands = operands;
+    st->operand_count = count;
+    return 1;
+}
+
+// A statement after any label: directive, data, times or instruction
+static int parse_statement(Assembler* as, int line, char* s, const char* times) {
+    s = skip_spaces(s);
+    if (*s == '\0') return 1;
+
+    char* word_start = s;
+    while (is_name_char(*s)) s++;
+    char word[MAX_WORD];
+    if (!lower_word(word_start, (size_t)(s - word_start), word)) {
+        return fail(as, line, "unknown instruction '%.*s'", (int)(s - word_start), word_start);
+    }
+
+    if (strcmp(word, "times") == 0) {
+        if (times) return fail(as, line, "nested times");
+
+        // The count runs up to the first word that starts a statement
+        char* p = skip_spaces(s);
+        char* count = p;
+        while (*p) {
+            if (*p == '\'' || *p == '"' || *p == '`') {
+                char quote = *p++;
+                while (*p && *p != quote) p++;
+                if (*p) p++;
+                continue;
+            }
+            if (is_name_start(*p) && (p == count || !is_name_char(p[-1]))) {
+                char* w = p;
+                while (is_name_char(*p)) p++;
+                char candidate[MAX_WORD];
+                if (lower_word(w, (size_t)(p - w), candidate) &&
+                    (data_unit(candidate) || find_mnemonic(as, w, (size_t)(p - w)))) {
+                    p = w;
+                    break;
+                }
+                continue;
+            }
+            p++;
+        }
+        if (!*p) return fail(as, line, "times needs a statement to repeat");
+        const char* expr = arena_strndup(as->storage, count, (size_t)(p - count));
+        return parse_statement(as, line, p, expr);
+    }
+
+    int unit = data_unit(word);
+    if (unit) {
+        int reserve = word[0] == 'r';
+        char* rest = skip_spaces(s);
+        if (*rest == '\0') return fail(as, line, "%s needs an operand", word);
+        Stmt* st = new_stmt(as, reserve ? STMT_RESERVE : STMT_DATA, line);
+        st->unit = unit;
+        st->text = rest;
+        st->times = times;
+        return 1;
+    }
+
+    if (strcmp(word, "align") == 0 || strcmp(word, "alignb") == 0) {
+        Stmt* st = new_stmt(as, STMT_ALIGN, line);
+        st->text = skip_spaces(s);
+        st->unit = word[5] == 'b' || as->section == SECTION_BSS;   // Zero fill
+        char* comma = strchr((char*)st->text, ',');
+        if (comma) *comma = '\0';
+        return 1;
+    }
+
+    int directive = parse_directive(as, line, word, s);
+    if (directive >= 0) return directive;
+
+    const Mnemonic* m = find_mnemonic(as, word_start, (size_t)(s - word_start));
+    if (!m) return fail(as, line, "unknown instruction '%s'", word);
+    return parse_instruction(as, line, m, s, times);
+}
+
+static int parse_line(Assembler* as, int line, const char* text) {
+    char* s = arena_strdup(as->storage, text);
+    strip_comment(s);
+    s = skip_spaces(s);
+    trim_end(s);
+    if (*s == '\0') return 1;
+
+    if (*s == '[') {
+        char* close = strchr(s, ']');
+        if (!close) return fail(as, line, "expected ']'");
+        *close = '\0';
+        char* w = skip_spaces(s + 1);
+        char* end = w;
+        while (is_name_char(*end)) end++;
+        char word[MAX_WORD];
+        if (!lower_word(w, (size_t)(end - w), word)) return fail(as, line, "unknown directive");
+        int directive = parse_directive(as, line, word, end);
+        if (directive < 0) return fail(as, line, "unknown directive '%s'", word);
+        return directive;
+    }
+
+    // A label is a name followed by a colon, or by data, times or equ
+    char* name = s;
+    char* p = s;
+    while (is_name_char(*p)) p++;
+    size_t len = (size_t)(p - name);
+    char* after = skip_spaces(p);
+
+    if (len > 0 && *after == ':') {
+        if (!is_name_start(*name)) return fail(as, line, "invalid label '%.*s'", (int)len, name);
+        if (!define_symbol(as, name, len, line, STMT_LABEL)) return 0;
+        return parse_statement(as, line, after + 1, NULL);
+    }
+
+    if (len > 0 && is_name_start(*name) && after != p) {
+        char* next = after;
+        char* next_end = next;
+        while (is_name_char(*next_end)) next_end++;
+        char word[MAX_WORD];
+        char own[MAX_WORD];
+        int own_is_keyword = lower_word(name, len, own) &&
+            (find_mnemonic(as, name, len) || is_data_word(own) || is_directive_word(own));
+        if (!own_is_keyword && lower_word(next, (size_t)(next_end - next), word) && is_data_word(word)) {
+            if (strcmp(word, "equ") == 0) {
+                if (!define_symbol(as, name, len, line, STMT_EQU)) return 0;
+                Stmt* st = &as->stmts[as->stmt_count - 1];
+                st->text = skip_spaces(next_end);
+                if (*st->text == '\0') return fail(as, line, "equ needs a value");
+                return 1;
+            }
+            if (!define_symbol(as, name, len, line, STMT_LABEL)) return 0;
+            return parse_statement(as, line, next, NULL);
+        }
+    }
+
+    return parse_statement(as, line, s, NULL);
+}
+
+/* ====================== Driver ====================== */
+
+// Parses the lines and lays them out until every address is stable
+static int assembler_run(Assembler* as, const AsmLine* lines, int count, AsmError* error) {
+    memset(as, 0, sizeof(*as));
+    as->storage = arena_create(0);
+    as->error = error;
+    as->section = SECTION_TEXT;
+    name_table_init(&as->symbol_index);
+    index_mnemonics(as);
+
+    error->line = 0;
+    error->message[0] = '\0';
+
+    // Most lines hold one statement
+    as->stmt_capacity = count + 16;
+    as->stmts = (Stmt*)malloc(sizeof(Stmt) * as->stmt_capacity);
+
+    int ok = 1;
+    for (int i = 0; i < count && ok; i++) {
+        if (lines[i].text) ok = parse_line(as, i + 1, lines[i].text);
+    }
+
+    if (ok) classify_statements(as);
+    for (int s = 0; s < SECTION_COUNT; s++) as->base[s] = as->org;
+
+    int passes = 0;
+    while (ok) {
+        int changed = layout(as, passes);
+        if (changed < 0) ok = 0;
+        else if (!changed) break;
+        else if (++passes >= MAX_PASSES) ok = fail(as, 0, "layout did not settle");
+    }
+    return ok;
+}
+
+static void assembler_free(Assembler* as) {
+    name_table_free(&as->symbol_index);
+    name_table_free(&as->mnemonic_index);
+    free(as->stmts);
+    free(as->symbols);
+    arena_destroy(as->storage);
+}
+
+int assemble_flat(const AsmLine* lines, int count, FlatImage* image, AsmError* error) {
+    Assembler as;
+    memset(image, 0, sizeof(FlatImage));
+
+    int ok = assembler_run(&as, lines, count, error);
+    if (ok) ok = write_image(&as, image);
+    if (!ok) flat_image_free(image);
+
+    assembler_free(&as);
+    return ok;
+}
+
+int assemble_line_sizes(const AsmLine* lines, int count, unsigned int* sizes, AsmError* error) {
+    Assembler as;
+    memset(sizes, 0, sizeof(unsigned int) * (size_t)count);
+
+    int ok = assembler_run(&as, lines, count, error);
+    if (ok) {
+        for (int i = 0; i < as.stmt_count; i++) {
+            sizes[as.stmts[i].line - 1] += as.stmts[i].size;
+        }
+    }
+
+    assembler_free(&as);
+    return ok;
+}
+
+void flat_image_free(FlatImage* image) {
+    free(image->bytes);
+    image->bytes = NULL;
+    image->size = 0;
+}
@@ -1,40 +1,66 @@
 #include "../Codegen.h"
+#include "../Peephole/Peephole.h"
+#include "../TreeShake/TreeShake.h"
+#include "../Assembler/Assembler.h"
+#include "../../Optimizer/Optimizer.h"
+#include "../../Memory/NameTable/NameTable.h"
 
 /* ====================== Symbol Table ====================== */
 
-#define MAX_LOCALS 256
-#define MAX_GLOBALS 256
 #define MAX_LOOP_DEPTH 32
 
+/* Registers the allocator hands out (all callee-saved under cdecl) */
+#define REG_NONE -1
+#define REG_POOL_SIZE 3
+
+static const char* pool_reg_names[REG_POOL_SIZE] = { "ebx", "esi", "edi" };
+
+// Names are interned by the CodeGen's interner and not owned here
 typedef struct {
-    char* name;
+    const char* name;
     int offset;
     int size;
     int is_param;
-    char* type_name;      // Full type including "struct Foo"
-    int pointer_level;
+    Type* type;           // Declared type, pointers and array extent included
     int element_size;
     int is_array;         // NEW: Track if this is an array
+    int reg;              // Allocated register, REG_NONE if it lives on the stack
+    int shadowed;         // Outer local with the same name, or -1
 } Local;
 
 typedef struct {
-    Local locals[MAX_LOCALS];
+    int count;            // Locals visible when the scope was entered
+    int stack_offset;
+} Scope;
+
+// Locals in declaration order; index maps each visible name to its
+// innermost declaration
+typedef struct {
+    Local* locals;
     int count;
+    int capacity;
+    NameTable index;
+    Interner* names;
     int stack_offset;
+    int max_offset;       // High-water mark of stack_offset
+    Scope* scopes;
+    int scope_depth;
+    int scope_capacity;
 } SymbolTable;
 
 typedef struct {
-    char* name;
-    char* type_name;
-    int pointer_level;
+    const char* name;
+    Type* type;
     int element_size;
     int is_array;
-    int array_size;
 } GlobalVar;
 
 typedef struct {
-    GlobalVar globals[MAX_GLOBALS];
+    GlobalVar* globals;
     int count;
+    int capacity;
+    NameTable index;
+    Interner* names;
 } GlobalTable;
 
 /* ====================== Loop Label Stack (for break/continue) ====================== */
@@ -44,237 +70,173 @@ typedef struct {
     int continue_label;
 } LoopContext;
 
-static LoopContext loop_stack[MAX_LOOP_DEPTH];
-static int loop_depth = 0;
+// Loops enclosing the statement being generated, innermost last
+typedef struct {
+    LoopContext loops[MAX_LOOP_DEPTH];
+    int depth;
+} LoopStack;
 
-static void push_loop(int break_lbl, int continue_lbl) {
-    if (loop_depth >= MAX_LOOP_DEPTH) {
-        fprintf(stderr, "Loop nesting too deep\n");
+static void loop_push(LoopStack* stack, Diagnostics* diag, int break_lbl, int continue_lbl) {
+    if (stack->depth >= MAX_LOOP_DEPTH) {
+        diag_report(diag, DIAG_WARNING, DIAG_CODEGEN, NULL, 0, 0, "Loop nesting too deep");
         return;
     }
-    loop_stack[loop_depth].break_label = break_lbl;
-    loop_stack[loop_depth].continue_label = continue_lbl;
-    loop_depth++;
+    stack->loops[stack->depth].break_label = break_lbl;
+    stack->loops[stack->depth].continue_label = continue_lbl;
+    stack->depth++;
 }
 
-static void pop_loop(void) {
-    if (loop_depth > 0) loop_depth--;
+static void loop_pop(LoopStack* stack) {
+    if (stack->depth > 0) stack->depth--;
 }
 
-static int get_break_label(void) {
-    if (loop_depth == 0) return -1;
-    return loop_stack[loop_depth - 1].break_label;
+static int loop_break_label(const LoopStack* stack) {
+    if (stack->depth == 0) return -1;
+    return stack->loops[stack->depth - 1].break_label;
 }
 
-static int get_continue_label(void) {
-    if (loop_depth == 0) return -1;
-    return loop_stack[loop_depth - 1].continue_label;
+static int loop_continue_label(const LoopStack* stack) {
+    if (stack->depth == 0) return -1;
+    return stack->loops[stack->depth - 1].continue_label;
 }
 
 /* ====================== Type Size Helpers ====================== */
 
-static int get_base_type_size(const char* type_name) {
-    if (!type_name) return 4;
+// Bytes of stack a local occupies, rounded up to keep slots dword aligned
+static int slot_size(const Type* type) {
+    return (type->size + 3) & ~3;
+}
 
-    // Make a copy we can modify
-    char base[64];
-    strncpy(base, type_name, 63);
-    base[63] = '\0';
+/* ====================== Symbol Table Functions ====================== */
 
-    // Skip qualifiers
-    char* p = base;
-    if (strncmp(p, "unsigned ", 9) == 0) p += 9;
-    else if (strncmp(p, "signed ", 7) == 0) p += 7;
-    else if (strncmp(p, "const ", 6) == 0) p += 6;
-    else if (strncmp(p, "volatile ", 9) == 0) p += 9;
+static void symtab_init(SymbolTable* st, Interner* names) {
+    memset(st, 0, sizeof(*st));
+    name_table_init(&st->index);
+    st->names = names;
+}
 
-    // Strip pointer asterisks and spaces from end
-    size_t len = strlen(p);
-    while (len > 0 && (p[len - 1] == '*' || p[len - 1] == ' ')) {
-        p[--len] = '\0';
+static void symtab_push_scope(SymbolTable* st) {
+    if (st->scope_depth >= st->scope_capacity) {
+        st->scope_capacity = st->scope_capacity == 0 ? 16 : st->scope_capacity * 2;
+        st->scopes = (Scope*)realloc(st->scopes, sizeof(Scope) * st->scope_capacity);
     }
-
-    if (strcmp(p, "char") == 0) return 1;
-    if (strcmp(p, "short") == 0) return 2;
-    if (strcmp(p, "int") == 0) return 4;
-    if (strcmp(p, "long") == 0) return 4;
-    if (strcmp(p, "void") == 0) return 1;  // void* arithmetic uses 1
-
-    // Struct types - will be resolved later
-    if (strncmp(p, "struct ", 7) == 0) return 4;  // Default, fixed by struct lookup
-
-    return 4;
+    st->scopes[st->scope_depth].count = st->count;
+    st->scopes[st->scope_depth].stack_offset = st->stack_offset;
+    st->scope_depth++;
 }
 
-static int calc_element_size(const char* type_name, int pointer_level) {
-    if (pointer_level > 1) return 4;  // Pointer to pointer = 4 bytes
-    if (pointer_level == 1) return get_base_type_size(type_name);
-    return get_base_type_size(type_name);
+// Removes locals from index down to first, uncovering what they shadowed
+static void symtab_truncate(SymbolTable* st, int first) {
+    for (int i = st->count - 1; i >= first; i--) {
+        Local* local = &st->locals[i];
+        name_table_remove(&st->index, local->name);
+        if (local->shadowed >= 0) name_table_put(&st->index, st->locals[local->shadowed].name, local->shadowed);
+    }
+    st->count = first;
 }
 
-/* ====================== Symbol Table Functions ====================== */
-
-static void symtab_init(SymbolTable* st) {
-    st->count = 0;
-    st->stack_offset = 0;
+// Leaving a block frees its names and hands its stack slots to the next sibling
+static void symtab_pop_scope(SymbolTable* st) {
+    if (st->scope_depth == 0) return;
+    st->scope_depth--;
+    Scope* scope = &st->scopes[st->scope_depth];
+    symtab_truncate(st, scope->count);
+    st->stack_offset = scope->stack_offset;
 }
 
-// Forward declaration - need access to CodeGen for struct lookup
-static CodeGen* g_current_cg = NULL;
-
-static int symtab_add_typed(SymbolTable* st, const char* name, const char* type_name,
-    int pointer_level, int is_array, int array_count) {
-    if (st->count >= MAX_LOCALS) {
-        fprintf(stderr, "Too many local variables\n");
-        exit(1);
-    }
-
-    int elem_size;
-    int total_size;
+// Appends a local and makes it the visible one for its name
+static Local* symtab_append(SymbolTable* st, const char* name) {
+    if (st->count >= st->capacity) {
+        st->capacity = st->capacity == 0 ? 32 : st->capacity * 2;
+        st->locals = (Local*)realloc(st->locals, sizeof(Local) * st->capacity);
+    }
+    int index = st->count++;
+    Local* local = &st->locals[index];
+    local->name = intern_cstr(st->names, name);
+    local->shadowed = name_table_get(&st->index, local->name, -1);
+    name_table_put(&st->index, local->name, index);
+    return local;
+}
 
-    // Check if this is a struct type
-    if (pointer_level == 0 && strncmp(type_name, "struct ", 7) == 0) {
-        // Look up struct size
-        StructInfo* sinfo = NULL;
-        if (g_current_cg) {
-            sinfo = codegen_find_struct(g_current_cg, type_name + 7);
-        }
-        if (sinfo) {
-            elem_size = sinfo->total_size;
-        }
-        else {
-            elem_size = 4;  // Fallback
-            fprintf(stderr, "Warning: Unknown struct '%s', using size 4\n", type_name);
-        }
-    }
-    else {
-        elem_size = get_base_type_size(type_name);
-    }
+static int symtab_add_typed(SymbolTable* st, const char* name, Type* type, int reg) {
+    int total_size = slot_size(type);
 
-    if (pointer_level > 0) {
-        // Pointers are always 4 bytes
-        total_size = 4;
-    }
-    else if (is_array && array_count > 0) {
-        total_size = elem_size * array_count;
+    // Register-allocated locals don't need a stack slot
+    if (reg == REG_NONE) {
+        st->stack_offset += total_size;
+        if (st->stack_offset > st->max_offset) st->max_offset = st->stack_offset;
     }
-    else {
-        total_size = elem_size;
-    }
-
-    // Align to 4 bytes
-    total_size = (total_size + 3) & ~3;
-
-    st->stack_offset += total_size;
 
-    Local* local = &st->locals[st->count];
-    local->name = _strdup(name);
-    local->offset = st->stack_offset;
+    Local* local = symtab_append(st, name);
+    local->offset = reg == REG_NONE ? st->stack_offset : 0;
     local->size = total_size;
     local->is_param = 0;
-    local->type_name = _strdup(type_name);
-    local->pointer_level = pointer_level;
-    // For pointers: element_size is size of what we point TO
+    local->type = type;
+    // For pointers and arrays: element_size is size of what we point TO
     // char* -> element_size = 1, int* -> element_size = 4, char** -> element_size = 4
-    if (pointer_level > 1) {
-        local->element_size = 4;  // Pointer to pointer = 4 bytes
-    }
-    else if (pointer_level == 1) {
-        local->element_size = get_base_type_size(type_name);  // Size of pointed-to type
-    }
-    else {
-        local->element_size = elem_size;
-    }
-    local->is_array = is_array;
-
-    st->count++;
-    return st->stack_offset;
+    local->element_size = type_element_size(type);
+    local->is_array = type->kind == TYPE_ARRAY;
+    local->reg = reg;
+    return local->offset;
 }
 
 static void symtab_add_param_typed(SymbolTable* st, const char* name, int stack_pos,
-    const char* type_name, int pointer_level) {
-    if (st->count >= MAX_LOCALS) {
-        fprintf(stderr, "Too many parameters\n");
-        exit(1);
-    }
-
-    Local* local = &st->locals[st->count];
-    local->name = _strdup(name);
+    Type* type, int reg) {
+    Local* local = symtab_append(st, name);
     local->offset = stack_pos;
     local->size = 4;
     local->is_param = 1;
-    local->type_name = _strdup(type_name);
-    local->pointer_level = pointer_level;
-    // For pointers: element_size is size of what we point TO
-    if (pointer_level > 1) {
-        local->element_size = 4;  // Pointer to pointer
-    }
-    else if (pointer_level == 1) {
-        local->element_size = get_base_type_size(type_name);
-    }
-    else {
-        local->element_size = get_base_type_size(type_name);
-    }
+    local->type = type;
+    local->element_size = type_element_size(type);
     local->is_array = 0;
-
-    st->count++;
+    local->reg = reg;
 }
 
 static Local* symtab_lookup_entry(SymbolTable* st, const char* name) {
-    for (int i = 0; i < st->count; i++) {
-        if (strcmp(st->locals[i].name, name) == 0) {
-            return &st->locals[i];
-        }
-    }
-    return NULL;
+    int index = name_table_get(&st->index, name, -1);
+    return index >= 0 ? &st->locals[index] : NULL;
 }
 
 static void symtab_free(SymbolTable* st) {
-    for (int i = 0; i < st->count; i++) {
-        free(st->locals[i].name);
-        if (st->locals[i].type_name) free(st->locals[i].type_name);
-    }
-    st->count = 0;
-    st->stack_offset = 0;
+    free(st->locals);
+    free(st->scopes);
+    name_table_free(&st->index);
+    memset(st, 0, sizeof(*st));
 }
 
 /* ====================== Global Table Functions ====================== */
 
-static void globtab_init(GlobalTable* gt) {
-    gt->count = 0;
+static void globtab_init(GlobalTable* gt, Interner* names) {
+    memset(gt, 0, sizeof(*gt));
+    name_table_init(&gt->index);
+    gt->names = names;
 }
 
-static void globtab_add(GlobalTable* gt, const char* name, const char* type_name,
-    int pointer_level, int is_array, int array_size) {
-    if (gt->count >= MAX_GLOBALS) {
-        fprintf(stderr, "Too many globals\n");
-        exit(1);
+static void globtab_add(GlobalTable* gt, const char* name, Type* type) {
+    if (gt->count >= gt->capacity) {
+        gt->capacity = gt->capacity == 0 ? 64 : gt->capacity * 2;
+        gt->globals = (GlobalVar*)realloc(gt->globals, sizeof(GlobalVar) * gt->capacity);
     }
     GlobalVar* gv = &gt->globals[gt->count];
-    gv->name = _strdup(name);
-    gv->type_name = _strdup(type_name);
-    gv->pointer_level = pointer_level;
-    gv->element_size = get_base_type_size(type_name);
-    gv->is_array = is_array;
-    gv->array_size = array_size;
+    gv->name = intern_cstr(gt->names, name);
+    gv->type = type;
+    gv->element_size = type_element_size(type);
+    gv->is_array = type->kind == TYPE_ARRAY;
+
+    // A redeclaration does not replace the first entry
+    if (name_table_get(&gt->index, gv->name, -1) < 0) name_table_put(&gt->index, gv->name, gt->count);
     gt->count++;
 }
 
 static GlobalVar* globtab_lookup(GlobalTable* gt, const char* name) {
-    for (int i = 0; i < gt->count; i++) {
-        if (strcmp(gt->globals[i].name, name) == 0) {
-            return &gt->globals[i];
-        }
-    }
-    return NULL;
+    int index = name_table_get(&gt->index, name, -1);
+    return index >= 0 ? &gt->globals[index] : NULL;
 }
 
 static void globtab_free(GlobalTable* gt) {
-    for (int i = 0; i < gt->count; i++) {
-        free(gt->globals[i].name);
-        free(gt->globals[i].type_name);
-    }
-    gt->count = 0;
+    free(gt->globals);
+    name_table_free(&gt->index);
+    memset(gt, 0, sizeof(*gt));
 }
 
 /* ====================== String Literal Tracking ====================== */
@@ -284,11 +246,50 @@ typedef struct {
     char* value;
 } StringLiteral;
 
+/* ====================== Register Allocation State ====================== */
+
+// Live range of a local or parameter, in preorder positions over the function body
+typedef struct {
+    const char* name;
+    int start;
+    int end;
+    int weight;           // Use count, scaled by loop nesting
+    int reg;
+    int is_param;
+    int decl_count;
+    int excluded;         // Address taken, aggregate, or volatile
+} LiveInterval;
+
+typedef struct {
+    LiveInterval* intervals;
+    int count;
+    int capacity;
+    int position;
+    int loop_depth;
+    int has_asm;
+
+    int saved_regs[REG_POOL_SIZE];   // Pushed in the prologue, in this order
+    int saved_count;
+    int temp_regs[REG_POOL_SIZE];    // Free registers reserved for temporaries
+    int temp_count;
+    int temp_top;
+} RegAlloc;
+
+/* ====================== Frame Report ====================== */
+
+typedef struct {
+    char* function;
+    int frame_size;       // Bytes reserved for locals below the saved registers
+    int saved_regs;
+} FrameRecord;
+
 /* ====================== CodeGen Structure ====================== */
 
 struct CodeGen {
     FILE* output;
     TargetPlatform target;
+    Interner* names;      // Shared with the parser; owns every symbol name
+    TypeTable* types;     // Shared with the parser; struct layouts come from here
     int label_count;
     int string_count;
     SymbolTable symtab;
@@ -296,167 +297,434 @@ struct CodeGen {
     int string_capacity;
     int string_list_count;
 
-    StructInfo* structs;
-    int struct_count;
-    int struct_capacity;
-
     GlobalTable globtab;
-};
-
-/* ====================== Struct Management ====================== */
 
-void codegen_init_struct_table(CodeGen* cg) {
-    cg->struct_capacity = 32;
-    cg->structs = (StructInfo*)malloc(sizeof(StructInfo) * cg->struct_capacity);
-    cg->struct_count = 0;
-}
+    int opt_level;
+    RegAlloc ra;
+
+    FrameRecord* frames;
+    int frame_count;
+    int frame_capacity;
+
+    // Emitted lines are buffered so the peephole pass can rewrite them; their
+    // text lives in line_text until codegen_flush writes it out in one block
+    AsmLine* lines;
+    int line_count;
+    int line_capacity;
+    Arena* line_text;
+    CodegenOutputStats output_stats;
+    CodegenSink sink;     // Takes the output in place of the file when set
+    void* sink_context;
+    CodegenOutputFormat format;
+    char* output_path;    // Reopened in binary mode for CODEGEN_OUTPUT_BINARY
+    CodegenSink listing;
+    void* listing_context;
+    Diagnostics* diag;    // NULL: warnings go to stderr and errors exit
+    int pin_output;       // Mark new lines as off-limits to the peephole pass
+    PeepholeStats peephole;
+    ShakeStats shake;
+    int size_report;      // Measure what tree shaking strips in bytes
+
+    int inline_exit;      // Label N_RETURN jumps to inside an N_INLINE body, or -1
+    LoopStack loops;      // break and continue targets
+};
 
-void codegen_register_struct(CodeGen* cg, AST* struct_decl) {
-    if (!struct_decl || struct_decl->type != N_STRUCT_DECL) return;
-    if (!struct_decl->data.struct_decl.name) return;
+/* ====================== Declared Types ====================== */
 
-    if (cg->struct_count >= cg->struct_capacity) {
-        cg->struct_capacity *= 2;
-        cg->structs = (StructInfo*)realloc(cg->structs,
-            sizeof(StructInfo) * cg->struct_capacity);
+// The full type a local or global declares: its base with the declarator's
+// pointers, then its extent if it is an array. Extents are evaluated here as
+// well as by folding, so -O0 sizes `buf[ROWS * 64]` the same as -O1.
+static Type* decl_type(CodeGen* cg, AST* decl) {
+    Type* type = type_derive(cg->types, decl->data.decl.type, decl->data.decl.pointer_level);
+    AST* size = decl->data.decl.array_size;
+    if (size) {
+        int count;
+        if (!optimize_const_value(size, &count) || count < 0) count = 0;
+        type = type_array(cg->types, type, count);
     }
+    return type;
+}
 
-    StructInfo* info = &cg->structs[cg->struct_count++];
-    info->name = _strdup(struct_decl->data.struct_decl.name);
-    info->member_count = (int)struct_decl->data.struct_decl.member_count;
-    info->members = (StructMember*)malloc(sizeof(StructMember) * info->member_count);
-
-    int offset = 0;
-    for (size_t i = 0; i < struct_decl->data.struct_decl.member_count; i++) {
-        AST* member = struct_decl->data.struct_decl.members[i];
-        if (member->type == N_DECL) {
-            info->members[i].name = _strdup(member->data.decl.name);
-            info->members[i].offset = offset;
-
-            int size;
-            if (member->data.decl.pointer_level > 0) {
-                size = 4;  // All pointers are 4 bytes
-            }
-            else if (member->data.decl.array_size) {
-                if (member->data.decl.array_size->type == N_INTLIT) {
-                    int arr_count = member->data.decl.array_size->data.int_lit.value;
-                    int elem_size = get_base_type_size(member->data.decl.type);
-                    size = arr_count * elem_size;
-                }
-                else {
-                    size = 4;
-                }
-            }
-            else {
-                size = get_base_type_size(member->data.decl.type);
-            }
-
-            info->members[i].size = size;
-            offset += size;
-
-            // Align to 4 bytes for next member
-            offset = (offset + 3) & ~3;
-        }
-    }
-    info->total_size = offset;
+// Array parameters decay to pointers
+static Type* param_type(CodeGen* cg, AST* param) {
+    Type* type = type_derive(cg->types, param->data.decl.type, param->data.decl.pointer_level);
+    if (param->data.decl.array_size) type = type_pointer(cg->types, type);
+    return type;
 }
 
-StructInfo* codegen_find_struct(CodeGen* cg, const char* name) {
+/* ====================== Struct Management ====================== */
+
+Type* codegen_find_struct(CodeGen* cg, const char* name) {
     const char* search_name = name;
     if (strncmp(name, "struct ", 7) == 0) {
         search_name = name + 7;
     }
-
-    for (int i = 0; i < cg->struct_count; i++) {
-        if (strcmp(cg->structs[i].name, search_name) == 0) {
-            return &cg->structs[i];
-        }
-    }
-    return NULL;
+    return type_find_struct(cg->types, search_name);
 }
 
 int codegen_get_member_offset(CodeGen* cg, const char* struct_name, const char* member_name) {
-    StructInfo* info = codegen_find_struct(cg, struct_name);
-    if (!info) return -1;
-
-    for (int i = 0; i < info->member_count; i++) {
-        if (strcmp(info->members[i].name, member_name) == 0) {
-            return info->members[i].offset;
-        }
-    }
-    return -1;
-}
-
-static int codegen_get_member_size(CodeGen* cg, const char* struct_name, const char* member_name) {
-    StructInfo* info = codegen_find_struct(cg, struct_name);
-    if (!info) return 4;
-
-    for (int i = 0; i < info->member_count; i++) {
-        if (strcmp(info->members[i].name, member_name) == 0) {
-            return info->members[i].size;
-        }
-    }
-    return 4;
-}
-
-void codegen_free_struct_table(CodeGen* cg) {
-    for (int i = 0; i < cg->struct_count; i++) {
-        free(cg->structs[i].name);
-        for (int j = 0; j < cg->structs[i].member_count; j++) {
-            free(cg->structs[i].members[j].name);
-        }
-        free(cg->structs[i].members);
-    }
-    free(cg->structs);
+    const TypeMember* member = type_find_member(codegen_find_struct(cg, struct_name), member_name);
+    return member ? member->offset : -1;
 }
 
 /* ====================== CodeGen Create/Free ====================== */
 
-CodeGen* codegen_create(const char* output_file, TargetPlatform target) {
+static CodeGen* codegen_init(FILE* output, TargetPlatform target, Interner* names, TypeTable* types) {
     CodeGen* cg = (CodeGen*)malloc(sizeof(CodeGen));
-    cg->output = fopen(output_file, "w");
-    if (!cg->output) {
-        fprintf(stderr, "Failed to open output file: %s\n", output_file);
-        free(cg);
-        return NULL;
-    }
+    cg->output = output;
     cg->target = target;
     cg->label_count = 0;
     cg->string_count = 0;
-    symtab_init(&cg->symtab);
-    globtab_init(&cg->globtab);
+    cg->names = names;
+    cg->types = types;
+    symtab_init(&cg->symtab, names);
+    globtab_init(&cg->globtab, names);
     cg->string_capacity = 32;
     cg->strings = (StringLiteral*)malloc(sizeof(StringLiteral) * cg->string_capacity);
     cg->string_list_count = 0;
 
-    codegen_init_struct_table(cg);
-    loop_depth = 0;  // Reset loop stack
+    cg->loops.depth = 0;
+
+    cg->opt_level = 0;
+    memset(&cg->ra, 0, sizeof(cg->ra));
+
+    cg->frames = NULL;
+    cg->frame_count = 0;
+    cg->frame_capacity = 0;
+
+    cg->line_capacity = 1024;
+    cg->lines = (AsmLine*)malloc(sizeof(AsmLine) * cg->line_capacity);
+    cg->line_count = 0;
+    cg->line_text = arena_create(0);
+    memset(&cg->output_stats, 0, sizeof(cg->output_stats));
+    cg->sink = NULL;
+    cg->sink_context = NULL;
+    cg->format = CODEGEN_OUTPUT_ASSEMBLY;
+    cg->output_path = NULL;
+    cg->listing = NULL;
+    cg->listing_context = NULL;
+    cg->diag = NULL;
+    cg->pin_output = 0;
+    cg->inline_exit = -1;
+    memset(&cg->peephole, 0, sizeof(cg->peephole));
+    memset(&cg->shake, 0, sizeof(cg->shake));
+    cg->size_report = 0;
+
+    return cg;
+}
+
+CodeGen* codegen_create(const char* output_file, TargetPlatform target, Interner* names, TypeTable* types) {
+    FILE* output = fopen(output_file, "w");
+    if (!output) {
+        fprintf(stderr, "Failed to open output file: %s\n", output_file);
+        return NULL;
+    }
+    CodeGen* cg = codegen_init(output, target, names, types);
+    cg->output_path = _strdup(output_file);
+    return cg;
+}
 
+CodeGen* codegen_create_with_sink(CodegenSink sink, void* context, TargetPlatform target,
+    Interner* names, TypeTable* types) {
+    CodeGen* cg = codegen_init(NULL, target, names, types);
+    cg->sink = sink;
+    cg->sink_context = context;
     return cg;
 }
 
+static void codegen_flush(CodeGen* cg);
+
 void codegen_free(CodeGen* cg) {
+    codegen_flush(cg);
+    free(cg->lines);
+    arena_destroy(cg->line_text);
     if (cg->output) fclose(cg->output);
+    free(cg->output_path);
     symtab_free(&cg->symtab);
     globtab_free(&cg->globtab);
     for (int i = 0; i < cg->string_list_count; i++) {
         free(cg->strings[i].value);
     }
     free(cg->strings);
-    codegen_free_struct_table(cg);
+    free(cg->ra.intervals);
+    for (int i = 0; i < cg->frame_count; i++) {
+        free(cg->frames[i].function);
+    }
+    free(cg->frames);
+    tree_shake_free(&cg->shake);
     free(cg);
 }
 
+void codegen_set_opt_level(CodeGen* cg, int level) {
+    cg->opt_level = level;
+}
+
+static void codegen_record_frame(CodeGen* cg, const char* function, int frame_size, int saved_regs) {
+    if (cg->frame_count >= cg->frame_capacity) {
+        cg->frame_capacity = cg->frame_capacity == 0 ? 16 : cg->frame_capacity * 2;
+        cg->frames = (FrameRecord*)realloc(cg->frames, sizeof(FrameRecord) * cg->frame_capacity);
+    }
+    FrameRecord* rec = &cg->frames[cg->frame_count++];
+    rec->function = _strdup(function);
+    rec->frame_size = frame_size;
+    rec->saved_regs = saved_regs;
+}
+
+void codegen_print_frame_report(CodeGen* cg, FILE* out) {
+    int total = 0;
+    int largest = 0;
+
+    fprintf(out, "%-32s %8s %6s\n", "function", "frame", "saved");
+    for (int i = 0; i < cg->frame_count; i++) {
+        FrameRecord* rec = &cg->frames[i];
+        fprintf(out, "%-32s %8d %6d\n", rec->function, rec->frame_size, rec->saved_regs);
+        total += rec->frame_size;
+        if (rec->frame_size > largest) largest = rec->frame_size;
+    }
+    fprintf(out, "%d functions, %d bytes of locals in total, largest frame %d bytes\n",
+        cg->frame_count, total, largest);
+}
+
 int codegen_new_label(CodeGen* cg) {
     return cg->label_count++;
 }
 
+/* ====================== Output Buffer ====================== */
+
+#define EMIT_LINE_MAX 256
+#define EMIT_NUMBER_MAX 24
+
+static char* format_unsigned(char* out, unsigned long long value) {
+    char digits[EMIT_NUMBER_MAX];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n > 0) *out++ = digits[--n];
+    return out;
+}
+
+static char* format_int(char* out, int value) {
+    if (value < 0) {
+        *out++ = '-';
+        return format_unsigned(out, 0ULL - (unsigned long long)value);
+    }
+    return format_unsigned(out, (unsigned long long)value);
+}
+
+// Formats the conversions the emitters use (%d %s %c %zu %%) without going
+// through stdio. Returns the length, or -1 for anything else or a line longer
+// than EMIT_LINE_MAX, which the caller leaves to vsnprintf.
+static int format_line(char* out, const char* fmt, va_list args) {
+    char* p = out;
+    char* limit = out + EMIT_LINE_MAX - EMIT_NUMBER_MAX;   // Room for one number
+
+    for (; *fmt; fmt++) {
+        if (p >= limit) return -1;
+        if (*fmt != '%') {
+            *p++ = *fmt;
+            continue;
+        }
+
+        switch (*++fmt) {
+        case 'd':
+            p = format_int(p, va_arg(args, int));
+            break;
+        case 'c':
+            *p++ = (char)va_arg(args, int);
+            break;
+        case '%':
+            *p++ = '%';
+            break;
+        case 's': {
+            const char* text = va_arg(args, const char*);
+            if (!text) return -1;
+            size_t len = strlen(text);
+            if (len >= (size_t)(limit - p)) return -1;
+            memcpy(p, text, len);
+            p += len;
+            break;
+        }
+        case 'z':
+            if (fmt[1] != 'u') return -1;
+            fmt++;
+            p = format_unsigned(p, (unsigned long long)va_arg(args, size_t));
+            break;
+        default:
+            return -1;
+        }
+    }
+    return (int)(p - out);
+}
+
 void emit(CodeGen* cg, const char* fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    vfprintf(cg->output, fmt, args);
-    va_end(args);
-    fprintf(cg->output, "\n");
+    const char* text;
+
+    if (!strchr(fmt, '%')) {
+        // Constant lines, most of the runtime, are buffered as the literal
+        // itself; later passes only ever swap a line's pointer
+        text = fmt;
+    }
+    else {
+        char buffer[EMIT_LINE_MAX];
+        va_list args;
+        va_start(args, fmt);
+        int len = format_line(buffer, fmt, args);
+        va_end(args);
+
+        if (len >= 0) {
+            text = arena_strndup(cg->line_text, buffer, (size_t)len);
+        }
+        else {
+            va_start(args, fmt);
+            len = vsnprintf(NULL, 0, fmt, args);
+            va_end(args);
+
+            char* formatted = (char*)arena_alloc(cg->line_text, (size_t)len + 1);
+            va_start(args, fmt);
+            vsnprintf(formatted, (size_t)len + 1, fmt, args);
+            va_end(args);
+            text = formatted;
+        }
+    }
+
+    if (cg->line_count >= cg->line_capacity) {
+        cg->line_capacity *= 2;
+        cg->lines = (AsmLine*)realloc(cg->lines, sizeof(AsmLine) * cg->line_capacity);
+    }
+    cg->lines[cg->line_count].text = text;
+    cg->lines[cg->line_count].pinned = cg->pin_output;
+    cg->line_count++;
+    cg->output_stats.lines_emitted++;
+}
+
+void codegen_set_output_format(CodeGen* cg, CodegenOutputFormat format) {
+    // Text mode would translate newline bytes inside the image
+    if (format == CODEGEN_OUTPUT_BINARY && cg->output && cg->output_path) {
+        cg->output = freopen(cg->output_path, "wb", cg->output);
+        if (!cg->output) {
+            fprintf(stderr, "Failed to open output file: %s\n", cg->output_path);
+            exit(1);
+        }
+    }
+    cg->format = format;
+}
+
+void codegen_set_listing(CodeGen* cg, CodegenSink listing, void* context) {
+    cg->listing = listing;
+    cg->listing_context = context;
+}
+
+void codegen_set_diagnostics(CodeGen* cg, Diagnostics* diag) {
+    cg->diag = diag;
+}
+
+// Drops the buffered lines so codegen_free has nothing left to flush
+static DIAG_NORETURN void codegen_error(CodeGen* cg, int line, const char* message) {
+    cg->line_count = 0;
+    diag_fatal(cg->diag, DIAG_CODEGEN, NULL, line, 0, "%s", message);
+}
+
+static void codegen_write(CodeGen* cg, const void* data, size_t length) {
+    if (cg->sink) {
+        cg->sink(cg->sink_context, (const char*)data, length);
+    }
+    else {
+        fwrite(data, 1, length, cg->output);
+    }
+    cg->output_stats.bytes_written += length;
+}
+
+// Encodes the buffered lines; a line the assembler rejects is a compiler bug
+// or a bad inline asm block, so it is fatal like any other codegen error
+static void codegen_assemble(CodeGen* cg) {
+    FlatImage image;
+    AsmError error;
+    if (!assemble_flat(cg->lines, cg->line_count, &image, &error)) {
+        char message[EMIT_LINE_MAX + sizeof(error.message) + 64];
+        if (error.line > 0) {
+            snprintf(message, sizeof(message), "Assembler error at line %d: %s\n    %s",
+                error.line, error.message, cg->lines[error.line - 1].text);
+        }
+        else {
+            snprintf(message, sizeof(message), "Assembler error: %s", error.message);
+        }
+        codegen_error(cg, error.line, message);
+    }
+
+    codegen_write(cg, image.bytes, image.size);
+    cg->output_stats.instructions_encoded += (size_t)image.instructions;
+    flat_image_free(&image);
+}
+
+// Runs the peephole pass over everything buffered, then hands the text to
+// the sink or the output file as a single block, or assembles it first in
+// binary mode
+static void codegen_flush(CodeGen* cg) {
+    if (cg->line_count == 0) return;
+
+    if (cg->opt_level >= 1) {
+        cg->line_count = peephole_optimize(cg->lines, cg->line_count, cg->line_text, &cg->peephole);
+    }
+    cg->output_stats.lines_written += (size_t)cg->line_count;
+
+    if (cg->format == CODEGEN_OUTPUT_BINARY) {
+        codegen_assemble(cg);
+        if (!cg->listing) {
+            cg->line_count = 0;
+            return;
+        }
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < cg->line_count; i++) {
+        total += strlen(cg->lines[i].text) + 1;
+    }
+
+    char* block = (char*)malloc(total + 1);
+    char* p = block;
+    for (int i = 0; i < cg->line_count; i++) {
+        size_t len = strlen(cg->lines[i].text);
+        memcpy(p, cg->lines[i].text, len);
+        p += len;
+        *p++ = '\n';
+    }
+    *p = '\0';
+
+    if (cg->format == CODEGEN_OUTPUT_ASSEMBLY) codegen_write(cg, block, total);
+    if (cg->listing) cg->listing(cg->listing_context, block, total);
+    free(block);
+
+    cg->line_count = 0;
+}
+
+const CodegenOutputStats* codegen_output_stats(CodeGen* cg) {
+    return &cg->output_stats;
+}
+
+void codegen_print_peephole_report(CodeGen* cg, FILE* out) {
+    peephole_print_report(&cg->peephole, out);
+}
+
+void codegen_set_size_report(CodeGen* cg, int enabled) {
+    cg->size_report = enabled;
+}
+
+// Encoded size of each buffered line, or NULL if the assembler rejects
+// them; the real error comes from whatever assembles the output
+static unsigned int* codegen_measure_lines(CodeGen* cg) {
+    unsigned int* sizes = (unsigned int*)malloc(sizeof(unsigned int) * (cg->line_count + 1));
+    AsmError error;
+    if (!assemble_line_sizes(cg->lines, cg->line_count, sizes, &error)) {
+        free(sizes);
+        return NULL;
+    }
+    return sizes;
+}
+
+void codegen_print_tree_shake_report(CodeGen* cg, FILE* out) {
+    tree_shake_print_report(&cg->shake, out);
 }
 
 int codegen_add_string(CodeGen* cg, const char* value) {
@@ -483,20 +751,16 @@ void codegen_emit_strings(CodeGen* cg) {
 
 /* ====================== Type Resolution Helpers ====================== */
 
-// Get the struct type name for a variable (returns NULL if not a struct)
-static const char* get_var_struct_type(CodeGen* cg, const char* var_name) {
+// Get the struct a variable is or points to (returns NULL if neither)
+static Type* get_var_struct_type(CodeGen* cg, const char* var_name) {
     Local* local = symtab_lookup_entry(&cg->symtab, var_name);
-    if (local && local->type_name) {
-        if (strncmp(local->type_name, "struct ", 7) == 0) {
-            return local->type_name + 7;  // Return just the struct name
-        }
+    if (local && type_struct_of(local->type)) {
+        return type_struct_of(local->type);
     }
 
     GlobalVar* global = globtab_lookup(&cg->globtab, var_name);
-    if (global && global->type_name) {
-        if (strncmp(global->type_name, "struct ", 7) == 0) {
-            return global->type_name + 7;
-        }
+    if (global) {
+        return type_struct_of(global->type);
     }
 
     return NULL;
@@ -515,18 +779,18 @@ static int get_element_size_for_var(CodeGen* cg, const char* var_name) {
 
 /* ====================== Emit helpers for sized operations ====================== */
 
-static void emit_scale_index(CodeGen* cg, int element_size) {
+static void emit_scale_index(CodeGen* cg, int element_size, const char* reg) {
     if (element_size == 1) {
         // No scaling needed
     }
     else if (element_size == 2) {
-        emit(cg, "    shl eax, 1        ; Scale index by 2");
+        emit(cg, "    shl %s, 1        ; Scale index by 2", reg);
     }
     else if (element_size == 4) {
-        emit(cg, "    shl eax, 2        ; Scale index by 4");
+        emit(cg, "    shl %s, 2        ; Scale index by 4", reg);
     }
     else if (element_size > 4) {
-        emit(cg, "    imul eax, %d      ; Scale index by %d", element_size, element_size);
+        emit(cg, "    imul %s, %d      ; Scale index by %d", reg, element_size, element_size);
     }
 }
 
@@ -554,6 +818,24 @@ static void emit_store_sized(CodeGen* cg, int element_size, const char* dest_reg
     }
 }
 
+/* ====================== Global Data ====================== */
+
+static int global_init_value(AST* global) {
+    AST* init = global->data.decl.init_value;
+    if (!init) return 0;
+    if (init->type == N_INTLIT) return init->data.int_lit.value;
+    if (init->type == N_CAST && init->data.cast.expr->type == N_INTLIT) {
+        return init->data.cast.expr->data.int_lit.value;
+    }
+    return 0;
+}
+
+// Arrays (which have no initializers) and everything else that starts at zero
+static int global_in_bss(AST* global) {
+    if (global->data.decl.array_size) return 1;
+    return global_init_value(global) == 0;
+}
+
 /* ====================== Bare Metal x86-32 Prologue ====================== */
 
 static void codegen_baremetal_prologue(CodeGen* cg) {
@@ -566,6 +848,11 @@ static void codegen_baremetal_prologue(CodeGen* cg) {
     emit(cg, "global kernel_main");
     emit(cg, "");
     emit(cg, "_start:");
+    emit(cg, "    cld");
+    emit(cg, "    mov edi, __bss_start");
+    emit(cg, "    mov ecx, (__bss_end - __bss_start) / 4");
+    emit(cg, "    xor eax, eax");
+    emit(cg, "    rep stosd              ; Zero .bss");
     emit(cg, "    jmp kernel_main");
     emit(cg, "");
 }
@@ -773,6 +1060,7 @@ static void codegen_emit_runtime(CodeGen* cg) {
     emit(cg, "    mov ebp, esp");
     emit(cg, "    push esi");
     emit(cg, "    push ebx");
+    emit(cg, "    push edi");
     emit(cg, "    mov esi, [ebp+8]     ; string ptr");
     emit(cg, "    mov ebx, 0xB8000");
     emit(cg, ".ps_loop:");
@@ -785,6 +1073,7 @@ static void codegen_emit_runtime(CodeGen* cg) {
     emit(cg, "    inc dword [vga_cursor]");
     emit(cg, "    jmp .ps_loop");
     emit(cg, ".ps_done:");
+    emit(cg, "    pop edi");
     emit(cg, "    pop ebx");
     emit(cg, "    pop esi");
     emit(cg, "    pop ebp");
@@ -797,6 +1086,7 @@ static void codegen_emit_runtime(CodeGen* cg) {
     emit(cg, "    push ebx");
     emit(cg, "    push ecx");
     emit(cg, "    push edx");
+    emit(cg, "    push edi");
     emit(cg, "    mov eax, [ebp+8]");
     emit(cg, "    mov ecx, 8");
     emit(cg, "    mov ebx, 0xB8000");
@@ -812,6 +1102,7 @@ static void codegen_emit_runtime(CodeGen* cg) {
     emit(cg, "    inc dword [vga_cursor]");
     emit(cg, "    pop eax");
     emit(cg, "    loop .ph_loop");
+    emit(cg, "    pop edi");
     emit(cg, "    pop edx");
     emit(cg, "    pop ecx");
     emit(cg, "    pop ebx");
@@ -826,6 +1117,7 @@ static void codegen_emit_runtime(CodeGen* cg) {
     emit(cg, "    push ecx");
     emit(cg, "    push edx");
     emit(cg, "    push esi");
+    emit(cg, "    push edi");
     emit(cg, "    mov eax, [ebp+8]");
     emit(cg, "    mov esi, 0xB8000");
     emit(cg, "    test eax, eax");
@@ -860,6 +1152,7 @@ static void codegen_emit_runtime(CodeGen* cg) {
     emit(cg, "    mov [esi + edi*2], ax");
     emit(cg, "    inc dword [vga_cursor]");
     emit(cg, "    loop .pi_print");
+    emit(cg, "    pop edi");
     emit(cg, "    pop esi");
     emit(cg, "    pop edx");
     emit(cg, "    pop ecx");
@@ -885,6 +1178,7 @@ static void codegen_emit_runtime(CodeGen* cg) {
     emit(cg, "newline:");
     emit(cg, "    push ebp");
     emit(cg, "    mov ebp, esp");
+    emit(cg, "    push ebx");
     emit(cg, "    mov eax, [vga_cursor]");
     emit(cg, "    mov ebx, 80");
     emit(cg, "    xor edx, edx");
@@ -892,6 +1186,7 @@ static void codegen_emit_runtime(CodeGen* cg) {
     emit(cg, "    inc eax");
     emit(cg, "    imul eax, 80");
     emit(cg, "    mov [vga_cursor], eax");
+    emit(cg, "    pop ebx");
     emit(cg, "    pop ebp");
     emit(cg, "    ret");
     emit(cg, "");
@@ -909,135 +1204,1519 @@ static void codegen_emit_runtime(CodeGen* cg) {
     emit(cg, "    ret");
     emit(cg, "");
 
-    emit(cg, "hex_chars db '0123456789ABCDEF'");
-    emit(cg, "");
+    emit(cg, "hex_chars db '0123456789ABCDEF'");
+    emit(cg, "");
+}
+
+/* ====================== Intrinsics ====================== */
+
+// Runtime routines whose whole body is one or two instructions. At -O1
+// calls to them are emitted in place, with arguments going straight to
+// DX/AL/AX/EAX instead of through the stack.
+
+typedef enum {
+    INTRINSIC_OUT,
+    INTRINSIC_IN,
+    INTRINSIC_CLI,
+    INTRINSIC_STI,
+    INTRINSIC_HLT,
+    INTRINSIC_READ_CR,
+    INTRINSIC_WRITE_CR
+} IntrinsicKind;
+
+typedef struct {
+    const char* name;
+    IntrinsicKind kind;
+    int operand;          // Port access width in bytes, or control register number
+    size_t arg_count;
+} Intrinsic;
+
+static const Intrinsic intrinsics[] = {
+    { "outb", INTRINSIC_OUT, 1, 2 },
+    { "outw", INTRINSIC_OUT, 2, 2 },
+    { "outl", INTRINSIC_OUT, 4, 2 },
+    { "inb", INTRINSIC_IN, 1, 1 },
+    { "inw", INTRINSIC_IN, 2, 1 },
+    { "inl", INTRINSIC_IN, 4, 1 },
+    { "disable_interrupts", INTRINSIC_CLI, 0, 0 },
+    { "cli_func", INTRINSIC_CLI, 0, 0 },
+    { "enable_interrupts", INTRINSIC_STI, 0, 0 },
+    { "sti_func", INTRINSIC_STI, 0, 0 },
+    { "halt", INTRINSIC_HLT, 0, 0 },
+    { "read_cr0", INTRINSIC_READ_CR, 0, 0 },
+    { "read_cr3", INTRINSIC_READ_CR, 3, 0 },
+    { "write_cr0", INTRINSIC_WRITE_CR, 0, 1 },
+    { "write_cr3", INTRINSIC_WRITE_CR, 3, 1 },
+};
+
+static const Intrinsic* find_intrinsic(const char* name, size_t arg_count) {
+    for (size_t i = 0; i < sizeof(intrinsics) / sizeof(intrinsics[0]); i++) {
+        if (strcmp(intrinsics[i].name, name) == 0) {
+            return intrinsics[i].arg_count == arg_count ? &intrinsics[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+/* ====================== Register Allocation ====================== */
+
+// Linear scan over whole-function live intervals. Scalar locals and params
+// compete for EBX/ESI/EDI by loop-weighted use count; registers no local
+// claims are handed out as expression temporaries instead of push/pop.
+
+static int ra_loop_weight(int depth) {
+    int w = 1;
+    for (int i = 0; i < depth && i < 4; i++) w *= 10;
+    return w;
+}
+
+static LiveInterval* ra_find(RegAlloc* ra, const char* name) {
+    for (int i = 0; i < ra->count; i++) {
+        if (strcmp(ra->intervals[i].name, name) == 0) {
+            return &ra->intervals[i];
+        }
+    }
+    return NULL;
+}
+
+static void ra_declare(RegAlloc* ra, const char* name, int is_param, int excluded) {
+    LiveInterval* iv = ra_find(ra, name);
+    if (iv) {
+        // Redeclared names resolve to the first entry; keep them in memory
+        iv->decl_count++;
+        return;
+    }
+
+    if (ra->count >= ra->capacity) {
+        ra->capacity = ra->capacity == 0 ? 16 : ra->capacity * 2;
+        ra->intervals = (LiveInterval*)realloc(ra->intervals,
+            sizeof(LiveInterval) * ra->capacity);
+    }
+
+    iv = &ra->intervals[ra->count++];
+    iv->name = name;
+    iv->start = ra->position;
+    iv->end = ra->position;
+    iv->weight = 0;
+    iv->reg = REG_NONE;
+    iv->is_param = is_param;
+    iv->decl_count = 1;
+    iv->excluded = excluded;
+}
+
+static void ra_use(RegAlloc* ra, const char* name) {
+    LiveInterval* iv = ra_find(ra, name);
+    if (!iv) return;  // Global
+    iv->end = ra->position;
+    iv->weight += ra_loop_weight(ra->loop_depth);
+}
+
+static void ra_exclude(RegAlloc* ra, const char* name) {
+    LiveInterval* iv = ra_find(ra, name);
+    if (iv) iv->excluded = 1;
+}
+
+static int ra_is_aggregate(AST* decl) {
+    return decl->data.decl.pointer_level == 0 && decl->data.decl.type->kind == TYPE_STRUCT;
+}
+
+static void ra_walk(RegAlloc* ra, AST* node);
+
+static void ra_walk_loop(RegAlloc* ra, AST* cond, AST* body, AST* incr) {
+    int loop_start = ra->position;
+    ra->loop_depth++;
+    ra_walk(ra, cond);
+    ra_walk(ra, body);
+    ra_walk(ra, incr);
+    ra->loop_depth--;
+    int loop_end = ra->position;
+
+    // Values live into the loop stay live around the back edge
+    for (int i = 0; i < ra->count; i++) {
+        LiveInterval* iv = &ra->intervals[i];
+        if (iv->start < loop_start && iv->end >= loop_start && iv->end < loop_end) {
+            iv->end = loop_end;
+        }
+    }
+}
+
+// Codegen does not evaluate operands in walk order: the value of a store
+// comes before its target, and operator and call operands go by register
+// need. When an inlined body inside the expression declares locals, keep
+// every variable the expression reads live until all of it is done, so
+// those locals cannot take a register a later-evaluated operand needs.
+static void ra_keep_operands_live(RegAlloc* ra, int start, int declared) {
+    if (ra->count == declared) return;
+
+    for (int i = 0; i < declared; i++) {
+        LiveInterval* iv = &ra->intervals[i];
+        if (iv->end >= start && iv->end < ra->position) {
+            iv->end = ra->position;
+        }
+    }
+}
+
+static void ra_walk(RegAlloc* ra, AST* node) {
+    if (!node) return;
+    int start = ra->position;
+    int declared = ra->count;
+    ra->position++;
+
+    switch (node->type) {
+    case N_IDENT:
+        ra_use(ra, node->data.ident.name);
+        break;
+    case N_ASSIGN:
+        ra_walk(ra, node->data.assign.value);
+        ra_use(ra, node->data.assign.var_name);
+        break;
+    case N_DECL:
+    {
+        int excluded = node->data.decl.array_size != NULL ||
+            node->data.decl.is_volatile ||
+            ra_is_aggregate(node);
+        ra_walk(ra, node->data.decl.init_value);
+        ra_declare(ra, node->data.decl.name, 0, excluded);
+        ra_use(ra, node->data.decl.name);
+        break;
+    }
+    case N_OPERATOR:
+        ra_walk(ra, node->data.op.left);
+        ra_walk(ra, node->data.op.right);
+        ra_keep_operands_live(ra, start, declared);
+        break;
+    case N_UNARY:
+        if (node->data.unary.op == TOKEN_AMPERSAND &&
+            node->data.unary.operand && node->data.unary.operand->type == N_IDENT) {
+            ra_exclude(ra, node->data.unary.operand->data.ident.name);
+        }
+        ra_walk(ra, node->data.unary.operand);
+        break;
+    case N_MEMBER_ACCESS:
+        if (!node->data.member_access.is_arrow &&
+            node->data.member_access.object->type == N_IDENT) {
+            ra_exclude(ra, node->data.member_access.object->data.ident.name);
+        }
+        ra_walk(ra, node->data.member_access.object);
+        break;
+    case N_ARRAY_ACCESS:
+        ra_walk(ra, node->data.array_access.array);
+        ra_walk(ra, node->data.array_access.index);
+        ra_keep_operands_live(ra, start, declared);
+        break;
+    case N_CALL:
+        for (size_t i = 0; i < node->data.call.arg_count; i++)
+            ra_walk(ra, node->data.call.args[i]);
+        ra_keep_operands_live(ra, start, declared);
+        break;
+    case N_CAST:
+        ra_walk(ra, node->data.cast.expr);
+        break;
+    case N_TERNARY:
+        ra_walk(ra, node->data.ternary.condition);
+        ra_walk(ra, node->data.ternary.true_expr);
+        ra_walk(ra, node->data.ternary.false_expr);
+        break;
+    case N_RETURN:
+        ra_walk(ra, node->data.return_stmt.value);
+        break;
+    case N_BLOCK:
+        for (size_t i = 0; i < node->data.block.count; i++)
+            ra_walk(ra, node->data.block.statements[i]);
+        break;
+    case N_IF:
+        ra_walk(ra, node->data.if_stmt.condition);
+        ra_walk(ra, node->data.if_stmt.then_block);
+        ra_walk(ra, node->data.if_stmt.else_block);
+        break;
+    case N_WHILE:
+        ra_walk_loop(ra, node->data.while_stmt.condition, node->data.while_stmt.body, NULL);
+        break;
+    case N_FOR:
+        ra_walk(ra, node->data.for_stmt.init);
+        ra_walk_loop(ra, node->data.for_stmt.condition, node->data.for_stmt.body,
+            node->data.for_stmt.increment);
+        break;
+    case N_ASM:
+        ra->has_asm = 1;
+        break;
+    case N_INLINE:
+        ra_walk(ra, node->data.inline_call.body);
+        break;
+    default:
+        break;
+    }
+}
+
+static int is_leaf_expr(AST* expr) {
+    if (!expr) return 0;
+    return expr->type == N_INTLIT || expr->type == N_CHAR_LIT ||
+        expr->type == N_STRING_LIT || expr->type == N_IDENT;
+}
+
+static int max_int(int a, int b) {
+    return a > b ? a : b;
+}
+
+// How many temporaries codegen will want live at once for this subtree
+static int ra_temp_depth(AST* node) {
+    if (!node) return 0;
+
+    switch (node->type) {
+    case N_OPERATOR:
+    {
+        AST* l = node->data.op.left;
+        AST* r = node->data.op.right;
+        int dl = ra_temp_depth(l);
+        int dr = ra_temp_depth(r);
+        Tokens op = node->data.op.op;
+        if (op == TOKEN_PLUS_ASSIGN || op == TOKEN_MINUS_ASSIGN ||
+            op == TOKEN_STAR_ASSIGN || op == TOKEN_SLASH_ASSIGN) {
+            return max_int(dl, 1 + (is_leaf_expr(r) ? 0 : 1 + dr));
+        }
+        if (op == TOKEN_ASSIGN) {
+            return is_leaf_expr(r) ? dl : max_int(dr, dl + 1);
+        }
+        if (is_leaf_expr(l) || is_leaf_expr(r)) return max_int(dl, dr);
+        return max_int(dl, dr + 1);
+    }
+    case N_ARRAY_ACCESS:
+    {
+        int da = ra_temp_depth(node->data.array_access.array);
+        int di = ra_temp_depth(node->data.array_access.index);
+        if (node->data.array_access.array->type == N_IDENT) return max_int(da, di);
+        return max_int(da, di + 1);
+    }
+    case N_UNARY: return ra_temp_depth(node->data.unary.operand);
+    case N_ASSIGN: return ra_temp_depth(node->data.assign.value);
+    case N_DECL: return ra_temp_depth(node->data.decl.init_value);
+    case N_CAST: return ra_temp_depth(node->data.cast.expr);
+    case N_MEMBER_ACCESS: return ra_temp_depth(node->data.member_access.object);
+    case N_RETURN: return ra_temp_depth(node->data.return_stmt.value);
+    case N_INLINE: return ra_temp_depth(node->data.inline_call.body);
+    case N_CALL:
+    {
+        int d = 0;
+        for (size_t i = 0; i < node->data.call.arg_count; i++)
+            d = max_int(d, ra_temp_depth(node->data.call.args[i]));
+        // out holds the value while a computed port is evaluated
+        const Intrinsic* in = find_intrinsic(node->data.call.name, node->data.call.arg_count);
+        if (in && in->kind == INTRINSIC_OUT && !is_leaf_expr(node->data.call.args[0])) {
+            d = max_int(d, 1 + ra_temp_depth(node->data.call.args[0]));
+        }
+        return d;
+    }
+    case N_TERNARY:
+        return max_int(ra_temp_depth(node->data.ternary.condition),
+            max_int(ra_temp_depth(node->data.ternary.true_expr),
+                ra_temp_depth(node->data.ternary.false_expr)));
+    case N_BLOCK:
+    {
+        int d = 0;
+        for (size_t i = 0; i < node->data.block.count; i++)
+            d = max_int(d, ra_temp_depth(node->data.block.statements[i]));
+        return d;
+    }
+    case N_IF:
+        return max_int(ra_temp_depth(node->data.if_stmt.condition),
+            max_int(ra_temp_depth(node->data.if_stmt.then_block),
+                ra_temp_depth(node->data.if_stmt.else_block)));
+    case N_WHILE:
+        return max_int(ra_temp_depth(node->data.while_stmt.condition),
+            ra_temp_depth(node->data.while_stmt.body));
+    case N_FOR:
+        return max_int(max_int(ra_temp_depth(node->data.for_stmt.init),
+            ra_temp_depth(node->data.for_stmt.condition)),
+            max_int(ra_temp_depth(node->data.for_stmt.increment),
+                ra_temp_depth(node->data.for_stmt.body)));
+    default:
+        return 0;
+    }
+}
+
+static void ra_linear_scan(RegAlloc* ra) {
+    int active[REG_POOL_SIZE];
+    for (int r = 0; r < REG_POOL_SIZE; r++) active[r] = -1;
+
+    // Candidates in order of increasing start point
+    int* order = (int*)malloc(sizeof(int) * (ra->count + 1));
+    int n = 0;
+    for (int i = 0; i < ra->count; i++) {
+        LiveInterval* iv = &ra->intervals[i];
+        // A register costs a save/restore pair, so skip cold variables
+        if (iv->excluded || iv->decl_count > 1 || iv->weight < 3) continue;
+        int j = n++;
+        while (j > 0 && ra->intervals[order[j - 1]].start > iv->start) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (int k = 0; k < n; k++) {
+        LiveInterval* iv = &ra->intervals[order[k]];
+
+        // Expire intervals that ended before this one starts
+        for (int r = 0; r < REG_POOL_SIZE; r++) {
+            if (active[r] >= 0 && ra->intervals[active[r]].end < iv->start) {
+                active[r] = -1;
+            }
+        }
+
+        int chosen = REG_NONE;
+        for (int r = 0; r < REG_POOL_SIZE; r++) {
+            if (active[r] < 0) { chosen = r; break; }
+        }
+
+        if (chosen == REG_NONE) {
+            // Spill whichever of the active intervals is coldest
+            int weakest = 0;
+            for (int r = 1; r < REG_POOL_SIZE; r++) {
+                if (ra->intervals[active[r]].weight < ra->intervals[active[weakest]].weight) {
+                    weakest = r;
+                }
+            }
+            if (ra->intervals[active[weakest]].weight >= iv->weight) continue;
+            ra->intervals[active[weakest]].reg = REG_NONE;
+            chosen = weakest;
+        }
+
+        iv->reg = chosen;
+        active[chosen] = order[k];
+    }
+
+    free(order);
+}
+
+// Decide register assignments for a function before its prologue is emitted
+static void regalloc_function(CodeGen* cg, AST* func) {
+    RegAlloc* ra = &cg->ra;
+    ra->count = 0;
+    ra->position = 0;
+    ra->loop_depth = 0;
+    ra->has_asm = 0;
+    ra->saved_count = 0;
+    ra->temp_count = 0;
+    ra->temp_top = 0;
+
+    if (cg->opt_level < 1) return;
+
+    for (size_t i = 0; i < func->data.function.param_count; i++) {
+        AST* param = func->data.function.params[i];
+        if (param->type == N_DECL) {
+            ra_declare(ra, param->data.decl.name, 1,
+                ra_is_aggregate(param));
+        }
+    }
+    ra_walk(ra, func->data.function.body);
+
+    if (ra->has_asm) {
+        // Inline asm may use any register: allocate nothing, but keep the
+        // callee-saved set intact for callers that do
+        for (int i = 0; i < ra->count; i++) ra->intervals[i].reg = REG_NONE;
+        for (int r = 0; r < REG_POOL_SIZE; r++) ra->saved_regs[ra->saved_count++] = r;
+        return;
+    }
+
+    ra_linear_scan(ra);
+
+    int used[REG_POOL_SIZE] = { 0 };
+    for (int i = 0; i < ra->count; i++) {
+        if (ra->intervals[i].reg != REG_NONE) used[ra->intervals[i].reg] = 1;
+    }
+
+    int depth = ra_temp_depth(func->data.function.body);
+    for (int r = 0; r < REG_POOL_SIZE && ra->temp_count < depth; r++) {
+        if (!used[r]) {
+            ra->temp_regs[ra->temp_count++] = r;
+            used[r] = 1;
+        }
+    }
+
+    for (int r = 0; r < REG_POOL_SIZE; r++) {
+        if (used[r]) ra->saved_regs[ra->saved_count++] = r;
+    }
+}
+
+static int regalloc_lookup(CodeGen* cg, const char* name) {
+    if (cg->opt_level < 1) return REG_NONE;
+    LiveInterval* iv = ra_find(&cg->ra, name);
+    return iv ? iv->reg : REG_NONE;
+}
+
+/* ====================== Frame Layout ====================== */
+
+// Stack bytes a declaration will claim; register-allocated locals take none
+static int frame_decl_size(CodeGen* cg, AST* decl) {
+    if (regalloc_lookup(cg, decl->data.decl.name) != REG_NONE) return 0;
+
+    return slot_size(decl_type(cg, decl));
+}
+
+static int frame_extent(CodeGen* cg, AST* stmt, int offset);
+
+// Inlined bodies inside an expression claim their slots past offset
+static int frame_expr_extent(CodeGen* cg, AST* expr, int offset) {
+    if (!expr) return offset;
+
+    switch (expr->type) {
+    case N_INLINE:
+        return frame_extent(cg, expr->data.inline_call.body, offset);
+    case N_OPERATOR:
+        return max_int(frame_expr_extent(cg, expr->data.op.left, offset),
+            frame_expr_extent(cg, expr->data.op.right, offset));
+    case N_UNARY:
+        return frame_expr_extent(cg, expr->data.unary.operand, offset);
+    case N_ASSIGN:
+        return frame_expr_extent(cg, expr->data.assign.value, offset);
+    case N_CAST:
+        return frame_expr_extent(cg, expr->data.cast.expr, offset);
+    case N_ARRAY_ACCESS:
+        return max_int(frame_expr_extent(cg, expr->data.array_access.array, offset),
+            frame_expr_extent(cg, expr->data.array_access.index, offset));
+    case N_MEMBER_ACCESS:
+        return frame_expr_extent(cg, expr->data.member_access.object, offset);
+    case N_TERNARY:
+        return max_int(frame_expr_extent(cg, expr->data.ternary.condition, offset),
+            max_int(frame_expr_extent(cg, expr->data.ternary.true_expr, offset),
+                frame_expr_extent(cg, expr->data.ternary.false_expr, offset)));
+    case N_CALL:
+    {
+        int deepest = offset;
+        for (size_t i = 0; i < expr->data.call.arg_count; i++)
+            deepest = max_int(deepest, frame_expr_extent(cg, expr->data.call.args[i], offset));
+        return deepest;
+    }
+    default:
+        return offset;
+    }
+}
+
+// Deepest stack offset reached while generating stmt, starting at offset.
+// Mirrors the scope pushes in codegen_statement, so sibling blocks share slots.
+static int frame_extent(CodeGen* cg, AST* stmt, int offset) {
+    if (!stmt) return offset;
+
+    switch (stmt->type) {
+    case N_DECL:
+    {
+        // The slot exists before the initializer runs
+        int end = offset + frame_decl_size(cg, stmt);
+        return max_int(end, frame_expr_extent(cg, stmt->data.decl.init_value, end));
+    }
+
+    case N_BLOCK:
+    {
+        int current = offset;
+        int deepest = offset;
+        for (size_t i = 0; i < stmt->data.block.count; i++) {
+            AST* child = stmt->data.block.statements[i];
+            if (child->type == N_DECL) {
+                current += frame_decl_size(cg, child);
+                deepest = max_int(deepest, current);
+                deepest = max_int(deepest,
+                    frame_expr_extent(cg, child->data.decl.init_value, current));
+            }
+            else {
+                deepest = max_int(deepest, frame_extent(cg, child, current));
+            }
+        }
+        return deepest;
+    }
+
+    case N_IF:
+        return max_int(frame_expr_extent(cg, stmt->data.if_stmt.condition, offset),
+            max_int(frame_extent(cg, stmt->data.if_stmt.then_block, offset),
+                frame_extent(cg, stmt->data.if_stmt.else_block, offset)));
+
+    case N_WHILE:
+        return max_int(frame_expr_extent(cg, stmt->data.while_stmt.condition, offset),
+            frame_extent(cg, stmt->data.while_stmt.body, offset));
+
+    case N_FOR:
+    {
+        int inner = frame_extent(cg, stmt->data.for_stmt.init, offset);
+        int deepest = max_int(inner, frame_extent(cg, stmt->data.for_stmt.body, inner));
+        deepest = max_int(deepest, frame_expr_extent(cg, stmt->data.for_stmt.condition, inner));
+        return max_int(deepest, frame_expr_extent(cg, stmt->data.for_stmt.increment, inner));
+    }
+
+    case N_RETURN:
+        return frame_expr_extent(cg, stmt->data.return_stmt.value, offset);
+
+    default:
+        return frame_expr_extent(cg, stmt, offset);
+    }
+}
+
+// Save EAX in a temporary register, or on the stack once they run out
+static int temp_push(CodeGen* cg) {
+    RegAlloc* ra = &cg->ra;
+    if (ra->temp_top < ra->temp_count) {
+        int reg = ra->temp_regs[ra->temp_top++];
+        emit(cg, "    mov %s, eax  ; Temp", pool_reg_names[reg]);
+        return reg;
+    }
+    emit(cg, "    push eax  ; Spill temp");
+    return REG_NONE;
+}
+
+static void temp_pop_into(CodeGen* cg, int temp, const char* dest) {
+    if (temp == REG_NONE) {
+        emit(cg, "    pop %s  ; Reload temp", dest);
+        return;
+    }
+    cg->ra.temp_top--;
+    emit(cg, "    mov %s, %s  ; Temp", dest, pool_reg_names[temp]);
+}
+
+/* ====================== Variable Access ====================== */
+
+// Register holding the local that name refers to here; REG_NONE if that
+// local lives in memory or the name is a global
+static int local_reg(CodeGen* cg, const char* name) {
+    Local* entry = symtab_lookup_entry(&cg->symtab, name);
+    return entry ? entry->reg : REG_NONE;
+}
+
+static void codegen_load_ident(CodeGen* cg, const char* name, const char* reg) {
+    Local* entry = symtab_lookup_entry(&cg->symtab, name);
+    if (entry) {
+        if (entry->reg != REG_NONE) {
+            if (strcmp(reg, pool_reg_names[entry->reg]) != 0) {
+                emit(cg, "    mov %s, %s  ; Local %s", reg, pool_reg_names[entry->reg], name);
+            }
+        }
+        else if (entry->is_array && !entry->is_param) {
+            // Local array - return address
+            emit(cg, "    lea %s, [ebp - %d]  ; Address of array %s",
+                reg, entry->offset, name);
+        }
+        else if (entry->is_param) {
+            emit(cg, "    mov %s, [ebp + %d]  ; Param %s",
+                reg, entry->offset, name);
+        }
+        else {
+            emit(cg, "    mov %s, [ebp - %d]  ; Local %s",
+                reg, entry->offset, name);
+        }
+    }
+    else {
+        GlobalVar* gv = globtab_lookup(&cg->globtab, name);
+        if (gv && gv->is_array) {
+            emit(cg, "    mov %s, %s  ; Address of global array", reg, name);
+        }
+        else {
+            emit(cg, "    mov %s, [%s]  ; Global %s", reg, name, name);
+        }
+    }
+}
+
+static void codegen_store_ident(CodeGen* cg, const char* name) {
+    Local* entry = symtab_lookup_entry(&cg->symtab, name);
+    if (entry) {
+        if (entry->reg != REG_NONE) {
+            emit(cg, "    mov %s, eax  ; Local %s", pool_reg_names[entry->reg], name);
+        }
+        else if (entry->is_param) {
+            emit(cg, "    mov [ebp + %d], eax  ; Param %s", entry->offset, name);
+        }
+        else {
+            emit(cg, "    mov [ebp - %d], eax  ; Local %s", entry->offset, name);
+        }
+    }
+    else {
+        emit(cg, "    mov [%s], eax  ; Global %s", name, name);
+    }
+}
+
+// Base address of an indexed variable: arrays by address, pointers by value
+static void codegen_array_base(CodeGen* cg, const char* name, const char* reg) {
+    Local* entry = symtab_lookup_entry(&cg->symtab, name);
+    if (entry && entry->reg != REG_NONE) {
+        emit(cg, "    mov %s, %s  ; Load pointer local", reg, pool_reg_names[entry->reg]);
+    }
+    else if (entry && entry->is_array && !entry->is_param) {
+        emit(cg, "    lea %s, [ebp - %d]  ; Array base", reg, entry->offset);
+    }
+    else if (entry) {
+        if (entry->is_param) {
+            emit(cg, "    mov %s, [ebp + %d]  ; Load pointer param", reg, entry->offset);
+        }
+        else {
+            emit(cg, "    mov %s, [ebp - %d]  ; Load pointer local", reg, entry->offset);
+        }
+    }
+    else {
+        GlobalVar* gv = globtab_lookup(&cg->globtab, name);
+        if (gv && gv->is_array) {
+            emit(cg, "    mov %s, %s  ; Array address", reg, name);
+        }
+        else {
+            emit(cg, "    mov %s, [%s]  ; Load global pointer", reg, name);
+        }
+    }
+}
+
+// Load a leaf expression straight into a register without touching EAX
+static void codegen_leaf_into(CodeGen* cg, AST* expr, const char* reg) {
+    switch (expr->type) {
+    case N_INTLIT:
+        emit(cg, "    mov %s, %d", reg, expr->data.int_lit.value);
+        break;
+    case N_CHAR_LIT:
+        emit(cg, "    mov %s, %d  ; char", reg, (unsigned char)expr->data.char_lit.value);
+        break;
+    case N_STRING_LIT:
+    {
+        int str_id = codegen_add_string(cg, expr->data.string_lit.value);
+        emit(cg, "    mov %s, str%d", reg, str_id);
+        break;
+    }
+    case N_IDENT:
+        codegen_load_ident(cg, expr->data.ident.name, reg);
+        break;
+    default:
+        break;
+    }
+}
+
+// Evaluate a binary operator's operands: left into EAX, right into ECX
+static void codegen_operands(CodeGen* cg, AST* left, AST* right) {
+    if (is_leaf_expr(right)) {
+        codegen_expression(cg, left);
+        codegen_leaf_into(cg, right, "ecx");
+    }
+    else if (is_leaf_expr(left)) {
+        codegen_expression(cg, right);
+        emit(cg, "    mov ecx, eax");
+        codegen_leaf_into(cg, left, "eax");
+    }
+    else {
+        codegen_expression(cg, left);
+        int temp = temp_push(cg);
+        codegen_expression(cg, right);
+        emit(cg, "    mov ecx, eax");
+        temp_pop_into(cg, temp, "eax");
+    }
+}
+
+/* ====================== Operand Selection ====================== */
+
+static int is_immediate(AST* expr) {
+    return expr && (expr->type == N_INTLIT || expr->type == N_CHAR_LIT);
+}
+
+static int immediate_value(AST* expr) {
+    if (expr->type == N_CHAR_LIT) return (unsigned char)expr->data.char_lit.value;
+    return expr->data.int_lit.value;
+}
+
+// Source operand for a leaf that ALU instructions accept without a load:
+// immediates, register locals and dword scalars in the frame or .data
+static int codegen_leaf_operand(CodeGen* cg, AST* expr, char* buf, size_t size) {
+    if (!expr) return 0;
+    if (is_immediate(expr)) {
+        snprintf(buf, size, "%d", immediate_value(expr));
+        return 1;
+    }
+    if (expr->type != N_IDENT) return 0;
+
+    const char* name = expr->data.ident.name;
+    Local* entry = symtab_lookup_entry(&cg->symtab, name);
+    if (entry) {
+        if (entry->reg != REG_NONE) {
+            snprintf(buf, size, "%s", pool_reg_names[entry->reg]);
+        }
+        else if (entry->is_array && !entry->is_param) {
+            return 0;  // Value is an address
+        }
+        else {
+            snprintf(buf, size, "dword [ebp %c %d]", entry->is_param ? '+' : '-', entry->offset);
+        }
+        return 1;
+    }
+
+    GlobalVar* gv = globtab_lookup(&cg->globtab, name);
+    if (gv && gv->is_array) return 0;
+    snprintf(buf, size, "dword [%s]", name);
+    return 1;
+}
+
+static int exact_log2(int value) {
+    for (int k = 1; k < 31; k++) {
+        if (value == (1 << k)) return k;
+    }
+    return -1;
+}
+
+// Whether emit_binary_operand can combine EAX with such a source directly
+static int binary_takes_operand(Tokens op, int is_imm) {
+    switch (op) {
+    case TOKEN_PLUS: case TOKEN_MINUS: case TOKEN_STAR:
+    case TOKEN_SLASH: case TOKEN_PERCENT:
+    case TOKEN_AMPERSAND: case TOKEN_PIPE: case TOKEN_CARET:
+    case TOKEN_EQUAL: case TOKEN_NOT_EQUAL:
+    case TOKEN_LESS: case TOKEN_GREATER:
+    case TOKEN_LESS_EQUAL: case TOKEN_GREATER_EQUAL:
+        return 1;
+    case TOKEN_LSHIFT: case TOKEN_RSHIFT:
+        return is_imm;
+    default:
+        return 0;
+    }
+}
+
+// The operator to use when the operands trade places; 0 if there is none
+static int mirror_operator(Tokens op, Tokens* mirrored) {
+    switch (op) {
+    case TOKEN_PLUS: case TOKEN_STAR:
+    case TOKEN_AMPERSAND: case TOKEN_PIPE: case TOKEN_CARET:
+    case TOKEN_EQUAL: case TOKEN_NOT_EQUAL:
+        *mirrored = op;
+        return 1;
+    case TOKEN_LESS:          *mirrored = TOKEN_GREATER; return 1;
+    case TOKEN_GREATER:       *mirrored = TOKEN_LESS; return 1;
+    case TOKEN_LESS_EQUAL:    *mirrored = TOKEN_GREATER_EQUAL; return 1;
+    case TOKEN_GREATER_EQUAL: *mirrored = TOKEN_LESS_EQUAL; return 1;
+    default:
+        return 0;
+    }
+}
+
+// Compare EAX against src, using test for zero
+static void emit_compare_operand(CodeGen* cg, const char* src, int is_imm, int imm) {
+    if (is_imm && imm == 0) {
+        emit(cg, "    test eax, eax");
+    }
+    else {
+        emit(cg, "    cmp eax, %s", src);
+    }
+}
+
+/* ====================== Address Generation (for lvalues) ====================== */
+
+// Generate code that leaves the ADDRESS of an lvalue in EAX
+static void codegen_lvalue_address(CodeGen* cg, AST* expr);
+static void codegen_element_operand(CodeGen* cg, AST* access, char* buf, size_t size);
+
+static void codegen_lvalue_address(CodeGen* cg, AST* expr) {
+    if (!expr) return;
+
+    switch (expr->type) {
+    case N_IDENT:
+    {
+        Local* entry = symtab_lookup_entry(&cg->symtab, expr->data.ident.name);
+        if (entry && entry->reg != REG_NONE) {
+            // The allocator never assigns registers to address-taken names
+            emit(cg, "    ; ERROR: Address of register variable %s", expr->data.ident.name);
+            emit(cg, "    xor eax, eax");
+        }
+        else if (entry) {
+            if (entry->is_param) {
+                emit(cg, "    lea eax, [ebp + %d]  ; Address of param %s",
+                    entry->offset, expr->data.ident.name);
+            }
+            else {
+                emit(cg, "    lea eax, [ebp - %d]  ; Address of local %s",
+                    entry->offset, expr->data.ident.name);
+            }
+        }
+        else {
+            emit(cg, "    mov eax, %s  ; Address of global %s",
+                expr->data.ident.name, expr->data.ident.name);
+        }
+        break;
+    }
+
+    case N_ARRAY_ACCESS:
+    {
+        AST* arr = expr->data.array_access.array;
+        AST* idx = expr->data.array_access.index;
+
+        int element_size = 1;
+        if (arr->type == N_IDENT) {
+            element_size = get_element_size_for_var(cg, arr->data.ident.name);
+        }
+
+        if (cg->opt_level >= 1) {
+            if (arr->type == N_IDENT) {
+                char operand[96];
+                codegen_element_operand(cg, expr, operand, sizeof(operand));
+                emit(cg, "    lea eax, %s  ; Element address", operand);
+            }
+            else {
+                codegen_expression(cg, arr);
+                int temp = temp_push(cg);
+                codegen_expression(cg, idx);
+                emit_scale_index(cg, element_size, "eax");
+                temp_pop_into(cg, temp, "ecx");
+                emit(cg, "    add eax, ecx  ; Compute element address");
+            }
+            break;
+        }
+
+        // Get base address
+        if (arr->type == N_IDENT) {
+            codegen_array_base(cg, arr->data.ident.name, "eax");
+        }
+        else {
+            codegen_expression(cg, arr);
+        }
+
+        emit(cg, "    push eax  ; Save base");
+        codegen_expression(cg, idx);
+        emit_scale_index(cg, element_size, "eax");
+        emit(cg, "    pop ebx  ; Restore base");
+        emit(cg, "    add eax, ebx  ; Compute element address");
+        break;
+    }
+
+    case N_UNARY:
+        if (expr->data.unary.op == TOKEN_STAR) {
+            // *ptr - address is the value of ptr
+            codegen_expression(cg, expr->data.unary.operand);
+        }
+        break;
+
+    case N_MEMBER_ACCESS:
+    {
+        AST* obj = expr->data.member_access.object;
+        char* member = expr->data.member_access.member;
+        int is_arrow = expr->data.member_access.is_arrow;
+
+        Type* struct_type = NULL;
+        if (obj->type == N_IDENT) {
+            struct_type = get_var_struct_type(cg, obj->data.ident.name);
+        }
+
+        if (!struct_type) {
+            emit(cg, "    ; WARNING: Unknown struct type for member access");
+            emit(cg, "    xor eax, eax");
+            return;
+        }
+
+        const TypeMember* field = type_find_member(struct_type, member);
+        if (!field) {
+            emit(cg, "    ; WARNING: Member '%s' not found in struct '%s'", member, struct_type->tag);
+            emit(cg, "    xor eax, eax");
+            return;
+        }
+        int offset = field->offset;
+
+        if (is_arrow) {
+            codegen_expression(cg, obj);  // Get pointer value
+            emit(cg, "    add eax, %d  ; Offset to member %s", offset, member);
+        }
+        else {
+            codegen_lvalue_address(cg, obj);  // Get struct address
+            emit(cg, "    add eax, %d  ; Offset to member %s", offset, member);
+        }
+        break;
+    }
+
+    default:
+        emit(cg, "    ; ERROR: Cannot take address of expression type %d", expr->type);
+        break;
+    }
+}
+
+/* ====================== Operator Lowering ====================== */
+
+// Combine EAX (left) with rhs (right) into EAX
+static void emit_binary_op(CodeGen* cg, Tokens op, const char* rhs) {
+    switch (op) {
+    case TOKEN_PLUS:
+        emit(cg, "    add eax, %s", rhs);
+        break;
+    case TOKEN_MINUS:
+        emit(cg, "    sub eax, %s", rhs);
+        break;
+    case TOKEN_STAR:
+        emit(cg, "    imul eax, %s", rhs);
+        break;
+    case TOKEN_SLASH:
+        emit(cg, "    cdq");
+        emit(cg, "    idiv %s", rhs);
+        break;
+    case TOKEN_PERCENT:
+        emit(cg, "    cdq");
+        emit(cg, "    idiv %s", rhs);
+        emit(cg, "    mov eax, edx  ; Remainder");
+        break;
+    case TOKEN_LSHIFT:
+        if (strcmp(rhs, "ecx") != 0) emit(cg, "    mov ecx, %s", rhs);
+        emit(cg, "    shl eax, cl");
+        break;
+    case TOKEN_RSHIFT:
+        if (strcmp(rhs, "ecx") != 0) emit(cg, "    mov ecx, %s", rhs);
+        emit(cg, "    sar eax, cl");
+        break;
+    case TOKEN_AMPERSAND:
+        emit(cg, "    and eax, %s", rhs);
+        break;
+    case TOKEN_PIPE:
+        emit(cg, "    or eax, %s", rhs);
+        break;
+    case TOKEN_CARET:
+        emit(cg, "    xor eax, %s", rhs);
+        break;
+    case TOKEN_EQUAL:
+        emit(cg, "    cmp eax, %s", rhs);
+        emit(cg, "    sete al");
+        emit(cg, "    movzx eax, al");
+        break;
+    case TOKEN_NOT_EQUAL:
+        emit(cg, "    cmp eax, %s", rhs);
+        emit(cg, "    setne al");
+        emit(cg, "    movzx eax, al");
+        break;
+    case TOKEN_LESS:
+        emit(cg, "    cmp eax, %s", rhs);
+        emit(cg, "    setl al");
+        emit(cg, "    movzx eax, al");
+        break;
+    case TOKEN_GREATER:
+        emit(cg, "    cmp eax, %s", rhs);
+        emit(cg, "    setg al");
+        emit(cg, "    movzx eax, al");
+        break;
+    case TOKEN_LESS_EQUAL:
+        emit(cg, "    cmp eax, %s", rhs);
+        emit(cg, "    setle al");
+        emit(cg, "    movzx eax, al");
+        break;
+    case TOKEN_GREATER_EQUAL:
+        emit(cg, "    cmp eax, %s", rhs);
+        emit(cg, "    setge al");
+        emit(cg, "    movzx eax, al");
+        break;
+    case TOKEN_ASSIGN:
+        emit(cg, "    mov [eax], %s", rhs);
+        emit(cg, "    mov eax, %s", rhs);
+        break;
+    default:
+        emit(cg, "    ; Unknown operator %d", op);
+        break;
+    }
+}
+
+static void emit_setcc(CodeGen* cg, Tokens op) {
+    switch (op) {
+    case TOKEN_EQUAL:         emit(cg, "    sete al"); break;
+    case TOKEN_NOT_EQUAL:     emit(cg, "    setne al"); break;
+    case TOKEN_LESS:          emit(cg, "    setl al"); break;
+    case TOKEN_GREATER:       emit(cg, "    setg al"); break;
+    case TOKEN_LESS_EQUAL:    emit(cg, "    setle al"); break;
+    default:                  emit(cg, "    setge al"); break;
+    }
+    emit(cg, "    movzx eax, al");
+}
+
+// Combine EAX with a register, memory or immediate source into EAX;
+// only valid when binary_takes_operand() agreed
+static void emit_binary_operand(CodeGen* cg, Tokens op, const char* src, int is_imm, int imm) {
+    switch (op) {
+    case TOKEN_PLUS:
+        emit(cg, "    add eax, %s", src);
+        break;
+    case TOKEN_MINUS:
+        emit(cg, "    sub eax, %s", src);
+        break;
+    case TOKEN_STAR:
+        if (is_imm && exact_log2(imm) > 0) {
+            emit(cg, "    shl eax, %d", exact_log2(imm));
+        }
+        else if (is_imm && (imm == 3 || imm == 5 || imm == 9)) {
+            emit(cg, "    lea eax, [eax + eax*%d]", imm - 1);
+        }
+        else if (is_imm) {
+            emit(cg, "    imul eax, eax, %d", imm);
+        }
+        else {
+            emit(cg, "    imul eax, %s", src);
+        }
+        break;
+    case TOKEN_SLASH:
+    case TOKEN_PERCENT:
+        // idiv has no immediate form
+        if (is_imm) {
+            emit(cg, "    mov ecx, %d", imm);
+            src = "ecx";
+        }
+        emit(cg, "    cdq");
+        emit(cg, "    idiv %s", src);
+        if (op == TOKEN_PERCENT) emit(cg, "    mov eax, edx  ; Remainder");
+        break;
+    case TOKEN_LSHIFT:
+        emit(cg, "    shl eax, %d", imm & 31);
+        break;
+    case TOKEN_RSHIFT:
+        emit(cg, "    sar eax, %d", imm & 31);
+        break;
+    case TOKEN_AMPERSAND:
+        emit(cg, "    and eax, %s", src);
+        break;
+    case TOKEN_PIPE:
+        emit(cg, "    or eax, %s", src);
+        break;
+    case TOKEN_CARET:
+        emit(cg, "    xor eax, %s", src);
+        break;
+    default:
+        emit_compare_operand(cg, src, is_imm, imm);
+        emit_setcc(cg, op);
+        break;
+    }
+}
+
+// Evaluate what an element access needs and describe it as one memory
+// operand such as "[ebp + eax*4 - 40]" or "[esi + eax*2 + 6]". The index
+// ends up in EAX and, if the base must be loaded, the base in ECX.
+static void codegen_element_operand(CodeGen* cg, AST* access, char* buf, size_t size) {
+    AST* arr = access->data.array_access.array;
+    AST* idx = access->data.array_access.index;
+
+    if (arr->type != N_IDENT) {
+        codegen_lvalue_address(cg, access);
+        snprintf(buf, size, "[eax]");
+        return;
+    }
+
+    const char* name = arr->data.ident.name;
+    int element_size = get_element_size_for_var(cg, name);
+    int scale = (element_size == 1 || element_size == 2 ||
+        element_size == 4 || element_size == 8) ? element_size : 1;
+
+    // Constant parts of the index become the displacement
+    int disp = 0;
+    AST* index_expr = idx;
+    if (is_immediate(idx)) {
+        disp = immediate_value(idx) * element_size;
+        index_expr = NULL;
+    }
+    else if (idx->type == N_OPERATOR && is_immediate(idx->data.op.right) &&
+        (idx->data.op.op == TOKEN_PLUS || idx->data.op.op == TOKEN_MINUS)) {
+        disp = immediate_value(idx->data.op.right) * element_size;
+        if (idx->data.op.op == TOKEN_MINUS) disp = -disp;
+        index_expr = idx->data.op.left;
+    }
+
+    if (index_expr) {
+        codegen_expression(cg, index_expr);
+        if (scale != element_size) emit_scale_index(cg, element_size, "eax");
+    }
+
+    char base[64];
+    Local* entry = symtab_lookup_entry(&cg->symtab, name);
+    if (entry && entry->reg != REG_NONE) {
+        snprintf(base, sizeof(base), "%s", pool_reg_names[entry->reg]);
+    }
+    else if (entry && entry->is_array && !entry->is_param) {
+        snprintf(base, sizeof(base), "ebp");
+        disp -= entry->offset;
+    }
+    else if (entry) {
+        codegen_array_base(cg, name, "ecx");
+        snprintf(base, sizeof(base), "ecx");
+    }
+    else {
+        GlobalVar* gv = globtab_lookup(&cg->globtab, name);
+        if (gv && gv->is_array) {
+            snprintf(base, sizeof(base), "%s", name);
+        }
+        else {
+            codegen_array_base(cg, name, "ecx");
+            snprintf(base, sizeof(base), "ecx");
+        }
+    }
+
+    char index_part[32] = "";
+    if (index_expr) {
+        if (scale == 1) snprintf(index_part, sizeof(index_part), " + eax");
+        else snprintf(index_part, sizeof(index_part), " + eax*%d", scale);
+    }
+
+    char disp_part[32] = "";
+    if (disp > 0) snprintf(disp_part, sizeof(disp_part), " + %d", disp);
+    else if (disp < 0) snprintf(disp_part, sizeof(disp_part), " - %d", -disp);
+
+    snprintf(buf, size, "[%s%s%s]", base, index_part, disp_part);
+}
+
+static const char* size_keyword(int element_size) {
+    if (element_size == 1) return "byte";
+    if (element_size == 2) return "word";
+    return "dword";
+}
+
+static int access_element_size(CodeGen* cg, AST* access) {
+    AST* arr = access->data.array_access.array;
+    if (arr->type == N_IDENT) return get_element_size_for_var(cg, arr->data.ident.name);
+    return 1;
+}
+
+// Evaluate the right side of an assignment, then the target address into
+// ECX; the value ends up back in EAX
+static void codegen_store_target(CodeGen* cg, AST* value, AST* address_expr, int is_lvalue) {
+    if (is_leaf_expr(value)) {
+        if (is_lvalue) codegen_lvalue_address(cg, address_expr);
+        else codegen_expression(cg, address_expr);
+        emit(cg, "    mov ecx, eax  ; Address in ecx");
+        codegen_leaf_into(cg, value, "eax");
+        return;
+    }
+
+    codegen_expression(cg, value);
+    int temp = temp_push(cg);
+    if (is_lvalue) codegen_lvalue_address(cg, address_expr);
+    else codegen_expression(cg, address_expr);
+    emit(cg, "    mov ecx, eax  ; Address in ecx");
+    temp_pop_into(cg, temp, "eax");
+}
+
+// -O1 lowering of N_OPERATOR: EBX/ESI/EDI may hold locals, so ECX is the
+// scratch register and intermediate values go to free pool registers
+static void codegen_operator_regs(CodeGen* cg, AST* expr) {
+    Tokens op = expr->data.op.op;
+    AST* left = expr->data.op.left;
+    AST* right = expr->data.op.right;
+
+    if (op == TOKEN_ASSIGN && left->type == N_MEMBER_ACCESS) {
+        codegen_store_target(cg, right, left, 1);
+        emit(cg, "    mov [ecx], eax  ; Store");
+        return;
+    }
+
+    if (op == TOKEN_ASSIGN && left->type == N_ARRAY_ACCESS) {
+        // Value goes through EDX so EAX/ECX stay free for the address
+        int element_size = access_element_size(cg, left);
+        char operand[96];
+        if (is_leaf_expr(right)) {
+            codegen_element_operand(cg, left, operand, sizeof(operand));
+            codegen_leaf_into(cg, right, "edx");
+        }
+        else {
+            codegen_expression(cg, right);
+            int temp = temp_push(cg);
+            codegen_element_operand(cg, left, operand, sizeof(operand));
+            temp_pop_into(cg, temp, "edx");
+        }
+        if (element_size == 1) emit(cg, "    mov %s, dl", operand);
+        else if (element_size == 2) emit(cg, "    mov %s, dx", operand);
+        else emit(cg, "    mov %s, edx", operand);
+        emit(cg, "    mov eax, edx");
+        return;
+    }
+
+    if (op == TOKEN_ASSIGN && left->type == N_UNARY &&
+        left->data.unary.op == TOKEN_STAR) {
+        codegen_store_target(cg, right, left->data.unary.operand, 0);
+        emit(cg, "    mov [ecx], eax  ; Store through pointer");
+        return;
+    }
+
+    if (op == TOKEN_PLUS_ASSIGN || op == TOKEN_MINUS_ASSIGN ||
+        op == TOKEN_STAR_ASSIGN || op == TOKEN_SLASH_ASSIGN) {
+        Tokens base_op = op == TOKEN_PLUS_ASSIGN ? TOKEN_PLUS :
+            op == TOKEN_MINUS_ASSIGN ? TOKEN_MINUS :
+            op == TOKEN_STAR_ASSIGN ? TOKEN_STAR : TOKEN_SLASH;
+
+        char src[64];
+        int direct = codegen_leaf_operand(cg, right, src, sizeof(src)) &&
+            binary_takes_operand(base_op, is_immediate(right));
+        int imm = is_immediate(right) ? immediate_value(right) : 0;
+
+        int reg = left->type == N_IDENT ?
+            local_reg(cg, left->data.ident.name) : REG_NONE;
+        if (reg != REG_NONE && direct) {
+            emit(cg, "    mov eax, %s", pool_reg_names[reg]);
+            emit_binary_operand(cg, base_op, src, is_immediate(right), imm);
+            emit(cg, "    mov %s, eax", pool_reg_names[reg]);
+            return;
+        }
+        if (reg != REG_NONE) {
+            if (is_leaf_expr(right)) {
+                codegen_leaf_into(cg, right, "ecx");
+            }
+            else {
+                codegen_expression(cg, right);
+                emit(cg, "    mov ecx, eax  ; Right value in ecx");
+            }
+            emit(cg, "    mov eax, %s", pool_reg_names[reg]);
+            emit_binary_op(cg, base_op, "ecx");
+            emit(cg, "    mov %s, eax", pool_reg_names[reg]);
+            return;
+        }
+
+        codegen_lvalue_address(cg, left);
+        // A constant divisor needs ECX, which holds the address here
+        if (direct && !(base_op == TOKEN_SLASH && is_immediate(right))) {
+            emit(cg, "    mov ecx, eax  ; Address in ecx");
+            emit(cg, "    mov eax, [ecx]  ; Load current value");
+            emit_binary_operand(cg, base_op, src, is_immediate(right), imm);
+            emit(cg, "    mov [ecx], eax  ; Store result");
+            return;
+        }
+        int addr = temp_push(cg);
+        emit(cg, "    mov eax, [eax]  ; Load current value");
+        if (is_leaf_expr(right)) {
+            codegen_leaf_into(cg, right, "ecx");
+        }
+        else {
+            int current = temp_push(cg);
+            codegen_expression(cg, right);
+            emit(cg, "    mov ecx, eax  ; Right value in ecx");
+            temp_pop_into(cg, current, "eax");
+        }
+        emit_binary_op(cg, base_op, "ecx");
+        temp_pop_into(cg, addr, "ecx");
+        emit(cg, "    mov [ecx], eax  ; Store result");
+        return;
+    }
+
+    char src[64];
+    Tokens mirrored;
+    if (codegen_leaf_operand(cg, right, src, sizeof(src)) &&
+        binary_takes_operand(op, is_immediate(right))) {
+        codegen_expression(cg, left);
+        emit_binary_operand(cg, op, src, is_immediate(right),
+            is_immediate(right) ? immediate_value(right) : 0);
+        return;
+    }
+    if (mirror_operator(op, &mirrored) && codegen_leaf_operand(cg, left, src, sizeof(src))) {
+        codegen_expression(cg, right);
+        emit_binary_operand(cg, mirrored, src, is_immediate(left),
+            is_immediate(left) ? immediate_value(left) : 0);
+        return;
+    }
+
+    codegen_operands(cg, left, right);
+    emit_binary_op(cg, op, "ecx");
+}
+
+/* ====================== Condition Code Generation ====================== */
+
+// Condition-code suffix for a comparison operator, NULL if op is not one
+static const char* condition_code(Tokens op) {
+    switch (op) {
+    case TOKEN_EQUAL:         return "e";
+    case TOKEN_NOT_EQUAL:     return "ne";
+    case TOKEN_LESS:          return "l";
+    case TOKEN_GREATER:       return "g";
+    case TOKEN_LESS_EQUAL:    return "le";
+    case TOKEN_GREATER_EQUAL: return "ge";
+    default:                  return NULL;
+    }
+}
+
+static const char* negate_condition(const char* cc) {
+    if (strcmp(cc, "e") == 0) return "ne";
+    if (strcmp(cc, "ne") == 0) return "e";
+    if (strcmp(cc, "l") == 0) return "ge";
+    if (strcmp(cc, "ge") == 0) return "l";
+    if (strcmp(cc, "g") == 0) return "le";
+    return "g";  // le
+}
+
+// Jump to label when cond evaluates to jump_if (nonzero for 1, zero for 0),
+// fall through otherwise. EAX holds nothing useful afterwards.
+static void codegen_branch(CodeGen* cg, AST* cond, int label, int jump_if) {
+    int value;
+    if (cond && cond->type == N_INTLIT) {
+        value = cond->data.int_lit.value != 0;
+        if (value == jump_if) emit(cg, "    jmp .L%d", label);
+        return;
+    }
+
+    if (cond && cond->type == N_UNARY && cond->data.unary.op == TOKEN_EXCLAIM) {
+        codegen_branch(cg, cond->data.unary.operand, label, !jump_if);
+        return;
+    }
+
+    if (cond && cond->type == N_OPERATOR) {
+        Tokens op = cond->data.op.op;
+        AST* left = cond->data.op.left;
+        AST* right = cond->data.op.right;
+
+        if (op == TOKEN_AND || op == TOKEN_OR) {
+            // a && b jumps on false as soon as either side is false;
+            // a || b jumps on true as soon as either side is true
+            int shortcut = op == TOKEN_OR;
+            if (jump_if == shortcut) {
+                codegen_branch(cg, left, label, jump_if);
+                codegen_branch(cg, right, label, jump_if);
+            }
+            else {
+                int skip = codegen_new_label(cg);
+                codegen_branch(cg, left, skip, shortcut);
+                codegen_branch(cg, right, label, jump_if);
+                emit(cg, ".L%d:", skip);
+            }
+            return;
+        }
+
+        if (op == TOKEN_AMPERSAND && is_immediate(right)) {
+            codegen_expression(cg, left);
+            emit(cg, "    test eax, %d", immediate_value(right));
+            emit(cg, "    j%s .L%d", jump_if ? "nz" : "z", label);
+            return;
+        }
+
+        const char* cc = condition_code(op);
+        char src[64];
+        Tokens mirrored;
+        if (cc && codegen_leaf_operand(cg, right, src, sizeof(src))) {
+            codegen_expression(cg, left);
+            emit_compare_operand(cg, src, is_immediate(right),
+                is_immediate(right) ? immediate_value(right) : 0);
+            emit(cg, "    j%s .L%d", jump_if ? cc : negate_condition(cc), label);
+            return;
+        }
+        if (cc && mirror_operator(op, &mirrored) &&
+            codegen_leaf_operand(cg, left, src, sizeof(src))) {
+            cc = condition_code(mirrored);
+            codegen_expression(cg, right);
+            emit_compare_operand(cg, src, is_immediate(left),
+                is_immediate(left) ? immediate_value(left) : 0);
+            emit(cg, "    j%s .L%d", jump_if ? cc : negate_condition(cc), label);
+            return;
+        }
+        if (cc) {
+            codegen_operands(cg, left, right);
+            emit(cg, "    cmp eax, ecx");
+            emit(cg, "    j%s .L%d", jump_if ? cc : negate_condition(cc), label);
+            return;
+        }
+    }
+
+    codegen_expression(cg, cond);
+    emit(cg, "    test eax, eax");
+    emit(cg, "    j%s .L%d", jump_if ? "nz" : "z", label);
+}
+
+// && and || as values: the right side only runs when it decides the result
+static void codegen_logical_value(CodeGen* cg, AST* expr) {
+    Tokens op = expr->data.op.op;
+    int lbl_short = codegen_new_label(cg);
+    int lbl_end = codegen_new_label(cg);
+    int short_value = op == TOKEN_OR;
+
+    if (cg->opt_level >= 1) {
+        codegen_branch(cg, expr, lbl_short, short_value);
+        emit(cg, "    mov eax, %d", !short_value);
+        emit(cg, "    jmp .L%d", lbl_end);
+        emit(cg, ".L%d:", lbl_short);
+        emit(cg, "    mov eax, %d", short_value);
+        emit(cg, ".L%d:", lbl_end);
+        return;
+    }
+
+    codegen_expression(cg, expr->data.op.left);
+    emit(cg, "    test eax, eax");
+    emit(cg, "    %s .L%d", short_value ? "jnz" : "jz", lbl_short);
+    codegen_expression(cg, expr->data.op.right);
+    emit(cg, "    test eax, eax");
+    emit(cg, "    setne al");
+    emit(cg, "    movzx eax, al");
+    emit(cg, "    jmp .L%d", lbl_end);
+    emit(cg, ".L%d:", lbl_short);
+    emit(cg, "    mov eax, %d", short_value);
+    emit(cg, ".L%d:", lbl_end);
 }
 
-/* ====================== Address Generation (for lvalues) ====================== */
+/* ====================== Expression Code Generation ====================== */
 
-// Generate code that leaves the ADDRESS of an lvalue in EAX
-static void codegen_lvalue_address(CodeGen* cg, AST* expr);
+/* ====================== Intrinsic Lowering ====================== */
 
-static void codegen_lvalue_address(CodeGen* cg, AST* expr) {
-    if (!expr) return;
+static const char* port_data_reg(int width) {
+    if (width == 1) return "al";
+    if (width == 2) return "ax";
+    return "eax";
+}
 
-    switch (expr->type) {
-    case N_IDENT:
-    {
-        Local* entry = symtab_lookup_entry(&cg->symtab, expr->data.ident.name);
-        if (entry) {
-            if (entry->is_param) {
-                emit(cg, "    lea eax, [ebp + %d]  ; Address of param %s",
-                    entry->offset, expr->data.ident.name);
-            }
-            else {
-                emit(cg, "    lea eax, [ebp - %d]  ; Address of local %s",
-                    entry->offset, expr->data.ident.name);
-            }
+// Constant ports below 256 fit the imm8 form of in/out
+static int is_short_port(AST* port) {
+    return is_immediate(port) && immediate_value(port) >= 0 && immediate_value(port) <= 255;
+}
+
+// Port number into DX, with EAX preserved
+static void codegen_port_into_dx(CodeGen* cg, AST* port) {
+    if (is_leaf_expr(port)) {
+        codegen_leaf_into(cg, port, "edx");
+        return;
+    }
+    int temp = temp_push(cg);
+    codegen_expression(cg, port);
+    emit(cg, "    mov edx, eax  ; Port");
+    temp_pop_into(cg, temp, "eax");
+}
+
+static int codegen_intrinsic(CodeGen* cg, AST* call) {
+    const Intrinsic* in = find_intrinsic(call->data.call.name, call->data.call.arg_count);
+    if (!in) return 0;
+
+    AST** args = call->data.call.args;
+    switch (in->kind) {
+    case INTRINSIC_OUT:
+        // Value before port, as the cdecl call evaluated them
+        codegen_expression(cg, args[1]);
+        if (is_short_port(args[0])) {
+            emit(cg, "    out %d, %s", immediate_value(args[0]), port_data_reg(in->operand));
         }
         else {
-            emit(cg, "    mov eax, %s  ; Address of global %s",
-                expr->data.ident.name, expr->data.ident.name);
+            codegen_port_into_dx(cg, args[0]);
+            emit(cg, "    out dx, %s", port_data_reg(in->operand));
         }
         break;
-    }
-
-    case N_ARRAY_ACCESS:
-    {
-        AST* arr = expr->data.array_access.array;
-        AST* idx = expr->data.array_access.index;
 
-        int element_size = 1;
-        if (arr->type == N_IDENT) {
-            element_size = get_element_size_for_var(cg, arr->data.ident.name);
+    case INTRINSIC_IN:
+        if (is_short_port(args[0])) {
+            if (in->operand < 4) emit(cg, "    xor eax, eax");
+            emit(cg, "    in %s, %d", port_data_reg(in->operand), immediate_value(args[0]));
         }
-
-        // Get base address
-        if (arr->type == N_IDENT) {
-            Local* entry = symtab_lookup_entry(&cg->symtab, arr->data.ident.name);
-            if (entry && entry->is_array && !entry->is_param) {
-                emit(cg, "    lea eax, [ebp - %d]  ; Array base", entry->offset);
-            }
-            else if (entry) {
-                if (entry->is_param) {
-                    emit(cg, "    mov eax, [ebp + %d]  ; Load pointer param", entry->offset);
-                }
-                else {
-                    emit(cg, "    mov eax, [ebp - %d]  ; Load pointer local", entry->offset);
-                }
+        else {
+            if (is_leaf_expr(args[0])) {
+                codegen_leaf_into(cg, args[0], "edx");
             }
             else {
-                GlobalVar* gv = globtab_lookup(&cg->globtab, arr->data.ident.name);
-                if (gv && gv->is_array) {
-                    emit(cg, "    mov eax, %s  ; Array address", arr->data.ident.name);
-                }
-                else {
-                    emit(cg, "    mov eax, [%s]  ; Load global pointer", arr->data.ident.name);
-                }
+                codegen_expression(cg, args[0]);
+                emit(cg, "    mov edx, eax  ; Port");
             }
+            if (in->operand < 4) emit(cg, "    xor eax, eax");
+            emit(cg, "    in %s, dx", port_data_reg(in->operand));
         }
-        else {
-            codegen_expression(cg, arr);
-        }
+        break;
 
-        emit(cg, "    push eax  ; Save base");
-        codegen_expression(cg, idx);
-        emit_scale_index(cg, element_size);
-        emit(cg, "    pop ebx  ; Restore base");
-        emit(cg, "    add eax, ebx  ; Compute element address");
+    case INTRINSIC_CLI:
+        emit(cg, "    cli");
         break;
-    }
 
-    case N_UNARY:
-        if (expr->data.unary.op == TOKEN_STAR) {
-            // *ptr - address is the value of ptr
-            codegen_expression(cg, expr->data.unary.operand);
-        }
+    case INTRINSIC_STI:
+        emit(cg, "    sti");
         break;
 
-    case N_MEMBER_ACCESS:
+    case INTRINSIC_HLT:
     {
-        AST* obj = expr->data.member_access.object;
-        char* member = expr->data.member_access.member;
-        int is_arrow = expr->data.member_access.is_arrow;
-
-        const char* struct_type = NULL;
-        if (obj->type == N_IDENT) {
-            struct_type = get_var_struct_type(cg, obj->data.ident.name);
-        }
-
-        if (!struct_type) {
-            emit(cg, "    ; WARNING: Unknown struct type for member access");
-            emit(cg, "    xor eax, eax");
-            return;
-        }
-
-        int offset = codegen_get_member_offset(cg, struct_type, member);
-        if (offset < 0) {
-            emit(cg, "    ; WARNING: Member '%s' not found in struct '%s'", member, struct_type);
-            emit(cg, "    xor eax, eax");
-            return;
-        }
-
-        if (is_arrow) {
-            codegen_expression(cg, obj);  // Get pointer value
-            emit(cg, "    add eax, %d  ; Offset to member %s", offset, member);
-        }
-        else {
-            codegen_lvalue_address(cg, obj);  // Get struct address
-            emit(cg, "    add eax, %d  ; Offset to member %s", offset, member);
-        }
+        int lbl = codegen_new_label(cg);
+        emit(cg, ".L%d:", lbl);
+        emit(cg, "    hlt");
+        emit(cg, "    jmp .L%d", lbl);
         break;
     }
 
-    default:
-        emit(cg, "    ; ERROR: Cannot take address of expression type %d", expr->type);
+    case INTRINSIC_READ_CR:
+        emit(cg, "    mov eax, cr%d", in->operand);
+        break;
+
+    case INTRINSIC_WRITE_CR:
+        codegen_expression(cg, args[0]);
+        emit(cg, "    mov cr%d, eax", in->operand);
         break;
     }
+    return 1;
 }
 
-/* ====================== Expression Code Generation ====================== */
-
 void codegen_expression(CodeGen* cg, AST* expr) {
     if (!expr) {
         emit(cg, "    xor eax, eax     ; NULL expression");
@@ -1064,36 +2743,8 @@ void codegen_expression(CodeGen* cg, AST* expr) {
         break;
 
     case N_IDENT:
-    {
-        Local* entry = symtab_lookup_entry(&cg->symtab, expr->data.ident.name);
-        if (entry) {
-            if (entry->is_array && !entry->is_param) {
-                // Local array - return address
-                emit(cg, "    lea eax, [ebp - %d]  ; Address of array %s",
-                    entry->offset, expr->data.ident.name);
-            }
-            else if (entry->is_param) {
-                emit(cg, "    mov eax, [ebp + %d]  ; Param %s",
-                    entry->offset, expr->data.ident.name);
-            }
-            else {
-                emit(cg, "    mov eax, [ebp - %d]  ; Local %s",
-                    entry->offset, expr->data.ident.name);
-            }
-        }
-        else {
-            GlobalVar* gv = globtab_lookup(&cg->globtab, expr->data.ident.name);
-            if (gv && gv->is_array) {
-                emit(cg, "    mov eax, %s  ; Address of global array",
-                    expr->data.ident.name);
-            }
-            else {
-                emit(cg, "    mov eax, [%s]  ; Global %s",
-                    expr->data.ident.name, expr->data.ident.name);
-            }
-        }
+        codegen_load_ident(cg, expr->data.ident.name, "eax");
         break;
-    }
 
     case N_MEMBER_ACCESS:
     {
@@ -1101,7 +2752,7 @@ void codegen_expression(CodeGen* cg, AST* expr) {
         char* member = expr->data.member_access.member;
         int is_arrow = expr->data.member_access.is_arrow;
 
-        const char* struct_type = NULL;
+        Type* struct_type = NULL;
         if (obj->type == N_IDENT) {
             struct_type = get_var_struct_type(cg, obj->data.ident.name);
         }
@@ -1112,14 +2763,14 @@ void codegen_expression(CodeGen* cg, AST* expr) {
             break;
         }
 
-        int offset = codegen_get_member_offset(cg, struct_type, member);
-        int mem_size = codegen_get_member_size(cg, struct_type, member);
-
-        if (offset < 0) {
+        const TypeMember* field = type_find_member(struct_type, member);
+        if (!field) {
             emit(cg, "    ; WARNING: Member '%s' not found", member);
             emit(cg, "    xor eax, eax");
             break;
         }
+        int offset = field->offset;
+        int mem_size = field->size;
 
         if (is_arrow) {
             // ptr->member
@@ -1178,6 +2829,16 @@ void codegen_expression(CodeGen* cg, AST* expr) {
         AST* left = expr->data.op.left;
         AST* right = expr->data.op.right;
 
+        if (op == TOKEN_AND || op == TOKEN_OR) {
+            codegen_logical_value(cg, expr);
+            break;
+        }
+
+        if (cg->opt_level >= 1) {
+            codegen_operator_regs(cg, expr);
+            break;
+        }
+
         // Handle assignment to member access
         if (op == TOKEN_ASSIGN && left->type == N_MEMBER_ACCESS) {
             codegen_expression(cg, right);
@@ -1261,98 +2922,16 @@ void codegen_expression(CodeGen* cg, AST* expr) {
         emit(cg, "    mov ebx, eax     ; Right in ebx");
         emit(cg, "    pop eax          ; Left in eax");
 
-        switch (op) {
-        case TOKEN_PLUS:
-            emit(cg, "    add eax, ebx");
-            break;
-        case TOKEN_MINUS:
-            emit(cg, "    sub eax, ebx");
-            break;
-        case TOKEN_STAR:
-            emit(cg, "    imul eax, ebx");
-            break;
-        case TOKEN_SLASH:
-            emit(cg, "    cdq");
-            emit(cg, "    idiv ebx");
-            break;
-        case TOKEN_PERCENT:
-            emit(cg, "    cdq");
-            emit(cg, "    idiv ebx");
-            emit(cg, "    mov eax, edx  ; Remainder");
-            break;
-        case TOKEN_LSHIFT:
-            emit(cg, "    mov ecx, ebx");
-            emit(cg, "    shl eax, cl");
-            break;
-        case TOKEN_RSHIFT:
-            emit(cg, "    mov ecx, ebx");
-            emit(cg, "    sar eax, cl");
-            break;
-        case TOKEN_AMPERSAND:
-            emit(cg, "    and eax, ebx");
-            break;
-        case TOKEN_PIPE:
-            emit(cg, "    or eax, ebx");
-            break;
-        case TOKEN_CARET:
-            emit(cg, "    xor eax, ebx");
-            break;
-        case TOKEN_EQUAL:
-            emit(cg, "    cmp eax, ebx");
-            emit(cg, "    sete al");
-            emit(cg, "    movzx eax, al");
-            break;
-        case TOKEN_NOT_EQUAL:
-            emit(cg, "    cmp eax, ebx");
-            emit(cg, "    setne al");
-            emit(cg, "    movzx eax, al");
-            break;
-        case TOKEN_LESS:
-            emit(cg, "    cmp eax, ebx");
-            emit(cg, "    setl al");
-            emit(cg, "    movzx eax, al");
-            break;
-        case TOKEN_GREATER:
-            emit(cg, "    cmp eax, ebx");
-            emit(cg, "    setg al");
-            emit(cg, "    movzx eax, al");
-            break;
-        case TOKEN_LESS_EQUAL:
-            emit(cg, "    cmp eax, ebx");
-            emit(cg, "    setle al");
-            emit(cg, "    movzx eax, al");
-            break;
-        case TOKEN_GREATER_EQUAL:
-            emit(cg, "    cmp eax, ebx");
-            emit(cg, "    setge al");
-            emit(cg, "    movzx eax, al");
-            break;
-        case TOKEN_AND:
-            emit(cg, "    test eax, eax");
-            emit(cg, "    setne al");
-            emit(cg, "    test ebx, ebx");
-            emit(cg, "    setne bl");
-            emit(cg, "    and al, bl");
-            emit(cg, "    movzx eax, al");
-            break;
-        case TOKEN_OR:
-            emit(cg, "    or eax, ebx");
-            emit(cg, "    setne al");
-            emit(cg, "    movzx eax, al");
-            break;
-        case TOKEN_ASSIGN:
-            emit(cg, "    mov [eax], ebx");
-            emit(cg, "    mov eax, ebx");
-            break;
-        default:
-            emit(cg, "    ; Unknown operator %d", op);
-            break;
-        }
+        emit_binary_op(cg, op, "ebx");
         break;
     }
 
     case N_CALL:
     {
+        if (cg->opt_level >= 1 && codegen_intrinsic(cg, expr)) {
+            break;
+        }
+
         emit(cg, "    ; Call %s", expr->data.call.name);
 
         // Push arguments right to left (cdecl)
@@ -1372,26 +2951,9 @@ void codegen_expression(CodeGen* cg, AST* expr) {
     }
 
     case N_ASSIGN:
-    {
-        Local* entry = symtab_lookup_entry(&cg->symtab, expr->data.assign.var_name);
         codegen_expression(cg, expr->data.assign.value);
-
-        if (entry) {
-            if (entry->is_param) {
-                emit(cg, "    mov [ebp + %d], eax  ; Param %s",
-                    entry->offset, expr->data.assign.var_name);
-            }
-            else {
-                emit(cg, "    mov [ebp - %d], eax  ; Local %s",
-                    entry->offset, expr->data.assign.var_name);
-            }
-        }
-        else {
-            emit(cg, "    mov [%s], eax  ; Global %s",
-                expr->data.assign.var_name, expr->data.assign.var_name);
-        }
+        codegen_store_ident(cg, expr->data.assign.var_name);
         break;
-    }
 
     case N_ARRAY_ACCESS:
     {
@@ -1402,6 +2964,18 @@ void codegen_expression(CodeGen* cg, AST* expr) {
             element_size = get_element_size_for_var(cg, arr->data.ident.name);
         }
 
+        if (cg->opt_level >= 1 && arr->type == N_IDENT) {
+            char operand[96];
+            codegen_element_operand(cg, expr, operand, sizeof(operand));
+            if (element_size == 1 || element_size == 2) {
+                emit(cg, "    movzx eax, %s %s", size_keyword(element_size), operand);
+            }
+            else {
+                emit(cg, "    mov eax, dword %s", operand);
+            }
+            break;
+        }
+
         codegen_lvalue_address(cg, expr);
         emit_load_sized(cg, element_size);
         break;
@@ -1427,6 +3001,24 @@ void codegen_expression(CodeGen* cg, AST* expr) {
         }
 
         // Prefix increment/decrement
+        if ((op == TOKEN_PLUS_PLUS || op == TOKEN_MINUS_MINUS) && cg->opt_level >= 1) {
+            const char* insn = op == TOKEN_PLUS_PLUS ? "inc" : "dec";
+            int reg = operand->type == N_IDENT ?
+                local_reg(cg, operand->data.ident.name) : REG_NONE;
+            if (reg != REG_NONE) {
+                emit(cg, "    %s %s", insn, pool_reg_names[reg]);
+                emit(cg, "    mov eax, %s", pool_reg_names[reg]);
+            }
+            else {
+                codegen_lvalue_address(cg, operand);
+                emit(cg, "    mov ecx, eax  ; Save address");
+                emit(cg, "    mov eax, [ecx]  ; Load value");
+                emit(cg, "    %s eax", insn);
+                emit(cg, "    mov [ecx], eax  ; Store back");
+            }
+            break;
+        }
+
         if (op == TOKEN_PLUS_PLUS || op == TOKEN_MINUS_MINUS) {
             codegen_lvalue_address(cg, operand);
             emit(cg, "    mov ebx, eax  ; Save address");
@@ -1471,9 +3063,14 @@ void codegen_expression(CodeGen* cg, AST* expr) {
         int lbl_false = codegen_new_label(cg);
         int lbl_end = codegen_new_label(cg);
 
-        codegen_expression(cg, expr->data.ternary.condition);
-        emit(cg, "    test eax, eax");
-        emit(cg, "    jz .L%d", lbl_false);
+        if (cg->opt_level >= 1) {
+            codegen_branch(cg, expr->data.ternary.condition, lbl_false, 0);
+        }
+        else {
+            codegen_expression(cg, expr->data.ternary.condition);
+            emit(cg, "    test eax, eax");
+            emit(cg, "    jz .L%d", lbl_false);
+        }
 
         codegen_expression(cg, expr->data.ternary.true_expr);
         emit(cg, "    jmp .L%d", lbl_end);
@@ -1487,28 +3084,26 @@ void codegen_expression(CodeGen* cg, AST* expr) {
 
     case N_SIZEOF:
     {
-        // Simplified sizeof - returns 4 for most things
-        // In a full implementation, we'd compute actual type sizes
-        AST* target = expr->data.sizeof_expr.expr;
-        int size = 4;
-
-        if (target->type == N_IDENT) {
-            // Check if it's a type name
-            const char* name = target->data.ident.name;
-            if (strcmp(name, "char") == 0) size = 1;
-            else if (strcmp(name, "short") == 0) size = 2;
-            else if (strcmp(name, "int") == 0) size = 4;
-            else if (strcmp(name, "long") == 0) size = 4;
-            else if (strncmp(name, "struct ", 7) == 0) {
-                StructInfo* info = codegen_find_struct(cg, name + 7);
-                if (info) size = info->total_size;
-            }
-        }
+        // Type names have exact sizes; expressions are taken as 4 bytes
+        Type* type = expr->data.sizeof_expr.type;
+        int size = type ? type->size : 4;
 
         emit(cg, "    mov eax, %d  ; sizeof", size);
         break;
     }
 
+    case N_INLINE:
+    {
+        // Returns inside the body leave their value in EAX and jump here
+        int saved_exit = cg->inline_exit;
+        cg->inline_exit = codegen_new_label(cg);
+        emit(cg, "    ; Inlined %s", expr->data.inline_call.callee);
+        codegen_statement(cg, expr->data.inline_call.body);
+        emit(cg, ".L%d:", cg->inline_exit);
+        cg->inline_exit = saved_exit;
+        break;
+    }
+
     default:
         emit(cg, "    ; TODO: Expression type %d", expr->type);
         emit(cg, "    xor eax, eax");
@@ -1518,26 +3113,40 @@ void codegen_expression(CodeGen* cg, AST* expr) {
 
 /* ====================== Statement Code Generation ====================== */
 
+// Branch and loop bodies get their own scope even without braces
+static void codegen_scoped_statement(CodeGen* cg, AST* stmt) {
+    symtab_push_scope(&cg->symtab);
+    codegen_statement(cg, stmt);
+    symtab_pop_scope(&cg->symtab);
+}
+
 void codegen_statement(CodeGen* cg, AST* stmt) {
     if (!stmt) return;
 
     switch (stmt->type) {
     case N_DECL:
     {
-        int is_array = (stmt->data.decl.array_size != NULL);
-        int array_count = 0;
-
-        if (is_array && stmt->data.decl.array_size->type == N_INTLIT) {
-            array_count = stmt->data.decl.array_size->data.int_lit.value;
+        int reg = regalloc_lookup(cg, stmt->data.decl.name);
+        Type* type = decl_type(cg, stmt);
+        if (type->kind == TYPE_STRUCT && !type->is_complete) {
+            diag_report(cg->diag, DIAG_WARNING, DIAG_CODEGEN, NULL, 0, 0,
+                "Warning: Unknown struct '%s', using size 4", type->name);
+        }
+        int offset = symtab_add_typed(&cg->symtab, stmt->data.decl.name, type, reg);
+
+        if (reg != REG_NONE) {
+            const char* reg_name = pool_reg_names[reg];
+            emit(cg, "    ; Declare %s in %s", stmt->data.decl.name, reg_name);
+            if (is_leaf_expr(stmt->data.decl.init_value)) {
+                codegen_leaf_into(cg, stmt->data.decl.init_value, reg_name);
+            }
+            else if (stmt->data.decl.init_value) {
+                codegen_expression(cg, stmt->data.decl.init_value);
+                emit(cg, "    mov %s, eax", reg_name);
+            }
+            break;
         }
 
-        int offset = symtab_add_typed(&cg->symtab,
-            stmt->data.decl.name,
-            stmt->data.decl.type,
-            stmt->data.decl.pointer_level,
-            is_array,
-            array_count);
-
         emit(cg, "    ; Declare %s at [ebp - %d]", stmt->data.decl.name, offset);
 
         if (stmt->data.decl.init_value) {
@@ -1555,13 +3164,20 @@ void codegen_statement(CodeGen* cg, AST* stmt) {
         else {
             emit(cg, "    xor eax, eax");
         }
-        emit(cg, "    jmp .epilogue");
+        if (cg->inline_exit >= 0) {
+            emit(cg, "    jmp .L%d", cg->inline_exit);
+        }
+        else {
+            emit(cg, "    jmp .epilogue");
+        }
         break;
 
     case N_BLOCK:
+        symtab_push_scope(&cg->symtab);
         for (size_t i = 0; i < stmt->data.block.count; i++) {
             codegen_statement(cg, stmt->data.block.statements[i]);
         }
+        symtab_pop_scope(&cg->symtab);
         break;
 
     case N_IF:
@@ -1570,20 +3186,25 @@ void codegen_statement(CodeGen* cg, AST* stmt) {
         int lbl_end = codegen_new_label(cg);
 
         emit(cg, "    ; If");
-        codegen_expression(cg, stmt->data.if_stmt.condition);
-        emit(cg, "    test eax, eax");
+        int lbl_false = stmt->data.if_stmt.else_block ? lbl_else : lbl_end;
+        if (cg->opt_level >= 1) {
+            codegen_branch(cg, stmt->data.if_stmt.condition, lbl_false, 0);
+        }
+        else {
+            codegen_expression(cg, stmt->data.if_stmt.condition);
+            emit(cg, "    test eax, eax");
+            emit(cg, "    jz .L%d", lbl_false);
+        }
 
         if (stmt->data.if_stmt.else_block) {
-            emit(cg, "    jz .L%d", lbl_else);
-            codegen_statement(cg, stmt->data.if_stmt.then_block);
+            codegen_scoped_statement(cg, stmt->data.if_stmt.then_block);
             emit(cg, "    jmp .L%d", lbl_end);
             emit(cg, ".L%d:", lbl_else);
-            codegen_statement(cg, stmt->data.if_stmt.else_block);
+            codegen_scoped_statement(cg, stmt->data.if_stmt.else_block);
             emit(cg, ".L%d:", lbl_end);
         }
         else {
-            emit(cg, "    jz .L%d", lbl_end);
-            codegen_statement(cg, stmt->data.if_stmt.then_block);
+            codegen_scoped_statement(cg, stmt->data.if_stmt.then_block);
             emit(cg, ".L%d:", lbl_end);
         }
         break;
@@ -1594,19 +3215,32 @@ void codegen_statement(CodeGen* cg, AST* stmt) {
         int lbl_start = codegen_new_label(cg);
         int lbl_end = codegen_new_label(cg);
 
-        push_loop(lbl_end, lbl_start);
+        loop_push(&cg->loops, cg->diag, lbl_end, lbl_start);
+
+        if (cg->opt_level >= 1) {
+            // Test at the bottom so each iteration takes a single branch
+            int lbl_body = codegen_new_label(cg);
+            emit(cg, "    jmp .L%d", lbl_start);
+            emit(cg, ".L%d:  ; While body", lbl_body);
+            codegen_scoped_statement(cg, stmt->data.while_stmt.body);
+            emit(cg, ".L%d:  ; While condition", lbl_start);
+            codegen_branch(cg, stmt->data.while_stmt.condition, lbl_body, 1);
+            emit(cg, ".L%d:  ; While end", lbl_end);
+            loop_pop(&cg->loops);
+            break;
+        }
 
         emit(cg, ".L%d:  ; While start", lbl_start);
         codegen_expression(cg, stmt->data.while_stmt.condition);
         emit(cg, "    test eax, eax");
         emit(cg, "    jz .L%d", lbl_end);
 
-        codegen_statement(cg, stmt->data.while_stmt.body);
+        codegen_scoped_statement(cg, stmt->data.while_stmt.body);
 
         emit(cg, "    jmp .L%d", lbl_start);
         emit(cg, ".L%d:  ; While end", lbl_end);
 
-        pop_loop();
+        loop_pop(&cg->loops);
         break;
     }
 
@@ -1616,13 +3250,39 @@ void codegen_statement(CodeGen* cg, AST* stmt) {
         int lbl_cont = codegen_new_label(cg);
         int lbl_end = codegen_new_label(cg);
 
-        push_loop(lbl_end, lbl_cont);
+        loop_push(&cg->loops, cg->diag, lbl_end, lbl_cont);
+
+        // A declaration in the init clause is scoped to the loop
+        symtab_push_scope(&cg->symtab);
 
         emit(cg, "    ; For loop");
         if (stmt->data.for_stmt.init) {
             codegen_statement(cg, stmt->data.for_stmt.init);
         }
 
+        if (cg->opt_level >= 1) {
+            int lbl_body = codegen_new_label(cg);
+            emit(cg, "    jmp .L%d", lbl_start);
+            emit(cg, ".L%d:  ; For body", lbl_body);
+            codegen_scoped_statement(cg, stmt->data.for_stmt.body);
+            emit(cg, ".L%d:  ; For increment", lbl_cont);
+            if (stmt->data.for_stmt.increment) {
+                codegen_expression(cg, stmt->data.for_stmt.increment);
+            }
+            emit(cg, ".L%d:  ; For condition", lbl_start);
+            if (stmt->data.for_stmt.condition) {
+                codegen_branch(cg, stmt->data.for_stmt.condition, lbl_body, 1);
+            }
+            else {
+                emit(cg, "    jmp .L%d", lbl_body);
+            }
+            emit(cg, ".L%d:  ; For end", lbl_end);
+
+            symtab_pop_scope(&cg->symtab);
+            loop_pop(&cg->loops);
+            break;
+        }
+
         emit(cg, ".L%d:  ; For condition", lbl_start);
         if (stmt->data.for_stmt.condition) {
             codegen_expression(cg, stmt->data.for_stmt.condition);
@@ -1630,7 +3290,7 @@ void codegen_statement(CodeGen* cg, AST* stmt) {
             emit(cg, "    jz .L%d", lbl_end);
         }
 
-        codegen_statement(cg, stmt->data.for_stmt.body);
+        codegen_scoped_statement(cg, stmt->data.for_stmt.body);
 
         emit(cg, ".L%d:  ; For increment", lbl_cont);
         if (stmt->data.for_stmt.increment) {
@@ -1640,13 +3300,14 @@ void codegen_statement(CodeGen* cg, AST* stmt) {
         emit(cg, "    jmp .L%d", lbl_start);
         emit(cg, ".L%d:  ; For end", lbl_end);
 
-        pop_loop();
+        symtab_pop_scope(&cg->symtab);
+        loop_pop(&cg->loops);
         break;
     }
 
     case N_BREAK:
     {
-        int lbl = get_break_label();
+        int lbl = loop_break_label(&cg->loops);
         if (lbl >= 0) {
             emit(cg, "    jmp .L%d  ; Break", lbl);
         }
@@ -1658,7 +3319,7 @@ void codegen_statement(CodeGen* cg, AST* stmt) {
 
     case N_CONTINUE:
     {
-        int lbl = get_continue_label();
+        int lbl = loop_continue_label(&cg->loops);
         if (lbl >= 0) {
             emit(cg, "    jmp .L%d  ; Continue", lbl);
         }
@@ -1671,18 +3332,22 @@ void codegen_statement(CodeGen* cg, AST* stmt) {
     case N_ASM:
     {
         emit(cg, "    ; Inline assembly");
+        cg->pin_output = 1;
         if (stmt->data.asm_stmt.assembly_code) {
             char* asm_copy = _strdup(stmt->data.asm_stmt.assembly_code);
-            char* line = strtok(asm_copy, "\n");
+            char* line = asm_copy;
             while (line) {
+                char* next = strchr(line, '\n');
+                if (next) *next++ = '\0';
                 while (*line == ' ' || *line == '\t') line++;
                 if (*line) {
                     emit(cg, "    %s", line);
                 }
-                line = strtok(NULL, "\n");
+                line = next;
             }
             free(asm_copy);
         }
+        cg->pin_output = 0;
         break;
     }
 
@@ -1700,7 +3365,7 @@ void codegen_statement(CodeGen* cg, AST* stmt) {
 
 /* ====================== Function Code Generation ====================== */
 
-static int is_runtime_function(const char* name) {
+int codegen_is_runtime_function(const char* name) {
     // VGA functions (runtime provides these)
     if (strcmp(name, "print_char") == 0) return 1;
     if (strcmp(name, "print_string") == 0) return 1;
@@ -1748,17 +3413,18 @@ void codegen_function_correct(CodeGen* cg, AST* func) {
     if (!func->data.function.body) return;  // Forward declaration
 
     // ADD THESE 4 LINES:
-    if (is_runtime_function(func->data.function.name)) {
+    if (codegen_is_runtime_function(func->data.function.name)) {
         return;  // Skip runtime functions
     }
 
-    // Set global for struct lookup in symtab_add_typed
-    g_current_cg = cg;
-
     // Reset symbol table for this function
     symtab_free(&cg->symtab);
-    symtab_init(&cg->symtab);
-    loop_depth = 0;
+    symtab_init(&cg->symtab, cg->names);
+    cg->loops.depth = 0;
+    cg->inline_exit = -1;
+
+    regalloc_function(cg, func);
+    RegAlloc* ra = &cg->ra;
 
     emit(cg, "");
     emit(cg, "; ========== Function: %s ==========", func->data.function.name);
@@ -1766,29 +3432,62 @@ void codegen_function_correct(CodeGen* cg, AST* func) {
     emit(cg, "    push ebp");
     emit(cg, "    mov ebp, esp");
 
+    // Callee-saved registers sit just below the frame pointer
+    for (int i = 0; i < ra->saved_count; i++) {
+        emit(cg, "    push %s", pool_reg_names[ra->saved_regs[i]]);
+    }
+    cg->symtab.stack_offset = ra->saved_count * 4;
+
     // Register parameters (cdecl: pushed right to left, so first param at ebp+8)
     for (size_t i = 0; i < func->data.function.param_count; i++) {
         AST* param = func->data.function.params[i];
         if (param->type == N_DECL) {
             int stack_pos = 8 + ((int)i * 4);
+            int reg = regalloc_lookup(cg, param->data.decl.name);
             symtab_add_param_typed(&cg->symtab,
                 param->data.decl.name,
                 stack_pos,
-                param->data.decl.type,
-                param->data.decl.pointer_level);
-            emit(cg, "    ; Param %zu: %s at [ebp + %d]", i, param->data.decl.name, stack_pos);
+                param_type(cg, param),
+                reg);
+            if (reg != REG_NONE) {
+                emit(cg, "    ; Param %zu: %s in %s", i, param->data.decl.name, pool_reg_names[reg]);
+                emit(cg, "    mov %s, [ebp + %d]", pool_reg_names[reg], stack_pos);
+            }
+            else {
+                emit(cg, "    ; Param %zu: %s at [ebp + %d]", i, param->data.decl.name, stack_pos);
+            }
         }
     }
 
-    // Reserve stack space (we'll use a fixed amount for simplicity)
-    emit(cg, "    sub esp, 512     ; Reserve stack");
+    // Reserve exactly what the deepest point of the body needs
+    int saved_bytes = ra->saved_count * 4;
+    int frame_size = frame_extent(cg, func->data.function.body, saved_bytes) - saved_bytes;
+    if (frame_size > 0) {
+        emit(cg, "    sub esp, %d     ; Reserve stack", frame_size);
+    }
+    codegen_record_frame(cg, func->data.function.name, frame_size, ra->saved_count);
 
     // Generate body
     codegen_statement(cg, func->data.function.body);
 
+    if (cg->symtab.max_offset > saved_bytes + frame_size) {
+        char message[256];
+        snprintf(message, sizeof(message), "Internal error: frame of '%.128s' underestimated (%d > %d)",
+            func->data.function.name, cg->symtab.max_offset - saved_bytes, frame_size);
+        codegen_error(cg, 0, message);
+    }
+
     // Epilogue (jumped to by return statements)
     emit(cg, ".epilogue:");
-    emit(cg, "    mov esp, ebp");
+    if (ra->saved_count > 0) {
+        emit(cg, "    lea esp, [ebp - %d]", ra->saved_count * 4);
+        for (int i = ra->saved_count - 1; i >= 0; i--) {
+            emit(cg, "    pop %s", pool_reg_names[ra->saved_regs[i]]);
+        }
+    }
+    else {
+        emit(cg, "    mov esp, ebp");
+    }
     emit(cg, "    pop ebp");
     emit(cg, "    ret");
 }
@@ -1802,26 +3501,16 @@ void codegen_program(CodeGen* cg, AST* program) {
     for (size_t i = 0; i < program->data.program.global_count; i++) {
         AST* global = program->data.program.globals[i];
 
-        if (global->type == N_STRUCT_DECL) {
-            codegen_register_struct(cg, global);
-        }
-        else if (global->type == N_DECL) {
-            int is_array = (global->data.decl.array_size != NULL);
-            int array_size = 0;
-            if (is_array && global->data.decl.array_size->type == N_INTLIT) {
-                array_size = global->data.decl.array_size->data.int_lit.value;
-            }
-            globtab_add(&cg->globtab,
-                global->data.decl.name,
-                global->data.decl.type,
-                global->data.decl.pointer_level,
-                is_array,
-                array_size);
+        // Struct layouts were settled by the parser
+        if (global->type == N_DECL) {
+            globtab_add(&cg->globtab, global->data.decl.name, decl_type(cg, global));
         }
     }
 
     // Emit prologue
+    cg->pin_output = 1;
     codegen_baremetal_prologue(cg);
+    cg->pin_output = 0;
 
     // Emit functions
     for (size_t i = 0; i < program->data.program.func_count; i++) {
@@ -1831,6 +3520,9 @@ void codegen_program(CodeGen* cg, AST* program) {
         }
     }
 
+    // Hand-written runtime and data are emitted verbatim
+    cg->pin_output = 1;
+
     // Emit runtime support
     codegen_emit_runtime(cg);
     codegen_emit_port_io_runtime(cg);
@@ -1845,36 +3537,44 @@ void codegen_program(CodeGen* cg, AST* program) {
     // String literals
     codegen_emit_strings(cg);
 
-    // Global variables
+    // Initialized global variables
     for (size_t i = 0; i < program->data.program.global_count; i++) {
         AST* global = program->data.program.globals[i];
-        if (global->type == N_DECL) {
-            if (global->data.decl.array_size &&
-                global->data.decl.array_size->type == N_INTLIT) {
-                int arr_size = global->data.decl.array_size->data.int_lit.value;
-                int elem_size = get_base_type_size(global->data.decl.type);
-                int total = arr_size * elem_size;
-                emit(cg, "%s: times %d db 0  ; array[%d]",
-                    global->data.decl.name, total, arr_size);
-            }
-            else {
-                int init_val = 0;
-                if (global->data.decl.init_value) {
-                    if (global->data.decl.init_value->type == N_INTLIT) {
-                        init_val = global->data.decl.init_value->data.int_lit.value;
-                    }
-                    else if (global->data.decl.init_value->type == N_CAST &&
-                        global->data.decl.init_value->data.cast.expr->type == N_INTLIT) {
-                        init_val = global->data.decl.init_value->data.cast.expr->data.int_lit.value;
-                    }
-                }
-                emit(cg, "%s dd %d", global->data.decl.name, init_val);
-            }
+        if (global->type == N_DECL && !global_in_bss(global)) {
+            emit(cg, "%s dd %d", global->data.decl.name, global_init_value(global));
         }
     }
 
+    // Zero-initialized globals take no space in the image; _start clears them
+    emit(cg, "");
+    emit(cg, "section .bss");
+    emit(cg, "alignb 4");
+    emit(cg, "__bss_start:");
+    for (size_t i = 0; i < program->data.program.global_count; i++) {
+        AST* global = program->data.program.globals[i];
+        if (global->type != N_DECL || !global_in_bss(global)) continue;
+
+        // Sized by the object's type, so structs and char arrays get exactly
+        // their bytes; the next object still starts dword aligned
+        Type* type = decl_type(cg, global);
+        emit(cg, "%s: resb %d  ; %s", global->data.decl.name, type->size, type->name);
+        if (type->size % 4 != 0) emit(cg, "alignb 4");
+    }
+
     // Runtime variables
-    emit(cg, "vga_cursor dd 0");
+    emit(cg, "vga_cursor: resd 1");
+    emit(cg, "alignb 4");
+    emit(cg, "__bss_end:");
     emit(cg, "");
     emit(cg, "; End of generated code");
+    cg->pin_output = 0;
+
+    // Drop runtime routines and functions nothing reachable calls
+    if (cg->opt_level >= 1) {
+        unsigned int* sizes = cg->size_report ? codegen_measure_lines(cg) : NULL;
+        cg->line_count = tree_shake(cg->lines, cg->line_count, "kernel_main", sizes, &cg->shake);
+        free(sizes);
+    }
+
+    codegen_flush(cg);
 }
\ No newline at end of file
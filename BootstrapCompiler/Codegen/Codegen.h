@@ -9,29 +9,69 @@ typedef enum {
     TARGET_X86_64_BAREMETAL
 } TargetPlatform;
 
-// Struct member information
-typedef struct {
-    char* name;
-    int offset;
-    int size;
-} StructMember;
+typedef struct CodeGen CodeGen;
+
+// Receives the finished assembly as one block of text in place of a file
+typedef void (*CodegenSink)(void* context, const char* text, size_t length);
 
-// Struct type information
 typedef struct {
-    char* name;
-    StructMember* members;
-    int member_count;
-    int total_size;
-} StructInfo;
+    size_t lines_emitted;     // Before the peephole pass and tree shaking
+    size_t lines_written;     // Assembly lines written or assembled
+    size_t bytes_written;
+    size_t instructions_encoded;  // Binary output only
+} CodegenOutputStats;
 
-typedef struct CodeGen CodeGen;
+// NASM text is the default and stays the reference; binary output encodes
+// the same lines with the built-in assembler into a flat image, as
+// `nasm -f bin` would
+typedef enum {
+    CODEGEN_OUTPUT_ASSEMBLY,
+    CODEGEN_OUTPUT_BINARY
+} CodegenOutputFormat;
 
 // Core CodeGen functions
-CodeGen* codegen_create(const char* output_file, TargetPlatform target);
+// names and types are the ones the parser used; they must outlive the CodeGen
+CodeGen* codegen_create(const char* output_file, TargetPlatform target, Interner* names, TypeTable* types);
+CodeGen* codegen_create_with_sink(CodegenSink sink, void* context, TargetPlatform target,
+    Interner* names, TypeTable* types);
 void codegen_free(CodeGen* cg);
 int codegen_new_label(CodeGen* cg);
+
+// Buffers one line of assembly. %d, %s, %c and %zu are formatted without
+// stdio; anything else goes through vsnprintf. A line with no conversions is
+// kept as fmt itself rather than copied, so fmt must be a string literal or
+// otherwise outlive the CodeGen.
 void emit(CodeGen* cg, const char* fmt, ...);
 
+// Output is written when codegen_program finishes
+const CodegenOutputStats* codegen_output_stats(CodeGen* cg);
+
+// Set before codegen_program. Assembler errors in binary mode are fatal.
+void codegen_set_output_format(CodeGen* cg, CodegenOutputFormat format);
+
+// Also hands the final assembly text to listing, whatever the output format
+void codegen_set_listing(CodeGen* cg, CodegenSink listing, void* context);
+
+// Where warnings and the error that stops code generation go. Without one,
+// warnings are printed to stderr and errors exit.
+void codegen_set_diagnostics(CodeGen* cg, Diagnostics* diag);
+
+// Optimization level: 0 = stack-machine codegen, 1 = register allocation
+void codegen_set_opt_level(CodeGen* cg, int level);
+
+// Per-function stack frame sizes of everything generated so far
+void codegen_print_frame_report(CodeGen* cg, FILE* out);
+
+// Instructions removed by the peephole pass, per pattern (-O1 only)
+void codegen_print_peephole_report(CodeGen* cg, FILE* out);
+
+// Set before codegen_program to have the tree shaking report give sizes in
+// bytes. Costs one extra assembler layout of the whole program.
+void codegen_set_size_report(CodeGen* cg, int enabled);
+
+// Text-section symbols not reachable from kernel_main, removed at -O1
+void codegen_print_tree_shake_report(CodeGen* cg, FILE* out);
+
 // Code generation entry points
 void codegen_program(CodeGen* cg, AST* program);
 void codegen_function(CodeGen* cg, AST* func);
@@ -39,11 +79,11 @@ void codegen_function_correct(CodeGen* cg, AST* func);
 void codegen_statement(CodeGen* cg, AST* stmt);
 void codegen_expression(CodeGen* cg, AST* expr);
 
-// Struct management functions
-void codegen_init_struct_table(CodeGen* cg);
-void codegen_register_struct(CodeGen* cg, AST* struct_decl);
-void codegen_free_struct_table(CodeGen* cg);
-StructInfo* codegen_find_struct(CodeGen* cg, const char* name);
+// Functions the emitted runtime provides; user definitions of them are skipped
+int codegen_is_runtime_function(const char* name);
+
+// Struct lookups; layouts are computed by the parser's type table
+Type* codegen_find_struct(CodeGen* cg, const char* name);
 int codegen_get_member_offset(CodeGen* cg, const char* struct_name, const char* member_name);
 
 // String literal management
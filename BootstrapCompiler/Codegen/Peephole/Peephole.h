@@ -0,0 +1,38 @@
+#pragma once
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "../../Includes.h"
+#include "../../Memory/Arena/Arena.h"
+
+// One line of emitted NASM text, without its newline. The text belongs to
+// the code generator's arena or is a string literal, so it is never freed
+// on its own. Pinned lines (runtime routines, inline asm, data) are never
+// rewritten and act as barriers for every pattern.
+typedef struct {
+    const char* text;
+    int pinned;
+} AsmLine;
+
+typedef enum {
+    PEEP_PUSH_POP,        // push r1 / pop r2       -> mov r2, r1
+    PEEP_MOV_BACK,        // mov a, b / mov b, a    -> mov a, b
+    PEEP_SELF_MOV,        // mov r, r               -> (nothing)
+    PEEP_SETCC_BRANCH,    // setcc al / movzx eax, al / test eax, eax / jz L -> jncc L
+    PEEP_JMP_NEXT,        // jmp L / L:             -> L:
+    PEEP_PATTERN_COUNT
+} PeepholePattern;
+
+typedef struct {
+    int hits[PEEP_PATTERN_COUNT];
+    int removed[PEEP_PATTERN_COUNT];   // Instructions removed by each pattern
+} PeepholeStats;
+
+// Rewrites lines in place until no pattern applies, allocating replacement
+// text from text. Removed lines are dropped and the array compacted;
+// returns the new line count.
+int peephole_optimize(AsmLine* lines, int count, Arena* text, PeepholeStats* stats);
+
+void peephole_print_report(const PeepholeStats* stats, FILE* out);
+
+#endif // !PEEPHOLE_H
@@ -0,0 +1,321 @@
+#include "../Peephole.h"
+
+#define MAX_MNEMONIC 16
+#define MAX_OPERAND 64
+#define MAX_PASSES 8
+
+/* ====================== Instruction Parsing ====================== */
+
+typedef enum {
+    LINE_TRANSPARENT,     // Blank or comment only
+    LINE_INSTRUCTION,
+    LINE_BARRIER          // Label, directive, pinned or unparseable line
+} LineKind;
+
+typedef struct {
+    char mnemonic[MAX_MNEMONIC];
+    char operands[2][MAX_OPERAND];
+    int operand_count;
+    char label[MAX_OPERAND];   // Set for label lines
+} Insn;
+
+static const char* skip_space(const char* s) {
+    while (*s == ' ' || *s == '\t') s++;
+    return s;
+}
+
+static void copy_trimmed(char* dest, const char* start, const char* end) {
+    while (start < end && (*start == ' ' || *start == '\t')) start++;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    size_t len = (size_t)(end - start);
+    if (len >= MAX_OPERAND) len = MAX_OPERAND - 1;
+    memcpy(dest, start, len);
+    dest[len] = '\0';
+}
+
+static LineKind classify_line(const AsmLine* line, Insn* insn) {
+    insn->mnemonic[0] = '\0';
+    insn->operand_count = 0;
+    insn->label[0] = '\0';
+
+    if (line->pinned) return LINE_BARRIER;
+
+    const char* s = skip_space(line->text);
+    if (*s == '\0' || *s == ';') return LINE_TRANSPARENT;
+
+    // Statement text ends at the comment; quoted text is never rewritten
+    const char* end = s;
+    while (*end && *end != ';') {
+        if (*end == '"' || *end == '\'' || *end == '`') return LINE_BARRIER;
+        end++;
+    }
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t')) end--;
+
+    if (end[-1] == ':') {
+        copy_trimmed(insn->label, s, end - 1);
+        return LINE_BARRIER;
+    }
+
+    const char* m = s;
+    while (m < end && isalpha((unsigned char)*m)) m++;
+    size_t mlen = (size_t)(m - s);
+    if (mlen == 0 || mlen >= MAX_MNEMONIC || (m < end && *m != ' ' && *m != '\t')) {
+        return LINE_BARRIER;
+    }
+    memcpy(insn->mnemonic, s, mlen);
+    insn->mnemonic[mlen] = '\0';
+
+    // Split operands on top-level commas
+    const char* op = skip_space(m);
+    int depth = 0;
+    const char* start = op;
+    for (const char* p = op; p <= end; p++) {
+        if (p < end && *p == '[') depth++;
+        if (p < end && *p == ']') depth--;
+        if (p == end || (*p == ',' && depth == 0)) {
+            if (p > start) {
+                if (insn->operand_count >= 2) return LINE_BARRIER;
+                copy_trimmed(insn->operands[insn->operand_count++], start, p);
+            }
+            start = p + 1;
+        }
+    }
+
+    return LINE_INSTRUCTION;
+}
+
+static int is_register(const char* op) {
+    static const char* regs[] = { "eax", "ebx", "ecx", "edx", "esi", "edi" };
+    for (int i = 0; i < 6; i++) {
+        if (strcmp(op, regs[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// Stack slots are the only memory operands we reason about; anything else
+// may be memory-mapped I/O behind a pointer. Only [ebp], [ebp + N] and
+// [ebp - N] qualify: an indexed slot such as [ebp + eax*4 - 40] moves when
+// its index register is written.
+static int is_frame_slot(const char* op) {
+    if (strncmp(op, "[ebp", 4) != 0) return 0;
+    const char* p = skip_space(op + 4);
+    if (*p == '+' || *p == '-') {
+        p = skip_space(p + 1);
+        if (!isdigit((unsigned char)*p)) return 0;
+        while (isalnum((unsigned char)*p)) p++;   // Decimal or 0x hex
+        p = skip_space(p);
+    }
+    return p[0] == ']' && p[1] == '\0';
+}
+
+static int is_mov(const Insn* insn, const char* dest, const char* src) {
+    return strcmp(insn->mnemonic, "mov") == 0 && insn->operand_count == 2 &&
+        (!dest || strcmp(insn->operands[0], dest) == 0) &&
+        (!src || strcmp(insn->operands[1], src) == 0);
+}
+
+/* ====================== Line Editing ====================== */
+
+static void remove_line(AsmLine* line) {
+    line->text = NULL;
+}
+
+static void replace_line(AsmLine* line, Arena* text, const char* fmt, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    if (len >= (int)sizeof(buffer)) len = (int)sizeof(buffer) - 1;
+    line->text = arena_strndup(text, buffer, (size_t)len);
+}
+
+// Collects up to max instruction lines from index i on, skipping comments
+// and stopping at barriers
+static int collect_window(AsmLine* lines, int count, int i, int* window, Insn* insns, int max) {
+    int n = 0;
+    for (int j = i; j < count && n < max; j++) {
+        if (!lines[j].text) continue;
+        LineKind kind = classify_line(&lines[j], &insns[n]);
+        if (kind == LINE_TRANSPARENT) continue;
+        if (kind == LINE_BARRIER) break;
+        window[n++] = j;
+    }
+    return n;
+}
+
+/* ====================== Patterns ====================== */
+
+// Each pattern inspects the window starting at an instruction and returns
+// how many instructions it removed (0 if it did not apply)
+typedef int (*PatternFn)(AsmLine* lines, int count, int i, Arena* text);
+
+static int pattern_push_pop(AsmLine* lines, int count, int i, Arena* text) {
+    int w[2];
+    Insn in[2];
+    if (collect_window(lines, count, i, w, in, 2) < 2) return 0;
+    if (strcmp(in[0].mnemonic, "push") != 0 || strcmp(in[1].mnemonic, "pop") != 0) return 0;
+    if (!is_register(in[0].operands[0]) || !is_register(in[1].operands[0])) return 0;
+
+    if (strcmp(in[0].operands[0], in[1].operands[0]) == 0) {
+        remove_line(&lines[w[0]]);
+        remove_line(&lines[w[1]]);
+        return 2;
+    }
+    replace_line(&lines[w[0]], text, "    mov %s, %s", in[1].operands[0], in[0].operands[0]);
+    remove_line(&lines[w[1]]);
+    return 1;
+}
+
+static int pattern_mov_back(AsmLine* lines, int count, int i, Arena* text) {
+    int w[2];
+    Insn in[2];
+    if (collect_window(lines, count, i, w, in, 2) < 2) return 0;
+    if (!is_mov(&in[0], NULL, NULL)) return 0;
+
+    const char* a = in[0].operands[0];
+    const char* b = in[0].operands[1];
+    if (!is_register(a) && !is_register(b)) return 0;
+    if (!(is_register(a) || is_frame_slot(a)) || !(is_register(b) || is_frame_slot(b))) return 0;
+    if (!is_mov(&in[1], b, a)) return 0;
+
+    remove_line(&lines[w[1]]);
+    return 1;
+}
+
+static int pattern_self_mov(AsmLine* lines, int count, int i, Arena* text) {
+    Insn insn;
+    (void)count;
+    if (classify_line(&lines[i], &insn) != LINE_INSTRUCTION) return 0;
+    if (!is_mov(&insn, NULL, NULL) || !is_register(insn.operands[0])) return 0;
+    if (strcmp(insn.operands[0], insn.operands[1]) != 0) return 0;
+
+    remove_line(&lines[i]);
+    return 1;
+}
+
+static const char* invert_condition(const char* cc) {
+    static const char* pairs[][2] = {
+        { "e", "ne" }, { "z", "nz" }, { "l", "ge" }, { "g", "le" },
+        { "b", "ae" }, { "a", "be" }, { "s", "ns" }
+    };
+    for (int i = 0; i < 7; i++) {
+        if (strcmp(cc, pairs[i][0]) == 0) return pairs[i][1];
+        if (strcmp(cc, pairs[i][1]) == 0) return pairs[i][0];
+    }
+    return NULL;
+}
+
+// A boolean materialized only to be tested is dead after the branch:
+// codegen re-evaluates every condition it tests
+static int pattern_setcc_branch(AsmLine* lines, int count, int i, Arena* text) {
+    int w[4];
+    Insn in[4];
+    if (collect_window(lines, count, i, w, in, 4) < 4) return 0;
+
+    if (strncmp(in[0].mnemonic, "set", 3) != 0 || in[0].operand_count != 1 ||
+        strcmp(in[0].operands[0], "al") != 0) return 0;
+    if (strcmp(in[1].mnemonic, "movzx") != 0 || in[1].operand_count != 2 ||
+        strcmp(in[1].operands[0], "eax") != 0 || strcmp(in[1].operands[1], "al") != 0) return 0;
+    if (strcmp(in[2].mnemonic, "test") != 0 || in[2].operand_count != 2 ||
+        strcmp(in[2].operands[0], "eax") != 0 || strcmp(in[2].operands[1], "eax") != 0) return 0;
+
+    const char* cc = in[0].mnemonic + 3;
+    const char* jump_cc;
+    if (strcmp(in[3].mnemonic, "jz") == 0 || strcmp(in[3].mnemonic, "je") == 0) {
+        jump_cc = invert_condition(cc);
+    }
+    else if (strcmp(in[3].mnemonic, "jnz") == 0 || strcmp(in[3].mnemonic, "jne") == 0) {
+        jump_cc = invert_condition(cc) ? cc : NULL;
+    }
+    else {
+        return 0;
+    }
+    if (!jump_cc || in[3].operand_count != 1) return 0;
+
+    replace_line(&lines[w[0]], text, "    j%s %s", jump_cc, in[3].operands[0]);
+    remove_line(&lines[w[1]]);
+    remove_line(&lines[w[2]]);
+    remove_line(&lines[w[3]]);
+    return 3;
+}
+
+static int pattern_jmp_next(AsmLine* lines, int count, int i, Arena* text) {
+    Insn insn;
+    if (classify_line(&lines[i], &insn) != LINE_INSTRUCTION) return 0;
+    if (strcmp(insn.mnemonic, "jmp") != 0 || insn.operand_count != 1) return 0;
+
+    for (int j = i + 1; j < count; j++) {
+        if (!lines[j].text) continue;
+        Insn next;
+        LineKind kind = classify_line(&lines[j], &next);
+        if (kind == LINE_TRANSPARENT) continue;
+        if (kind == LINE_BARRIER && next.label[0] && !lines[j].pinned) {
+            // Fall through any run of labels looking for the target
+            if (strcmp(next.label, insn.operands[0]) == 0) {
+                remove_line(&lines[i]);
+                return 1;
+            }
+            continue;
+        }
+        break;
+    }
+    return 0;
+}
+
+typedef struct {
+    const char* name;
+    PatternFn apply;
+} PatternEntry;
+
+static const PatternEntry g_patterns[PEEP_PATTERN_COUNT] = {
+    [PEEP_PUSH_POP]     = { "push/pop -> mov",           pattern_push_pop },
+    [PEEP_MOV_BACK]     = { "mov a,b / mov b,a",         pattern_mov_back },
+    [PEEP_SELF_MOV]     = { "mov r,r",                   pattern_self_mov },
+    [PEEP_SETCC_BRANCH] = { "setcc/movzx/test/jcc",      pattern_setcc_branch },
+    [PEEP_JMP_NEXT]     = { "jmp to next line",          pattern_jmp_next },
+};
+
+/* ====================== Driver ====================== */
+
+int peephole_optimize(AsmLine* lines, int count, Arena* text, PeepholeStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    for (int pass = 0; pass < MAX_PASSES; pass++) {
+        int changed = 0;
+
+        for (int i = 0; i < count; i++) {
+            if (!lines[i].text) continue;
+            for (int p = 0; p < PEEP_PATTERN_COUNT && lines[i].text; p++) {
+                int removed = g_patterns[p].apply(lines, count, i, text);
+                if (removed > 0) {
+                    stats->hits[p]++;
+                    stats->removed[p] += removed;
+                    changed = 1;
+                }
+            }
+        }
+
+        // Compact
+        int out = 0;
+        for (int i = 0; i < count; i++) {
+            if (lines[i].text) lines[out++] = lines[i];
+        }
+        count = out;
+
+        if (!changed) break;
+    }
+
+    return count;
+}
+
+void peephole_print_report(const PeepholeStats* stats, FILE* out) {
+    int total = 0;
+    fprintf(out, "%-28s %6s %8s\n", "pattern", "hits", "removed");
+    for (int p = 0; p < PEEP_PATTERN_COUNT; p++) {
+        fprintf(out, "%-28s %6d %8d\n", g_patterns[p].name, stats->hits[p], stats->removed[p]);
+        total += stats->removed[p];
+    }
+    fprintf(out, "%d instructions removed\n", total);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef TREESHAKE_H
+#define TREESHAKE_H
+
+#include "../Peephole/Peephole.h"
+
+// A top-level symbol in the text section: a column-0 label or data
+// definition, plus the comment header above it, up to the next one
+typedef struct {
+    char* name;
+    int statements;       // Instructions and data directives it held
+    int bytes;            // Encoded size, if the lines were measured
+} StrippedSymbol;
+
+typedef struct {
+    StrippedSymbol* stripped;
+    int stripped_count;
+    int stripped_capacity;
+    int kept;
+    int kept_statements;
+    int kept_bytes;
+    int measured;         // Byte sizes are known
+} ShakeStats;
+
+// Removes text-section symbols that nothing reachable from entry refers to.
+// Lines outside any symbol (prologue, directives, data sections) are always
+// kept and count as references, as does every kept symbol's own text, so
+// calls, address-taken functions and names used in inline asm all keep
+// their targets. Does nothing if entry is not defined. Removed lines are
+// dropped and the array compacted; returns the new line count.
+// line_bytes, if not NULL, holds the encoded size of each line and lets the
+// report give sizes in bytes.
+int tree_shake(AsmLine* lines, int count, const char* entry, const unsigned int* line_bytes,
+    ShakeStats* stats);
+
+void tree_shake_print_report(const ShakeStats* stats, FILE* out);
+void tree_shake_free(ShakeStats* stats);
+
+#endif // !TREESHAKE_H
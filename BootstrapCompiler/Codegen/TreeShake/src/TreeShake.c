@@ -0,0 +1,315 @@
+#include "../TreeShake.h"
+#include "../../../Memory/NameTable/NameTable.h"
+
+#define MAX_SYMBOL_NAME 128
+
+/* ====================== Line Classification ====================== */
+
+typedef struct {
+    char name[MAX_SYMBOL_NAME];
+    int statements;
+    int bytes;
+    int kept;
+    int first_line;       // Range of lines owned, so marking it stays linear
+    int last_line;
+} Symbol;
+
+static int is_ident_start(char c) {
+    return isalpha((unsigned char)c) || c == '_';
+}
+
+static int is_ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static int starts_with_word(const char* s, const char* word) {
+    size_t len = strlen(word);
+    return strncmp(s, word, len) == 0 && !is_ident_char(s[len]);
+}
+
+// Column-0 "name:" or "name db/dw/dd/times/resb ..." opens a symbol
+static int symbol_start(const char* text, char* name) {
+    if (!is_ident_start(text[0])) return 0;
+
+    const char* p = text;
+    while (is_ident_char(*p)) p++;
+    size_t len = (size_t)(p - text);
+    if (len >= MAX_SYMBOL_NAME) return 0;
+
+    int is_symbol = 0;
+    if (*p == ':') {
+        is_symbol = 1;
+    }
+    else if (*p == ' ' || *p == '\t') {
+        while (*p == ' ' || *p == '\t') p++;
+        static const char* data_words[] = { "db", "dw", "dd", "dq", "times", "resb", "resw", "resd" };
+        for (size_t i = 0; i < sizeof(data_words) / sizeof(data_words[0]); i++) {
+            if (starts_with_word(p, data_words[i])) is_symbol = 1;
+        }
+    }
+
+    if (is_symbol) {
+        memcpy(name, text, len);
+        name[len] = '\0';
+    }
+    return is_symbol;
+}
+
+static int is_blank_or_comment(const char* text) {
+    while (*text == ' ' || *text == '\t') text++;
+    return *text == '\0' || *text == ';';
+}
+
+// Instructions and data directives, as opposed to labels and comments
+static int is_statement(const char* text) {
+    if (is_blank_or_comment(text)) return 0;
+    const char* end = text + strlen(text);
+    const char* semi = strchr(text, ';');
+    if (semi) end = semi;
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    if (end > text && end[-1] == ':') return 0;
+    return 1;
+}
+
+/* ====================== Reference Scanning ====================== */
+
+typedef struct {
+    Symbol* symbols;
+    int count;
+    char (*aliases)[MAX_SYMBOL_NAME];   // Extra labels directly after a symbol's own
+    int* alias_owner;
+    int alias_count;
+    NameTable index;      // Symbol and alias names to symbol index
+    int* worklist;
+    int pending;
+} SymbolTable;
+
+static int find_symbol(SymbolTable* table, const char* name, size_t len) {
+    char key[MAX_SYMBOL_NAME];
+    if (len >= MAX_SYMBOL_NAME) return -1;
+    memcpy(key, name, len);
+    key[len] = '\0';
+    return name_table_get(&table->index, key, -1);
+}
+
+// The first definition of a name wins, as the assembler would reject the rest
+static void index_symbol(SymbolTable* table, const char* name, int index) {
+    if (name_table_get(&table->index, name, -1) < 0) name_table_put(&table->index, name, index);
+}
+
+static void keep_symbol(SymbolTable* table, int index) {
+    if (index < 0 || table->symbols[index].kept) return;
+    table->symbols[index].kept = 1;
+    table->worklist[table->pending++] = index;
+}
+
+// Keeps every symbol named by an identifier in text outside quotes and comments
+static void mark_references(SymbolTable* table, const char* text) {
+    const char* p = text;
+    char quote = 0;
+
+    while (*p) {
+        if (quote) {
+            if (*p == quote) quote = 0;
+            p++;
+            continue;
+        }
+        if (*p == '\'' || *p == '"' || *p == '`') {
+            quote = *p++;
+            continue;
+        }
+        if (*p == ';') break;
+
+        // Local labels (.L12, .epilogue) are not symbols
+        if (is_ident_start(*p) && (p == text || (!is_ident_char(p[-1]) && p[-1] != '.'))) {
+            const char* start = p;
+            while (is_ident_char(*p)) p++;
+            keep_symbol(table, find_symbol(table, start, (size_t)(p - start)));
+            continue;
+        }
+        p++;
+    }
+}
+
+/* ====================== Stripping ====================== */
+
+static void record_stripped(ShakeStats* stats, const Symbol* symbol) {
+    if (stats->stripped_count >= stats->stripped_capacity) {
+        stats->stripped_capacity = stats->stripped_capacity == 0 ? 16 : stats->stripped_capacity * 2;
+        stats->stripped = (StrippedSymbol*)realloc(stats->stripped,
+            sizeof(StrippedSymbol) * stats->stripped_capacity);
+    }
+    StrippedSymbol* s = &stats->stripped[stats->stripped_count++];
+    s->name = _strdup(symbol->name);
+    s->statements = symbol->statements;
+    s->bytes = symbol->bytes;
+}
+
+// Splits the text section into symbols; returns the owner of each line, -1
+// for lines outside every symbol
+static int* split_symbols(AsmLine* lines, int count, SymbolTable* table) {
+    int* owner = (int*)malloc(sizeof(int) * (count + 1));
+    int current = -1;
+    int in_text = 1;
+
+    for (int i = 0; i < count; i++) {
+        const char* text = lines[i].text;
+        char name[MAX_SYMBOL_NAME];
+        owner[i] = -1;
+
+        if (starts_with_word(text, "section")) {
+            in_text = strstr(text, ".text") != NULL;
+            current = -1;
+            continue;
+        }
+        if (!in_text) continue;
+
+        if (symbol_start(text, name)) {
+            Symbol* sym = current >= 0 ? &table->symbols[current] : NULL;
+            if (sym && sym->statements == 0 && owner[i - 1] == current) {
+                // Second label on the same code, e.g. cli_func
+                snprintf(table->aliases[table->alias_count], MAX_SYMBOL_NAME, "%s", name);
+                index_symbol(table, table->aliases[table->alias_count], current);
+                table->alias_owner[table->alias_count++] = current;
+                owner[i] = current;
+                continue;
+            }
+
+            current = table->count++;
+            sym = &table->symbols[current];
+            snprintf(sym->name, sizeof(sym->name), "%s", name);
+            index_symbol(table, sym->name, current);
+            sym->statements = text[strlen(name)] == ':' ? 0 : 1;
+            sym->kept = 0;
+            owner[i] = current;
+
+            // The column-0 comment header directly above belongs to it too
+            for (int j = i - 1; j >= 0 && is_blank_or_comment(lines[j].text) &&
+                lines[j].text[0] != ' ' && lines[j].text[0] != '\t'; j--) {
+                owner[j] = current;
+            }
+            continue;
+        }
+
+        // Indented code, local labels and comments extend the current symbol;
+        // any other column-0 line (global, align, ...) ends it
+        if (current >= 0 && (text[0] == ' ' || text[0] == '\t' || text[0] == '.' ||
+            is_blank_or_comment(text))) {
+            owner[i] = current;
+            if (is_statement(text)) table->symbols[current].statements++;
+        }
+        else {
+            current = -1;
+        }
+    }
+    for (int s = 0; s < table->count; s++) {
+        table->symbols[s].first_line = count;
+        table->symbols[s].last_line = -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (owner[i] < 0) continue;
+        Symbol* sym = &table->symbols[owner[i]];
+        if (i < sym->first_line) sym->first_line = i;
+        if (i > sym->last_line) sym->last_line = i;
+    }
+    return owner;
+}
+
+int tree_shake(AsmLine* lines, int count, const char* entry, const unsigned int* line_bytes,
+    ShakeStats* stats) {
+    SymbolTable table;
+    table.symbols = (Symbol*)malloc(sizeof(Symbol) * (count + 1));
+    table.count = 0;
+    table.aliases = (char(*)[MAX_SYMBOL_NAME])malloc(MAX_SYMBOL_NAME * (size_t)(count + 1));
+    table.alias_owner = (int*)malloc(sizeof(int) * (count + 1));
+    table.alias_count = 0;
+    table.worklist = (int*)malloc(sizeof(int) * (count + 1));
+    table.pending = 0;
+    name_table_init(&table.index);
+
+    int* owner = split_symbols(lines, count, &table);
+    int entry_index = find_symbol(&table, entry, strlen(entry));
+
+    int out = count;
+    if (entry_index >= 0) {
+        keep_symbol(&table, entry_index);
+        for (int i = 0; i < count; i++) {
+            if (owner[i] < 0) mark_references(&table, lines[i].text);
+        }
+        while (table.pending > 0) {
+            int s = table.worklist[--table.pending];
+            for (int i = table.symbols[s].first_line; i <= table.symbols[s].last_line; i++) {
+                if (owner[i] == s) mark_references(&table, lines[i].text);
+            }
+        }
+
+        for (int s = 0; s < table.count; s++) {
+            table.symbols[s].bytes = 0;
+        }
+        if (line_bytes) {
+            for (int i = 0; i < count; i++) {
+                if (owner[i] >= 0) table.symbols[owner[i]].bytes += (int)line_bytes[i];
+            }
+        }
+        stats->measured = line_bytes != NULL;
+
+        out = 0;
+        for (int i = 0; i < count; i++) {
+            if (owner[i] >= 0 && !table.symbols[owner[i]].kept) continue;
+            lines[out++] = lines[i];
+        }
+
+        for (int s = 0; s < table.count; s++) {
+            if (table.symbols[s].kept) {
+                stats->kept++;
+                stats->kept_statements += table.symbols[s].statements;
+                stats->kept_bytes += table.symbols[s].bytes;
+            }
+            else {
+                record_stripped(stats, &table.symbols[s]);
+            }
+        }
+    }
+
+    free(owner);
+    name_table_free(&table.index);
+    free(table.worklist);
+    free(table.alias_owner);
+    free(table.aliases);
+    free(table.symbols);
+    return out;
+}
+
+// Bytes are as encoded before the peephole pass; "statements" counts
+// instructions and data directives, whatever their size
+void tree_shake_print_report(const ShakeStats* stats, FILE* out) {
+    int total_statements = 0;
+    int total_bytes = 0;
+    fprintf(out, "%-32s %10s %10s\n", "stripped symbol", "bytes", "statements");
+    for (int i = 0; i < stats->stripped_count; i++) {
+        const StrippedSymbol* s = &stats->stripped[i];
+        if (stats->measured) fprintf(out, "%-32s %10d %10d\n", s->name, s->bytes, s->statements);
+        else fprintf(out, "%-32s %10s %10d\n", s->name, "?", s->statements);
+        total_statements += s->statements;
+        total_bytes += s->bytes;
+    }
+    if (stats->measured) {
+        fprintf(out, "%-32s %10d %10d\n", "total", total_bytes, total_statements);
+        fprintf(out, "Stripped %d symbols (%d bytes), kept %d (%d bytes)\n",
+            stats->stripped_count, total_bytes, stats->kept, stats->kept_bytes);
+    }
+    else {
+        fprintf(out, "%-32s %10s %10d\n", "total", "?", total_statements);
+        fprintf(out, "Stripped %d symbols (%d statements), kept %d (%d statements); "
+            "sizes unknown, the assembler rejected the program\n",
+            stats->stripped_count, total_statements, stats->kept, stats->kept_statements);
+    }
+}
+
+void tree_shake_free(ShakeStats* stats) {
+    for (int i = 0; i < stats->stripped_count; i++) free(stats->stripped[i].name);
+    free(stats->stripped);
+    stats->stripped = NULL;
+    stats->stripped_count = 0;
+    stats->stripped_capacity = 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "../Diagnostics/Diagnostics.h"
+
+// The whole pipeline behind one call, for hosts that link the compiler in
+// rather than run the executable. Everything a compilation builds belongs
+// to its CompilerResult and no state is shared between compilations, so a
+// host can compile any number of units in one process, on as many threads
+// as it likes.
+#if defined(COMPILER_BUILD_DLL)
+#define COMPILER_API __declspec(dllexport)
+#elif defined(COMPILER_USE_DLL)
+#define COMPILER_API __declspec(dllimport)
+#elif defined(__GNUC__)
+#define COMPILER_API __attribute__((visibility("default")))
+#else
+#define COMPILER_API
+#endif
+
+typedef enum {
+    COMPILER_OUTPUT_ASSEMBLY,     // NASM text
+    COMPILER_OUTPUT_BINARY        // Flat image from the built-in assembler
+} CompilerOutputFormat;
+
+typedef struct {
+    const char* base_dir;         // Where #include "..." is resolved, "." if NULL
+    int opt_level;
+    int inline_limit;
+    CompilerOutputFormat format;
+    int keep_listing;             // Keep the assembly text of binary output too
+
+    // Reports the command line compiler prints on request, written to
+    // report as each phase finishes; nothing is written if report is NULL
+    FILE* report;
+    int dump_preprocessed;
+    int dump_ast;
+    int print_reports;            // Frame, inlining, folding, peephole and tree shaking
+} CompilerOptions;
+
+typedef enum {
+    COMPILER_PHASE_PREPROCESS,
+    COMPILER_PHASE_TOKENIZE,
+    COMPILER_PHASE_PARSE,
+    COMPILER_PHASE_OPTIMIZE,
+    COMPILER_PHASE_CODEGEN,
+    COMPILER_PHASE_COUNT
+} CompilerPhase;
+
+typedef struct {
+    double phase_ms[COMPILER_PHASE_COUNT];
+    size_t source_bytes;
+    size_t preprocessed_bytes;
+    size_t tokens;
+    size_t lines_emitted;
+    size_t lines_written;
+    size_t output_bytes;
+    size_t instructions_encoded;  // Binary output only
+    size_t arena_allocated;
+    size_t arena_reserved;
+    size_t names_interned;
+} CompilerStats;
+
+typedef struct CompilerResult CompilerResult;
+
+COMPILER_API void compiler_options_init(CompilerOptions* options);
+
+// Compiles length bytes of C source; the source need not be NUL-terminated.
+// Always returns a result, which the caller releases with
+// compiler_result_free; options may be NULL for the defaults.
+COMPILER_API CompilerResult* compiler_compile(const char* source, size_t length,
+    const CompilerOptions* options);
+
+COMPILER_API int compiler_succeeded(const CompilerResult* result);
+
+// The assembly text or binary image; NULL if the compilation failed. Text
+// output is NUL-terminated, which size does not count.
+COMPILER_API const char* compiler_output(const CompilerResult* result, size_t* size);
+
+// The assembly text, whatever the format, if it was asked for; otherwise NULL
+COMPILER_API const char* compiler_listing(const CompilerResult* result, size_t* size);
+
+// Warnings, and the error that stopped a failed compilation, in the order
+// they were found
+COMPILER_API int compiler_diagnostic_count(const CompilerResult* result);
+COMPILER_API const Diagnostic* compiler_diagnostic(const CompilerResult* result, int index);
+
+// Filled in for the phases that ran
+COMPILER_API const CompilerStats* compiler_stats(const CompilerResult* result);
+
+COMPILER_API void compiler_result_free(CompilerResult* result);
+
+#endif // !COMPILER_H
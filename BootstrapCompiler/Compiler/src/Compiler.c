@@ -0,0 +1,470 @@
+#include "../Compiler.h"
+#include "../../Codegen/Codegen.h"
+#include "../../Optimizer/Optimizer.h"
+#include "../../Tokenizer/Preprocessor/Preprocessor.h"
+#include <time.h>
+
+// Growable block of output handed over by codegen
+typedef struct {
+    char* data;
+    size_t length;
+} OutputBuffer;
+
+struct CompilerResult {
+    int succeeded;
+    CompilerOutputFormat format;
+    OutputBuffer output;
+    OutputBuffer listing;
+    Diagnostics diag;
+    CompilerStats stats;
+};
+
+// What one compilation builds. It is reached through a pointer so an error
+// that jumps back into compiler_compile sees every object created so far.
+typedef struct {
+    char* source;
+    Interner* names;
+    char* preprocessed;
+    TokenStream tokens;
+    int has_tokens;
+    Arena* arena;
+    TypeTable* types;
+    Parser* parser;
+    CodeGen* cg;
+} Pipeline;
+
+/* ====================== AST Printer ====================== */
+
+static void print_indent(FILE* out, int indent) {
+    for (int i = 0; i < indent; ++i) fputs("  ", out);
+}
+
+static const char* node_type_name(Nodes type) {
+    switch (type) {
+    case N_PROGRAM: return "PROGRAM";
+    case N_FUNCTION: return "FUNCTION";
+    case N_RETURN: return "RETURN";
+    case N_BLOCK: return "BLOCK";
+    case N_INTLIT: return "INT_LITERAL";
+    case N_STRING_LIT: return "STRING_LITERAL";
+    case N_CHAR_LIT: return "CHAR_LITERAL";
+    case N_IDENT: return "IDENTIFIER";
+    case N_OPERATOR: return "OPERATOR";
+    case N_UNARY: return "UNARY";
+    case N_ASSIGN: return "ASSIGN";
+    case N_DECL: return "DECLARATION";
+    case N_IF: return "IF";
+    case N_WHILE: return "WHILE";
+    case N_FOR: return "FOR";
+    case N_BREAK: return "BREAK";
+    case N_CONTINUE: return "CONTINUE";
+    case N_CALL: return "CALL";
+    case N_ARRAY_ACCESS: return "ARRAY_ACCESS";
+    case N_MEMBER_ACCESS: return "MEMBER_ACCESS";
+    case N_STRUCT_DECL: return "STRUCT_DECL";
+    case N_TYPEDEF: return "TYPEDEF";
+    case N_ENUM_DECL: return "ENUM_DECL";
+    case N_CAST: return "CAST";
+    case N_SIZEOF: return "SIZEOF";
+    case N_TERNARY: return "TERNARY";
+    case N_INLINE: return "INLINE";
+    default: return "UNKNOWN";
+    }
+}
+
+static void ast_print(FILE* out, AST* node, int indent) {
+    if (!node) {
+        print_indent(out, indent);
+        fprintf(out, "NULL\n");
+        return;
+    }
+
+    print_indent(out, indent);
+    fprintf(out, "%s", node_type_name(node->type));
+
+    switch (node->type) {
+    case N_INTLIT:
+        fprintf(out, " %d", node->data.int_lit.value);
+        break;
+    case N_STRING_LIT:
+        fprintf(out, " \"%s\"", node->data.string_lit.value);
+        break;
+    case N_CHAR_LIT:
+        fprintf(out, " '%c'", node->data.char_lit.value);
+        break;
+    case N_IDENT:
+        fprintf(out, " %s", node->data.ident.name);
+        break;
+    case N_OPERATOR:
+        fprintf(out, " (op: %d)\n", node->data.op.op);
+        ast_print(out, node->data.op.left, indent + 1);
+        ast_print(out, node->data.op.right, indent + 1);
+        return;
+    case N_UNARY:
+        fprintf(out, " (op: %d)\n", node->data.unary.op);
+        ast_print(out, node->data.unary.operand, indent + 1);
+        return;
+    case N_ASSIGN:
+        fprintf(out, " %s =\n", node->data.assign.var_name);
+        ast_print(out, node->data.assign.value, indent + 1);
+        return;
+    case N_DECL:
+        fprintf(out, " type=%s name=%s ptr_level=%d",
+            node->data.decl.type->name, node->data.decl.name, node->data.decl.pointer_level);
+        if (node->data.decl.init_value) {
+            fprintf(out, " init=\n");
+            ast_print(out, node->data.decl.init_value, indent + 1);
+            return;
+        }
+        break;
+    case N_RETURN:
+        fprintf(out, "\n");
+        ast_print(out, node->data.return_stmt.value, indent + 1);
+        return;
+    case N_FUNCTION:
+        fprintf(out, " %s %s\n", node->data.function.return_type->name, node->data.function.name);
+        print_indent(out, indent + 1);
+        fprintf(out, "PARAMS (%zu):\n", node->data.function.param_count);
+        for (size_t i = 0; i < node->data.function.param_count; i++)
+            ast_print(out, node->data.function.params[i], indent + 2);
+        print_indent(out, indent + 1);
+        fprintf(out, "BODY:\n");
+        ast_print(out, node->data.function.body, indent + 2);
+        return;
+    case N_BLOCK:
+        fprintf(out, " (%zu stmts)\n", node->data.block.count);
+        for (size_t i = 0; i < node->data.block.count; i++)
+            ast_print(out, node->data.block.statements[i], indent + 1);
+        return;
+    case N_IF:
+        fprintf(out, "\n");
+        print_indent(out, indent + 1); fprintf(out, "COND:\n"); ast_print(out, node->data.if_stmt.condition, indent + 2);
+        print_indent(out, indent + 1); fprintf(out, "THEN:\n"); ast_print(out, node->data.if_stmt.then_block, indent + 2);
+        if (node->data.if_stmt.else_block) {
+            print_indent(out, indent + 1); fprintf(out, "ELSE:\n"); ast_print(out, node->data.if_stmt.else_block, indent + 2);
+        }
+        return;
+    case N_WHILE:
+        fprintf(out, "\n");
+        print_indent(out, indent + 1); fprintf(out, "COND:\n"); ast_print(out, node->data.while_stmt.condition, indent + 2);
+        print_indent(out, indent + 1); fprintf(out, "BODY:\n"); ast_print(out, node->data.while_stmt.body, indent + 2);
+        return;
+    case N_FOR:
+        fprintf(out, "\n");
+        print_indent(out, indent + 1); fprintf(out, "INIT:\n"); ast_print(out, node->data.for_stmt.init, indent + 2);
+        print_indent(out, indent + 1); fprintf(out, "COND:\n"); ast_print(out, node->data.for_stmt.condition, indent + 2);
+        print_indent(out, indent + 1); fprintf(out, "INCR:\n"); ast_print(out, node->data.for_stmt.increment, indent + 2);
+        print_indent(out, indent + 1); fprintf(out, "BODY:\n"); ast_print(out, node->data.for_stmt.body, indent + 2);
+        return;
+    case N_CALL:
+        fprintf(out, " %s(%zu args)\n", node->data.call.name, node->data.call.arg_count);
+        for (size_t i = 0; i < node->data.call.arg_count; i++)
+            ast_print(out, node->data.call.args[i], indent + 1);
+        return;
+    case N_STRUCT_DECL:
+        fprintf(out, " %s (%zu members)\n", node->data.struct_decl.name ? node->data.struct_decl.name : "(anon)",
+            node->data.struct_decl.member_count);
+        for (size_t i = 0; i < node->data.struct_decl.member_count; i++)
+            ast_print(out, node->data.struct_decl.members[i], indent + 1);
+        return;
+    case N_TYPEDEF:
+        fprintf(out, " %s -> %s", node->data.typedef_decl.old_name, node->data.typedef_decl.new_name);
+        break;
+    case N_ENUM_DECL:
+        fprintf(out, " %s (%zu values)\n", node->data.enum_decl.name ? node->data.enum_decl.name : "(anon)",
+            node->data.enum_decl.value_count);
+        for (size_t i = 0; i < node->data.enum_decl.value_count; i++)
+            ast_print(out, node->data.enum_decl.values[i], indent + 1);
+        return;
+    case N_INLINE:
+        fprintf(out, " %s\n", node->data.inline_call.callee);
+        ast_print(out, node->data.inline_call.body, indent + 1);
+        return;
+    case N_PROGRAM:
+        fprintf(out, " (%zu functions, %zu globals)\n", node->data.program.func_count, node->data.program.global_count);
+        for (size_t i = 0; i < node->data.program.func_count; i++)
+            ast_print(out, node->data.program.functions[i], indent + 1);
+        for (size_t i = 0; i < node->data.program.global_count; i++)
+            ast_print(out, node->data.program.globals[i], indent + 1);
+        return;
+    default:
+        break;
+    }
+    fprintf(out, "\n");
+}
+
+/* ====================== Output ====================== */
+
+static void output_append(OutputBuffer* buffer, const char* text, size_t length) {
+    buffer->data = (char*)realloc(buffer->data, buffer->length + length + 1);
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+static void capture_output(void* context, const char* text, size_t length) {
+    output_append(&((CompilerResult*)context)->output, text, length);
+}
+
+static void capture_listing(void* context, const char* text, size_t length) {
+    output_append(&((CompilerResult*)context)->listing, text, length);
+}
+
+/* ====================== Pipeline ====================== */
+
+static double elapsed_ms(clock_t start) {
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+static void pipeline_free(Pipeline* pipeline) {
+    if (pipeline->cg) codegen_free(pipeline->cg);
+    if (pipeline->parser) parser_free(pipeline->parser);
+    if (pipeline->has_tokens) token_stream_free(&pipeline->tokens);
+    type_table_destroy(pipeline->types);
+    if (pipeline->arena) arena_destroy(pipeline->arena);
+    free(pipeline->preprocessed);
+    free(pipeline->source);
+    if (pipeline->names) interner_destroy(pipeline->names);
+    free(pipeline);
+}
+
+static void tokenize_source(Pipeline* pipeline, Diagnostics* diag) {
+    const char* text = pipeline->preprocessed;
+    TokenStream* tokens = &pipeline->tokens;
+    token_stream_init(tokens, text);
+    pipeline->has_tokens = 1;
+
+    Scanner* scanner = scanner_create(pipeline->preprocessed);
+    Tokens last;
+    do {
+        last = tokenize(scanner, tokens);
+    } while (last != TOKEN_EOF && last != TOKEN_ERROR);
+    scanner_free(scanner);
+
+    if (last == TOKEN_ERROR) {
+        size_t at = tokens->count - 1;
+        int line = tokens->lines[at];
+        int column = token_stream_column(tokens, at);
+        diag_fatal(diag, DIAG_TOKENIZE, NULL, line, column,
+            "Tokenization failed at line %d, column %d\nError token: '%.*s'",
+            line, column, (int)tokens->lengths[at], text + tokens->offsets[at]);
+    }
+}
+
+// The optimizer reports go out with the frame report, once code is generated
+static void optimize_program(AST* program, Arena* arena, const CompilerOptions* options,
+    FoldStats* fold_stats, InlineStats* inline_stats) {
+    optimize_fold_constants(program, fold_stats);
+
+    // Inlined constant arguments give folding a second chance
+    InlineOptions inline_options = { options->inline_limit, codegen_is_runtime_function };
+    optimize_inline_calls(program, arena, &inline_options, inline_stats);
+    if (inline_stats->call_sites > 0) {
+        FoldStats refold;
+        optimize_fold_constants(program, &refold);
+        fold_stats->folded += refold.folded;
+        fold_stats->simplified += refold.simplified;
+        fold_stats->globals += refold.globals;
+    }
+}
+
+static void print_reports(FILE* out, CodeGen* cg, const CompilerOptions* options,
+    const FoldStats* fold_stats, const InlineStats* inline_stats) {
+    fprintf(out, "=== FRAME REPORT ===\n");
+    codegen_print_frame_report(cg, out);
+    fprintf(out, "\n");
+
+    if (options->opt_level < 1) return;
+
+    fprintf(out, "=== INLINING ===\n");
+    fprintf(out, "Inlined %d call sites of %d functions (limit %d nodes)\n\n",
+        inline_stats->call_sites, inline_stats->functions, options->inline_limit);
+
+    fprintf(out, "=== CONSTANT FOLDING ===\n");
+    fprintf(out, "Folded %d constant expressions, simplified %d identities, "
+        "read %d read-only globals as constants\n\n",
+        fold_stats->folded, fold_stats->simplified, fold_stats->globals);
+
+    fprintf(out, "=== PEEPHOLE ===\n");
+    codegen_print_peephole_report(cg, out);
+    fprintf(out, "\n");
+
+    fprintf(out, "=== TREE SHAKING ===\n");
+    codegen_print_tree_shake_report(cg, out);
+    fprintf(out, "\n");
+}
+
+// Runs every phase; errors leave through the bailout in compiler_compile
+static void run_pipeline(Pipeline* pipeline, CompilerResult* result, const CompilerOptions* options) {
+    Diagnostics* diag = &result->diag;
+    CompilerStats* stats = &result->stats;
+    FILE* report = options->report;
+
+    // PREPROCESS - handle #include, #define and conditionals
+    clock_t phase_start = clock();
+
+    // Every name the compiler stores is interned here, from macro names to
+    // codegen symbols, and stays valid until the end of compilation
+    pipeline->names = interner_create();
+    pipeline->preprocessed = preprocess(pipeline->source,
+        options->base_dir ? options->base_dir : ".", pipeline->names, diag);
+    free(pipeline->source);
+    pipeline->source = NULL;
+    stats->preprocessed_bytes = strlen(pipeline->preprocessed);
+    stats->phase_ms[COMPILER_PHASE_PREPROCESS] = elapsed_ms(phase_start);
+
+    if (report && options->dump_preprocessed) {
+        fprintf(report, "=== SOURCE CODE (after preprocessing) ===\n%s\n", pipeline->preprocessed);
+    }
+
+    // Tokens refer into the preprocessed source, which outlives parsing
+    phase_start = clock();
+    tokenize_source(pipeline, diag);
+    stats->tokens = pipeline->tokens.count;
+    stats->phase_ms[COMPILER_PHASE_TOKENIZE] = elapsed_ms(phase_start);
+
+    // The AST and the strings it keeps live in one arena, released after codegen
+    pipeline->arena = arena_create(0);
+
+    // Type descriptors are built by the parser and read by codegen
+    pipeline->types = type_table_create(pipeline->names);
+
+    phase_start = clock();
+    pipeline->parser = parser_create(&pipeline->tokens, pipeline->arena, pipeline->names,
+        pipeline->types, diag);
+    AST* program = parse_program(pipeline->parser);
+    parser_free(pipeline->parser);
+    pipeline->parser = NULL;
+    stats->phase_ms[COMPILER_PHASE_PARSE] = elapsed_ms(phase_start);
+
+    FoldStats fold_stats = { 0 };
+    InlineStats inline_stats = { 0 };
+    phase_start = clock();
+    if (options->opt_level >= 1) {
+        optimize_program(program, pipeline->arena, options, &fold_stats, &inline_stats);
+    }
+    stats->phase_ms[COMPILER_PHASE_OPTIMIZE] = elapsed_ms(phase_start);
+
+    if (report && options->dump_ast) {
+        fprintf(report, "=== AST DUMP ===\n");
+        ast_print(report, program, 0);
+        fprintf(report, "\n");
+    }
+
+    // Generate code; the output is complete once codegen_program returns
+    phase_start = clock();
+    CodeGen* cg = codegen_create_with_sink(capture_output, result, TARGET_X86_64_PE,
+        pipeline->names, pipeline->types);
+    pipeline->cg = cg;
+    codegen_set_diagnostics(cg, diag);
+    codegen_set_opt_level(cg, options->opt_level);
+    if (report && options->print_reports) codegen_set_size_report(cg, 1);
+    if (options->format == COMPILER_OUTPUT_BINARY) {
+        codegen_set_output_format(cg, CODEGEN_OUTPUT_BINARY);
+        if (options->keep_listing) codegen_set_listing(cg, capture_listing, result);
+    }
+    codegen_program(cg, program);
+
+    if (report && options->print_reports) {
+        print_reports(report, cg, options, &fold_stats, &inline_stats);
+    }
+
+    const CodegenOutputStats* output = codegen_output_stats(cg);
+    stats->lines_emitted = output->lines_emitted;
+    stats->lines_written = output->lines_written;
+    stats->output_bytes = output->bytes_written;
+    stats->instructions_encoded = output->instructions_encoded;
+    stats->arena_allocated = pipeline->arena->allocated;
+    stats->arena_reserved = pipeline->arena->reserved;
+    stats->names_interned = pipeline->names->count;
+    stats->phase_ms[COMPILER_PHASE_CODEGEN] = elapsed_ms(phase_start);
+}
+
+/* ====================== API ====================== */
+
+void compiler_options_init(CompilerOptions* options) {
+    memset(options, 0, sizeof(CompilerOptions));
+    options->inline_limit = INLINE_DEFAULT_LIMIT;
+    options->format = COMPILER_OUTPUT_ASSEMBLY;
+}
+
+CompilerResult* compiler_compile(const char* source, size_t length, const CompilerOptions* options) {
+    CompilerOptions defaults;
+    if (!options) {
+        compiler_options_init(&defaults);
+        options = &defaults;
+    }
+
+    CompilerResult* result = (CompilerResult*)calloc(1, sizeof(CompilerResult));
+    diagnostics_init(&result->diag);
+    result->format = options->format;
+    result->stats.source_bytes = length;
+
+    Pipeline* pipeline = (Pipeline*)calloc(1, sizeof(Pipeline));
+    pipeline->source = (char*)malloc(length + 1);
+    memcpy(pipeline->source, source, length);
+    pipeline->source[length] = '\0';
+
+    jmp_buf bailout;
+    if (setjmp(bailout)) {
+        // Output of a failed compilation is never handed out
+        result->diag.bailout = NULL;
+        pipeline_free(pipeline);
+        free(result->output.data);
+        free(result->listing.data);
+        result->output.data = result->listing.data = NULL;
+        result->output.length = result->listing.length = 0;
+        return result;
+    }
+    result->diag.bailout = &bailout;
+
+    run_pipeline(pipeline, result, options);
+
+    result->diag.bailout = NULL;
+    pipeline_free(pipeline);
+    result->succeeded = 1;
+
+    // Text output is a string even when it is empty
+    if (options->format == COMPILER_OUTPUT_ASSEMBLY && !result->output.data) {
+        output_append(&result->output, "", 0);
+    }
+    return result;
+}
+
+int compiler_succeeded(const CompilerResult* result) {
+    return result->succeeded;
+}
+
+const char* compiler_output(const CompilerResult* result, size_t* size) {
+    if (size) *size = result->output.length;
+    return result->output.data;
+}
+
+const char* compiler_listing(const CompilerResult* result, size_t* size) {
+    // Text output is its own listing
+    const OutputBuffer* listing = result->format == COMPILER_OUTPUT_ASSEMBLY ?
+        &result->output : &result->listing;
+    if (size) *size = listing->length;
+    return listing->data;
+}
+
+int compiler_diagnostic_count(const CompilerResult* result) {
+    return result->diag.count;
+}
+
+const Diagnostic* compiler_diagnostic(const CompilerResult* result, int index) {
+    if (index < 0 || index >= result->diag.count) return NULL;
+    return &result->diag.items[index];
+}
+
+const CompilerStats* compiler_stats(const CompilerResult* result) {
+    return &result->stats;
+}
+
+void compiler_result_free(CompilerResult* result) {
+    if (!result) return;
+    diagnostics_free(&result->diag);
+    free(result->output.data);
+    free(result->listing.data);
+    free(result);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "../Includes.h"
+#include <setjmp.h>
+
+#if defined(_MSC_VER)
+#define DIAG_NORETURN __declspec(noreturn)
+#elif defined(__GNUC__)
+#define DIAG_NORETURN __attribute__((noreturn))
+#else
+#define DIAG_NORETURN
+#endif
+
+typedef enum {
+    DIAG_NOTE,
+    DIAG_WARNING,
+    DIAG_ERROR
+} DiagSeverity;
+
+typedef enum {
+    DIAG_PREPROCESS,
+    DIAG_TOKENIZE,
+    DIAG_PARSE,
+    DIAG_OPTIMIZE,
+    DIAG_CODEGEN
+} DiagPhase;
+
+// One problem found by a compilation. message is the full line the
+// command line compiler prints for it; the other fields say the same in a
+// form a host can act on.
+typedef struct {
+    DiagSeverity severity;
+    DiagPhase phase;
+    char* file;           // Include file it was found in, NULL for the main source
+    int line;             // 1-based, 0 if unknown
+    int column;           // 1-based, 0 if unknown
+    char* message;
+} Diagnostic;
+
+// Collects the diagnostics of one compilation. Errors are fatal: once
+// recorded, diag_fatal jumps to bailout, which the owner of the
+// compilation sets with setjmp to release what it built.
+typedef struct {
+    Diagnostic* items;
+    int count;
+    int capacity;
+    int error_count;
+    jmp_buf* bailout;
+} Diagnostics;
+
+void diagnostics_init(Diagnostics* diag);
+void diagnostics_free(Diagnostics* diag);
+
+// Records a note or warning. With no Diagnostics the message goes straight
+// to stderr, as it did before diagnostics were collected.
+void diag_report(Diagnostics* diag, DiagSeverity severity, DiagPhase phase,
+    const char* file, int line, int column, const char* format, ...);
+
+// Records an error and abandons the compilation through the bailout. With
+// no Diagnostics or no bailout set it prints the error and exits.
+DIAG_NORETURN void diag_fatal(Diagnostics* diag, DiagPhase phase,
+    const char* file, int line, int column, const char* format, ...);
+
+// Writes every message, one per line, in the order they were found
+void diagnostics_print(const Diagnostics* diag, FILE* out);
+
+#endif // !DIAGNOSTICS_H
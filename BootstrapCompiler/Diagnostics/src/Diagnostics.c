@@ -0,0 +1,74 @@
+#include "../Diagnostics.h"
+
+#define DIAG_MESSAGE_MAX 512
+
+void diagnostics_init(Diagnostics* diag) {
+    diag->items = NULL;
+    diag->count = 0;
+    diag->capacity = 0;
+    diag->error_count = 0;
+    diag->bailout = NULL;
+}
+
+void diagnostics_free(Diagnostics* diag) {
+    for (int i = 0; i < diag->count; i++) {
+        free(diag->items[i].file);
+        free(diag->items[i].message);
+    }
+    free(diag->items);
+    diagnostics_init(diag);
+}
+
+static void diag_add(Diagnostics* diag, DiagSeverity severity, DiagPhase phase,
+    const char* file, int line, int column, const char* message) {
+    if (diag->count >= diag->capacity) {
+        diag->capacity = diag->capacity == 0 ? 8 : diag->capacity * 2;
+        diag->items = (Diagnostic*)realloc(diag->items, sizeof(Diagnostic) * diag->capacity);
+    }
+    Diagnostic* item = &diag->items[diag->count++];
+    item->severity = severity;
+    item->phase = phase;
+    item->file = file ? _strdup(file) : NULL;
+    item->line = line;
+    item->column = column;
+    item->message = _strdup(message);
+    if (severity == DIAG_ERROR) diag->error_count++;
+}
+
+void diag_report(Diagnostics* diag, DiagSeverity severity, DiagPhase phase,
+    const char* file, int line, int column, const char* format, ...) {
+    char message[DIAG_MESSAGE_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (!diag) {
+        fprintf(stderr, "%s\n", message);
+        return;
+    }
+    diag_add(diag, severity, phase, file, line, column, message);
+}
+
+void diag_fatal(Diagnostics* diag, DiagPhase phase,
+    const char* file, int line, int column, const char* format, ...) {
+    char message[DIAG_MESSAGE_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (!diag || !diag->bailout) {
+        if (diag) diagnostics_print(diag, stderr);
+        fprintf(stderr, "%s\n", message);
+        exit(1);
+    }
+    diag_add(diag, DIAG_ERROR, phase, file, line, column, message);
+    longjmp(*diag->bailout, 1);
+}
+
+void diagnostics_print(const Diagnostics* diag, FILE* out) {
+    for (int i = 0; i < diag->count; i++) {
+        fprintf(out, "%s\n", diag->items[i].message);
+    }
+}
@@ -1,189 +1,118 @@
 #include "Main.h"
 
-
-/* ====================== AST Printer ====================== */
-
-void print_indent(int indent)
+/* ====================== Options ====================== */
+
+// Everything the driver prints besides diagnostics is opt-in, so a default
+// build only writes the output file
+typedef struct {
+    const char* input_file;
+    const char* output_file;
+    int opt_level;
+    int inline_limit;
+    int dump_pp;          // Source after preprocessing
+    int dump_ast;
+    int dump_asm;         // The final assembly, echoed once it is written
+    int stats;            // Phase timings, sizes and optimizer reports
+    int binary;           // Flat binary from the built-in assembler, not NASM text
+} DriverOptions;
+
+static void print_usage(const char* program)
 {
-    for (int i = 0; i < indent; ++i) printf("  ");
+    fprintf(stderr, "Usage: %s <input.c> -o <output.asm|output.bin> [-O0|-O1] [-finline-limit=N]\n"
+        "       [--bin] [-q] [--dump-pp] [--dump-ast] [--dump-asm] [--stats]\n", program);
 }
 
-const char* node_type_name(Nodes type)
+// Returns 0 if the command line is not usable. -q turns off the dumps and
+// statistics requested before it.
+static int parse_options(int argc, char** argv, DriverOptions* options)
 {
-    switch (type) {
-    case N_PROGRAM: return "PROGRAM";
-    case N_FUNCTION: return "FUNCTION";
-    case N_RETURN: return "RETURN";
-    case N_BLOCK: return "BLOCK";
-    case N_INTLIT: return "INT_LITERAL";
-    case N_STRING_LIT: return "STRING_LITERAL";
-    case N_CHAR_LIT: return "CHAR_LITERAL";
-    case N_IDENT: return "IDENTIFIER";
-    case N_OPERATOR: return "OPERATOR";
-    case N_UNARY: return "UNARY";
-    case N_ASSIGN: return "ASSIGN";
-    case N_DECL: return "DECLARATION";
-    case N_IF: return "IF";
-    case N_WHILE: return "WHILE";
-    case N_FOR: return "FOR";
-    case N_BREAK: return "BREAK";
-    case N_CONTINUE: return "CONTINUE";
-    case N_CALL: return "CALL";
-    case N_ARRAY_ACCESS: return "ARRAY_ACCESS";
-    case N_MEMBER_ACCESS: return "MEMBER_ACCESS";
-    case N_STRUCT_DECL: return "STRUCT_DECL";
-    case N_TYPEDEF: return "TYPEDEF";
-    case N_ENUM_DECL: return "ENUM_DECL";
-    case N_CAST: return "CAST";
-    case N_SIZEOF: return "SIZEOF";
-    case N_TERNARY: return "TERNARY";
-    default: return "UNKNOWN";
+    memset(options, 0, sizeof(DriverOptions));
+    options->inline_limit = INLINE_DEFAULT_LIMIT;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            options->output_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-O") == 0) {
+            options->opt_level = 1;
+        }
+        else if (strncmp(argv[i], "-O", 2) == 0 && isdigit((unsigned char)argv[i][2])) {
+            options->opt_level = atoi(argv[i] + 2);
+        }
+        else if (strncmp(argv[i], "-finline-limit=", 15) == 0 && isdigit((unsigned char)argv[i][15])) {
+            options->inline_limit = atoi(argv[i] + 15);
+        }
+        else if (strcmp(argv[i], "-q") == 0) {
+            options->dump_pp = options->dump_ast = options->dump_asm = options->stats = 0;
+        }
+        else if (strcmp(argv[i], "--dump-pp") == 0) {
+            options->dump_pp = 1;
+        }
+        else if (strcmp(argv[i], "--dump-ast") == 0) {
+            options->dump_ast = 1;
+        }
+        else if (strcmp(argv[i], "--dump-asm") == 0) {
+            options->dump_asm = 1;
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            options->stats = 1;
+        }
+        else if (strcmp(argv[i], "--bin") == 0) {
+            options->binary = 1;
+        }
+        else if (argv[i][0] != '-' && !options->input_file) {
+            options->input_file = argv[i];
+        }
+        else {
+            return 0;
+        }
     }
+    return options->input_file && options->output_file;
 }
 
-void ast_print(AST* node, int indent)
-{
-    if (!node) {
-        print_indent(indent);
-        printf("NULL\n");
-        return;
-    }
+/* ====================== Statistics ====================== */
 
-    print_indent(indent);
-    printf("%s", node_type_name(node->type));
+static const char* phase_names[COMPILER_PHASE_COUNT] = {
+    "preprocess", "tokenize", "parse", "optimize", "codegen"
+};
 
-    switch (node->type) {
-    case N_INTLIT:
-        printf(" %d", node->data.int_lit.value);
-        break;
-    case N_STRING_LIT:
-        printf(" \"%s\"", node->data.string_lit.value);
-        break;
-    case N_CHAR_LIT:
-        printf(" '%c'", node->data.char_lit.value);
-        break;
-    case N_IDENT:
-        printf(" %s", node->data.ident.name);
-        break;
-    case N_OPERATOR:
-        printf(" (op: %d)", node->data.op.op);
-        printf("\n");
-        ast_print(node->data.op.left, indent + 1);
-        ast_print(node->data.op.right, indent + 1);
-        return;
-    case N_UNARY:
-        printf(" (op: %d)", node->data.unary.op);
-        printf("\n");
-        ast_print(node->data.unary.operand, indent + 1);
-        return;
-    case N_ASSIGN:
-        printf(" %s =", node->data.assign.var_name);
-        printf("\n");
-        ast_print(node->data.assign.value, indent + 1);
-        return;
-    case N_DECL:
-        printf(" type=%s name=%s ptr_level=%d",
-            node->data.decl.type, node->data.decl.name, node->data.decl.pointer_level);
-        if (node->data.decl.init_value) {
-            printf(" init=");
-            printf("\n");
-            ast_print(node->data.decl.init_value, indent + 1);
-            return;
-        }
-        break;
-    case N_RETURN:
-        printf("\n");
-        ast_print(node->data.return_stmt.value, indent + 1);
-        return;
-    case N_FUNCTION:
-        printf(" %s %s", node->data.function.return_type, node->data.function.name);
-        printf("\n");
-        print_indent(indent + 1);
-        printf("PARAMS (%zu):\n", node->data.function.param_count);
-        for (size_t i = 0; i < node->data.function.param_count; i++)
-            ast_print(node->data.function.params[i], indent + 2);
-        print_indent(indent + 1);
-        printf("BODY:\n");
-        ast_print(node->data.function.body, indent + 2);
-        return;
-    case N_BLOCK:
-        printf(" (%zu stmts)\n", node->data.block.count);
-        for (size_t i = 0; i < node->data.block.count; i++)
-            ast_print(node->data.block.statements[i], indent + 1);
-        return;
-    case N_IF:
-        printf("\n");
-        print_indent(indent + 1); printf("COND:\n"); ast_print(node->data.if_stmt.condition, indent + 2);
-        print_indent(indent + 1); printf("THEN:\n"); ast_print(node->data.if_stmt.then_block, indent + 2);
-        if (node->data.if_stmt.else_block) {
-            print_indent(indent + 1); printf("ELSE:\n"); ast_print(node->data.if_stmt.else_block, indent + 2);
-        }
-        return;
-    case N_WHILE:
-        printf("\n");
-        print_indent(indent + 1); printf("COND:\n"); ast_print(node->data.while_stmt.condition, indent + 2);
-        print_indent(indent + 1); printf("BODY:\n"); ast_print(node->data.while_stmt.body, indent + 2);
-        return;
-    case N_FOR:
-        printf("\n");
-        print_indent(indent + 1); printf("INIT:\n"); ast_print(node->data.for_stmt.init, indent + 2);
-        print_indent(indent + 1); printf("COND:\n"); ast_print(node->data.for_stmt.condition, indent + 2);
-        print_indent(indent + 1); printf("INCR:\n"); ast_print(node->data.for_stmt.increment, indent + 2);
-        print_indent(indent + 1); printf("BODY:\n"); ast_print(node->data.for_stmt.body, indent + 2);
-        return;
-    case N_CALL:
-        printf(" %s(%zu args)\n", node->data.call.name, node->data.call.arg_count);
-        for (size_t i = 0; i < node->data.call.arg_count; i++)
-            ast_print(node->data.call.args[i], indent + 1);
-        return;
-    case N_STRUCT_DECL:
-        printf(" %s (%zu members)", node->data.struct_decl.name ? node->data.struct_decl.name : "(anon)",
-            node->data.struct_decl.member_count);
-        printf("\n");
-        for (size_t i = 0; i < node->data.struct_decl.member_count; i++)
-            ast_print(node->data.struct_decl.members[i], indent + 1);
-        return;
-    case N_TYPEDEF:
-        printf(" %s -> %s", node->data.typedef_decl.old_name, node->data.typedef_decl.new_name);
-        break;
-    case N_ENUM_DECL:
-        printf(" %s (%zu values)", node->data.enum_decl.name ? node->data.enum_decl.name : "(anon)",
-            node->data.enum_decl.value_count);
-        printf("\n");
-        for (size_t i = 0; i < node->data.enum_decl.value_count; i++)
-            ast_print(node->data.enum_decl.values[i], indent + 1);
-        return;
-    case N_PROGRAM:
-        printf(" (%zu functions, %zu globals)\n", node->data.program.func_count, node->data.program.global_count);
-        for (size_t i = 0; i < node->data.program.func_count; i++)
-            ast_print(node->data.program.functions[i], indent + 1);
-        for (size_t i = 0; i < node->data.program.global_count; i++)
-            ast_print(node->data.program.globals[i], indent + 1);
-        return;
-    default:
-        break;
+static void print_phase_times(const double* times)
+{
+    double total = 0;
+    printf("%-12s %10s\n", "phase", "ms");
+    for (int i = 0; i < COMPILER_PHASE_COUNT; i++) {
+        printf("%-12s %10.2f\n", phase_names[i], times[i]);
+        total += times[i];
     }
-    printf("\n");
+    printf("%-12s %10.2f\n", "total", total);
 }
 
-/* ====================== Main ====================== */
-
-int main(int argc, char** argv)
+static void print_statistics(const CompilerStats* stats, const DriverOptions* options)
 {
-    if (argc != 4 || strcmp(argv[2], "-o") != 0) {
-        fprintf(stderr, "Usage: %s <input.c> -o <output.asm>\n", argv[0]);
-        return 1;
+    const double codegen_ms = stats->phase_ms[COMPILER_PHASE_CODEGEN];
+
+    printf("=== STATISTICS ===\n");
+    print_phase_times(stats->phase_ms);
+    printf("%zu source bytes, %zu after preprocessing, %zu tokens\n",
+        stats->source_bytes, stats->preprocessed_bytes, stats->tokens);
+    printf("%zu assembly lines emitted, %zu written (%zu bytes), %.0f lines/s\n",
+        stats->lines_emitted, stats->lines_written, stats->output_bytes,
+        codegen_ms > 0 ? stats->lines_emitted * 1000.0 / codegen_ms : 0.0);
+    if (options->binary) {
+        printf("%zu instructions encoded into a %zu byte image\n",
+            stats->instructions_encoded, stats->output_bytes);
     }
+    printf("%zu arena bytes used of %zu reserved, %zu names interned\n\n",
+        stats->arena_allocated, stats->arena_reserved, stats->names_interned);
+}
 
-    const char* input_file = argv[1];
-    const char* output_file = argv[3];
+/* ====================== Main ====================== */
 
-    // Read source file
-    FILE* f = fopen(input_file, "rb");
-    if (!f) {
-        fprintf(stderr, "Error: Cannot open input file '%s'\n", input_file);
-        return 1;
-    }
+// Returns the file's contents, or NULL if it cannot be read
+static char* read_source(const char* path, size_t* length)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
     fseek(f, 0, SEEK_END);
     long file_size = ftell(f);
     fseek(f, 0, SEEK_SET);
@@ -192,131 +121,93 @@ int main(int argc, char** argv)
     if (!src) {
         fclose(f);
         fprintf(stderr, "Error: Out of memory\n");
-        return 1;
+        exit(1);
     }
-    fread(src, 1, file_size, f);
+    *length = fread(src, 1, file_size, f);
     fclose(f);
-    src[file_size] = '\0';
-
-    // PREPROCESS - handle #include and #define
-    printf("=== PREPROCESSING ===\n");
+    src[*length] = '\0';
+    return src;
+}
 
-    // Extract base directory from input file path
-    char base_dir[512] = ".";
+// Includes are looked up next to the input file
+static void input_directory(const char* input_file, char* base_dir, size_t size)
+{
     const char* last_slash = strrchr(input_file, '/');
     const char* last_backslash = strrchr(input_file, '\\');
     const char* separator = last_slash > last_backslash ? last_slash : last_backslash;
 
+    snprintf(base_dir, size, ".");
     if (separator) {
         size_t dir_len = separator - input_file;
-        if (dir_len < sizeof(base_dir)) {
+        if (dir_len < size) {
             memcpy(base_dir, input_file, dir_len);
             base_dir[dir_len] = '\0';
         }
     }
+}
 
-    char* preprocessed = preprocess(src, base_dir);
-    free(src);
-
-    if (!preprocessed) {
-        fprintf(stderr, "Preprocessing failed\n");
+int main(int argc, char** argv)
+{
+    DriverOptions options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
         return 1;
     }
 
-    printf("=== SOURCE CODE (after preprocessing) ===\n%s\n", preprocessed);
-
-    // Tokenize the preprocessed source
-    Scanner* scanner = scanner_create(preprocessed);
-    size_t capacity = 128;
-    size_t token_count = 0;
-    Token** token_ptrs = (Token**)malloc(capacity * sizeof(Token*));
-
-    Token* temp;
-    while (1) {
-        temp = tokenize(scanner);
-
-        if (token_count >= capacity) {
-            capacity *= 2;
-            token_ptrs = (Token**)realloc(token_ptrs, capacity * sizeof(Token*));
-        }
-
-        token_ptrs[token_count++] = temp;
-
-        if (temp->type == TOKEN_EOF || temp->type == TOKEN_ERROR) {
-            break;
-        }
-    }
-
-    scanner_free(scanner);
-
-    if (token_ptrs[token_count - 1]->type == TOKEN_ERROR) {
-        fprintf(stderr, "Tokenization failed at line %d, column %d\n",
-            token_ptrs[token_count - 1]->line,
-            token_ptrs[token_count - 1]->column);
-        fprintf(stderr, "Error token: '%s'\n",
-            token_ptrs[token_count - 1]->word ? token_ptrs[token_count - 1]->word : "(null)");
-
-        for (size_t i = 0; i < token_count; i++) {
-            token_free(token_ptrs[i]);
-        }
-        free(token_ptrs);
-        free(preprocessed);
+    size_t source_length;
+    char* src = read_source(options.input_file, &source_length);
+    if (!src) {
+        fprintf(stderr, "Error: Cannot open input file '%s'\n", options.input_file);
         return 1;
     }
 
-    printf("Successfully tokenized %zu tokens!\n\n", token_count);
+    char base_dir[512];
+    input_directory(options.input_file, base_dir, sizeof(base_dir));
+
+    CompilerOptions compile;
+    compiler_options_init(&compile);
+    compile.base_dir = base_dir;
+    compile.opt_level = options.opt_level;
+    compile.inline_limit = options.inline_limit;
+    compile.format = options.binary ? COMPILER_OUTPUT_BINARY : COMPILER_OUTPUT_ASSEMBLY;
+    compile.keep_listing = options.dump_asm;
+    compile.report = stdout;
+    compile.dump_preprocessed = options.dump_pp;
+    compile.dump_ast = options.dump_ast;
+    compile.print_reports = options.stats;
+
+    CompilerResult* result = compiler_compile(src, source_length, &compile);
+    free(src);
 
-    // Parse
-    Token* tokens = (Token*)malloc(token_count * sizeof(Token));
-    for (size_t i = 0; i < token_count; i++) {
-        tokens[i] = *token_ptrs[i];
+    for (int i = 0; i < compiler_diagnostic_count(result); i++) {
+        fprintf(stderr, "%s\n", compiler_diagnostic(result, i)->message);
     }
-
-    Parser* parser = parser_create(tokens, token_count);
-    AST* program = parse_program(parser);
-    parser_free(parser);
-
-    printf("=== AST DUMP ===\n");
-    ast_print(program, 0);
-    printf("\n");
-
-    // Generate code
-    printf("=== CODE GENERATION ===\n");
-    CodeGen* cg = codegen_create(output_file, TARGET_X86_64_PE);
-    if (!cg) {
-        fprintf(stderr, "Failed to create code generator\n");
+    if (!compiler_succeeded(result)) {
+        compiler_result_free(result);
         return 1;
     }
 
-    codegen_program(cg, program);
-    codegen_free(cg);
-
-    printf("Generated assembly written to: %s\n\n", output_file);
-
-    // Read and display the generated assembly
-    printf("=== GENERATED ASSEMBLY ===\n");
-    FILE* asm_file = fopen(output_file, "r");
-    if (asm_file) {
-        char line[512];
-        while (fgets(line, sizeof(line), asm_file)) {
-            printf("%s", line);
-        }
-        fclose(asm_file);
-    }
-    else {
-        fprintf(stderr, "Could not open %s for reading\n", output_file);
+    // Text mode would translate newline bytes inside a binary image
+    size_t output_size;
+    const char* output = compiler_output(result, &output_size);
+    FILE* out = fopen(options.output_file, options.binary ? "wb" : "w");
+    if (!out) {
+        fprintf(stderr, "Failed to open output file: %s\n", options.output_file);
+        compiler_result_free(result);
+        return 1;
     }
+    fwrite(output, 1, output_size, out);
+    fclose(out);
 
-    // Cleanup
-    for (size_t i = 0; i < token_count; i++) {
-        token_free(token_ptrs[i]);
-    }
-    free(token_ptrs);
-    free(tokens);
-    ast_free(program);
-    free(preprocessed);
+    if (options.stats) print_statistics(compiler_stats(result), &options);
 
-    printf("\n=== COMPILATION COMPLETE ===\n");
+    if (options.dump_asm) {
+        size_t listing_size;
+        const char* listing = compiler_listing(result, &listing_size);
+        printf("=== GENERATED ASSEMBLY ===\n");
+        if (listing) fwrite(listing, 1, listing_size, stdout);
+    }
 
+    compiler_result_free(result);
     return 0;
-}
\ No newline at end of file
+}
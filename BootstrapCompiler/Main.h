@@ -2,8 +2,8 @@
 #ifndef MAIN_H
 #define MAIN_H
 
-#include "Codegen/Codegen.h"
-#include "Tokenizer/Preprocessor/Preprocessor.h"
+#include "Compiler/Compiler.h"
+#include "Optimizer/Optimizer.h"
 
 int main(int argc, char** argv);
 
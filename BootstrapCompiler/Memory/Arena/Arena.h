@@ -0,0 +1,33 @@
+#pragma once
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "../../Includes.h"
+
+#define ARENA_DEFAULT_BLOCK (64 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump allocator for objects that live as long as one compilation, such as
+// the AST and interned names. Nothing is freed individually; arena_destroy
+// releases everything at once.
+typedef struct {
+    ArenaBlock* head;
+    size_t block_size;
+    size_t allocated;     // Bytes handed out, for reports
+    size_t reserved;      // Bytes obtained from malloc
+} Arena;
+
+Arena* arena_create(size_t block_size);
+void arena_destroy(Arena* arena);
+
+// Memory is aligned for any scalar type and never zeroed
+void* arena_alloc(Arena* arena, size_t size);
+
+// Grows an allocation of old_size bytes, in place when it was the last one
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+
+char* arena_strdup(Arena* arena, const char* s);
+char* arena_strndup(Arena* arena, const char* s, size_t len);
+
+#endif // !ARENA_H
@@ -0,0 +1,109 @@
+#include "../Arena.h"
+
+#define ARENA_ALIGN 8
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t size;
+    size_t used;
+    size_t last;          // Offset of the most recent allocation
+};
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static char* block_data(ArenaBlock* block) {
+    return (char*)block + align_up(sizeof(ArenaBlock));
+}
+
+static ArenaBlock* arena_new_block(Arena* arena, size_t size) {
+    ArenaBlock* block = (ArenaBlock*)malloc(align_up(sizeof(ArenaBlock)) + size);
+    if (!block) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    block->size = size;
+    block->used = 0;
+    block->last = 0;
+    arena->reserved += size;
+    return block;
+}
+
+Arena* arena_create(size_t block_size) {
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+    arena->allocated = 0;
+    arena->reserved = 0;
+    arena->head = arena_new_block(arena, arena->block_size);
+    arena->head->next = NULL;
+    return arena;
+}
+
+void arena_destroy(Arena* arena) {
+    if (!arena) return;
+    ArenaBlock* block = arena->head;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = align_up(size ? size : 1);
+    arena->allocated += size;
+
+    ArenaBlock* head = arena->head;
+    if (head->used + size <= head->size) {
+        head->last = head->used;
+        head->used += size;
+        return block_data(head) + head->last;
+    }
+
+    // Large requests get their own block behind the head so the rest of
+    // the current block stays usable
+    if (size > arena->block_size / 4) {
+        ArenaBlock* block = arena_new_block(arena, size);
+        block->used = size;
+        block->next = head->next;
+        head->next = block;
+        return block_data(block);
+    }
+
+    ArenaBlock* block = arena_new_block(arena, arena->block_size);
+    block->next = head;
+    arena->head = block;
+    block->used = size;
+    return block_data(block);
+}
+
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(arena, new_size);
+    if (new_size <= old_size) return ptr;
+
+    ArenaBlock* head = arena->head;
+    if ((char*)ptr == block_data(head) + head->last &&
+        head->last + align_up(new_size) <= head->size) {
+        size_t extra = align_up(new_size) - (head->used - head->last);
+        head->used += extra;
+        arena->allocated += extra;
+        return ptr;
+    }
+
+    void* copy = arena_alloc(arena, new_size);
+    memcpy(copy, ptr, old_size);
+    return copy;
+}
+
+char* arena_strndup(Arena* arena, const char* s, size_t len) {
+    char* copy = (char*)arena_alloc(arena, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char* arena_strdup(Arena* arena, const char* s) {
+    return arena_strndup(arena, s, strlen(s));
+}
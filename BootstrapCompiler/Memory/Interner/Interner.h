@@ -0,0 +1,30 @@
+#pragma once
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include "../../Includes.h"
+#include "../Arena/Arena.h"
+
+// One stored copy of every distinct name seen by a compilation. Interning
+// the same text twice yields the same pointer, so interned strings can be
+// compared with ==. The strings are NUL-terminated, must not be modified,
+// and live until interner_destroy.
+typedef struct {
+    Arena* storage;
+    const char** slots;
+    unsigned int* hashes;
+    size_t capacity;      // Power of two
+    size_t count;
+} Interner;
+
+Interner* interner_create(void);
+void interner_destroy(Interner* interner);
+
+// text need not be NUL-terminated
+const char* intern(Interner* interner, const char* text, size_t len);
+const char* intern_cstr(Interner* interner, const char* s);
+
+// The interned copy of text, or NULL if it has never been interned
+const char* interner_find(const Interner* interner, const char* text, size_t len);
+
+#endif // !INTERNER_H
@@ -0,0 +1,87 @@
+#include "../Interner.h"
+#include "../../NameTable/NameTable.h"
+
+#define INTERNER_MIN_CAPACITY 1024
+
+Interner* interner_create(void) {
+    Interner* interner = (Interner*)malloc(sizeof(Interner));
+    interner->storage = arena_create(0);
+    interner->capacity = INTERNER_MIN_CAPACITY;
+    interner->count = 0;
+    interner->slots = (const char**)calloc(interner->capacity, sizeof(const char*));
+    interner->hashes = (unsigned int*)malloc(interner->capacity * sizeof(unsigned int));
+    if (!interner->slots || !interner->hashes) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    return interner;
+}
+
+void interner_destroy(Interner* interner) {
+    if (!interner) return;
+    arena_destroy(interner->storage);
+    free(interner->slots);
+    free(interner->hashes);
+    free(interner);
+}
+
+static size_t find_slot(const Interner* interner, const char* text, size_t len, unsigned int hash) {
+    size_t mask = interner->capacity - 1;
+    size_t i = hash & mask;
+    while (interner->slots[i]) {
+        const char* s = interner->slots[i];
+        if (interner->hashes[i] == hash && strncmp(s, text, len) == 0 && s[len] == '\0') break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void interner_grow(Interner* interner) {
+    const char** old_slots = interner->slots;
+    unsigned int* old_hashes = interner->hashes;
+    size_t old_capacity = interner->capacity;
+
+    interner->capacity *= 2;
+    interner->slots = (const char**)calloc(interner->capacity, sizeof(const char*));
+    interner->hashes = (unsigned int*)malloc(interner->capacity * sizeof(unsigned int));
+    if (!interner->slots || !interner->hashes) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    size_t mask = interner->capacity - 1;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (!old_slots[i]) continue;
+        size_t slot = old_hashes[i] & mask;
+        while (interner->slots[slot]) slot = (slot + 1) & mask;
+        interner->slots[slot] = old_slots[i];
+        interner->hashes[slot] = old_hashes[i];
+    }
+
+    free(old_slots);
+    free(old_hashes);
+}
+
+const char* intern(Interner* interner, const char* text, size_t len) {
+    unsigned int hash = name_hash_bytes(text, len);
+    size_t slot = find_slot(interner, text, len, hash);
+    if (interner->slots[slot]) return interner->slots[slot];
+
+    const char* copy = arena_strndup(interner->storage, text, len);
+    interner->slots[slot] = copy;
+    interner->hashes[slot] = hash;
+    interner->count++;
+
+    // Keep the load factor at or below 1/2
+    if (interner->count * 2 > interner->capacity) interner_grow(interner);
+    return copy;
+}
+
+const char* intern_cstr(Interner* interner, const char* s) {
+    return intern(interner, s, strlen(s));
+}
+
+const char* interner_find(const Interner* interner, const char* text, size_t len) {
+    size_t slot = find_slot(interner, text, len, name_hash_bytes(text, len));
+    return interner->slots[slot];
+}
@@ -0,0 +1,31 @@
+#pragma once
+#ifndef NAMETABLE_H
+#define NAMETABLE_H
+
+#include "../../Includes.h"
+
+// Open-addressing map from a name to an int, typically an index into the
+// array that owns the named records. Keys are not copied and must outlive
+// their entries.
+typedef struct {
+    const char** keys;
+    unsigned int* hashes;
+    int* values;
+    size_t capacity;      // Power of two, 0 until the first insert
+    size_t count;
+} NameTable;
+
+void name_table_init(NameTable* table);
+void name_table_free(NameTable* table);
+
+unsigned int name_hash(const char* name);
+unsigned int name_hash_bytes(const char* text, size_t len);
+
+// Value stored for name, or missing if there is none
+int name_table_get(const NameTable* table, const char* name, int missing);
+
+// Inserts name or replaces its value
+void name_table_put(NameTable* table, const char* name, int value);
+void name_table_remove(NameTable* table, const char* name);
+
+#endif // !NAMETABLE_H
@@ -0,0 +1,116 @@
+#include "../NameTable.h"
+
+#define NAME_TABLE_MIN_CAPACITY 16
+
+void name_table_init(NameTable* table) {
+    memset(table, 0, sizeof(*table));
+}
+
+void name_table_free(NameTable* table) {
+    free(table->keys);
+    free(table->hashes);
+    free(table->values);
+    memset(table, 0, sizeof(*table));
+}
+
+// FNV-1a
+unsigned int name_hash(const char* name) {
+    unsigned int hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+unsigned int name_hash_bytes(const char* text, size_t len) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Slot holding name, or the empty slot where it would go
+static size_t find_slot(const NameTable* table, const char* name, unsigned int hash) {
+    size_t mask = table->capacity - 1;
+    size_t i = hash & mask;
+    while (table->keys[i]) {
+        // Interned names match by pointer; others fall back to comparing text
+        if (table->keys[i] == name ||
+            (table->hashes[i] == hash && strcmp(table->keys[i], name) == 0)) break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void name_table_grow(NameTable* table) {
+    NameTable old = *table;
+    table->capacity = old.capacity ? old.capacity * 2 : NAME_TABLE_MIN_CAPACITY;
+    table->keys = (const char**)calloc(table->capacity, sizeof(const char*));
+    table->hashes = (unsigned int*)malloc(table->capacity * sizeof(unsigned int));
+    table->values = (int*)malloc(table->capacity * sizeof(int));
+    if (!table->keys || !table->hashes || !table->values) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < old.capacity; i++) {
+        if (!old.keys[i]) continue;
+        size_t slot = find_slot(table, old.keys[i], old.hashes[i]);
+        table->keys[slot] = old.keys[i];
+        table->hashes[slot] = old.hashes[i];
+        table->values[slot] = old.values[i];
+    }
+
+    free(old.keys);
+    free(old.hashes);
+    free(old.values);
+}
+
+int name_table_get(const NameTable* table, const char* name, int missing) {
+    if (table->count == 0) return missing;
+    size_t slot = find_slot(table, name, name_hash(name));
+    return table->keys[slot] ? table->values[slot] : missing;
+}
+
+void name_table_put(NameTable* table, const char* name, int value) {
+    // Keep the load factor at or below 1/2
+    if ((table->count + 1) * 2 > table->capacity) name_table_grow(table);
+
+    unsigned int hash = name_hash(name);
+    size_t slot = find_slot(table, name, hash);
+    if (!table->keys[slot]) {
+        table->keys[slot] = name;
+        table->hashes[slot] = hash;
+        table->count++;
+    }
+    table->values[slot] = value;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones
+void name_table_remove(NameTable* table, const char* name) {
+    if (table->count == 0) return;
+    size_t mask = table->capacity - 1;
+    size_t hole = find_slot(table, name, name_hash(name));
+    if (!table->keys[hole]) return;
+
+    size_t i = hole;
+    while (1) {
+        i = (i + 1) & mask;
+        if (!table->keys[i]) break;
+
+        // An entry may move back into the hole only if its home slot is
+        // not cyclically between the hole and where it sits now
+        size_t home = table->hashes[i] & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table->keys[hole] = table->keys[i];
+            table->hashes[hole] = table->hashes[i];
+            table->values[hole] = table->values[i];
+            hole = i;
+        }
+    }
+    table->keys[hole] = NULL;
+    table->count--;
+}
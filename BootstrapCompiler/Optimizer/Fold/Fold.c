@@ -0,0 +1,469 @@
+#include "../Optimizer.h"
+#include "../../Memory/NameTable/NameTable.h"
+#include <limits.h>
+
+/* ====================== Tree Rewriting ====================== */
+
+// Nodes live in the compilation arena, so the subtrees these drop are
+// simply left behind
+
+static void fold_to_intlit(AST* node, int value) {
+    node->type = N_INTLIT;
+    node->data.int_lit.value = value;
+}
+
+static void fold_to_child(AST* node, AST* child) {
+    *node = *child;
+}
+
+static void fold_to_empty_block(AST* node) {
+    node->type = N_BLOCK;
+    node->data.block.statements = NULL;
+    node->data.block.count = 0;
+    node->data.block.capacity = 0;
+}
+
+static int is_const(AST* node, int* value) {
+    if (!node) return 0;
+    if (node->type == N_INTLIT) {
+        *value = node->data.int_lit.value;
+        return 1;
+    }
+    if (node->type == N_CHAR_LIT) {
+        // Codegen loads chars zero-extended
+        *value = (unsigned char)node->data.char_lit.value;
+        return 1;
+    }
+    return 0;
+}
+
+static int is_const_value(AST* node, int expected) {
+    int value;
+    return is_const(node, &value) && value == expected;
+}
+
+/* ====================== Evaluation ====================== */
+
+// Evaluates op with the 32-bit semantics codegen uses. Returns 0 when the
+// result is not known at compile time (division by zero, overflow traps,
+// assignments)
+static int eval_binary(Tokens op, int a, int b, int* out) {
+    unsigned int ua = (unsigned int)a;
+    unsigned int ub = (unsigned int)b;
+
+    switch (op) {
+    case TOKEN_PLUS:          *out = (int)(ua + ub); return 1;
+    case TOKEN_MINUS:         *out = (int)(ua - ub); return 1;
+    case TOKEN_STAR:          *out = (int)(ua * ub); return 1;
+    case TOKEN_SLASH:
+        if (b == 0 || (a == INT_MIN && b == -1)) return 0;
+        *out = a / b;
+        return 1;
+    case TOKEN_PERCENT:
+        if (b == 0 || (a == INT_MIN && b == -1)) return 0;
+        *out = a % b;
+        return 1;
+    // x86 masks shift counts to five bits
+    case TOKEN_LSHIFT:        *out = (int)(ua << (b & 31)); return 1;
+    case TOKEN_RSHIFT:        *out = a >> (b & 31); return 1;
+    case TOKEN_AMPERSAND:     *out = a & b; return 1;
+    case TOKEN_PIPE:          *out = a | b; return 1;
+    case TOKEN_CARET:         *out = a ^ b; return 1;
+    case TOKEN_EQUAL:         *out = a == b; return 1;
+    case TOKEN_NOT_EQUAL:     *out = a != b; return 1;
+    case TOKEN_LESS:          *out = a < b; return 1;
+    case TOKEN_GREATER:       *out = a > b; return 1;
+    case TOKEN_LESS_EQUAL:    *out = a <= b; return 1;
+    case TOKEN_GREATER_EQUAL: *out = a >= b; return 1;
+    case TOKEN_AND:           *out = a != 0 && b != 0; return 1;
+    case TOKEN_OR:            *out = a != 0 || b != 0; return 1;
+    default:                  return 0;
+    }
+}
+
+static int eval_unary(Tokens op, int a, int* out) {
+    switch (op) {
+    case TOKEN_MINUS:   *out = (int)(0u - (unsigned int)a); return 1;
+    case TOKEN_TILDE:   *out = ~a; return 1;
+    case TOKEN_EXCLAIM: *out = !a; return 1;
+    default:            return 0;
+    }
+}
+
+// Matches what codegen_expression emits for N_SIZEOF
+static int sizeof_value(AST* node) {
+    Type* type = node->data.sizeof_expr.type;
+    return type ? type->size : 4;
+}
+
+int optimize_const_value(AST* expr, int* value) {
+    int a, b;
+    if (is_const(expr, value)) return 1;
+    if (!expr) return 0;
+
+    switch (expr->type) {
+    case N_OPERATOR:
+        return optimize_const_value(expr->data.op.left, &a) &&
+            optimize_const_value(expr->data.op.right, &b) &&
+            eval_binary(expr->data.op.op, a, b, value);
+    case N_UNARY:
+        return optimize_const_value(expr->data.unary.operand, &a) &&
+            eval_unary(expr->data.unary.op, a, value);
+    case N_CAST:
+        return optimize_const_value(expr->data.cast.expr, value);
+    case N_SIZEOF:
+        *value = sizeof_value(expr);
+        return 1;
+    case N_TERNARY:
+        if (!optimize_const_value(expr->data.ternary.condition, &a)) return 0;
+        return optimize_const_value(a ? expr->data.ternary.true_expr
+            : expr->data.ternary.false_expr, value);
+    default:
+        return 0;
+    }
+}
+
+/* ====================== Simplification ====================== */
+
+// x+0, 0+x, x-0, x*1, 1*x, x/1, x<<0, x>>0, x&-1, -1&x, x|0, 0|x, x^0, 0^x
+static int simplify_identity(AST* node) {
+    Tokens op = node->data.op.op;
+    AST** left = &node->data.op.left;
+    AST** right = &node->data.op.right;
+
+    int right_neutral = 0;
+    int left_neutral = 0;
+
+    switch (op) {
+    case TOKEN_PLUS:
+    case TOKEN_PIPE:
+    case TOKEN_CARET:
+        right_neutral = is_const_value(*right, 0);
+        left_neutral = is_const_value(*left, 0);
+        break;
+    case TOKEN_MINUS:
+    case TOKEN_LSHIFT:
+    case TOKEN_RSHIFT:
+        right_neutral = is_const_value(*right, 0);
+        break;
+    case TOKEN_STAR:
+        right_neutral = is_const_value(*right, 1);
+        left_neutral = is_const_value(*left, 1);
+        break;
+    case TOKEN_SLASH:
+        right_neutral = is_const_value(*right, 1);
+        break;
+    case TOKEN_AMPERSAND:
+        right_neutral = is_const_value(*right, -1);
+        left_neutral = is_const_value(*left, -1);
+        break;
+    default:
+        break;
+    }
+
+    if (right_neutral) {
+        fold_to_child(node, *left);
+        return 1;
+    }
+    if (left_neutral) {
+        fold_to_child(node, *right);
+        return 1;
+    }
+    return 0;
+}
+
+/* ====================== Read-only Globals ====================== */
+
+// A global the program only ever reads, such as the stdlib's VGA_WIDTH
+typedef struct {
+    const char* name;
+    int value;          // Constant initializer
+    int written;        // Assigned, incremented, address-taken or named in asm
+    int shadowed;       // A local or parameter of the current function has its name
+} ConstGlobal;
+
+typedef struct {
+    FoldStats* stats;
+    ConstGlobal* globals;
+    size_t global_count;
+    size_t global_capacity;
+    NameTable global_index;   // Name to index into globals
+} Folder;
+
+static ConstGlobal* find_global(Folder* f, const char* name) {
+    int index = name_table_get(&f->global_index, name, -1);
+    return index < 0 ? NULL : &f->globals[index];
+}
+
+// Codegen reads a plain signed int global as exactly its stored bits; other
+// types load with an extension or carry pointer scaling a literal would lose
+static int is_foldable_global(AST* decl, int* value) {
+    Type* type = decl->data.decl.type;
+    return type && type->kind == TYPE_INT && !type->is_unsigned &&
+        !decl->data.decl.is_unsigned && !decl->data.decl.is_extern &&
+        !decl->data.decl.is_volatile && decl->data.decl.pointer_level == 0 &&
+        !decl->data.decl.array_size && is_const(decl->data.decl.init_value, value);
+}
+
+static void add_global(Folder* f, AST* decl) {
+    const char* name = decl->data.decl.name;
+    ConstGlobal* seen = find_global(f, name);
+    int value;
+
+    // A second declaration may be the extern or tentative one; trust neither
+    if (seen) {
+        seen->written = 1;
+        return;
+    }
+    if (f->global_count >= f->global_capacity) {
+        f->global_capacity = f->global_capacity == 0 ? 16 : f->global_capacity * 2;
+        f->globals = (ConstGlobal*)realloc(f->globals, sizeof(ConstGlobal) * f->global_capacity);
+    }
+    ConstGlobal* global = &f->globals[f->global_count];
+    global->name = name;
+    global->value = 0;
+    global->written = !is_foldable_global(decl, &value);
+    global->shadowed = 0;
+    if (!global->written) global->value = value;
+    name_table_put(&f->global_index, name, (int)f->global_count);
+    f->global_count++;
+}
+
+static void mark_written_name(Folder* f, const char* name) {
+    ConstGlobal* global = find_global(f, name);
+    if (global) global->written = 1;
+}
+
+static void mark_written_ident(Folder* f, AST* node) {
+    if (node && node->type == N_IDENT) mark_written_name(f, node->data.ident.name);
+}
+
+static void find_writes(AST* node, void* ctx) {
+    Folder* f = (Folder*)ctx;
+
+    switch (node->type) {
+    case N_ASSIGN:
+        mark_written_name(f, node->data.assign.var_name);
+        break;
+    case N_OPERATOR:
+        switch (node->data.op.op) {
+        case TOKEN_ASSIGN:
+        case TOKEN_PLUS_ASSIGN:
+        case TOKEN_MINUS_ASSIGN:
+        case TOKEN_STAR_ASSIGN:
+        case TOKEN_SLASH_ASSIGN:
+            mark_written_ident(f, node->data.op.left);
+            break;
+        default:
+            break;
+        }
+        break;
+    case N_UNARY:
+        if (node->data.unary.op == TOKEN_PLUS_PLUS || node->data.unary.op == TOKEN_MINUS_MINUS ||
+            node->data.unary.op == TOKEN_AMPERSAND) {
+            mark_written_ident(f, node->data.unary.operand);
+        }
+        break;
+    case N_ASM:
+        // Inline asm may store to any global it names
+        for (size_t i = 0; i < f->global_count; i++) {
+            if (strstr(node->data.asm_stmt.assembly_code, f->globals[i].name)) {
+                f->globals[i].written = 1;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    visit_children(node, find_writes, ctx);
+}
+
+static void find_shadows(AST* node, void* ctx) {
+    Folder* f = (Folder*)ctx;
+    if (node->type == N_DECL) {
+        ConstGlobal* global = find_global(f, node->data.decl.name);
+        if (global) global->shadowed = 1;
+    }
+    visit_children(node, find_shadows, ctx);
+}
+
+// Substitution is per function rather than per scope, so a function that
+// reuses a global's name anywhere keeps loading that global
+static void mark_shadows(Folder* f, AST* func) {
+    for (size_t i = 0; i < f->global_count; i++) {
+        f->globals[i].shadowed = 0;
+    }
+    for (size_t i = 0; i < func->data.function.param_count; i++) {
+        find_shadows(func->data.function.params[i], f);
+    }
+    if (func->data.function.body) find_shadows(func->data.function.body, f);
+}
+
+// Records the program's globals, then rules out every one that is written
+static void collect_globals(Folder* f, AST* program) {
+    ProgramNode* prog = &program->data.program;
+
+    for (size_t i = 0; i < prog->global_count; i++) {
+        if (prog->globals[i]->type == N_DECL) add_global(f, prog->globals[i]);
+    }
+    for (size_t i = 0; i < prog->global_count; i++) {
+        find_writes(prog->globals[i], f);
+    }
+    for (size_t i = 0; i < prog->func_count; i++) {
+        AST* func = prog->functions[i];
+        for (size_t j = 0; j < func->data.function.param_count; j++) {
+            find_writes(func->data.function.params[j], f);
+        }
+        if (func->data.function.body) find_writes(func->data.function.body, f);
+    }
+}
+
+/* ====================== Tree Walk ====================== */
+
+static void fold_node(AST* node, Folder* f);
+
+static void fold_list(AST** nodes, size_t count, Folder* f) {
+    for (size_t i = 0; i < count; i++) {
+        fold_node(nodes[i], f);
+    }
+}
+
+static void fold_node(AST* node, Folder* f) {
+    if (!node) return;
+
+    FoldStats* stats = f->stats;
+
+    int a, b, result;
+
+    switch (node->type) {
+    case N_IDENT: {
+        ConstGlobal* global = find_global(f, node->data.ident.name);
+        if (global && !global->written && !global->shadowed) {
+            fold_to_intlit(node, global->value);
+            stats->globals++;
+        }
+        break;
+    }
+
+    case N_OPERATOR:
+        fold_node(node->data.op.left, f);
+        fold_node(node->data.op.right, f);
+        if (is_const(node->data.op.left, &a) && is_const(node->data.op.right, &b) &&
+            eval_binary(node->data.op.op, a, b, &result)) {
+            fold_to_intlit(node, result);
+            stats->folded++;
+        }
+        else if (simplify_identity(node)) {
+            stats->simplified++;
+        }
+        break;
+
+    case N_UNARY:
+        fold_node(node->data.unary.operand, f);
+        if (is_const(node->data.unary.operand, &a) &&
+            eval_unary(node->data.unary.op, a, &result)) {
+            fold_to_intlit(node, result);
+            stats->folded++;
+        }
+        break;
+
+    case N_CAST:
+        // Casts do not change the bits in this compiler
+        fold_node(node->data.cast.expr, f);
+        if (is_const(node->data.cast.expr, &a)) {
+            fold_to_intlit(node, a);
+            stats->folded++;
+        }
+        break;
+
+    case N_SIZEOF:
+        fold_to_intlit(node, sizeof_value(node));
+        stats->folded++;
+        break;
+
+    case N_TERNARY:
+        fold_node(node->data.ternary.condition, f);
+        fold_node(node->data.ternary.true_expr, f);
+        fold_node(node->data.ternary.false_expr, f);
+        if (is_const(node->data.ternary.condition, &a)) {
+            fold_to_child(node, a ? node->data.ternary.true_expr
+                : node->data.ternary.false_expr);
+            stats->folded++;
+        }
+        break;
+
+    case N_ASSIGN:
+        fold_node(node->data.assign.value, f);
+        break;
+    case N_DECL:
+        fold_node(node->data.decl.init_value, f);
+        fold_node(node->data.decl.array_size, f);
+        break;
+    case N_RETURN:
+        fold_node(node->data.return_stmt.value, f);
+        break;
+    case N_BLOCK:
+        fold_list(node->data.block.statements, node->data.block.count, f);
+        break;
+    case N_FUNCTION:
+        mark_shadows(f, node);
+        fold_node(node->data.function.body, f);
+        break;
+    case N_IF:
+        fold_node(node->data.if_stmt.condition, f);
+        fold_node(node->data.if_stmt.then_block, f);
+        fold_node(node->data.if_stmt.else_block, f);
+        // Constant conditions show up once inlined arguments are substituted
+        if (is_const(node->data.if_stmt.condition, &a)) {
+            AST* taken = a ? node->data.if_stmt.then_block : node->data.if_stmt.else_block;
+            if (taken) fold_to_child(node, taken);
+            else fold_to_empty_block(node);
+            stats->folded++;
+        }
+        break;
+    case N_WHILE:
+        fold_node(node->data.while_stmt.condition, f);
+        fold_node(node->data.while_stmt.body, f);
+        break;
+    case N_FOR:
+        fold_node(node->data.for_stmt.init, f);
+        fold_node(node->data.for_stmt.condition, f);
+        fold_node(node->data.for_stmt.increment, f);
+        fold_node(node->data.for_stmt.body, f);
+        break;
+    case N_CALL:
+        fold_list(node->data.call.args, node->data.call.arg_count, f);
+        break;
+    case N_ARRAY_ACCESS:
+        fold_node(node->data.array_access.array, f);
+        fold_node(node->data.array_access.index, f);
+        break;
+    case N_MEMBER_ACCESS:
+        fold_node(node->data.member_access.object, f);
+        break;
+    case N_INLINE:
+        fold_node(node->data.inline_call.body, f);
+        break;
+    default:
+        break;
+    }
+}
+
+void optimize_fold_constants(AST* program, FoldStats* stats) {
+    stats->folded = 0;
+    stats->simplified = 0;
+    stats->globals = 0;
+
+    Folder f = { 0 };
+    f.stats = stats;
+    name_table_init(&f.global_index);
+
+    // Initializers first, so `int x = -1;` counts as a constant
+    ProgramNode* prog = &program->data.program;
+    fold_list(prog->globals, prog->global_count, &f);
+    collect_globals(&f, program);
+    fold_list(prog->functions, prog->func_count, &f);
+
+    name_table_free(&f.global_index);
+    free(f.globals);
+}
@@ -0,0 +1,518 @@
+#include "../Optimizer.h"
+#include "../../Memory/NameTable/NameTable.h"
+
+// Later rounds pick up callees that became call-free once their own calls
+// were inlined; the cap also bounds mutually recursive `inline` functions
+#define INLINE_ROUNDS 3
+
+/* ====================== Tree Copying ====================== */
+
+static AST* clone_node(Arena* arena, AST* node);
+
+static AST** clone_list(Arena* arena, AST** nodes, size_t count) {
+    if (count == 0) return NULL;
+    AST** copy = (AST**)arena_alloc(arena, sizeof(AST*) * count);
+    for (size_t i = 0; i < count; i++) {
+        copy[i] = clone_node(arena, nodes[i]);
+    }
+    return copy;
+}
+
+// Deep copy of a function body's nodes; strings are never modified in
+// place, so the copy shares them. measure_node rejects the node types not
+// covered.
+static AST* clone_node(Arena* arena, AST* node) {
+    if (!node) return NULL;
+
+    AST* copy = (AST*)arena_alloc(arena, sizeof(AST));
+    *copy = *node;
+
+    switch (node->type) {
+    case N_OPERATOR:
+        copy->data.op.left = clone_node(arena, node->data.op.left);
+        copy->data.op.right = clone_node(arena, node->data.op.right);
+        break;
+    case N_UNARY:
+        copy->data.unary.operand = clone_node(arena, node->data.unary.operand);
+        break;
+    case N_ASSIGN:
+        copy->data.assign.value = clone_node(arena, node->data.assign.value);
+        break;
+    case N_DECL:
+        copy->data.decl.init_value = clone_node(arena, node->data.decl.init_value);
+        copy->data.decl.array_size = clone_node(arena, node->data.decl.array_size);
+        break;
+    case N_RETURN:
+        copy->data.return_stmt.value = clone_node(arena, node->data.return_stmt.value);
+        break;
+    case N_BLOCK:
+        copy->data.block.statements = clone_list(arena, node->data.block.statements,
+            node->data.block.count);
+        copy->data.block.capacity = node->data.block.count;
+        break;
+    case N_IF:
+        copy->data.if_stmt.condition = clone_node(arena, node->data.if_stmt.condition);
+        copy->data.if_stmt.then_block = clone_node(arena, node->data.if_stmt.then_block);
+        copy->data.if_stmt.else_block = clone_node(arena, node->data.if_stmt.else_block);
+        break;
+    case N_WHILE:
+        copy->data.while_stmt.condition = clone_node(arena, node->data.while_stmt.condition);
+        copy->data.while_stmt.body = clone_node(arena, node->data.while_stmt.body);
+        break;
+    case N_FOR:
+        copy->data.for_stmt.init = clone_node(arena, node->data.for_stmt.init);
+        copy->data.for_stmt.condition = clone_node(arena, node->data.for_stmt.condition);
+        copy->data.for_stmt.increment = clone_node(arena, node->data.for_stmt.increment);
+        copy->data.for_stmt.body = clone_node(arena, node->data.for_stmt.body);
+        break;
+    case N_CALL:
+        copy->data.call.args = clone_list(arena, node->data.call.args, node->data.call.arg_count);
+        break;
+    case N_ARRAY_ACCESS:
+        copy->data.array_access.array = clone_node(arena, node->data.array_access.array);
+        copy->data.array_access.index = clone_node(arena, node->data.array_access.index);
+        break;
+    case N_MEMBER_ACCESS:
+        copy->data.member_access.object = clone_node(arena, node->data.member_access.object);
+        break;
+    case N_CAST:
+        copy->data.cast.expr = clone_node(arena, node->data.cast.expr);
+        break;
+    case N_SIZEOF:
+        copy->data.sizeof_expr.expr = clone_node(arena, node->data.sizeof_expr.expr);
+        break;
+    case N_TERNARY:
+        copy->data.ternary.condition = clone_node(arena, node->data.ternary.condition);
+        copy->data.ternary.true_expr = clone_node(arena, node->data.ternary.true_expr);
+        copy->data.ternary.false_expr = clone_node(arena, node->data.ternary.false_expr);
+        break;
+    case N_INLINE:
+        copy->data.inline_call.body = clone_node(arena, node->data.inline_call.body);
+        break;
+    default:
+        break;
+    }
+    return copy;
+}
+
+/* ====================== Body Analysis ====================== */
+
+typedef struct {
+    const char** items;
+    size_t count;
+    size_t capacity;
+} NameList;
+
+static void names_add(NameList* list, const char* name) {
+    if (list->count >= list->capacity) {
+        list->capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        list->items = (const char**)realloc(list->items, sizeof(char*) * list->capacity);
+    }
+    list->items[list->count++] = name;
+}
+
+static int names_contain(NameList* list, const char* name) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+static void collect_decl_names(AST* node, void* ctx) {
+    if (node->type == N_DECL) names_add((NameList*)ctx, node->data.decl.name);
+    visit_children(node, collect_decl_names, ctx);
+}
+
+typedef struct {
+    const char* self;
+    int size;           // AST nodes
+    int has_call;
+    int calls_self;
+    int unsupported;    // Inline asm, local type declarations, static locals
+} BodyInfo;
+
+static void measure_node(AST* node, void* ctx) {
+    BodyInfo* info = (BodyInfo*)ctx;
+    info->size++;
+
+    switch (node->type) {
+    case N_CALL:
+        info->has_call = 1;
+        if (strcmp(node->data.call.name, info->self) == 0) info->calls_self = 1;
+        break;
+    case N_DECL:
+        if (node->data.decl.is_static) info->unsupported = 1;
+        break;
+    case N_ASM:
+    case N_STRUCT_DECL:
+    case N_TYPEDEF:
+    case N_ENUM_DECL:
+        info->unsupported = 1;
+        break;
+    default:
+        break;
+    }
+    visit_children(node, measure_node, ctx);
+}
+
+typedef struct {
+    const char* name;
+    int written;
+} WriteCheck;
+
+static int is_ident_named(AST* node, const char* name) {
+    return node && node->type == N_IDENT && strcmp(node->data.ident.name, name) == 0;
+}
+
+// Whether the body assigns, increments or takes the address of name
+static void check_written(AST* node, void* ctx) {
+    WriteCheck* check = (WriteCheck*)ctx;
+
+    switch (node->type) {
+    case N_ASSIGN:
+        if (strcmp(node->data.assign.var_name, check->name) == 0) check->written = 1;
+        break;
+    case N_OPERATOR:
+        switch (node->data.op.op) {
+        case TOKEN_ASSIGN:
+        case TOKEN_PLUS_ASSIGN:
+        case TOKEN_MINUS_ASSIGN:
+        case TOKEN_STAR_ASSIGN:
+        case TOKEN_SLASH_ASSIGN:
+            if (is_ident_named(node->data.op.left, check->name)) check->written = 1;
+            break;
+        default:
+            break;
+        }
+        break;
+    case N_UNARY:
+        if ((node->data.unary.op == TOKEN_PLUS_PLUS || node->data.unary.op == TOKEN_MINUS_MINUS ||
+            node->data.unary.op == TOKEN_AMPERSAND) &&
+            is_ident_named(node->data.unary.operand, check->name)) {
+            check->written = 1;
+        }
+        break;
+    default:
+        break;
+    }
+    visit_children(node, check_written, ctx);
+}
+
+typedef struct {
+    NameList* callee_names;   // Params and locals, which get renamed
+    NameList* caller_names;
+    int conflict;
+} CaptureCheck;
+
+// A name the callee resolves globally must not be shadowed at the call site
+static void check_capture(AST* node, void* ctx) {
+    CaptureCheck* check = (CaptureCheck*)ctx;
+    const char* name = NULL;
+
+    if (node->type == N_IDENT) name = node->data.ident.name;
+    else if (node->type == N_ASSIGN) name = node->data.assign.var_name;
+
+    if (name && !names_contain(check->callee_names, name) &&
+        names_contain(check->caller_names, name)) {
+        check->conflict = 1;
+    }
+    visit_children(node, check_capture, ctx);
+}
+
+/* ====================== Renaming ====================== */
+
+typedef struct {
+    const char* name;
+    char* renamed;
+    AST* literal;       // Read-only parameter bound to a constant argument
+} Binding;
+
+typedef struct {
+    Binding* items;
+    size_t count;
+} BindingList;
+
+static Binding* binding_find(BindingList* list, const char* name) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i].name, name) == 0) return &list->items[i];
+    }
+    return NULL;
+}
+
+static void rename_node(AST* node, void* ctx) {
+    BindingList* bindings = (BindingList*)ctx;
+    Binding* b;
+
+    switch (node->type) {
+    case N_IDENT:
+        b = binding_find(bindings, node->data.ident.name);
+        if (!b) break;
+        if (b->literal) {
+            *node = *b->literal;
+        }
+        else {
+            node->data.ident.name = b->renamed;
+        }
+        break;
+    case N_ASSIGN:
+        b = binding_find(bindings, node->data.assign.var_name);
+        if (b && b->renamed) {
+            node->data.assign.var_name = b->renamed;
+        }
+        break;
+    case N_DECL:
+        b = binding_find(bindings, node->data.decl.name);
+        if (b && b->renamed) {
+            node->data.decl.name = b->renamed;
+        }
+        break;
+    default:
+        break;
+    }
+    visit_children(node, rename_node, ctx);
+}
+
+/* ====================== Call Site Expansion ====================== */
+
+typedef struct {
+    AST* func;
+    BodyInfo info;
+    int param_count;    // -1 when a parameter cannot become a local
+    int inlined;
+} Callee;
+
+typedef struct {
+    AST* program;
+    Arena* arena;
+    const InlineOptions* options;
+    InlineStats* stats;
+    Callee* callees;
+    size_t callee_count;
+    NameTable callee_index;   // Function name to callee
+    NameTable global_index;   // Names of global variables
+    AST* caller;
+    NameList caller_names;
+    int site_id;
+} Inliner;
+
+static int is_literal(AST* node) {
+    return node && (node->type == N_INTLIT || node->type == N_CHAR_LIT);
+}
+
+// Parameters the body can declare as ordinary locals; `f(void)` has none
+static int inline_param_count(AST* func) {
+    size_t count = func->data.function.param_count;
+    AST** params = func->data.function.params;
+
+    if (count == 1 && params[0]->type == N_DECL && params[0]->data.decl.name[0] == '\0' &&
+        params[0]->data.decl.pointer_level == 0 && params[0]->data.decl.type->kind == TYPE_VOID) {
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        AST* param = params[i];
+        if (param->type != N_DECL || param->data.decl.name[0] == '\0') return -1;
+        // Structs are passed by value and have no copy to initialize from
+        if (param->data.decl.pointer_level == 0 && param->data.decl.type->kind == TYPE_STRUCT) {
+            return -1;
+        }
+    }
+    return (int)count;
+}
+
+static void callee_analyze(Callee* callee) {
+    AST* func = callee->func;
+    memset(&callee->info, 0, sizeof(callee->info));
+    callee->info.self = func->data.function.name;
+    measure_node(func->data.function.body, &callee->info);
+    callee->param_count = inline_param_count(func);
+}
+
+static Callee* find_callee(Inliner* in, const char* name) {
+    int index = name_table_get(&in->callee_index, name, -1);
+    return index >= 0 ? &in->callees[index] : NULL;
+}
+
+static int is_global_name(Inliner* in, const char* name) {
+    return name_table_get(&in->global_index, name, 0);
+}
+
+static int should_inline(Inliner* in, Callee* callee, AST* call) {
+    AST* func = callee->func;
+    const char* name = func->data.function.name;
+
+    if (callee->info.unsupported || callee->info.calls_self) return 0;
+    if (callee->param_count < 0 || (size_t)callee->param_count != call->data.call.arg_count) return 0;
+    if (strcmp(name, in->caller->data.function.name) == 0) return 0;
+    if (in->options->is_reserved && in->options->is_reserved(name)) return 0;
+
+    if (!func->data.function.is_inline &&
+        (callee->info.has_call || callee->info.size > in->options->size_limit)) {
+        return 0;
+    }
+    return 1;
+}
+
+// Rewrite call in place into an N_INLINE holding renamed copies of the
+// parameters (initialized from the arguments) followed by the callee body
+static int expand_call(Inliner* in, Callee* callee, AST* call) {
+    AST* func = callee->func;
+    AST* body = func->data.function.body;
+    size_t param_count = (size_t)callee->param_count;
+
+    NameList callee_names = { NULL, 0, 0 };
+    for (size_t i = 0; i < param_count; i++) {
+        names_add(&callee_names, func->data.function.params[i]->data.decl.name);
+    }
+    size_t local_start = callee_names.count;
+    collect_decl_names(body, &callee_names);
+
+    // Renaming a local that shadows a global would also capture the global's
+    // uses ahead of the declaration
+    int conflict = 0;
+    for (size_t j = local_start; j < callee_names.count; j++) {
+        if (is_global_name(in, callee_names.items[j])) conflict = 1;
+    }
+
+    CaptureCheck capture = { &callee_names, &in->caller_names, 0 };
+    check_capture(body, &capture);
+    if (conflict || capture.conflict) {
+        free(callee_names.items);
+        return 0;
+    }
+
+    int site = ++in->site_id;
+    BindingList bindings;
+    bindings.items = (Binding*)calloc(callee_names.count, sizeof(Binding));
+    bindings.count = 0;
+
+    for (size_t i = 0; i < callee_names.count; i++) {
+        const char* name = callee_names.items[i];
+        if (binding_find(&bindings, name)) continue;
+
+        Binding* b = &bindings.items[bindings.count++];
+        b->name = name;
+
+        // A parameter the body only reads can take a constant argument directly
+        AST* arg = i < local_start ? call->data.call.args[i] : NULL;
+        AST* param = i < local_start ? func->data.function.params[i] : NULL;
+        if (arg && is_literal(arg) && param->data.decl.pointer_level == 0 &&
+            !param->data.decl.array_size) {
+            WriteCheck check = { name, 0 };
+            check_written(body, &check);
+            int redeclared = 0;
+            for (size_t j = local_start; j < callee_names.count; j++) {
+                if (strcmp(callee_names.items[j], name) == 0) redeclared = 1;
+            }
+            if (!check.written && !redeclared) {
+                b->literal = arg;
+                continue;
+            }
+        }
+
+        // '.' cannot appear in a C identifier, so renamed locals never collide
+        size_t len = strlen(name) + 24;
+        b->renamed = (char*)arena_alloc(in->arena, len);
+        snprintf(b->renamed, len, "%s.%d", name, site);
+    }
+
+    AST* copy = clone_node(in->arena, body);
+    rename_node(copy, &bindings);
+
+    AST* block = create_block_node(in->arena);
+    // cdecl evaluates arguments right to left; keep that order
+    for (size_t k = param_count; k-- > 0;) {
+        AST* param = func->data.function.params[k];
+        AST* arg = call->data.call.args[k];
+        Binding* b = binding_find(&bindings, param->data.decl.name);
+        if (b->literal) continue;
+        // Array parameters decay to pointers
+        int pointer_level = param->data.decl.pointer_level + (param->data.decl.array_size ? 1 : 0);
+        block_add_statement(in->arena, block,
+            create_decl_node(in->arena, param->data.decl.type, b->renamed, pointer_level, arg, NULL));
+    }
+    block_add_statement(in->arena, block, copy);
+
+    free(bindings.items);
+    free(callee_names.items);
+
+    call->type = N_INLINE;
+    call->data.inline_call.callee = func->data.function.name;
+    call->data.inline_call.body = block;
+    return 1;
+}
+
+static void inline_node(AST* node, void* ctx) {
+    Inliner* in = (Inliner*)ctx;
+
+    // Arguments first, so calls nested in them are expanded too
+    visit_children(node, inline_node, ctx);
+    if (node->type != N_CALL) return;
+
+    Callee* callee = find_callee(in, node->data.call.name);
+    if (!callee || !should_inline(in, callee, node)) return;
+
+    if (expand_call(in, callee, node)) {
+        in->stats->call_sites++;
+        if (!callee->inlined) {
+            callee->inlined = 1;
+            in->stats->functions++;
+        }
+    }
+}
+
+void optimize_inline_calls(AST* program, Arena* arena, const InlineOptions* options, InlineStats* stats) {
+    stats->call_sites = 0;
+    stats->functions = 0;
+    if (!program || program->type != N_PROGRAM) return;
+
+    Inliner in;
+    memset(&in, 0, sizeof(in));
+    in.program = program;
+    in.arena = arena;
+    in.options = options;
+    in.stats = stats;
+
+    size_t func_count = program->data.program.func_count;
+    in.callees = (Callee*)calloc(func_count + 1, sizeof(Callee));
+    for (size_t i = 0; i < func_count; i++) {
+        AST* func = program->data.program.functions[i];
+        if (!func->data.function.body) continue;  // Prototype
+        // The first definition of a name is the one calls resolve to
+        if (name_table_get(&in.callee_index, func->data.function.name, -1) < 0) {
+            name_table_put(&in.callee_index, func->data.function.name, (int)in.callee_count);
+        }
+        in.callees[in.callee_count++].func = func;
+    }
+    for (size_t i = 0; i < program->data.program.global_count; i++) {
+        AST* global = program->data.program.globals[i];
+        if (global->type == N_DECL) name_table_put(&in.global_index, global->data.decl.name, 1);
+    }
+
+    for (int round = 0; round < INLINE_ROUNDS; round++) {
+        int before = stats->call_sites;
+
+        for (size_t i = 0; i < in.callee_count; i++) {
+            callee_analyze(&in.callees[i]);
+        }
+
+        for (size_t i = 0; i < in.callee_count; i++) {
+            AST* caller = in.callees[i].func;
+            in.caller = caller;
+            in.caller_names.count = 0;
+            for (size_t p = 0; p < caller->data.function.param_count; p++) {
+                AST* param = caller->data.function.params[p];
+                if (param->type == N_DECL) names_add(&in.caller_names, param->data.decl.name);
+            }
+            collect_decl_names(caller->data.function.body, &in.caller_names);
+
+            inline_node(caller->data.function.body, &in);
+        }
+
+        if (stats->call_sites == before) break;
+    }
+
+    free(in.caller_names.items);
+    name_table_free(&in.global_index);
+    name_table_free(&in.callee_index);
+    free(in.callees);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "../Parser/Parser.h"
+
+// AST-level passes run between parse_program and codegen_program
+
+typedef void (*NodeVisitor)(AST* node, void* ctx);
+
+// Calls fn on each non-NULL direct child of a statement or expression node
+void visit_children(AST* node, NodeVisitor fn, void* ctx);
+
+typedef struct {
+    int folded;       // Constant subtrees replaced by literals
+    int simplified;   // Identities such as x*1 or x+0 removed
+    int globals;      // Reads of read-only globals replaced by their value
+} FoldStats;
+
+// Folds constant N_OPERATOR/N_UNARY/N_CAST/N_SIZEOF/N_TERNARY subtrees into
+// N_INTLIT and strips algebraic identities, in place. A plain int global with
+// a constant initializer that is never assigned, incremented, address-taken
+// or named in inline asm is read as its initial value, except in functions
+// that declare a local or parameter of the same name
+void optimize_fold_constants(AST* program, FoldStats* stats);
+
+// Evaluates a constant expression, such as an array extent, the way folding
+// would, without changing the tree. Returns 0 if it is not constant.
+int optimize_const_value(AST* expr, int* value);
+
+#define INLINE_DEFAULT_LIMIT 32
+
+typedef struct {
+    int size_limit;                         // Max AST nodes in a non-inline callee
+    int (*is_reserved)(const char* name);   // Calls that must stay calls, or NULL
+} InlineOptions;
+
+typedef struct {
+    int call_sites;   // Calls replaced by N_INLINE bodies
+    int functions;    // Distinct callees inlined at least once
+} InlineStats;
+
+// Replaces calls to `inline` functions, and to call-free functions of at
+// most size_limit nodes, by renamed copies of their bodies. The copies are
+// allocated from arena, which must be the one the program was parsed into.
+void optimize_inline_calls(AST* program, Arena* arena, const InlineOptions* options, InlineStats* stats);
+
+#endif // !OPTIMIZER_H
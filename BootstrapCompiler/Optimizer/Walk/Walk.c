@@ -0,0 +1,66 @@
+#include "../Optimizer.h"
+
+void visit_children(AST* node, NodeVisitor fn, void* ctx) {
+    AST* children[4] = { NULL, NULL, NULL, NULL };
+    AST** list = NULL;
+    size_t list_count = 0;
+
+    switch (node->type) {
+    case N_OPERATOR:
+        children[0] = node->data.op.left;
+        children[1] = node->data.op.right;
+        break;
+    case N_UNARY:         children[0] = node->data.unary.operand; break;
+    case N_ASSIGN:        children[0] = node->data.assign.value; break;
+    case N_RETURN:        children[0] = node->data.return_stmt.value; break;
+    case N_CAST:          children[0] = node->data.cast.expr; break;
+    case N_SIZEOF:        children[0] = node->data.sizeof_expr.expr; break;
+    case N_MEMBER_ACCESS: children[0] = node->data.member_access.object; break;
+    case N_INLINE:        children[0] = node->data.inline_call.body; break;
+    case N_DECL:
+        children[0] = node->data.decl.init_value;
+        children[1] = node->data.decl.array_size;
+        break;
+    case N_ARRAY_ACCESS:
+        children[0] = node->data.array_access.array;
+        children[1] = node->data.array_access.index;
+        break;
+    case N_TERNARY:
+        children[0] = node->data.ternary.condition;
+        children[1] = node->data.ternary.true_expr;
+        children[2] = node->data.ternary.false_expr;
+        break;
+    case N_IF:
+        children[0] = node->data.if_stmt.condition;
+        children[1] = node->data.if_stmt.then_block;
+        children[2] = node->data.if_stmt.else_block;
+        break;
+    case N_WHILE:
+        children[0] = node->data.while_stmt.condition;
+        children[1] = node->data.while_stmt.body;
+        break;
+    case N_FOR:
+        children[0] = node->data.for_stmt.init;
+        children[1] = node->data.for_stmt.condition;
+        children[2] = node->data.for_stmt.increment;
+        children[3] = node->data.for_stmt.body;
+        break;
+    case N_BLOCK:
+        list = node->data.block.statements;
+        list_count = node->data.block.count;
+        break;
+    case N_CALL:
+        list = node->data.call.args;
+        list_count = node->data.call.arg_count;
+        break;
+    default:
+        break;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (children[i]) fn(children[i], ctx);
+    }
+    for (size_t i = 0; i < list_count; i++) {
+        if (list[i]) fn(list[i], ctx);
+    }
+}
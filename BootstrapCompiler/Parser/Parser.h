@@ -3,14 +3,38 @@
 #define PARSER_H
 
 #include "../Tokenizer/Tokenizer.h"
+#include "../Memory/Arena/Arena.h"
+#include "../Memory/Interner/Interner.h"
+#include "Types/Types.h"
+#include "../Diagnostics/Diagnostics.h"
 
 typedef struct AST AST;
 
+// Names are interned, so aliases are matched by pointer
 typedef struct
 {
-	Token* tokens;
-	size_t pos;
-	size_t len;
+	const char* alias;  // The new name (e.g., "uint8_t")
+	Type* type;         // The underlying type, pointers included (e.g., int* for IntPtr)
+} TypedefEntry;
+
+// Typedefs of one translation unit, in declaration order
+typedef struct
+{
+	TypedefEntry* entries;
+	int count;
+	int capacity;
+	NameTable index;    // Alias to its first entry
+} TypedefTable;
+
+typedef struct
+{
+	TokenStream* tokens;
+	size_t pos;         // Index of the next token
+	Interner* names;    // Owns identifier and literal text kept by the AST
+	Arena* arena;       // Owns every node and child array built
+	TypeTable* types;   // Owns the type descriptors nodes point to
+	Diagnostics* diag;  // Takes the error that stops parsing, NULL to exit on it
+	TypedefTable typedefs;
 } Parser;
 
 typedef enum
@@ -41,12 +65,13 @@ typedef enum
 	N_STRING_LIT,
 	N_CHAR_LIT,
 	N_TERNARY,
-	N_ASM  // NEW: Inline assembly
+	N_ASM,  // NEW: Inline assembly
+	N_INLINE  // Call site replaced by the callee's body (optimizer only)
 } Nodes;
 
 typedef struct
 {
-	char* return_type;
+	Type* return_type;
 	char* name;
 	AST** params;
 	size_t param_count;
@@ -110,7 +135,7 @@ typedef struct
 
 typedef struct
 {
-	char* type;
+	Type* type;         // Declared type before the declarator's pointers and extent
 	char* name;
 	int pointer_level;
 	AST* init_value;
@@ -189,13 +214,14 @@ typedef struct
 
 typedef struct
 {
-	char* type;
+	Type* type;
 	AST* expr;
 } CastNode;
 
 typedef struct
 {
 	AST* expr;
+	Type* type;         // sizeof(type-name); expr is NULL then
 } SizeofNode;
 
 typedef struct
@@ -212,6 +238,14 @@ typedef struct
 	int is_volatile;
 } AsmNode;
 
+// Expression whose value is whatever the first N_RETURN inside body yields.
+// body declares the renamed parameters, then holds the renamed callee body
+typedef struct
+{
+	char* callee;
+	AST* body;
+} InlineNode;
+
 typedef struct
 {
 	AST** functions;
@@ -252,47 +286,60 @@ typedef struct AST
 		SizeofNode sizeof_expr;
 		TernaryNode ternary;
 		AsmNode asm_stmt;  // NEW
+		InlineNode inline_call;
 	} data;
 } AST;
 
-Parser* parser_create(Token* tokens, size_t len);
+Parser* parser_create(TokenStream* tokens, Arena* arena, Interner* names, TypeTable* types,
+	Diagnostics* diag);
 void parser_free(Parser* p);
-Token peek_token(Parser* p);
-Token peek_ahead(Parser* p, int offset);
-Token advance_token(Parser* p);
+Tokens peek_token(Parser* p);
+Tokens peek_ahead(Parser* p, int offset);
+size_t advance_token(Parser* p);
 int check_token(Parser* p, Tokens type);
 int match_token(Parser* p, Tokens type);
-Token expect(Parser* p, Tokens expected);
-
-AST* create_intlit_node(int value);
-AST* create_stringlit_node(char* value);
-AST* create_charlit_node(char value);
-AST* create_ident_node(char* name);
-AST* create_operator_node(Tokens op, AST* left, AST* right);
-AST* create_unary_node(Tokens op, AST* operand);
-AST* create_return_node(AST* value);
-AST* create_assign_node(char* name, AST* value);
-AST* create_decl_node(char* type, char* name, int pointer_level, AST* init, AST* array_size);
-AST* create_block_node();
-AST* create_function_node(char* return_type, char* name, AST** params, size_t param_count, AST* body);
-AST* create_if_node(AST* condition, AST* then_block, AST* else_block);
-AST* create_while_node(AST* condition, AST* body);
-AST* create_for_node(AST* init, AST* condition, AST* increment, AST* body);
-AST* create_call_node(char* name, AST** args, size_t arg_count);
-AST* create_array_access_node(AST* array, AST* index);
-AST* create_member_access_node(AST* object, char* member, int is_arrow);
-AST* create_struct_decl_node(char* name, AST** members, size_t member_count);
-AST* create_typedef_node(char* old_name, char* new_name);
-AST* create_enum_decl_node(char* name, AST** values, size_t value_count);
-AST* create_cast_node(char* type, AST* expr);
-AST* create_sizeof_node(AST* expr);
-AST* create_ternary_node(AST* condition, AST* true_expr, AST* false_expr);
-AST* create_program_node();
-AST* create_asm_node(char* code, int is_volatile);  // NEW
-
-void block_add_statement(AST* block, AST* stmt);
-void program_add_function(AST* program, AST* func);
-void program_add_global(AST* program, AST* global);
+size_t expect(Parser* p, Tokens expected);
+
+// Tokens are referred to by index into the stream
+const char* token_start(Parser* p, size_t index);
+size_t token_length(Parser* p, size_t index);
+char* token_text(Parser* p, size_t index);
+int token_line(Parser* p, size_t index);
+
+// Nodes are allocated from the arena and keep the strings they are given
+// rather than copying them, so those must live as long as the arena too
+// (interned names from token_text, or arena_strdup copies)
+AST* create_intlit_node(Arena* arena, int value);
+AST* create_stringlit_node(Arena* arena, char* value);
+AST* create_charlit_node(Arena* arena, char value);
+AST* create_ident_node(Arena* arena, char* name);
+AST* create_operator_node(Arena* arena, Tokens op, AST* left, AST* right);
+AST* create_unary_node(Arena* arena, Tokens op, AST* operand);
+AST* create_return_node(Arena* arena, AST* value);
+AST* create_assign_node(Arena* arena, char* name, AST* value);
+AST* create_decl_node(Arena* arena, Type* type, char* name, int pointer_level, AST* init, AST* array_size);
+AST* create_block_node(Arena* arena);
+AST* create_function_node(Arena* arena, Type* return_type, char* name, AST** params, size_t param_count, AST* body);
+AST* create_if_node(Arena* arena, AST* condition, AST* then_block, AST* else_block);
+AST* create_while_node(Arena* arena, AST* condition, AST* body);
+AST* create_for_node(Arena* arena, AST* init, AST* condition, AST* increment, AST* body);
+AST* create_call_node(Arena* arena, char* name, AST** args, size_t arg_count);
+AST* create_array_access_node(Arena* arena, AST* array, AST* index);
+AST* create_member_access_node(Arena* arena, AST* object, char* member, int is_arrow);
+AST* create_struct_decl_node(Arena* arena, char* name, AST** members, size_t member_count);
+AST* create_typedef_node(Arena* arena, char* old_name, char* new_name);
+AST* create_enum_decl_node(Arena* arena, char* name, AST** values, size_t value_count);
+AST* create_cast_node(Arena* arena, Type* type, AST* expr);
+AST* create_sizeof_node(Arena* arena, AST* expr);
+AST* create_sizeof_type_node(Arena* arena, Type* type);
+AST* create_ternary_node(Arena* arena, AST* condition, AST* true_expr, AST* false_expr);
+AST* create_program_node(Arena* arena);
+AST* create_asm_node(Arena* arena, char* code, int is_volatile);  // NEW
+AST* create_inline_node(Arena* arena, char* callee, AST* body);
+
+void block_add_statement(Arena* arena, AST* block, AST* stmt);
+void program_add_function(Arena* arena, AST* program, AST* func);
+void program_add_global(Arena* arena, AST* program, AST* global);
 
 AST* parse_primary(Parser* p);
 AST* parse_postfix(Parser* p);
@@ -323,6 +370,4 @@ AST* parse_function(Parser* p);
 AST* parse_program(Parser* p);
 AST* parse_asm_statement(Parser* p);  // NEW
 
-void ast_free(AST* node);
-
 #endif // !PARSER_H
\ No newline at end of file
@@ -1,89 +1,85 @@
 #include "../Parser.h"
 
-/* ====================== Typedef Table (NEW) ====================== */
+/* ====================== Typedef Table ====================== */
 
-#define MAX_TYPEDEFS 256
-
-typedef struct {
-    char* alias;        // The new name (e.g., "uint8_t")
-    char* real_type;    // The underlying type (e.g., "unsigned char")
-    int pointer_level;  // If typedef includes pointer (e.g., typedef int* IntPtr)
-} TypedefEntry;
-
-typedef struct {
-    TypedefEntry entries[MAX_TYPEDEFS];
-    int count;
-} TypedefTable;
-
-static TypedefTable g_typedefs = { .count = 0 };
-
-void typedef_table_init() {
-    g_typedefs.count = 0;
+static void typedef_table_init(TypedefTable* table) {
+    table->entries = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    name_table_init(&table->index);
 }
 
-void typedef_table_add(const char* alias, const char* real_type, int ptr_level) {
-    if (g_typedefs.count >= MAX_TYPEDEFS) {
-        fprintf(stderr, "Too many typedefs\n");
-        return;
-    }
-    g_typedefs.entries[g_typedefs.count].alias = _strdup(alias);
-    g_typedefs.entries[g_typedefs.count].real_type = _strdup(real_type);
-    g_typedefs.entries[g_typedefs.count].pointer_level = ptr_level;
-    g_typedefs.count++;
+static void typedef_table_free(TypedefTable* table) {
+    free(table->entries);
+    name_table_free(&table->index);
 }
 
-TypedefEntry* typedef_table_lookup(const char* name) {
-    for (int i = 0; i < g_typedefs.count; i++) {
-        if (strcmp(g_typedefs.entries[i].alias, name) == 0) {
-            return &g_typedefs.entries[i];
-        }
+// A redeclared alias keeps its first type
+static void typedef_table_add(TypedefTable* table, Interner* names, const char* alias, Type* type) {
+    if (table->count >= table->capacity) {
+        table->capacity = table->capacity == 0 ? 32 : table->capacity * 2;
+        table->entries = (TypedefEntry*)realloc(table->entries, sizeof(TypedefEntry) * table->capacity);
+    }
+    TypedefEntry* entry = &table->entries[table->count];
+    entry->alias = intern_cstr(names, alias);
+    entry->type = type;
+    if (name_table_get(&table->index, entry->alias, -1) < 0) {
+        name_table_put(&table->index, entry->alias, table->count);
     }
-    return NULL;
+    table->count++;
 }
 
-int is_typedef_name(const char* name) {
-    return typedef_table_lookup(name) != NULL;
+// name must be interned
+static TypedefEntry* typedef_table_lookup(TypedefTable* table, const char* name) {
+    int index = name_table_get(&table->index, name, -1);
+    return index >= 0 ? &table->entries[index] : NULL;
 }
 
 /* ====================== Parser Basics ====================== */
 
-Parser* parser_create(Token* tokens, size_t len)
+Parser* parser_create(TokenStream* tokens, Arena* arena, Interner* names, TypeTable* types,
+    Diagnostics* diag)
 {
     Parser* p = (Parser*)malloc(sizeof(Parser));
     p->tokens = tokens;
+    p->arena = arena;
+    p->names = names;
+    p->types = types;
+    p->diag = diag;
     p->pos = 0;
-    p->len = len;
-    typedef_table_init();  // NEW: Reset typedef table
+    typedef_table_init(&p->typedefs);
     return p;
 }
 
 void parser_free(Parser* p)
 {
+    typedef_table_free(&p->typedefs);
     free(p);
 }
 
-Token peek_token(Parser* p)
+Tokens peek_token(Parser* p)
 {
-    if (p->pos >= p->len) return (Token) { .type = TOKEN_EOF };
-    return p->tokens[p->pos];
+    if (p->pos >= p->tokens->count) return TOKEN_EOF;
+    return (Tokens)p->tokens->types[p->pos];
 }
 
-Token peek_ahead(Parser* p, int offset)
+Tokens peek_ahead(Parser* p, int offset)
 {
     size_t pos = p->pos + offset;
-    if (pos >= p->len) return (Token) { .type = TOKEN_EOF };
-    return p->tokens[pos];
+    if (pos >= p->tokens->count) return TOKEN_EOF;
+    return (Tokens)p->tokens->types[pos];
 }
 
-Token advance_token(Parser* p)
+// Returns the index of the consumed token
+size_t advance_token(Parser* p)
 {
-    if (p->pos >= p->len) return (Token) { .type = TOKEN_EOF };
-    return p->tokens[p->pos++];
+    if (p->pos >= p->tokens->count) return p->tokens->count - 1;
+    return p->pos++;
 }
 
 int check_token(Parser* p, Tokens type)
 {
-    return peek_token(p).type == type;
+    return peek_token(p) == type;
 }
 
 int match_token(Parser* p, Tokens type)
@@ -96,17 +92,70 @@ int match_token(Parser* p, Tokens type)
     return 0;
 }
 
-Token expect(Parser* p, Tokens expected)
+size_t expect(Parser* p, Tokens expected)
 {
-    Token t = peek_token(p);
-    if (t.type != expected)
+    Tokens t = peek_token(p);
+    if (t != expected)
     {
-        fprintf(stderr, "Parse error at line %d: expected token %d, got %d\n",
-            t.line, expected, t.type);
-        exit(1);
+        int line = token_line(p, p->pos);
+        diag_fatal(p->diag, DIAG_PARSE, NULL, line, 0,
+            "Parse error at line %d: expected token %d, got %d", line, expected, t);
     }
-    advance_token(p);
-    return t;
+    return advance_token(p);
+}
+
+/* Token text is a span of the preprocessed source. Names and literals the
+   AST keeps are interned, so each distinct one is stored once; lookups
+   find the interned copy without adding to it. */
+
+const char* token_start(Parser* p, size_t index)
+{
+    return p->tokens->source + p->tokens->offsets[index];
+}
+
+size_t token_length(Parser* p, size_t index)
+{
+    return p->tokens->lengths[index];
+}
+
+// Interned, so shared between nodes and never modified
+char* token_text(Parser* p, size_t index)
+{
+    return (char*)intern(p->names, token_start(p, index), token_length(p, index));
+}
+
+// The struct type tagged by the identifier at index
+static Type* struct_type(Parser* p, size_t index)
+{
+    return type_struct(p->types, token_text(p, index));
+}
+
+int token_line(Parser* p, size_t index)
+{
+    if (index >= p->tokens->count) index = p->tokens->count - 1;
+    return p->tokens->lines[index];
+}
+
+TypedefEntry* typedef_lookup_token(Parser* p, size_t index)
+{
+    if (p->tokens->types[index] != TOKEN_IDENTIFIER) return NULL;
+    const char* name = interner_find(p->names, token_start(p, index), token_length(p, index));
+    return name ? typedef_table_lookup(&p->typedefs, name) : NULL;
+}
+
+// Current token names a typedef
+int at_typedef_name(Parser* p)
+{
+    return check_token(p, TOKEN_IDENTIFIER) && typedef_lookup_token(p, p->pos) != NULL;
+}
+
+// The type a single-token type name stands for: a typedef's underlying
+// type, or the keyword or name itself
+static Type* resolve_type_token(Parser* p, size_t index)
+{
+    TypedefEntry* tdef = typedef_lookup_token(p, index);
+    if (tdef) return tdef->type;
+    return type_named(p->types, token_text(p, index));
 }
 
 int is_hex_digit(char c)
@@ -118,18 +167,18 @@ int is_hex_digit(char c)
 
 /* NEW: Check if current token starts a type */
 int is_type_token(Parser* p) {
-    Token t = peek_token(p);
-    if (t.type == TOKEN_INT || t.type == TOKEN_CHAR_KW || t.type == TOKEN_VOID ||
-        t.type == TOKEN_STRUCT || t.type == TOKEN_ENUM ||
-        t.type == TOKEN_UNSIGNED || t.type == TOKEN_SIGNED ||
-        t.type == TOKEN_LONG || t.type == TOKEN_SHORT ||
-        t.type == TOKEN_CONST || t.type == TOKEN_VOLATILE ||
-        t.type == TOKEN_STATIC || t.type == TOKEN_EXTERN ||
-        t.type == TOKEN_REGISTER) {
+    Tokens t = peek_token(p);
+    if (t == TOKEN_INT || t == TOKEN_CHAR_KW || t == TOKEN_VOID ||
+        t == TOKEN_STRUCT || t == TOKEN_ENUM ||
+        t == TOKEN_UNSIGNED || t == TOKEN_SIGNED ||
+        t == TOKEN_LONG || t == TOKEN_SHORT ||
+        t == TOKEN_CONST || t == TOKEN_VOLATILE ||
+        t == TOKEN_STATIC || t == TOKEN_EXTERN ||
+        t == TOKEN_REGISTER) {
         return 1;
     }
     // Check if it's a typedef name
-    if (t.type == TOKEN_IDENTIFIER && is_typedef_name(t.word)) {
+    if (at_typedef_name(p)) {
         return 1;
     }
     return 0;
@@ -137,41 +186,41 @@ int is_type_token(Parser* p) {
 
 /* ====================== Node Creation ====================== */
 
-AST* create_intlit_node(int value)
+AST* create_intlit_node(Arena* arena, int value)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_INTLIT;
     node->data.int_lit.value = value;
     return node;
 }
 
-AST* create_stringlit_node(char* value)
+AST* create_stringlit_node(Arena* arena, char* value)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_STRING_LIT;
-    node->data.string_lit.value = _strdup(value);
+    node->data.string_lit.value = value;
     return node;
 }
 
-AST* create_charlit_node(char value)
+AST* create_charlit_node(Arena* arena, char value)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_CHAR_LIT;
     node->data.char_lit.value = value;
     return node;
 }
 
-AST* create_ident_node(char* name)
+AST* create_ident_node(Arena* arena, char* name)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_IDENT;
-    node->data.ident.name = _strdup(name);
+    node->data.ident.name = name;
     return node;
 }
 
-AST* create_operator_node(Tokens op, AST* left, AST* right)
+AST* create_operator_node(Arena* arena, Tokens op, AST* left, AST* right)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_OPERATOR;
     node->data.op.op = op;
     node->data.op.left = left;
@@ -179,38 +228,38 @@ AST* create_operator_node(Tokens op, AST* left, AST* right)
     return node;
 }
 
-AST* create_unary_node(Tokens op, AST* operand)
+AST* create_unary_node(Arena* arena, Tokens op, AST* operand)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_UNARY;
     node->data.unary.op = op;
     node->data.unary.operand = operand;
     return node;
 }
 
-AST* create_return_node(AST* value)
+AST* create_return_node(Arena* arena, AST* value)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_RETURN;
     node->data.return_stmt.value = value;
     return node;
 }
 
-AST* create_assign_node(char* name, AST* value)
+AST* create_assign_node(Arena* arena, char* name, AST* value)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_ASSIGN;
-    node->data.assign.var_name = _strdup(name);
+    node->data.assign.var_name = name;
     node->data.assign.value = value;
     return node;
 }
 
-AST* create_decl_node(char* type, char* name, int pointer_level, AST* init, AST* array_size)
+AST* create_decl_node(Arena* arena, Type* type, char* name, int pointer_level, AST* init, AST* array_size)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_DECL;
-    node->data.decl.type = _strdup(type);
-    node->data.decl.name = _strdup(name);
+    node->data.decl.type = type;
+    node->data.decl.name = name;
     node->data.decl.pointer_level = pointer_level;
     node->data.decl.init_value = init;
     node->data.decl.array_size = array_size;
@@ -225,9 +274,9 @@ AST* create_decl_node(char* type, char* name, int pointer_level, AST* init, AST*
     return node;
 }
 
-AST* create_block_node()
+AST* create_block_node(Arena* arena)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_BLOCK;
     node->data.block.statements = NULL;
     node->data.block.count = 0;
@@ -235,12 +284,12 @@ AST* create_block_node()
     return node;
 }
 
-AST* create_function_node(char* return_type, char* name, AST** params, size_t param_count, AST* body)
+AST* create_function_node(Arena* arena, Type* return_type, char* name, AST** params, size_t param_count, AST* body)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_FUNCTION;
-    node->data.function.return_type = _strdup(return_type);
-    node->data.function.name = _strdup(name);
+    node->data.function.return_type = return_type;
+    node->data.function.name = name;
     node->data.function.params = params;
     node->data.function.param_count = param_count;
     node->data.function.body = body;
@@ -250,9 +299,9 @@ AST* create_function_node(char* return_type, char* name, AST** params, size_t pa
     return node;
 }
 
-AST* create_if_node(AST* condition, AST* then_block, AST* else_block)
+AST* create_if_node(Arena* arena, AST* condition, AST* then_block, AST* else_block)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_IF;
     node->data.if_stmt.condition = condition;
     node->data.if_stmt.then_block = then_block;
@@ -260,18 +309,18 @@ AST* create_if_node(AST* condition, AST* then_block, AST* else_block)
     return node;
 }
 
-AST* create_while_node(AST* condition, AST* body)
+AST* create_while_node(Arena* arena, AST* condition, AST* body)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_WHILE;
     node->data.while_stmt.condition = condition;
     node->data.while_stmt.body = body;
     return node;
 }
 
-AST* create_for_node(AST* init, AST* condition, AST* increment, AST* body)
+AST* create_for_node(Arena* arena, AST* init, AST* condition, AST* increment, AST* body)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_FOR;
     node->data.for_stmt.init = init;
     node->data.for_stmt.condition = condition;
@@ -280,84 +329,92 @@ AST* create_for_node(AST* init, AST* condition, AST* increment, AST* body)
     return node;
 }
 
-AST* create_call_node(char* name, AST** args, size_t arg_count)
+AST* create_call_node(Arena* arena, char* name, AST** args, size_t arg_count)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_CALL;
-    node->data.call.name = _strdup(name);
+    node->data.call.name = name;
     node->data.call.args = args;
     node->data.call.arg_count = arg_count;
     return node;
 }
 
-AST* create_array_access_node(AST* array, AST* index)
+AST* create_array_access_node(Arena* arena, AST* array, AST* index)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_ARRAY_ACCESS;
     node->data.array_access.array = array;
     node->data.array_access.index = index;
     return node;
 }
 
-AST* create_member_access_node(AST* object, char* member, int is_arrow)
+AST* create_member_access_node(Arena* arena, AST* object, char* member, int is_arrow)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_MEMBER_ACCESS;
     node->data.member_access.object = object;
-    node->data.member_access.member = _strdup(member);
+    node->data.member_access.member = member;
     node->data.member_access.is_arrow = is_arrow;
     return node;
 }
 
-AST* create_struct_decl_node(char* name, AST** members, size_t member_count)
+AST* create_struct_decl_node(Arena* arena, char* name, AST** members, size_t member_count)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_STRUCT_DECL;
-    node->data.struct_decl.name = name ? _strdup(name) : NULL;
+    node->data.struct_decl.name = name;
     node->data.struct_decl.members = members;
     node->data.struct_decl.member_count = member_count;
     return node;
 }
 
-AST* create_typedef_node(char* old_name, char* new_name)
+AST* create_typedef_node(Arena* arena, char* old_name, char* new_name)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_TYPEDEF;
-    node->data.typedef_decl.old_name = _strdup(old_name);
-    node->data.typedef_decl.new_name = _strdup(new_name);
+    node->data.typedef_decl.old_name = old_name;
+    node->data.typedef_decl.new_name = new_name;
     return node;
 }
 
-AST* create_enum_decl_node(char* name, AST** values, size_t value_count)
+AST* create_enum_decl_node(Arena* arena, char* name, AST** values, size_t value_count)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_ENUM_DECL;
-    node->data.enum_decl.name = name ? _strdup(name) : NULL;
+    node->data.enum_decl.name = name;
     node->data.enum_decl.values = values;
     node->data.enum_decl.value_count = value_count;
     return node;
 }
 
-AST* create_cast_node(char* type, AST* expr)
+AST* create_cast_node(Arena* arena, Type* type, AST* expr)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_CAST;
-    node->data.cast.type = _strdup(type);
+    node->data.cast.type = type;
     node->data.cast.expr = expr;
     return node;
 }
 
-AST* create_sizeof_node(AST* expr)
+AST* create_sizeof_node(Arena* arena, AST* expr)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_SIZEOF;
     node->data.sizeof_expr.expr = expr;
+    node->data.sizeof_expr.type = NULL;
     return node;
 }
 
-AST* create_ternary_node(AST* condition, AST* true_expr, AST* false_expr)
+AST* create_sizeof_type_node(Arena* arena, Type* type)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = create_sizeof_node(arena, NULL);
+    node->data.sizeof_expr.type = type;
+    return node;
+}
+
+AST* create_ternary_node(Arena* arena, AST* condition, AST* true_expr, AST* false_expr)
+{
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_TERNARY;
     node->data.ternary.condition = condition;
     node->data.ternary.true_expr = true_expr;
@@ -365,18 +422,27 @@ AST* create_ternary_node(AST* condition, AST* true_expr, AST* false_expr)
     return node;
 }
 
-AST* create_asm_node(char* code, int is_volatile)
+AST* create_asm_node(Arena* arena, char* code, int is_volatile)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_ASM;
-    node->data.asm_stmt.assembly_code = _strdup(code);
+    node->data.asm_stmt.assembly_code = code;
     node->data.asm_stmt.is_volatile = is_volatile;
     return node;
 }
 
-AST* create_program_node()
+AST* create_inline_node(Arena* arena, char* callee, AST* body)
+{
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
+    node->type = N_INLINE;
+    node->data.inline_call.callee = callee;
+    node->data.inline_call.body = body;
+    return node;
+}
+
+AST* create_program_node(Arena* arena)
 {
-    AST* node = (AST*)malloc(sizeof(AST));
+    AST* node = (AST*)arena_alloc(arena, sizeof(AST));
     node->type = N_PROGRAM;
     node->data.program.functions = NULL;
     node->data.program.globals = NULL;
@@ -387,40 +453,43 @@ AST* create_program_node()
     return node;
 }
 
-void block_add_statement(AST* block, AST* stmt)
+void block_add_statement(Arena* arena, AST* block, AST* stmt)
 {
     if (block->type != N_BLOCK) return;
 
     if (block->data.block.count >= block->data.block.capacity)
     {
         size_t new_cap = block->data.block.capacity == 0 ? 8 : block->data.block.capacity * 2;
-        block->data.block.statements = (AST**)realloc(block->data.block.statements, new_cap * sizeof(AST*));
+        block->data.block.statements = (AST**)arena_grow(arena, block->data.block.statements,
+            block->data.block.capacity * sizeof(AST*), new_cap * sizeof(AST*));
         block->data.block.capacity = new_cap;
     }
     block->data.block.statements[block->data.block.count++] = stmt;
 }
 
-void program_add_function(AST* program, AST* func)
+void program_add_function(Arena* arena, AST* program, AST* func)
 {
     if (program->type != N_PROGRAM) return;
 
     if (program->data.program.func_count >= program->data.program.func_capacity)
     {
         size_t new_cap = program->data.program.func_capacity == 0 ? 8 : program->data.program.func_capacity * 2;
-        program->data.program.functions = (AST**)realloc(program->data.program.functions, new_cap * sizeof(AST*));
+        program->data.program.functions = (AST**)arena_grow(arena, program->data.program.functions,
+            program->data.program.func_capacity * sizeof(AST*), new_cap * sizeof(AST*));
         program->data.program.func_capacity = new_cap;
     }
     program->data.program.functions[program->data.program.func_count++] = func;
 }
 
-void program_add_global(AST* program, AST* global)
+void program_add_global(Arena* arena, AST* program, AST* global)
 {
     if (program->type != N_PROGRAM) return;
 
     if (program->data.program.global_count >= program->data.program.global_capacity)
     {
         size_t new_cap = program->data.program.global_capacity == 0 ? 8 : program->data.program.global_capacity * 2;
-        program->data.program.globals = (AST**)realloc(program->data.program.globals, new_cap * sizeof(AST*));
+        program->data.program.globals = (AST**)arena_grow(arena, program->data.program.globals,
+            program->data.program.global_capacity * sizeof(AST*), new_cap * sizeof(AST*));
         program->data.program.global_capacity = new_cap;
     }
     program->data.program.globals[program->data.program.global_count++] = global;
@@ -435,39 +504,40 @@ AST* parse_declaration(Parser* p);
 
 AST* parse_primary(Parser* p)
 {
-    Token t = peek_token(p);
+    Tokens t = peek_token(p);
+    size_t at = p->pos;
 
-    if (t.type == TOKEN_NUMBER)
+    if (t == TOKEN_NUMBER)
     {
         advance_token(p);
-        return create_intlit_node(atoi(t.word));
+        return create_intlit_node(p->arena, token_int_value(token_start(p, at), token_length(p, at)));
     }
-    if (t.type == TOKEN_STRING)
+    if (t == TOKEN_STRING)
     {
         advance_token(p);
-        return create_stringlit_node(t.word);
+        return create_stringlit_node(p->arena, token_text(p, at));
     }
-    if (t.type == TOKEN_CHAR)
+    if (t == TOKEN_CHAR)
     {
         advance_token(p);
-        return create_charlit_node(t.word[0]);
+        return create_charlit_node(p->arena, token_char_value(token_start(p, at), token_length(p, at)));
     }
-    if (t.type == TOKEN_IDENTIFIER)
+    if (t == TOKEN_IDENTIFIER)
     {
         advance_token(p);
-        return create_ident_node(t.word);
+        return create_ident_node(p->arena, token_text(p, at));
     }
-    if (t.type == TOKEN_LPAREN)
+    if (t == TOKEN_LPAREN)
     {
         advance_token(p);
 
         // Check for cast: (Type*) or (Type) or (TypedefName)
-        Token next = peek_token(p);
-        if (next.type == TOKEN_INT || next.type == TOKEN_CHAR_KW ||
-            next.type == TOKEN_VOID || next.type == TOKEN_UNSIGNED ||
-            next.type == TOKEN_SIGNED || next.type == TOKEN_LONG ||
-            next.type == TOKEN_SHORT || next.type == TOKEN_STRUCT ||
-            (next.type == TOKEN_IDENTIFIER && is_typedef_name(next.word)))  // NEW: Check typedef
+        Tokens next = peek_token(p);
+        if (next == TOKEN_INT || next == TOKEN_CHAR_KW ||
+            next == TOKEN_VOID || next == TOKEN_UNSIGNED ||
+            next == TOKEN_SIGNED || next == TOKEN_LONG ||
+            next == TOKEN_SHORT || next == TOKEN_STRUCT ||
+            at_typedef_name(p))  // NEW: Check typedef
         {
             size_t saved = p->pos;
 
@@ -478,14 +548,7 @@ AST* parse_primary(Parser* p)
                 advance_token(p);
             }
 
-            Token type_tok = advance_token(p);
-
-            // NEW: Resolve typedef to real type for codegen
-            char* resolved_type = type_tok.word;
-            TypedefEntry* tdef = typedef_table_lookup(type_tok.word);
-            if (tdef) {
-                resolved_type = tdef->real_type;
-            }
+            size_t type_tok = advance_token(p);
 
             int stars = 0;
             while (match_token(p, TOKEN_STAR)) stars++;
@@ -493,8 +556,9 @@ AST* parse_primary(Parser* p)
             if (check_token(p, TOKEN_RPAREN))
             {
                 expect(p, TOKEN_RPAREN);
+                Type* type = type_derive(p->types, resolve_type_token(p, type_tok), stars);
                 AST* expr = parse_unary(p);
-                return create_cast_node(resolved_type, expr);
+                return create_cast_node(p->arena, type, expr);
             }
 
             p->pos = saved;
@@ -504,55 +568,41 @@ AST* parse_primary(Parser* p)
         expect(p, TOKEN_RPAREN);
         return expr;
     }
-    if (t.type == TOKEN_SIZEOF)
+    if (t == TOKEN_SIZEOF)
     {
         advance_token(p);
         expect(p, TOKEN_LPAREN);
 
-        Token next = peek_token(p);
-        if (next.type == TOKEN_INT || next.type == TOKEN_CHAR_KW ||
-            next.type == TOKEN_VOID || next.type == TOKEN_STRUCT ||
-            next.type == TOKEN_UNSIGNED || next.type == TOKEN_SIGNED ||
-            next.type == TOKEN_LONG || next.type == TOKEN_SHORT ||
-            (next.type == TOKEN_IDENTIFIER && is_typedef_name(next.word)))  // NEW
+        Tokens next = peek_token(p);
+        if (next == TOKEN_INT || next == TOKEN_CHAR_KW ||
+            next == TOKEN_VOID || next == TOKEN_STRUCT ||
+            next == TOKEN_UNSIGNED || next == TOKEN_SIGNED ||
+            next == TOKEN_LONG || next == TOKEN_SHORT ||
+            at_typedef_name(p))  // NEW
         {
-            char* type_str = NULL;
+            Type* type = NULL;
 
-            if (next.type == TOKEN_STRUCT)
+            if (next == TOKEN_STRUCT)
             {
                 advance_token(p);
-                Token struct_name = expect(p, TOKEN_IDENTIFIER);
-                size_t len = strlen("struct ") + strlen(struct_name.word) + 1;
-                type_str = (char*)malloc(len);
-                strcpy(type_str, "struct ");
-                strcat(type_str, struct_name.word);
+                type = struct_type(p, expect(p, TOKEN_IDENTIFIER));
             }
             else
             {
-                Token type_tok = advance_token(p);
-                // NEW: Resolve typedef
-                TypedefEntry* tdef = typedef_table_lookup(type_tok.word);
-                if (tdef) {
-                    type_str = _strdup(tdef->real_type);
-                }
-                else {
-                    type_str = _strdup(type_tok.word);
-                }
+                type = resolve_type_token(p, advance_token(p));
             }
 
             expect(p, TOKEN_RPAREN);
-            AST* type_node = create_ident_node(type_str);
-            free(type_str);
-            return create_sizeof_node(type_node);
+            return create_sizeof_type_node(p->arena, type);
         }
 
         AST* expr = parse_expression(p);
         expect(p, TOKEN_RPAREN);
-        return create_sizeof_node(expr);
+        return create_sizeof_node(p->arena, expr);
     }
 
-    fprintf(stderr, "Unexpected token in primary: %d at line %d\n", t.type, t.line);
-    exit(1);
+    int line = token_line(p, at);
+    diag_fatal(p->diag, DIAG_PARSE, NULL, line, 0, "Unexpected token in primary: %d at line %d", t, line);
 }
 
 AST* parse_postfix(Parser* p)
@@ -561,9 +611,9 @@ AST* parse_postfix(Parser* p)
 
     while (1)
     {
-        Token t = peek_token(p);
+        Tokens t = peek_token(p);
 
-        if (t.type == TOKEN_LPAREN)
+        if (t == TOKEN_LPAREN)
         {
             advance_token(p);
             AST** args = NULL;
@@ -575,8 +625,9 @@ AST* parse_postfix(Parser* p)
                 {
                     if (arg_count >= cap)
                     {
-                        cap = cap == 0 ? 4 : cap * 2;
-                        args = (AST**)realloc(args, cap * sizeof(AST*));
+                        size_t new_cap = cap == 0 ? 4 : cap * 2;
+                        args = (AST**)arena_grow(p->arena, args, cap * sizeof(AST*), new_cap * sizeof(AST*));
+                        cap = new_cap;
                     }
                     args[arg_count++] = parse_assignment(p);
                 } while (match_token(p, TOKEN_COMMA));
@@ -585,36 +636,32 @@ AST* parse_postfix(Parser* p)
 
             if (expr->type == N_IDENT)
             {
-                char* name = expr->data.ident.name;
-                free(expr);
-                expr = create_call_node(name, args, arg_count);
+                expr = create_call_node(p->arena, expr->data.ident.name, args, arg_count);
             }
             else
             {
-                for (size_t i = 0; i < arg_count; i++) ast_free(args[i]);
-                free(args);
-                fprintf(stderr, "Function pointer calls not supported\n");
-                exit(1);
+                diag_fatal(p->diag, DIAG_PARSE, NULL, token_line(p, p->pos - 1), 0,
+                    "Function pointer calls not supported");
             }
         }
-        else if (t.type == TOKEN_LBRACKET)
+        else if (t == TOKEN_LBRACKET)
         {
             advance_token(p);
             AST* index = parse_expression(p);
             expect(p, TOKEN_RBRACKET);
-            expr = create_array_access_node(expr, index);
+            expr = create_array_access_node(p->arena, expr, index);
         }
-        else if (t.type == TOKEN_DOT || t.type == TOKEN_ARROW)
+        else if (t == TOKEN_DOT || t == TOKEN_ARROW)
         {
-            int is_arrow = (t.type == TOKEN_ARROW);
+            int is_arrow = (t == TOKEN_ARROW);
             advance_token(p);
-            Token member = expect(p, TOKEN_IDENTIFIER);
-            expr = create_member_access_node(expr, member.word, is_arrow);
+            size_t member = expect(p, TOKEN_IDENTIFIER);
+            expr = create_member_access_node(p->arena, expr, token_text(p, member), is_arrow);
         }
-        else if (t.type == TOKEN_PLUS_PLUS || t.type == TOKEN_MINUS_MINUS)
+        else if (t == TOKEN_PLUS_PLUS || t == TOKEN_MINUS_MINUS)
         {
             advance_token(p);
-            expr = create_unary_node(t.type, expr);
+            expr = create_unary_node(p->arena, t, expr);
         }
         else
         {
@@ -626,15 +673,15 @@ AST* parse_postfix(Parser* p)
 
 AST* parse_unary(Parser* p)
 {
-    Token t = peek_token(p);
-    if (t.type == TOKEN_PLUS_PLUS || t.type == TOKEN_MINUS_MINUS ||
-        t.type == TOKEN_AMPERSAND || t.type == TOKEN_STAR ||
-        t.type == TOKEN_PLUS || t.type == TOKEN_MINUS ||
-        t.type == TOKEN_TILDE || t.type == TOKEN_EXCLAIM)
+    Tokens t = peek_token(p);
+    if (t == TOKEN_PLUS_PLUS || t == TOKEN_MINUS_MINUS ||
+        t == TOKEN_AMPERSAND || t == TOKEN_STAR ||
+        t == TOKEN_PLUS || t == TOKEN_MINUS ||
+        t == TOKEN_TILDE || t == TOKEN_EXCLAIM)
     {
         advance_token(p);
         AST* operand = parse_unary(p);
-        return create_unary_node(t.type, operand);
+        return create_unary_node(p->arena, t, operand);
     }
     return parse_postfix(p);
 }
@@ -644,12 +691,12 @@ AST* parse_multiplicative(Parser* p)
     AST* left = parse_unary(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_STAR || t.type == TOKEN_SLASH || t.type == TOKEN_PERCENT)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_STAR || t == TOKEN_SLASH || t == TOKEN_PERCENT)
         {
             advance_token(p);
             AST* right = parse_unary(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -661,12 +708,12 @@ AST* parse_additive(Parser* p)
     AST* left = parse_multiplicative(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_PLUS || t.type == TOKEN_MINUS)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_PLUS || t == TOKEN_MINUS)
         {
             advance_token(p);
             AST* right = parse_multiplicative(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -678,12 +725,12 @@ AST* parse_shift(Parser* p)
     AST* left = parse_additive(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_LSHIFT || t.type == TOKEN_RSHIFT)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_LSHIFT || t == TOKEN_RSHIFT)
         {
             advance_token(p);
             AST* right = parse_additive(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -695,13 +742,13 @@ AST* parse_relational(Parser* p)
     AST* left = parse_shift(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_LESS || t.type == TOKEN_GREATER ||
-            t.type == TOKEN_LESS_EQUAL || t.type == TOKEN_GREATER_EQUAL)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_LESS || t == TOKEN_GREATER ||
+            t == TOKEN_LESS_EQUAL || t == TOKEN_GREATER_EQUAL)
         {
             advance_token(p);
             AST* right = parse_shift(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -713,12 +760,12 @@ AST* parse_equality(Parser* p)
     AST* left = parse_relational(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_EQUAL || t.type == TOKEN_NOT_EQUAL)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_EQUAL || t == TOKEN_NOT_EQUAL)
         {
             advance_token(p);
             AST* right = parse_relational(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -730,12 +777,12 @@ AST* parse_bitwise_and(Parser* p)
     AST* left = parse_equality(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_AMPERSAND)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_AMPERSAND)
         {
             advance_token(p);
             AST* right = parse_equality(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -747,12 +794,12 @@ AST* parse_bitwise_xor(Parser* p)
     AST* left = parse_bitwise_and(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_CARET)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_CARET)
         {
             advance_token(p);
             AST* right = parse_bitwise_and(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -764,12 +811,12 @@ AST* parse_bitwise_or(Parser* p)
     AST* left = parse_bitwise_xor(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_PIPE)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_PIPE)
         {
             advance_token(p);
             AST* right = parse_bitwise_xor(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -781,12 +828,12 @@ AST* parse_logical_and(Parser* p)
     AST* left = parse_bitwise_or(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_AND)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_AND)
         {
             advance_token(p);
             AST* right = parse_bitwise_or(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -798,12 +845,12 @@ AST* parse_logical_or(Parser* p)
     AST* left = parse_logical_and(p);
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_OR)
+        Tokens t = peek_token(p);
+        if (t == TOKEN_OR)
         {
             advance_token(p);
             AST* right = parse_logical_and(p);
-            left = create_operator_node(t.type, left, right);
+            left = create_operator_node(p->arena, t, left, right);
         }
         else break;
     }
@@ -818,7 +865,7 @@ AST* parse_ternary(Parser* p)
         AST* true_expr = parse_expression(p);
         expect(p, TOKEN_COLON);
         AST* false_expr = parse_ternary(p);
-        return create_ternary_node(cond, true_expr, false_expr);
+        return create_ternary_node(p->arena, cond, true_expr, false_expr);
     }
     return cond;
 }
@@ -826,19 +873,17 @@ AST* parse_ternary(Parser* p)
 AST* parse_assignment(Parser* p)
 {
     AST* left = parse_ternary(p);
-    Token t = peek_token(p);
-    if (t.type == TOKEN_ASSIGN || t.type == TOKEN_PLUS_ASSIGN || t.type == TOKEN_MINUS_ASSIGN ||
-        t.type == TOKEN_STAR_ASSIGN || t.type == TOKEN_SLASH_ASSIGN)
+    Tokens t = peek_token(p);
+    if (t == TOKEN_ASSIGN || t == TOKEN_PLUS_ASSIGN || t == TOKEN_MINUS_ASSIGN ||
+        t == TOKEN_STAR_ASSIGN || t == TOKEN_SLASH_ASSIGN)
     {
         advance_token(p);
         AST* right = parse_assignment(p);
         if (left->type == N_IDENT)
         {
-            char* name = left->data.ident.name;
-            free(left);
-            return create_assign_node(name, right);
+            return create_assign_node(p->arena, left->data.ident.name, right);
         }
-        return create_operator_node(t.type, left, right);
+        return create_operator_node(p->arena, t, left, right);
     }
     return left;
 }
@@ -852,7 +897,7 @@ AST* parse_expression(Parser* p)
 
 AST* parse_declaration(Parser* p)
 {
-    char* type_str = NULL;
+    Type* type = NULL;
     int is_static = 0;
     int is_extern = 0;
     int is_volatile = 0;
@@ -862,46 +907,41 @@ AST* parse_declaration(Parser* p)
 
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_STATIC) { is_static = 1; advance_token(p); }
-        else if (t.type == TOKEN_EXTERN) { is_extern = 1; advance_token(p); }
-        else if (t.type == TOKEN_VOLATILE) { is_volatile = 1; advance_token(p); }
-        else if (t.type == TOKEN_CONST) { is_const = 1; advance_token(p); }
-        else if (t.type == TOKEN_UNSIGNED) { is_unsigned = 1; advance_token(p); }
-        else if (t.type == TOKEN_REGISTER) { is_register = 1; advance_token(p); }
+        Tokens t = peek_token(p);
+        if (t == TOKEN_STATIC) { is_static = 1; advance_token(p); }
+        else if (t == TOKEN_EXTERN) { is_extern = 1; advance_token(p); }
+        else if (t == TOKEN_VOLATILE) { is_volatile = 1; advance_token(p); }
+        else if (t == TOKEN_CONST) { is_const = 1; advance_token(p); }
+        else if (t == TOKEN_UNSIGNED) { is_unsigned = 1; advance_token(p); }
+        else if (t == TOKEN_REGISTER) { is_register = 1; advance_token(p); }
         else break;
     }
 
     if (check_token(p, TOKEN_STRUCT))
     {
         advance_token(p);
-        Token struct_name = expect(p, TOKEN_IDENTIFIER);
-        size_t len = strlen("struct ") + strlen(struct_name.word) + 1;
-        type_str = (char*)malloc(len);
-        strcpy(type_str, "struct ");
-        strcat(type_str, struct_name.word);
+        type = struct_type(p, expect(p, TOKEN_IDENTIFIER));
     }
     else
     {
-        Token type_tok = advance_token(p);
-
-        // NEW: Check if it's a typedef and resolve to real type
-        TypedefEntry* tdef = typedef_table_lookup(type_tok.word);
-        if (tdef) {
-            type_str = _strdup(tdef->real_type);
-            // If typedef has pointer level, we need to handle it
-            // For now, just use the resolved type
+        size_t type_tok = advance_token(p);
+        if (is_unsigned && !typedef_lookup_token(p, type_tok))
+        {
+            char spelling[256];
+            snprintf(spelling, sizeof(spelling), "unsigned %s", token_text(p, type_tok));
+            type = type_named(p->types, spelling);
         }
-        else {
-            type_str = _strdup(type_tok.word);
+        else
+        {
+            type = resolve_type_token(p, type_tok);
         }
     }
 
     int ptr_level = 0;
     while (match_token(p, TOKEN_STAR)) ptr_level++;
 
-    Token name_tok = expect(p, TOKEN_IDENTIFIER);
-    char* name_str = _strdup(name_tok.word);
+    size_t name_tok = expect(p, TOKEN_IDENTIFIER);
+    char* name_str = token_text(p, name_tok);
 
     AST* array_size = NULL;
     if (match_token(p, TOKEN_LBRACKET))
@@ -917,7 +957,7 @@ AST* parse_declaration(Parser* p)
 
     expect(p, TOKEN_SEMICOLON);
 
-    AST* node = create_decl_node(type_str, name_str, ptr_level, init, array_size);
+    AST* node = create_decl_node(p->arena, type, name_str, ptr_level, init, array_size);
     node->data.decl.is_static = is_static;
     node->data.decl.is_extern = is_extern;
     node->data.decl.is_volatile = is_volatile;
@@ -931,10 +971,10 @@ AST* parse_declaration(Parser* p)
 AST* parse_block(Parser* p)
 {
     expect(p, TOKEN_LBRACE);
-    AST* block = create_block_node();
+    AST* block = create_block_node(p->arena);
 
-    while (!check_token(p, TOKEN_RBRACE) && peek_token(p).type != TOKEN_EOF)
-        block_add_statement(block, parse_statement(p));
+    while (!check_token(p, TOKEN_RBRACE) && peek_token(p) != TOKEN_EOF)
+        block_add_statement(p->arena, block, parse_statement(p));
 
     expect(p, TOKEN_RBRACE);
     return block;
@@ -950,7 +990,7 @@ AST* parse_if_statement(Parser* p)
     AST* else_b = NULL;
     if (match_token(p, TOKEN_ELSE))
         else_b = parse_statement(p);
-    return create_if_node(cond, then_b, else_b);
+    return create_if_node(p->arena, cond, then_b, else_b);
 }
 
 AST* parse_while_statement(Parser* p)
@@ -960,7 +1000,7 @@ AST* parse_while_statement(Parser* p)
     AST* cond = parse_expression(p);
     expect(p, TOKEN_RPAREN);
     AST* body = parse_statement(p);
-    return create_while_node(cond, body);
+    return create_while_node(p->arena, cond, body);
 }
 
 AST* parse_for_statement(Parser* p)
@@ -971,12 +1011,12 @@ AST* parse_for_statement(Parser* p)
     AST* init = NULL;
     if (!check_token(p, TOKEN_SEMICOLON))
     {
-        Token t = peek_token(p);
+        Tokens t = peek_token(p);
         // NEW: Check for typedef names as type specifiers
-        if (t.type == TOKEN_INT || t.type == TOKEN_CHAR_KW || t.type == TOKEN_VOID ||
-            t.type == TOKEN_UNSIGNED || t.type == TOKEN_SIGNED ||
-            t.type == TOKEN_STATIC || t.type == TOKEN_CONST ||
-            (t.type == TOKEN_IDENTIFIER && is_typedef_name(t.word)))
+        if (t == TOKEN_INT || t == TOKEN_CHAR_KW || t == TOKEN_VOID ||
+            t == TOKEN_UNSIGNED || t == TOKEN_SIGNED ||
+            t == TOKEN_STATIC || t == TOKEN_CONST ||
+            at_typedef_name(p))
             init = parse_declaration(p);
         else
         {
@@ -997,7 +1037,7 @@ AST* parse_for_statement(Parser* p)
     expect(p, TOKEN_RPAREN);
 
     AST* body = parse_statement(p);
-    return create_for_node(init, cond, incr, body);
+    return create_for_node(p->arena, init, cond, incr, body);
 }
 
 AST* parse_return_statement(Parser* p)
@@ -1007,7 +1047,7 @@ AST* parse_return_statement(Parser* p)
     if (!check_token(p, TOKEN_SEMICOLON))
         value = parse_expression(p);
     expect(p, TOKEN_SEMICOLON);
-    return create_return_node(value);
+    return create_return_node(p->arena, value);
 }
 
 AST* parse_asm_statement(Parser* p)
@@ -1023,51 +1063,51 @@ AST* parse_asm_statement(Parser* p)
     }
 
     expect(p, TOKEN_LPAREN);
-    Token asm_str = expect(p, TOKEN_STRING);
+    size_t asm_str = expect(p, TOKEN_STRING);
     expect(p, TOKEN_RPAREN);
     expect(p, TOKEN_SEMICOLON);
 
-    return create_asm_node(asm_str.word, is_volatile);
+    return create_asm_node(p->arena, token_text(p, asm_str), is_volatile);
 }
 
 AST* parse_statement(Parser* p)
 {
-    Token t = peek_token(p);
+    Tokens t = peek_token(p);
 
-    if (t.type == TOKEN_LBRACE) return parse_block(p);
-    if (t.type == TOKEN_IF) return parse_if_statement(p);
-    if (t.type == TOKEN_WHILE) return parse_while_statement(p);
-    if (t.type == TOKEN_FOR) return parse_for_statement(p);
-    if (t.type == TOKEN_RETURN) return parse_return_statement(p);
-    if (t.type == TOKEN_ASM) return parse_asm_statement(p);
+    if (t == TOKEN_LBRACE) return parse_block(p);
+    if (t == TOKEN_IF) return parse_if_statement(p);
+    if (t == TOKEN_WHILE) return parse_while_statement(p);
+    if (t == TOKEN_FOR) return parse_for_statement(p);
+    if (t == TOKEN_RETURN) return parse_return_statement(p);
+    if (t == TOKEN_ASM) return parse_asm_statement(p);
 
-    if (t.type == TOKEN_BREAK)
+    if (t == TOKEN_BREAK)
     {
         advance_token(p);
         expect(p, TOKEN_SEMICOLON);
-        AST* node = (AST*)malloc(sizeof(AST));
+        AST* node = (AST*)arena_alloc(p->arena, sizeof(AST));
         node->type = N_BREAK;
         return node;
     }
 
-    if (t.type == TOKEN_CONTINUE)
+    if (t == TOKEN_CONTINUE)
     {
         advance_token(p);
         expect(p, TOKEN_SEMICOLON);
-        AST* node = (AST*)malloc(sizeof(AST));
+        AST* node = (AST*)arena_alloc(p->arena, sizeof(AST));
         node->type = N_CONTINUE;
         return node;
     }
 
     // Local declaration - NEW: check for typedef names
-    if (t.type == TOKEN_INT || t.type == TOKEN_CHAR_KW || t.type == TOKEN_VOID ||
-        t.type == TOKEN_STRUCT || t.type == TOKEN_ENUM ||
-        t.type == TOKEN_STATIC || t.type == TOKEN_EXTERN ||
-        t.type == TOKEN_VOLATILE || t.type == TOKEN_CONST ||
-        t.type == TOKEN_UNSIGNED || t.type == TOKEN_SIGNED ||
-        t.type == TOKEN_LONG || t.type == TOKEN_SHORT ||
-        t.type == TOKEN_REGISTER ||
-        (t.type == TOKEN_IDENTIFIER && is_typedef_name(t.word)))  // NEW
+    if (t == TOKEN_INT || t == TOKEN_CHAR_KW || t == TOKEN_VOID ||
+        t == TOKEN_STRUCT || t == TOKEN_ENUM ||
+        t == TOKEN_STATIC || t == TOKEN_EXTERN ||
+        t == TOKEN_VOLATILE || t == TOKEN_CONST ||
+        t == TOKEN_UNSIGNED || t == TOKEN_SIGNED ||
+        t == TOKEN_LONG || t == TOKEN_SHORT ||
+        t == TOKEN_REGISTER ||
+        at_typedef_name(p))  // NEW
         return parse_declaration(p);
 
     AST* expr = parse_expression(p);
@@ -1077,17 +1117,41 @@ AST* parse_statement(Parser* p)
 
 /* ====================== Top-level ====================== */
 
+// Gives type the layout of its parsed member declarations
+static void define_struct(Parser* p, Type* type, AST** members, size_t count)
+{
+    const char** names = (const char**)malloc(sizeof(const char*) * (count + 1));
+    Type** types = (Type**)malloc(sizeof(Type*) * (count + 1));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        DeclNode* member = &members[i]->data.decl;
+        Type* member_type = type_derive(p->types, member->type, member->pointer_level);
+        if (member->array_size)
+        {
+            int array_count = member->array_size->type == N_INTLIT ? member->array_size->data.int_lit.value : 0;
+            member_type = type_array(p->types, member_type, array_count);
+        }
+        names[i] = member->name;
+        types[i] = member_type;
+    }
+    type_struct_define(p->types, type, (int)count, names, types);
+
+    free(types);
+    free(names);
+}
+
 AST* parse_struct_declaration(Parser* p)
 {
     expect(p, TOKEN_STRUCT);
     char* name = NULL;
     if (check_token(p, TOKEN_IDENTIFIER))
-        name = _strdup(advance_token(p).word);
+        name = token_text(p, advance_token(p));
 
     if (check_token(p, TOKEN_SEMICOLON))
     {
         expect(p, TOKEN_SEMICOLON);
-        return create_struct_decl_node(name, NULL, 0);
+        return create_struct_decl_node(p->arena, name, NULL, 0);
     }
 
     expect(p, TOKEN_LBRACE);
@@ -1099,8 +1163,9 @@ AST* parse_struct_declaration(Parser* p)
     {
         if (count >= cap)
         {
-            cap = cap == 0 ? 4 : cap * 2;
-            members = (AST**)realloc(members, cap * sizeof(AST*));
+            size_t new_cap = cap == 0 ? 4 : cap * 2;
+            members = (AST**)arena_grow(p->arena, members, cap * sizeof(AST*), new_cap * sizeof(AST*));
+            cap = new_cap;
         }
         members[count++] = parse_declaration(p);
     }
@@ -1108,7 +1173,8 @@ AST* parse_struct_declaration(Parser* p)
     expect(p, TOKEN_RBRACE);
     expect(p, TOKEN_SEMICOLON);
 
-    return create_struct_decl_node(name, members, count);
+    if (name) define_struct(p, type_struct(p->types, name), members, count);
+    return create_struct_decl_node(p->arena, name, members, count);
 }
 
 AST* parse_typedef(Parser* p)
@@ -1122,9 +1188,9 @@ AST* parse_typedef(Parser* p)
 
         char* struct_name = NULL;
 
-        if (check_token(p, TOKEN_IDENTIFIER) && peek_ahead(p, 1).type == TOKEN_LBRACE)
+        if (check_token(p, TOKEN_IDENTIFIER) && peek_ahead(p, 1) == TOKEN_LBRACE)
         {
-            struct_name = _strdup(advance_token(p).word);
+            struct_name = token_text(p, advance_token(p));
         }
 
         if (check_token(p, TOKEN_LBRACE))
@@ -1138,45 +1204,41 @@ AST* parse_typedef(Parser* p)
             {
                 if (count >= cap)
                 {
-                    cap = cap == 0 ? 4 : cap * 2;
-                    members = (AST**)realloc(members, cap * sizeof(AST*));
+                    size_t new_cap = cap == 0 ? 4 : cap * 2;
+                    members = (AST**)arena_grow(p->arena, members, cap * sizeof(AST*), new_cap * sizeof(AST*));
+                    cap = new_cap;
                 }
                 members[count++] = parse_declaration(p);
             }
 
             expect(p, TOKEN_RBRACE);
 
-            Token alias = expect(p, TOKEN_IDENTIFIER);
+            size_t alias = expect(p, TOKEN_IDENTIFIER);
             expect(p, TOKEN_SEMICOLON);
 
-            char real_type[256];
-            if (struct_name) {
-                snprintf(real_type, sizeof(real_type), "struct %s", struct_name);
-            }
-            else {
-                snprintf(real_type, sizeof(real_type), "struct %s", alias.word);
-            }
+            // An untagged struct takes the alias as its tag
+            Type* type = type_struct(p->types, struct_name ? struct_name : token_text(p, alias));
+            define_struct(p, type, members, count);
 
-            typedef_table_add(alias.word, real_type, 0);
+            typedef_table_add(&p->typedefs, p->names, token_text(p, alias), type);
 
-            return create_typedef_node(real_type, alias.word);
+            return create_typedef_node(p->arena, (char*)type->name, token_text(p, alias));
         }
         else
         {
-            Token old_name = expect(p, TOKEN_IDENTIFIER);
+            size_t old_name = expect(p, TOKEN_IDENTIFIER);
 
             int ptr_level = 0;
             while (match_token(p, TOKEN_STAR)) ptr_level++;
 
-            Token new_name = expect(p, TOKEN_IDENTIFIER);
+            size_t new_name = expect(p, TOKEN_IDENTIFIER);
             expect(p, TOKEN_SEMICOLON);
 
-            char real_type[256];
-            snprintf(real_type, sizeof(real_type), "struct %s", old_name.word);
+            Type* type = struct_type(p, old_name);
 
-            typedef_table_add(new_name.word, real_type, ptr_level);
+            typedef_table_add(&p->typedefs, p->names, token_text(p, new_name), type_derive(p->types, type, ptr_level));
 
-            return create_typedef_node(real_type, new_name.word);
+            return create_typedef_node(p->arena, (char*)type->name, token_text(p, new_name));
         }
     }
 
@@ -1189,37 +1251,37 @@ AST* parse_typedef(Parser* p)
     // Keep consuming type parts until we hit * or an identifier that's followed by ;
     while (1)
     {
-        Token t = peek_token(p);
-        Token next = peek_ahead(p, 1);
+        Tokens t = peek_token(p);
+        Tokens next = peek_ahead(p, 1);
 
         // If this is an identifier followed by ; or *, it's the alias name
-        if (t.type == TOKEN_IDENTIFIER &&
-            (next.type == TOKEN_SEMICOLON || next.type == TOKEN_STAR))
+        if (t == TOKEN_IDENTIFIER &&
+            (next == TOKEN_SEMICOLON || next == TOKEN_STAR))
         {
             break;
         }
 
         // These are all valid type components
-        if (t.type == TOKEN_UNSIGNED || t.type == TOKEN_SIGNED ||
-            t.type == TOKEN_CONST || t.type == TOKEN_VOLATILE ||
-            t.type == TOKEN_LONG || t.type == TOKEN_SHORT ||
-            t.type == TOKEN_INT || t.type == TOKEN_CHAR_KW ||
-            t.type == TOKEN_VOID)
+        if (t == TOKEN_UNSIGNED || t == TOKEN_SIGNED ||
+            t == TOKEN_CONST || t == TOKEN_VOLATILE ||
+            t == TOKEN_LONG || t == TOKEN_SHORT ||
+            t == TOKEN_INT || t == TOKEN_CHAR_KW ||
+            t == TOKEN_VOID)
         {
-            advance_token(p);
+            size_t at = advance_token(p);
             if (strlen(type_buf) > 0) strcat(type_buf, " ");
-            strcat(type_buf, t.word);
+            strncat(type_buf, token_start(p, at), token_length(p, at));
         }
-        else if (t.type == TOKEN_IDENTIFIER)
+        else if (t == TOKEN_IDENTIFIER)
         {
             // Could be a type name (from previous typedef)
             // Check if next token suggests this is still the type
-            if (next.type == TOKEN_IDENTIFIER || next.type == TOKEN_STAR)
+            if (next == TOKEN_IDENTIFIER || next == TOKEN_STAR)
             {
                 // This identifier is part of the type
-                advance_token(p);
+                size_t at = advance_token(p);
                 if (strlen(type_buf) > 0) strcat(type_buf, " ");
-                strcat(type_buf, t.word);
+                strncat(type_buf, token_start(p, at), token_length(p, at));
             }
             else
             {
@@ -1236,19 +1298,20 @@ AST* parse_typedef(Parser* p)
     int ptr_level = 0;
     while (match_token(p, TOKEN_STAR)) ptr_level++;
 
-    Token alias = expect(p, TOKEN_IDENTIFIER);
+    size_t alias = expect(p, TOKEN_IDENTIFIER);
     expect(p, TOKEN_SEMICOLON);
 
     // If type_buf is empty, something went wrong
     if (strlen(type_buf) == 0)
     {
-        fprintf(stderr, "Parse error: empty type in typedef\n");
-        exit(1);
+        diag_fatal(p->diag, DIAG_PARSE, NULL, token_line(p, alias), 0,
+            "Parse error: empty type in typedef");
     }
 
-    typedef_table_add(alias.word, type_buf, ptr_level);
+    Type* type = type_named(p->types, type_buf);
+    typedef_table_add(&p->typedefs, p->names, token_text(p, alias), type_derive(p->types, type, ptr_level));
 
-    return create_typedef_node(type_buf, alias.word);
+    return create_typedef_node(p->arena, (char*)intern_cstr(p->names, type_buf), token_text(p, alias));
 }
 
 AST* parse_enum_declaration(Parser* p)
@@ -1256,7 +1319,7 @@ AST* parse_enum_declaration(Parser* p)
     expect(p, TOKEN_ENUM);
     char* name = NULL;
     if (check_token(p, TOKEN_IDENTIFIER))
-        name = _strdup(advance_token(p).word);
+        name = token_text(p, advance_token(p));
 
     expect(p, TOKEN_LBRACE);
 
@@ -1265,22 +1328,23 @@ AST* parse_enum_declaration(Parser* p)
 
     while (!check_token(p, TOKEN_RBRACE))
     {
-        Token id = expect(p, TOKEN_IDENTIFIER);
+        size_t id = expect(p, TOKEN_IDENTIFIER);
         AST* val = NULL;
 
         if (match_token(p, TOKEN_ASSIGN))
         {
-            val = create_assign_node(id.word, parse_expression(p));
+            val = create_assign_node(p->arena, token_text(p, id), parse_expression(p));
         }
         else
         {
-            val = create_ident_node(id.word);
+            val = create_ident_node(p->arena, token_text(p, id));
         }
 
         if (count >= cap)
         {
-            cap = cap == 0 ? 4 : cap * 2;
-            values = (AST**)realloc(values, cap * sizeof(AST*));
+            size_t new_cap = cap == 0 ? 4 : cap * 2;
+            values = (AST**)arena_grow(p->arena, values, cap * sizeof(AST*), new_cap * sizeof(AST*));
+            cap = new_cap;
         }
         values[count++] = val;
 
@@ -1297,7 +1361,7 @@ AST* parse_enum_declaration(Parser* p)
     expect(p, TOKEN_RBRACE);
     expect(p, TOKEN_SEMICOLON);
 
-    return create_enum_decl_node(name, values, count);
+    return create_enum_decl_node(p->arena, name, values, count);
 }
 
 AST* parse_function(Parser* p)
@@ -1308,30 +1372,22 @@ AST* parse_function(Parser* p)
 
     while (1)
     {
-        Token t = peek_token(p);
-        if (t.type == TOKEN_STATIC) { is_static = 1; advance_token(p); }
-        else if (t.type == TOKEN_INLINE) { is_inline = 1; advance_token(p); }
-        else if (t.type == TOKEN_EXTERN) { is_extern = 1; advance_token(p); }
+        Tokens t = peek_token(p);
+        if (t == TOKEN_STATIC) { is_static = 1; advance_token(p); }
+        else if (t == TOKEN_INLINE) { is_inline = 1; advance_token(p); }
+        else if (t == TOKEN_EXTERN) { is_extern = 1; advance_token(p); }
         else break;
     }
 
-    Token ret_tok = advance_token(p);
-
-    // NEW: Resolve typedef for return type
-    char* ret_type;
-    TypedefEntry* tdef = typedef_table_lookup(ret_tok.word);
-    if (tdef) {
-        ret_type = _strdup(tdef->real_type);
-    }
-    else {
-        ret_type = _strdup(ret_tok.word);
-    }
+    size_t ret_tok = advance_token(p);
 
     int ptr_level = 0;
     while (match_token(p, TOKEN_STAR)) ptr_level++;
 
-    Token name_tok = expect(p, TOKEN_IDENTIFIER);
-    char* name = _strdup(name_tok.word);
+    Type* ret_type = type_derive(p->types, resolve_type_token(p, ret_tok), ptr_level);
+
+    size_t name_tok = expect(p, TOKEN_IDENTIFIER);
+    char* name = token_text(p, name_tok);
 
     expect(p, TOKEN_LPAREN);
 
@@ -1345,16 +1401,14 @@ AST* parse_function(Parser* p)
             while (check_token(p, TOKEN_CONST) || check_token(p, TOKEN_VOLATILE))
                 advance_token(p);
 
-            Token ptok = advance_token(p);
-
-            // NEW: Resolve typedef for parameter type
-            char* ptype;
-            TypedefEntry* ptdef = typedef_table_lookup(ptok.word);
-            if (ptdef) {
-                ptype = _strdup(ptdef->real_type);
+            Type* ptype;
+            if (match_token(p, TOKEN_STRUCT))
+            {
+                ptype = struct_type(p, expect(p, TOKEN_IDENTIFIER));
             }
-            else {
-                ptype = _strdup(ptok.word);
+            else
+            {
+                ptype = resolve_type_token(p, advance_token(p));
             }
 
             int pptr = 0;
@@ -1362,7 +1416,7 @@ AST* parse_function(Parser* p)
 
             char* pname = "";
             if (check_token(p, TOKEN_IDENTIFIER))
-                pname = _strdup(advance_token(p).word);
+                pname = token_text(p, advance_token(p));
 
             AST* arr_sz = NULL;
             if (match_token(p, TOKEN_LBRACKET))
@@ -1374,10 +1428,11 @@ AST* parse_function(Parser* p)
 
             if (pcount >= pcap)
             {
-                pcap = pcap == 0 ? 4 : pcap * 2;
-                params = (AST**)realloc(params, pcap * sizeof(AST*));
+                size_t new_cap = pcap == 0 ? 4 : pcap * 2;
+                params = (AST**)arena_grow(p->arena, params, pcap * sizeof(AST*), new_cap * sizeof(AST*));
+                pcap = new_cap;
             }
-            params[pcount++] = create_decl_node(ptype, pname, pptr, NULL, arr_sz);
+            params[pcount++] = create_decl_node(p->arena, ptype, pname, pptr, NULL, arr_sz);
         } while (match_token(p, TOKEN_COMMA));
     }
 
@@ -1386,7 +1441,7 @@ AST* parse_function(Parser* p)
     if (check_token(p, TOKEN_SEMICOLON))
     {
         expect(p, TOKEN_SEMICOLON);
-        AST* func = create_function_node(ret_type, name, params, pcount, NULL);
+        AST* func = create_function_node(p->arena, ret_type, name, params, pcount, NULL);
         func->data.function.is_static = is_static;
         func->data.function.is_inline = is_inline;
         func->data.function.is_extern = is_extern;
@@ -1394,7 +1449,7 @@ AST* parse_function(Parser* p)
     }
 
     AST* body = parse_block(p);
-    AST* func = create_function_node(ret_type, name, params, pcount, body);
+    AST* func = create_function_node(p->arena, ret_type, name, params, pcount, body);
     func->data.function.is_static = is_static;
     func->data.function.is_inline = is_inline;
     func->data.function.is_extern = is_extern;
@@ -1403,18 +1458,18 @@ AST* parse_function(Parser* p)
 
 AST* parse_program(Parser* p)
 {
-    AST* prog = create_program_node();
+    AST* prog = create_program_node(p->arena);
 
-    while (peek_token(p).type != TOKEN_EOF)
+    while (peek_token(p) != TOKEN_EOF)
     {
-        Token t = peek_token(p);
-
-        if (t.type == TOKEN_STRUCT)
-            program_add_global(prog, parse_struct_declaration(p));
-        else if (t.type == TOKEN_TYPEDEF)
-            program_add_global(prog, parse_typedef(p));
-        else if (t.type == TOKEN_ENUM)
-            program_add_global(prog, parse_enum_declaration(p));
+        Tokens t = peek_token(p);
+
+        if (t == TOKEN_STRUCT)
+            program_add_global(p->arena, prog, parse_struct_declaration(p));
+        else if (t == TOKEN_TYPEDEF)
+            program_add_global(p->arena, prog, parse_typedef(p));
+        else if (t == TOKEN_ENUM)
+            program_add_global(p->arena, prog, parse_enum_declaration(p));
         else
         {
             size_t saved_pos = p->pos;
@@ -1429,126 +1484,15 @@ AST* parse_program(Parser* p)
             advance_token(p);
             while (match_token(p, TOKEN_STAR));
 
-            int is_func = check_token(p, TOKEN_IDENTIFIER) && peek_ahead(p, 1).type == TOKEN_LPAREN;
+            int is_func = check_token(p, TOKEN_IDENTIFIER) && peek_ahead(p, 1) == TOKEN_LPAREN;
             p->pos = saved_pos;
 
             if (is_func)
-                program_add_function(prog, parse_function(p));
+                program_add_function(p->arena, prog, parse_function(p));
             else
-                program_add_global(prog, parse_declaration(p));
+                program_add_global(p->arena, prog, parse_declaration(p));
         }
     }
 
     return prog;
 }
-
-/* ====================== Memory Cleanup ====================== */
-
-void ast_free(AST* node)
-{
-    if (!node) return;
-
-    switch (node->type)
-    {
-    case N_STRING_LIT: free(node->data.string_lit.value); break;
-    case N_IDENT: free(node->data.ident.name); break;
-    case N_OPERATOR:
-        ast_free(node->data.op.left);
-        ast_free(node->data.op.right);
-        break;
-    case N_UNARY: ast_free(node->data.unary.operand); break;
-    case N_ASSIGN:
-        free(node->data.assign.var_name);
-        ast_free(node->data.assign.value);
-        break;
-    case N_DECL:
-        free(node->data.decl.type);
-        free(node->data.decl.name);
-        ast_free(node->data.decl.init_value);
-        ast_free(node->data.decl.array_size);
-        break;
-    case N_RETURN: ast_free(node->data.return_stmt.value); break;
-    case N_BLOCK:
-        for (size_t i = 0; i < node->data.block.count; i++)
-            ast_free(node->data.block.statements[i]);
-        free(node->data.block.statements);
-        break;
-    case N_FUNCTION:
-        free(node->data.function.return_type);
-        free(node->data.function.name);
-        for (size_t i = 0; i < node->data.function.param_count; i++)
-            ast_free(node->data.function.params[i]);
-        free(node->data.function.params);
-        ast_free(node->data.function.body);
-        break;
-    case N_IF:
-        ast_free(node->data.if_stmt.condition);
-        ast_free(node->data.if_stmt.then_block);
-        ast_free(node->data.if_stmt.else_block);
-        break;
-    case N_WHILE:
-        ast_free(node->data.while_stmt.condition);
-        ast_free(node->data.while_stmt.body);
-        break;
-    case N_FOR:
-        ast_free(node->data.for_stmt.init);
-        ast_free(node->data.for_stmt.condition);
-        ast_free(node->data.for_stmt.increment);
-        ast_free(node->data.for_stmt.body);
-        break;
-    case N_CALL:
-        free(node->data.call.name);
-        for (size_t i = 0; i < node->data.call.arg_count; i++)
-            ast_free(node->data.call.args[i]);
-        free(node->data.call.args);
-        break;
-    case N_ARRAY_ACCESS:
-        ast_free(node->data.array_access.array);
-        ast_free(node->data.array_access.index);
-        break;
-    case N_MEMBER_ACCESS:
-        ast_free(node->data.member_access.object);
-        free(node->data.member_access.member);
-        break;
-    case N_STRUCT_DECL:
-        if (node->data.struct_decl.name) free(node->data.struct_decl.name);
-        for (size_t i = 0; i < node->data.struct_decl.member_count; i++)
-            ast_free(node->data.struct_decl.members[i]);
-        free(node->data.struct_decl.members);
-        break;
-    case N_TYPEDEF:
-        free(node->data.typedef_decl.old_name);
-        free(node->data.typedef_decl.new_name);
-        break;
-    case N_ENUM_DECL:
-        if (node->data.enum_decl.name) free(node->data.enum_decl.name);
-        for (size_t i = 0; i < node->data.enum_decl.value_count; i++)
-            ast_free(node->data.enum_decl.values[i]);
-        free(node->data.enum_decl.values);
-        break;
-    case N_CAST:
-        free(node->data.cast.type);
-        ast_free(node->data.cast.expr);
-        break;
-    case N_SIZEOF: ast_free(node->data.sizeof_expr.expr); break;
-    case N_TERNARY:
-        ast_free(node->data.ternary.condition);
-        ast_free(node->data.ternary.true_expr);
-        ast_free(node->data.ternary.false_expr);
-        break;
-    case N_ASM:
-        free(node->data.asm_stmt.assembly_code);
-        break;
-    case N_PROGRAM:
-        for (size_t i = 0; i < node->data.program.func_count; i++)
-            ast_free(node->data.program.functions[i]);
-        free(node->data.program.functions);
-        for (size_t i = 0; i < node->data.program.global_count; i++)
-            ast_free(node->data.program.globals[i]);
-        free(node->data.program.globals);
-        break;
-    default:
-        break;
-    }
-    free(node);
-}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+#ifndef TYPES_H
+#define TYPES_H
+
+#include "../../Includes.h"
+#include "../../Memory/Arena/Arena.h"
+#include "../../Memory/Interner/Interner.h"
+#include "../../Memory/NameTable/NameTable.h"
+
+typedef enum {
+    TYPE_VOID,
+    TYPE_CHAR,
+    TYPE_SHORT,
+    TYPE_INT,
+    TYPE_LONG,
+    TYPE_NAMED,           // Unknown name such as bool; treated as an int
+    TYPE_STRUCT,
+    TYPE_POINTER,
+    TYPE_ARRAY
+} TypeKind;
+
+typedef struct Type Type;
+
+// Names are interned
+typedef struct {
+    const char* name;
+    Type* type;
+    int offset;
+    int size;
+} TypeMember;
+
+// One descriptor per distinct type, so types compare with == and every
+// property is computed once, when the type is first built. Struct types are
+// created incomplete on first mention and laid out when their body is seen.
+struct Type {
+    TypeKind kind;
+    int is_unsigned;
+    int size;             // Bytes; 4 for a struct with no body yet
+    int pointer_level;    // Pointers between this type and its base scalar
+    int array_count;      // Elements of an array type, 0 if unknown
+    Type* base;           // Pointee or element type, NULL for the rest
+    const char* name;     // Interned spelling: "unsigned char", "struct Foo"
+    const char* tag;      // Interned struct tag, NULL for the rest
+
+    TypeMember* members;
+    int member_count;
+    int is_complete;
+
+    Type* pointer;        // The type pointing to this one, built on demand
+    Type* arrays;         // Array types of this element, linked by next_array
+    Type* next_array;
+};
+
+// Owns every descriptor of one compilation; names come from the interner,
+// which must outlive the table
+typedef struct {
+    Arena* storage;
+    Interner* names;
+    NameTable index;      // Spelling or canonical name to position in types
+    Type** types;
+    int count;
+    int capacity;
+} TypeTable;
+
+TypeTable* type_table_create(Interner* names);
+void type_table_destroy(TypeTable* table);
+
+// A scalar or struct type from its spelling, e.g. "int", "unsigned char",
+// "const char" or "struct Foo"; qualifiers are dropped
+Type* type_named(TypeTable* table, const char* spelling);
+Type* type_struct(TypeTable* table, const char* tag);
+Type* type_pointer(TypeTable* table, Type* base);
+Type* type_array(TypeTable* table, Type* element, int count);
+
+// base with pointer_level pointers applied
+Type* type_derive(TypeTable* table, Type* base, int pointer_level);
+
+// Lays out members in order, each starting dword aligned. A struct that
+// already has a body keeps its first one.
+void type_struct_define(TypeTable* table, Type* type, int count,
+    const char** names, Type** types);
+
+// The struct type with this tag, or NULL if it was never mentioned
+Type* type_find_struct(TypeTable* table, const char* tag);
+const TypeMember* type_find_member(const Type* type, const char* name);
+
+// Size of what a pointer or array steps over; a scalar's own size
+int type_element_size(const Type* type);
+
+// The struct behind any pointers and arrays, NULL if there is none
+Type* type_struct_of(Type* type);
+
+#endif // !TYPES_H
@@ -0,0 +1,252 @@
+#include "../Types.h"
+
+#define TYPE_NAME_MAX 256
+
+/* ====================== Table ====================== */
+
+TypeTable* type_table_create(Interner* names) {
+    TypeTable* table = (TypeTable*)malloc(sizeof(TypeTable));
+    table->storage = arena_create(0);
+    table->names = names;
+    name_table_init(&table->index);
+    table->types = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    return table;
+}
+
+void type_table_destroy(TypeTable* table) {
+    if (!table) return;
+    name_table_free(&table->index);
+    free(table->types);
+    arena_destroy(table->storage);
+    free(table);
+}
+
+static Type* type_new(TypeTable* table, TypeKind kind, int size, const char* name) {
+    Type* type = (Type*)arena_alloc(table->storage, sizeof(Type));
+    memset(type, 0, sizeof(Type));
+    type->kind = kind;
+    type->size = size;
+    type->name = name;
+    type->is_complete = 1;
+    return type;
+}
+
+// Named types are indexed by canonical name; derived ones hang off their base
+static Type* type_add_named(TypeTable* table, Type* type) {
+    if (table->count >= table->capacity) {
+        table->capacity = table->capacity == 0 ? 32 : table->capacity * 2;
+        table->types = (Type**)realloc(table->types, sizeof(Type*) * table->capacity);
+    }
+    name_table_put(&table->index, type->name, table->count);
+    table->types[table->count++] = type;
+    return type;
+}
+
+static Type* type_lookup(TypeTable* table, const char* name) {
+    int index = name_table_get(&table->index, name, -1);
+    return index >= 0 ? table->types[index] : NULL;
+}
+
+/* ====================== Spelling ====================== */
+
+static int word_is(const char* word, size_t len, const char* keyword) {
+    return strlen(keyword) == len && strncmp(word, keyword, len) == 0;
+}
+
+// Reads a scalar spelling such as "const unsigned long int" into its kind
+// and canonical name; anything that is not a keyword names itself
+static TypeKind parse_spelling(const char* spelling, int* is_unsigned, char* canonical) {
+    TypeKind kind = TYPE_INT;
+    int has_base = 0;
+    const char* named = NULL;
+    size_t named_len = 0;
+    *is_unsigned = 0;
+
+    const char* p = spelling;
+    while (*p) {
+        while (*p == ' ') p++;
+        const char* word = p;
+        while (*p && *p != ' ') p++;
+        size_t len = (size_t)(p - word);
+        if (len == 0) break;
+
+        if (word_is(word, len, "unsigned")) *is_unsigned = 1;
+        else if (word_is(word, len, "signed") || word_is(word, len, "const") ||
+            word_is(word, len, "volatile")) continue;
+        else if (word_is(word, len, "char")) { kind = TYPE_CHAR; has_base = 1; }
+        else if (word_is(word, len, "short")) { kind = TYPE_SHORT; has_base = 1; }
+        else if (word_is(word, len, "long")) { kind = TYPE_LONG; has_base = 1; }
+        else if (word_is(word, len, "void")) { kind = TYPE_VOID; has_base = 1; }
+        else if (word_is(word, len, "int")) {
+            // "short int" and "long int" are short and long
+            if (!has_base) kind = TYPE_INT;
+            has_base = 1;
+        }
+        else if (!named) { named = word; named_len = len; }
+    }
+
+    if (named && !has_base) {
+        snprintf(canonical, TYPE_NAME_MAX, "%.*s", (int)named_len, named);
+        *is_unsigned = 0;
+        return TYPE_NAMED;
+    }
+
+    static const char* keywords[] = { "void", "char", "short", "int", "long" };
+    snprintf(canonical, TYPE_NAME_MAX, "%s%s", *is_unsigned ? "unsigned " : "", keywords[kind]);
+    return kind;
+}
+
+static int scalar_size(TypeKind kind) {
+    switch (kind) {
+    case TYPE_CHAR:  return 1;
+    case TYPE_SHORT: return 2;
+    case TYPE_VOID:  return 1;    // void* arithmetic steps by bytes
+    default:         return 4;
+    }
+}
+
+Type* type_named(TypeTable* table, const char* spelling) {
+    // Spellings are indexed too, so the same text is only parsed once
+    const char* key = intern_cstr(table->names, spelling);
+    Type* type = type_lookup(table, key);
+    if (type) return type;
+
+    if (strncmp(spelling, "struct ", 7) == 0) {
+        type = type_struct(table, spelling + 7);
+    }
+    else {
+        char canonical[TYPE_NAME_MAX];
+        int is_unsigned;
+        TypeKind kind = parse_spelling(spelling, &is_unsigned, canonical);
+        const char* name = intern_cstr(table->names, canonical);
+
+        type = type_lookup(table, name);
+        if (!type) {
+            type = type_new(table, kind, scalar_size(kind), name);
+            type->is_unsigned = is_unsigned;
+            type_add_named(table, type);
+        }
+    }
+
+    if (key != type->name) name_table_put(&table->index, key, name_table_get(&table->index, type->name, -1));
+    return type;
+}
+
+/* ====================== Structs ====================== */
+
+Type* type_struct(TypeTable* table, const char* tag) {
+    char buf[TYPE_NAME_MAX];
+    snprintf(buf, sizeof(buf), "struct %s", tag);
+    const char* name = intern_cstr(table->names, buf);
+
+    Type* type = type_lookup(table, name);
+    if (type) return type;
+
+    type = type_new(table, TYPE_STRUCT, 4, name);
+    type->tag = intern_cstr(table->names, tag);
+    type->is_complete = 0;
+    return type_add_named(table, type);
+}
+
+Type* type_find_struct(TypeTable* table, const char* tag) {
+    char buf[TYPE_NAME_MAX];
+    snprintf(buf, sizeof(buf), "struct %s", tag);
+    Type* type = type_lookup(table, buf);
+    return type && type->kind == TYPE_STRUCT ? type : NULL;
+}
+
+void type_struct_define(TypeTable* table, Type* type, int count,
+    const char** names, Type** types) {
+    if (type->kind != TYPE_STRUCT || type->is_complete) return;
+
+    type->members = (TypeMember*)arena_alloc(table->storage, sizeof(TypeMember) * (count ? count : 1));
+    type->member_count = count;
+
+    int offset = 0;
+    for (int i = 0; i < count; i++) {
+        TypeMember* member = &type->members[i];
+        member->name = intern_cstr(table->names, names[i]);
+        member->type = types[i];
+        member->offset = offset;
+        member->size = types[i]->size;
+        offset += member->size;
+
+        // Align to 4 bytes for next member
+        offset = (offset + 3) & ~3;
+    }
+    type->size = offset;
+    type->is_complete = 1;
+
+    // Arrays of it built while it had no body were sized as 4 byte elements
+    for (Type* array = type->arrays; array; array = array->next_array) {
+        array->size = offset * (array->array_count > 0 ? array->array_count : 1);
+    }
+}
+
+const TypeMember* type_find_member(const Type* type, const char* name) {
+    if (!type || type->kind != TYPE_STRUCT) return NULL;
+    for (int i = 0; i < type->member_count; i++) {
+        if (type->members[i].name == name || strcmp(type->members[i].name, name) == 0) {
+            return &type->members[i];
+        }
+    }
+    return NULL;
+}
+
+/* ====================== Derived Types ====================== */
+
+static const char* derived_name(TypeTable* table, const Type* base, const char* suffix) {
+    char buf[TYPE_NAME_MAX];
+    snprintf(buf, sizeof(buf), "%s%s", base->name, suffix);
+    return intern_cstr(table->names, buf);
+}
+
+Type* type_pointer(TypeTable* table, Type* base) {
+    if (base->pointer) return base->pointer;
+
+    Type* type = type_new(table, TYPE_POINTER, 4, derived_name(table, base, "*"));
+    type->base = base;
+    type->pointer_level = base->pointer_level + 1;
+    base->pointer = type;
+    return type;
+}
+
+Type* type_derive(TypeTable* table, Type* base, int pointer_level) {
+    for (int i = 0; i < pointer_level; i++) base = type_pointer(table, base);
+    return base;
+}
+
+Type* type_array(TypeTable* table, Type* element, int count) {
+    for (Type* t = element->arrays; t; t = t->next_array) {
+        if (t->array_count == count) return t;
+    }
+
+    char suffix[32];
+    if (count > 0) snprintf(suffix, sizeof(suffix), "[%d]", count);
+    else snprintf(suffix, sizeof(suffix), "[]");
+
+    Type* type = type_new(table, TYPE_ARRAY, 0, derived_name(table, element, suffix));
+    type->base = element;
+    type->array_count = count;
+    type->pointer_level = element->pointer_level;
+    // An array of unknown extent is sized as one element
+    type->size = element->size * (count > 0 ? count : 1);
+    type->next_array = element->arrays;
+    element->arrays = type;
+    return type;
+}
+
+/* ====================== Queries ====================== */
+
+int type_element_size(const Type* type) {
+    if (!type) return 4;
+    if (type->kind == TYPE_POINTER || type->kind == TYPE_ARRAY) return type->base->size;
+    return type->size;
+}
+
+Type* type_struct_of(Type* type) {
+    while (type && (type->kind == TYPE_POINTER || type->kind == TYPE_ARRAY)) type = type->base;
+    return type && type->kind == TYPE_STRUCT ? type : NULL;
+}
@@ -0,0 +1,172 @@
+// Keyword recognition microbenchmark. Classifies a generated corpus of
+// identifiers, about 30% keywords and the rest typical kernel names, with
+// the scanner's check_keyword and with the strcmp chain it replaced, and
+// prints the throughput of each.
+//
+//   gcc -O2 KeywordBench.c ../../Tokenizer/Scanner/Tokenizer.c -o keyword_bench
+//   cl /O2 KeywordBench.c ..\..\Tokenizer\Scanner\Tokenizer.c
+//
+// Usage: keyword_bench [identifiers] [rounds]
+
+#include "../../Tokenizer/Tokenizer.h"
+#include <time.h>
+
+#define DEFAULT_IDENTIFIERS 2000000
+#define DEFAULT_ROUNDS 10
+
+static const char* keywords[] = {
+    "int", "char", "void", "struct", "typedef", "enum", "if", "else", "while",
+    "for", "return", "sizeof", "break", "continue", "inline", "static",
+    "extern", "volatile", "const", "unsigned", "signed", "long", "short",
+    "register", "asm", "__asm__", "__packed", "__attribute__"
+};
+
+static const char* identifiers[] = {
+    "vga_cursor", "kernel_main", "print_string", "x", "i", "buffer", "len",
+    "outb", "inb", "memset", "strlen", "color", "port", "value", "result",
+    "count", "ptr", "next", "node", "data"
+};
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+// The keyword test the scanner used before the perfect hash, kept as the
+// baseline: one strcmp per keyword on NUL-terminated text
+static Tokens strcmp_check_keyword(const char* word) {
+    if (strcmp(word, "int") == 0) return TOKEN_INT;
+    if (strcmp(word, "char") == 0) return TOKEN_CHAR_KW;
+    if (strcmp(word, "void") == 0) return TOKEN_VOID;
+    if (strcmp(word, "struct") == 0) return TOKEN_STRUCT;
+    if (strcmp(word, "typedef") == 0) return TOKEN_TYPEDEF;
+    if (strcmp(word, "enum") == 0) return TOKEN_ENUM;
+    if (strcmp(word, "if") == 0) return TOKEN_IF;
+    if (strcmp(word, "else") == 0) return TOKEN_ELSE;
+    if (strcmp(word, "while") == 0) return TOKEN_WHILE;
+    if (strcmp(word, "for") == 0) return TOKEN_FOR;
+    if (strcmp(word, "return") == 0) return TOKEN_RETURN;
+    if (strcmp(word, "sizeof") == 0) return TOKEN_SIZEOF;
+    if (strcmp(word, "break") == 0) return TOKEN_BREAK;
+    if (strcmp(word, "continue") == 0) return TOKEN_CONTINUE;
+    if (strcmp(word, "inline") == 0) return TOKEN_INLINE;
+    if (strcmp(word, "static") == 0) return TOKEN_STATIC;
+    if (strcmp(word, "extern") == 0) return TOKEN_EXTERN;
+    if (strcmp(word, "volatile") == 0) return TOKEN_VOLATILE;
+    if (strcmp(word, "const") == 0) return TOKEN_CONST;
+    if (strcmp(word, "unsigned") == 0) return TOKEN_UNSIGNED;
+    if (strcmp(word, "signed") == 0) return TOKEN_SIGNED;
+    if (strcmp(word, "long") == 0) return TOKEN_LONG;
+    if (strcmp(word, "short") == 0) return TOKEN_SHORT;
+    if (strcmp(word, "register") == 0) return TOKEN_REGISTER;
+    if (strcmp(word, "asm") == 0) return TOKEN_ASM;
+    if (strcmp(word, "__asm__") == 0) return TOKEN_ASM;
+    if (strcmp(word, "__packed") == 0) return TOKEN_PACKED;
+    return TOKEN_IDENTIFIER;
+}
+
+typedef struct {
+    char* text;           // Every identifier, each followed by a NUL
+    size_t* offsets;
+    size_t* lengths;
+    size_t count;
+} Corpus;
+
+// Same corpus for the same count on every run and platform
+static void corpus_generate(Corpus* corpus, size_t count) {
+    size_t capacity = count * 16;
+    size_t pos = 0;
+    unsigned seed = 12345;
+
+    corpus->text = (char*)malloc(capacity);
+    corpus->offsets = (size_t*)malloc(sizeof(size_t) * count);
+    corpus->lengths = (size_t*)malloc(sizeof(size_t) * count);
+    corpus->count = count;
+
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        const char* word = (seed >> 16) % 10 < 3 ?
+            keywords[(seed >> 8) % COUNT(keywords)] :
+            identifiers[(seed >> 4) % COUNT(identifiers)];
+        size_t len = strlen(word);
+        memcpy(corpus->text + pos, word, len + 1);
+        corpus->offsets[i] = pos;
+        corpus->lengths[i] = len;
+        pos += len + 1;
+    }
+}
+
+static void corpus_free(Corpus* corpus) {
+    free(corpus->text);
+    free(corpus->offsets);
+    free(corpus->lengths);
+}
+
+// Both tests must agree on every keyword and every proper prefix of one
+static int check_agreement(void) {
+    char word[32];
+    for (size_t i = 0; i < COUNT(keywords); i++) {
+        size_t len = strlen(keywords[i]);
+        for (size_t k = 1; k <= len; k++) {
+            memcpy(word, keywords[i], k);
+            word[k] = '\0';
+            if (check_keyword(word, k) != strcmp_check_keyword(word)) {
+                fprintf(stderr, "Mismatch on \"%s\"\n", word);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static double seconds_since(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void report(const char* name, double seconds, size_t lookups) {
+    printf("%-24s %8.3f s %10.1f M identifiers/s\n",
+        name, seconds, seconds > 0 ? lookups / seconds / 1e6 : 0.0);
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? (size_t)atol(argv[1]) : DEFAULT_IDENTIFIERS;
+    int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+    if (count == 0 || rounds <= 0) {
+        fprintf(stderr, "Usage: %s [identifiers] [rounds]\n", argv[0]);
+        return 1;
+    }
+    if (!check_agreement()) return 1;
+
+    Corpus corpus;
+    corpus_generate(&corpus, count);
+    size_t lookups = count * rounds;
+    size_t chain_hits = 0;
+    size_t hashed_hits = 0;
+
+    clock_t start = clock();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++) {
+            chain_hits += strcmp_check_keyword(corpus.text + corpus.offsets[i]) != TOKEN_IDENTIFIER;
+        }
+    }
+    double chain = seconds_since(start);
+
+    start = clock();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++) {
+            hashed_hits += check_keyword(corpus.text + corpus.offsets[i],
+                corpus.lengths[i]) != TOKEN_IDENTIFIER;
+        }
+    }
+    double hashed = seconds_since(start);
+
+    printf("%zu identifiers x %d rounds, %zu keywords\n", count, rounds, hashed_hits);
+    if (chain_hits != hashed_hits) {
+        fprintf(stderr, "Keyword counts differ: %zu vs %zu\n", chain_hits, hashed_hits);
+        corpus_free(&corpus);
+        return 1;
+    }
+    report("strcmp chain", chain, lookups);
+    report("check_keyword", hashed, lookups);
+    if (hashed > 0) printf("speedup %.1fx\n", chain / hashed);
+
+    corpus_free(&corpus);
+    return 0;
+}
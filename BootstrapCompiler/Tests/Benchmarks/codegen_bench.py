@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Codegen throughput benchmark in assembly lines per second.
+
+Generates --functions functions, each with a block of debug tracing behind
+#ifdef DEBUG_TRACE, compiles them at each of --levels with --stats and
+reports the codegen phase time and lines/s, best of --runs. --wall times
+whole compiles instead, for builds from before --stats; builds from before
+-O1 also need --levels=-O0. Lines are counted in the output file when the
+build does not report how many it emitted.
+
+Usage: codegen_bench.py <compiler> [--functions N] [--levels=-O0,-O1] [--runs N]
+                        [--wall] [--keep DIR]
+"""
+import argparse
+import os
+import sys
+import tempfile
+
+from compiler_stats import best_of
+
+TRACE_LINES = 8
+
+
+def write_source(path, functions):
+    with open(path, "w") as f:
+        f.write("#define DEBUG_TRACE\n\n")
+        for n in range(functions):
+            f.write("int f%d(int x) {\n#ifdef DEBUG_TRACE\n" % n)
+            for k in range(TRACE_LINES):
+                f.write("    print_int(x + %d); newline(); x = x * %d + (x >> %d);\n"
+                        % (k, k + 1, k % 5))
+            f.write("#endif\n    return x + %d;\n}\n" % n)
+        # Call everything so tree shaking at -O1 keeps it all
+        f.write("\nint kernel_main() {\n    int x = 1;\n")
+        for n in range(functions):
+            f.write("    x = f%d(x);\n" % n)
+        f.write("    return x;\n}\n")
+
+
+def count_lines(path):
+    with open(path, "rb") as f:
+        return sum(1 for _ in f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark codegen throughput.")
+    parser.add_argument("compiler")
+    parser.add_argument("--functions", type=int, default=2000)
+    parser.add_argument("--levels", default="-O0,-O1")
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--wall", action="store_true", help="time whole compiles without --stats")
+    parser.add_argument("--keep", metavar="DIR", help="write the generated file here and keep it")
+    args = parser.parse_args()
+
+    compiler = os.path.abspath(args.compiler)
+    print("%d functions (best of %d)" % (args.functions, args.runs))
+    print("%-6s %10s %12s %14s" % ("level", "lines", "ms", "lines/s"))
+    with tempfile.TemporaryDirectory() as scratch:
+        work = args.keep or scratch
+        os.makedirs(work, exist_ok=True)
+        source = os.path.join(work, "trace.c")
+        write_source(source, args.functions)
+
+        for opt_level in args.levels.split(","):
+            # -O0 is the default, and the only level of the oldest builds
+            extra_args = [] if opt_level == "-O0" else [opt_level]
+            stats = best_of(args.runs, compiler, source, extra_args, use_stats=not args.wall)
+            ms = stats["wall"] if args.wall else stats["codegen"]
+            lines = stats.get("lines_emitted") or count_lines(os.path.join(work, "trace.asm"))
+            print("%-6s %10d %12.2f %14.0f" % (opt_level, lines, ms,
+                                              lines * 1000 / ms if ms > 0 else 0))
+    print("(%s, lines %s)" % ("whole compile" if args.wall else "codegen phase",
+                              "in the output file" if "lines_emitted" not in stats else "emitted"))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,54 @@
+"""Runs the compiler with --stats and reads back what it printed.
+
+Shared by the benchmark scripts in this directory. Builds from before
+--stats existed can still be timed as a whole: pass use_stats=False and
+only the wall-clock time is filled in.
+"""
+import os
+import re
+import subprocess
+import time
+
+PHASES = ["preprocess", "tokenize", "parse", "optimize", "codegen", "total"]
+
+
+def compile_stats(compiler, source, extra_args=(), use_stats=True):
+    """Compiles source once; returns times in ms and the reported sizes."""
+    output = os.path.splitext(source)[0] + ".asm"
+    command = [compiler, source, "-o", output] + list(extra_args)
+    if use_stats:
+        command.append("--stats")
+
+    start = time.perf_counter()
+    result = subprocess.run(command, capture_output=True, text=True)
+    stats = {"wall": (time.perf_counter() - start) * 1000}
+    if result.returncode != 0:
+        raise RuntimeError("compile failed:\n" + result.stdout[-2000:] + result.stderr)
+    if not use_stats:
+        return stats
+
+    for phase in PHASES:
+        match = re.search(r"^%s\s+([\d.]+)$" % phase, result.stdout, re.M)
+        stats[phase] = float(match.group(1))
+    # Sizes are left out when the build does not report them
+    match = re.search(r"^(\d+) assembly lines emitted", result.stdout, re.M)
+    if match:
+        stats["lines_emitted"] = int(match.group(1))
+    match = re.search(r"^(\d+) source bytes, (\d+) after preprocessing, (\d+) tokens", result.stdout, re.M)
+    if match:
+        stats["source_bytes"], stats["preprocessed_bytes"], stats["tokens"] = map(int, match.groups())
+    return stats
+
+
+def best_of(runs, compiler, source, extra_args=(), use_stats=True):
+    """Fastest of several compiles, time by time."""
+    best = None
+    for _ in range(runs):
+        stats = compile_stats(compiler, source, extra_args, use_stats)
+        if best is None:
+            best = stats
+            continue
+        for key in PHASES + ["wall"]:
+            if key in stats:
+                best[key] = min(best[key], stats[key])
+    return best
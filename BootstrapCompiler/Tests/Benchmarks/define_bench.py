@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Preprocessor benchmark over a header with thousands of #defines.
+
+Generates a hardware-style header of --defines register macros and a file
+that includes it and references them --references times, compiles it with
+--stats and reports the preprocessing time, best of --runs. --wall times
+whole compiles instead, for builds from before --stats.
+
+Usage: define_bench.py <compiler> [--defines N] [--references N] [--runs N]
+                       [--wall] [--keep DIR]
+"""
+import argparse
+import os
+import random
+import sys
+import tempfile
+
+from compiler_stats import best_of
+
+REFERENCES_PER_LINE = 10
+LINES_PER_FUNCTION = 100
+
+
+def write_header(path, defines):
+    with open(path, "w") as f:
+        f.write("// Generated register map\n")
+        for n in range(defines):
+            f.write("#define REG_%d 0x%08X\n" % (n, 0x40000000 + n * 4))
+
+
+def write_source(path, defines, references):
+    rng = random.Random(12345)
+    lines = (references + REFERENCES_PER_LINE - 1) // REFERENCES_PER_LINE
+    functions = (lines + LINES_PER_FUNCTION - 1) // LINES_PER_FUNCTION
+    with open(path, "w") as f:
+        f.write('#include "hw.h"\n\n')
+        for fn in range(functions):
+            f.write("int read_block_%d() {\n    int sum = 0;\n" % fn)
+            for _ in range(min(LINES_PER_FUNCTION, lines - fn * LINES_PER_FUNCTION)):
+                regs = " ^ ".join("REG_%d" % rng.randrange(defines)
+                                  for _ in range(REFERENCES_PER_LINE))
+                f.write("    sum = sum ^ %s;\n" % regs)
+            f.write("    return sum;\n}\n\n")
+        f.write("int kernel_main() {\n    return read_block_0();\n}\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark #define lookup in the preprocessor.")
+    parser.add_argument("compiler")
+    parser.add_argument("--defines", type=int, default=10000)
+    parser.add_argument("--references", type=int, default=100000)
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--wall", action="store_true", help="time whole compiles without --stats")
+    parser.add_argument("--keep", metavar="DIR", help="write the generated files here and keep them")
+    args = parser.parse_args()
+
+    compiler = os.path.abspath(args.compiler)
+    with tempfile.TemporaryDirectory() as scratch:
+        work = args.keep or scratch
+        os.makedirs(work, exist_ok=True)
+        write_header(os.path.join(work, "hw.h"), args.defines)
+        source = os.path.join(work, "main.c")
+        write_source(source, args.defines, args.references)
+
+        stats = best_of(args.runs, compiler, source, use_stats=not args.wall)
+
+    print("%d defines, %d references (best of %d)" % (args.defines, args.references, args.runs))
+    if not args.wall:
+        print("%d bytes after preprocessing" % stats["preprocessed_bytes"])
+        print("preprocess %10.2f ms" % stats["preprocess"])
+        print("total      %10.2f ms" % stats["total"])
+    print("wall       %10.2f ms" % stats["wall"])
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
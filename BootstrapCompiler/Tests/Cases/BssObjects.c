@@ -0,0 +1,47 @@
+// Zero-initialized globals reserve their type's full size in .bss: a
+// struct is not a dword, and an array extent that is a constant expression
+// is sized at -O0 as well as at -O1.
+// expect: 1 2 7
+// expect: 9
+// expect: 63
+// expect: 5
+#include "Check.h"
+
+#define ROWS 16
+
+typedef struct {
+    int a;
+    int b;
+    int c;
+} Point;
+
+Point point;
+int after_point;
+char buf[ROWS * 64];
+int after_buf;
+char odd[3];
+int after_odd;
+
+int kernel_main() {
+    char line[8];
+    after_point = 9;
+    point.a = 1;
+    point.b = 2;
+    point.c = 7;
+    buf[ROWS * 64 - 1] = 63;
+    after_buf = 5;
+    after_odd = 0;
+    odd[2] = 1;
+
+    line[0] = '0' + point.a;
+    line[1] = ' ';
+    line[2] = '0' + point.b;
+    line[3] = ' ';
+    line[4] = '0' + point.c;
+    line[5] = 0;
+    check_line(line);
+    check_int(after_point);
+    check_int(buf[ROWS * 64 - 1]);
+    check_int(after_buf + after_odd);
+    return 0;
+}
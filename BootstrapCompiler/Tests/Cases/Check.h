@@ -0,0 +1,39 @@
+// Output for the regression cases. Each call writes one line of text
+// straight into VGA memory, where run_tests.py reads the screen back and
+// compares it with the case's "// expect:" lines.
+
+int check_row = 0;
+
+void check_line(char* text) {
+    char* cell = (char*)0xB8000 + check_row * 160;
+    int i;
+    for (i = 0; text[i]; i++) {
+        cell[i * 2] = text[i];
+        cell[i * 2 + 1] = 0x07;
+    }
+    check_row++;
+}
+
+void check_int(int value) {
+    char digits[12];
+    char text[12];
+    int count = 0;
+    int length = 0;
+    if (value < 0) {
+        text[length] = '-';
+        length++;
+        value = -value;
+    }
+    while (count == 0 || value > 0) {
+        digits[count] = '0' + value % 10;
+        count++;
+        value = value / 10;
+    }
+    while (count > 0) {
+        count--;
+        text[length] = digits[count];
+        length++;
+    }
+    text[length] = 0;
+    check_line(text);
+}
@@ -0,0 +1,23 @@
+// Directive lines inside block comments, and a '#' inside literals, are
+// ignored in compiled code just as they are in skipped branches.
+// expect: 3
+// expect: 5
+// expect: # is text
+#include "Check.h"
+#include "CommentedEndif.h"
+
+/*
+#if 0
+*/
+int three() { return 3; }
+/*
+#endif
+*/
+
+int kernel_main() {
+    char hash = '#';
+    check_int(three());
+    check_int(guarded);
+    check_line("# is text");
+    return hash == 35 ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+// Included by CommentedDirectives.c: the #endif inside the block comment
+// must not close the guard
+#ifndef COMMENTED_ENDIF_H
+#define COMMENTED_ENDIF_H
+
+/* A stray
+#endif
+in a comment */
+int guarded = 5;
+
+#endif
@@ -0,0 +1,14 @@
+// A directive inside a block comment must not make a header look like a
+// classic include guard, or its second #include is wrongly dropped.
+// expect: 2
+#include "Check.h"
+
+#include "CommentedGuard.h"
+#undef INCLUDED_LAST
+#define INCLUDED_LAST 1
+#include "CommentedGuard.h"
+
+int kernel_main() {
+    check_int(INCLUDED_LAST);
+    return 0;
+}
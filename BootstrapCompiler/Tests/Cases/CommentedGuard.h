@@ -0,0 +1,14 @@
+// Included twice by CommentedGuard.c. The guard ends at the first #endif,
+// so the lines after it are not guarded and the header must be read again.
+#ifndef COMMENTED_GUARD_H
+#define COMMENTED_GUARD_H
+/*
+#ifdef NOT_DEFINED
+*/
+int guarded_once = 1;
+#endif
+
+#undef INCLUDED_LAST
+#define INCLUDED_LAST 2
+/*
+#endif */
@@ -0,0 +1,14 @@
+// A header whose #ifndef group has an #else must be read again on its
+// second #include.
+// expect: 1
+// expect: 2
+#include "Check.h"
+
+#include "GuardWithElse.h"
+#include "GuardWithElse.h"
+
+int kernel_main() {
+    check_int(first);
+    check_int(second);
+    return 0;
+}
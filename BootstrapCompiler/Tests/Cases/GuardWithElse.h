@@ -0,0 +1,9 @@
+// Included twice by GuardWithElse.c. The #else belongs to the guard, so
+// this is not a plain include guard: the second include adds the #else
+// branch.
+#ifndef GUARD_WITH_ELSE_H
+#define GUARD_WITH_ELSE_H
+int first = 1;
+#else
+int second = 2;
+#endif
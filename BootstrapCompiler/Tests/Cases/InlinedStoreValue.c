@@ -0,0 +1,23 @@
+// A store whose value is an inlined call: the callee's locals must not take
+// the register of a variable the store's index still needs.
+// expect: OLLEH
+#include "Check.h"
+
+int to_upper(int c) {
+    if (c >= 'a' && c <= 'z') return c - 32;
+    return c;
+}
+
+int kernel_main() {
+    char* src = "hello";
+    char dst[8];
+    int n = 5;
+    int i;
+    for (i = 0; i < n; i++) {
+        int j = n - 1 - i;
+        dst[j] = to_upper(src[i]);
+    }
+    dst[n] = 0;
+    check_line(dst);
+    return 0;
+}
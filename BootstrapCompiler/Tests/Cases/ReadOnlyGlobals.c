@@ -0,0 +1,54 @@
+// Globals that are only ever read fold to their initializers at -O1, so
+// vga_scroll's loop bounds become immediates. A global that is written, or
+// that a function shadows with a local, keeps its load.
+// expect: second
+// expect: 3840
+// expect: 4000
+// expect: 7
+// expect: 11
+// asm-O1-lacks: [VGA_WIDTH]
+// asm-O1-lacks: [VGA_HEIGHT]
+#include "Check.h"
+
+// As declared in the IDE's stdlib
+int VGA_WIDTH = 80;
+int VGA_HEIGHT = 25;
+int VGA_MEMORY = 0xB8000;
+int vga_attr = 0x07;
+
+int counter = 10;
+int limit = 5;
+
+void vga_scroll() {
+    char* vga = (char*)VGA_MEMORY;
+    int i = 0;
+    while (i < VGA_WIDTH * (VGA_HEIGHT - 1) * 2) {
+        vga[i] = vga[i + VGA_WIDTH * 2];
+        i = i + 1;
+    }
+    i = VGA_WIDTH * (VGA_HEIGHT - 1) * 2;
+    while (i < VGA_WIDTH * VGA_HEIGHT * 2) {
+        vga[i] = 32;
+        vga[i + 1] = vga_attr;
+        i = i + 2;
+    }
+}
+
+int shadowed_limit() {
+    int limit = 7;
+    return limit;
+}
+
+int kernel_main() {
+    check_line("first");
+    check_line("second");
+    vga_scroll();
+
+    check_row = 1;
+    check_int(VGA_WIDTH * (VGA_HEIGHT - 1) * 2);
+    check_int(VGA_WIDTH * VGA_HEIGHT * 2);
+    check_int(shadowed_limit() + limit - 5);
+    counter++;
+    check_int(counter);
+    return 0;
+}
@@ -0,0 +1,55 @@
+// ++ and -- on a global must update the global even where the function
+// also has a register-allocated local of the same name that is not in
+// scope at that point.
+// expect: 51
+// expect: 101
+// expect: 99
+// expect: 14
+// expect: 3
+#include "Check.h"
+
+int h = 50;
+int g = 100;
+
+// The local is declared after the increment
+int before_local() {
+    ++h;
+    int h = 7;
+    h = h * 2;
+    return h;
+}
+
+// The local's block has ended before the increment
+int after_block() {
+    int total = 0;
+    int i;
+    for (i = 0; i < 3; i++) {
+        int g = i;
+        total = total + g;
+    }
+    ++g;
+    return total;
+}
+
+int after_block_decrement() {
+    int i;
+    for (i = 0; i < 2; i++) {
+        int g = i * 3;
+        --g;
+    }
+    --g;
+    --g;
+    return i;
+}
+
+int kernel_main() {
+    int doubled = before_local();
+    int total = after_block();
+    check_int(h);
+    check_int(g);
+    after_block_decrement();
+    check_int(g);
+    check_int(doubled);
+    check_int(total);
+    return 0;
+}
@@ -0,0 +1,25 @@
+// A "/*" inside a line comment in a skipped branch must not start a block
+// comment that hides the directive ending the branch.
+// expect: 2
+// expect: 7
+#include "Check.h"
+
+#ifdef NOT_DEFINED
+// matches src/* only
+int value = 1;
+#else
+int value = 2;
+#endif
+
+/* A later block comment */
+int other = 7;
+
+#ifdef NOT_DEFINED
+// a quote ' in a comment
+#endif
+
+int kernel_main() {
+    check_int(value);
+    check_int(other);
+    return 0;
+}
@@ -0,0 +1,27 @@
+// #if converts both operands to unsigned when either one is, so -1 is the
+// largest value once compared with 0u.
+// expect: 1
+// expect: 2
+// expect: 3
+// expect: 4
+#include "Check.h"
+
+int kernel_main() {
+#if -1 < 0u
+    check_int(0);
+#else
+    check_int(1);
+#endif
+#if -1 > 0
+    check_int(0);
+#elif 0xFFFFFFFFFFFFFFFF > 0 && -1 / 2u > 0
+    check_int(2);
+#endif
+#if (1 ? -1 : 0u) > 0 && -1 >> 1 < 0
+    check_int(3);
+#endif
+#if ~0u == 18446744073709551615u && -1 % 3 == -1
+    check_int(4);
+#endif
+    return 0;
+}
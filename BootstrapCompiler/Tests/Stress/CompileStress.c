@@ -0,0 +1,271 @@
+// Concurrency stress test for the in-process compiler API. Every unit is
+// compiled once up front for each mix of -O0/-O1 and text/binary output;
+// then one thread per core compiles all of them over and over through
+// compiler_compile, in an order that differs per thread and per round, and
+// every result is checked against the reference: success, output bytes
+// and diagnostics. Units that fail to compile are fine and worth including,
+// since the error path has to be reentrant too.
+//
+// From BootstrapCompiler (or build CompileStress.vcxproj):
+//
+//   gcc -O2 -D_strdup=strdup -o compile_stress Tests/Stress/CompileStress.c
+//       $(find Codegen Compiler Diagnostics Memory Optimizer Parser Tokenizer -name '*.c')
+//       -lpthread -lm
+//
+// Adding -fsanitize=thread also reports races that happen not to change
+// any output.
+//
+// Usage: compile_stress [-j threads] [-n rounds] unit.c ...
+
+#include "../../Compiler/Compiler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define VARIANTS 4           // -O0/-O1 times text/binary
+#define DEFAULT_ROUNDS 20
+#define MAX_THREADS 256
+
+typedef struct {
+    int succeeded;
+    char* output;
+    size_t size;
+    char* diagnostics;       // Every message, one per line
+} Reference;
+
+typedef struct {
+    const char* path;
+    char* source;
+    size_t length;
+    char base_dir[260];
+    Reference refs[VARIANTS];
+} Unit;
+
+typedef struct {
+    int id;
+    int rounds;
+    Unit* units;
+    int unit_count;
+    int compiles;
+    int mismatches;
+} Worker;
+
+/* ====================== Threads ====================== */
+
+static void worker_run(Worker* worker);
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+
+static DWORD WINAPI thread_entry(LPVOID arg) {
+    worker_run((Worker*)arg);
+    return 0;
+}
+
+static int thread_start(Thread* thread, Worker* worker) {
+    *thread = CreateThread(NULL, 0, thread_entry, worker, 0, NULL);
+    return *thread != NULL;
+}
+
+static void thread_join(Thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static int core_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t Thread;
+
+static void* thread_entry(void* arg) {
+    worker_run((Worker*)arg);
+    return NULL;
+}
+
+static int thread_start(Thread* thread, Worker* worker) {
+    return pthread_create(thread, NULL, thread_entry, worker) == 0;
+}
+
+static void thread_join(Thread thread) {
+    pthread_join(thread, NULL);
+}
+
+static int core_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+#endif
+
+/* ====================== Compiling ====================== */
+
+static CompilerResult* compile_variant(const Unit* unit, int variant) {
+    CompilerOptions options;
+    compiler_options_init(&options);
+    options.base_dir = unit->base_dir;
+    options.opt_level = variant & 1;
+    options.format = (variant & 2) ? COMPILER_OUTPUT_BINARY : COMPILER_OUTPUT_ASSEMBLY;
+    return compiler_compile(unit->source, unit->length, &options);
+}
+
+static char* diagnostic_text(const CompilerResult* result) {
+    size_t length = 0;
+    int count = compiler_diagnostic_count(result);
+    for (int i = 0; i < count; i++) {
+        length += strlen(compiler_diagnostic(result, i)->message) + 1;
+    }
+
+    char* text = (char*)malloc(length + 1);
+    text[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        strcat(text, compiler_diagnostic(result, i)->message);
+        strcat(text, "\n");
+    }
+    return text;
+}
+
+static void reference_build(Unit* unit, int variant) {
+    Reference* ref = &unit->refs[variant];
+    CompilerResult* result = compile_variant(unit, variant);
+    const char* output = compiler_output(result, &ref->size);
+
+    ref->succeeded = compiler_succeeded(result);
+    ref->output = (char*)malloc(ref->size + 1);
+    if (ref->size) memcpy(ref->output, output, ref->size);
+    ref->diagnostics = diagnostic_text(result);
+    compiler_result_free(result);
+}
+
+// Returns 1 if the result is the one the unit gave when compiled alone
+static int reference_matches(const Reference* ref, const CompilerResult* result) {
+    size_t size = 0;
+    const char* output = compiler_output(result, &size);
+    if (compiler_succeeded(result) != ref->succeeded || size != ref->size) return 0;
+    if (size && memcmp(output, ref->output, size) != 0) return 0;
+
+    char* diagnostics = diagnostic_text(result);
+    int same = strcmp(diagnostics, ref->diagnostics) == 0;
+    free(diagnostics);
+    return same;
+}
+
+static void worker_run(Worker* worker) {
+    for (int round = 0; round < worker->rounds; round++) {
+        for (int k = 0; k < worker->unit_count; k++) {
+            const Unit* unit = &worker->units[(k + worker->id + round) % worker->unit_count];
+            int variant = (k + worker->id + round) % VARIANTS;
+
+            CompilerResult* result = compile_variant(unit, variant);
+            if (!reference_matches(&unit->refs[variant], result)) {
+                if (worker->mismatches == 0) {
+                    fprintf(stderr, "thread %d: %s differs at -O%d %s\n", worker->id, unit->path,
+                        variant & 1, (variant & 2) ? "binary" : "text");
+                }
+                worker->mismatches++;
+            }
+            worker->compiles++;
+            compiler_result_free(result);
+        }
+    }
+}
+
+/* ====================== Main ====================== */
+
+static int unit_load(Unit* unit, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    unit->path = path;
+    unit->source = (char*)malloc(size > 0 ? size : 1);
+    unit->length = fread(unit->source, 1, size, f);
+    fclose(f);
+
+    // Includes are looked up next to the unit, as the driver does
+    const char* slash = strrchr(path, '/');
+    const char* backslash = strrchr(path, '\\');
+    const char* separator = slash > backslash ? slash : backslash;
+    if (separator) {
+        snprintf(unit->base_dir, sizeof(unit->base_dir), "%.*s", (int)(separator - path), path);
+    }
+    else {
+        snprintf(unit->base_dir, sizeof(unit->base_dir), ".");
+    }
+
+    for (int variant = 0; variant < VARIANTS; variant++) {
+        reference_build(unit, variant);
+    }
+    return 1;
+}
+
+static void unit_free(Unit* unit) {
+    for (int variant = 0; variant < VARIANTS; variant++) {
+        free(unit->refs[variant].output);
+        free(unit->refs[variant].diagnostics);
+    }
+    free(unit->source);
+}
+
+int main(int argc, char** argv) {
+    int threads = core_count();
+    int rounds = DEFAULT_ROUNDS;
+    int first_unit = 1;
+
+    while (first_unit + 1 < argc && argv[first_unit][0] == '-') {
+        if (strcmp(argv[first_unit], "-j") == 0) threads = atoi(argv[first_unit + 1]);
+        else if (strcmp(argv[first_unit], "-n") == 0) rounds = atoi(argv[first_unit + 1]);
+        else break;
+        first_unit += 2;
+    }
+    int unit_count = argc - first_unit;
+    if (unit_count <= 0 || threads <= 0 || rounds <= 0 || argv[first_unit][0] == '-') {
+        fprintf(stderr, "Usage: %s [-j threads] [-n rounds] unit.c ...\n", argv[0]);
+        return 1;
+    }
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    Unit* units = (Unit*)calloc(unit_count, sizeof(Unit));
+    for (int i = 0; i < unit_count; i++) {
+        if (!unit_load(&units[i], argv[first_unit + i])) {
+            fprintf(stderr, "Error: Could not open %s\n", argv[first_unit + i]);
+            return 1;
+        }
+    }
+
+    Worker workers[MAX_THREADS];
+    Thread handles[MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        workers[i].id = i;
+        workers[i].rounds = rounds;
+        workers[i].units = units;
+        workers[i].unit_count = unit_count;
+        workers[i].compiles = 0;
+        workers[i].mismatches = 0;
+        if (!thread_start(&handles[i], &workers[i])) break;
+        started++;
+    }
+
+    int compiles = 0;
+    int mismatches = 0;
+    for (int i = 0; i < started; i++) {
+        thread_join(handles[i]);
+        compiles += workers[i].compiles;
+        mismatches += workers[i].mismatches;
+    }
+
+    printf("%d threads, %d units, %d compiles, %d mismatches\n",
+        started, unit_count, compiles, mismatches);
+
+    for (int i = 0; i < unit_count; i++) unit_free(&units[i]);
+    free(units);
+    return mismatches != 0 || started != threads;
+}
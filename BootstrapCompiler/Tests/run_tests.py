@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Regression cases for the compiler.
+
+Compiles every Cases/*.c at -O0 and -O1 with the built-in assembler, runs
+the image's kernel_main as an ordinary 32-bit Linux process and compares
+what it wrote to VGA memory with the case's "// expect:" lines. A case can
+also list "// asm-O1-lacks:" lines, text its -O1 NASM listing must not
+contain.
+
+Needs a Linux (or WSL) shell with python3 and GNU binutils that can target
+i386 (as, ld, objcopy). The image is linked at its org of 0x8000, so
+vm.mmap_min_addr must not be above that:
+
+    sudo sysctl vm.mmap_min_addr=4096
+
+Usage: run_tests.py <compiler> [case.c ...]
+"""
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+OPT_LEVELS = ["-O0", "-O1"]
+
+IMAGE_BASE = 0x8000
+VGA_BASE = 0xB8000
+VGA_SIZE = 80 * 25 * 2
+BSS_RESERVE = 0x10000
+
+# Calls the image's entry point, writes the VGA buffer to stdout and exits
+# with kernel_main's return value
+STUB = """\
+.intel_syntax noprefix
+.text
+.globl __start
+__start:
+    mov eax, 0x%x
+    call eax
+    push eax
+    mov eax, 4
+    mov ebx, 1
+    mov ecx, 0x%x
+    mov edx, %d
+    int 0x80
+    pop ebx
+    mov eax, 1
+    int 0x80
+""" % (IMAGE_BASE, VGA_BASE, VGA_SIZE)
+
+LINKER_SCRIPT = """\
+SECTIONS {
+  .kern 0x%x : { image.o(.kern) }
+  .kbss (NOLOAD) : { . += 0x%x; }
+  .vga 0x%x (NOLOAD) : { . += %d; }
+  .text 0x2000000 : { stub.o(.text) }
+}
+""" % (IMAGE_BASE, BSS_RESERVE, VGA_BASE, VGA_SIZE)
+
+
+def directive_lines(path, directive):
+    lines = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith(directive):
+                lines.append(line[len(directive):].strip())
+    return lines
+
+
+def screen_lines(vga):
+    rows = []
+    for row in range(25):
+        cells = vga[row * 160:(row + 1) * 160:2]
+        rows.append(cells.decode("latin-1").replace("\0", " ").rstrip())
+    while rows and not rows[-1]:
+        rows.pop()
+    return rows
+
+
+def run(command, cwd):
+    result = subprocess.run(command, cwd=cwd, capture_output=True)
+    if result.returncode != 0:
+        raise RuntimeError("%s failed:\n%s" % (command[0],
+            (result.stdout + result.stderr).decode(errors="replace")))
+    return result
+
+
+# Returns the screen lines the case printed, or raises with the reason
+def run_case(compiler, case, opt_level, work):
+    image = os.path.join(work, "image.bin")
+    run([compiler, case, "-o", image, "--bin", opt_level], work)
+
+    with open(os.path.join(work, "stub.s"), "w") as f:
+        f.write(STUB)
+    with open(os.path.join(work, "link.ld"), "w") as f:
+        f.write(LINKER_SCRIPT)
+    run(["objcopy", "-I", "binary", "-O", "elf32-i386", "-B", "i386",
+         "--rename-section", ".data=.kern,alloc,load,contents,code",
+         "image.bin", "image.o"], work)
+    run(["as", "--32", "stub.s", "-o", "stub.o"], work)
+    run(["ld", "-m", "elf_i386", "-e", "__start", "-T", "link.ld",
+         "image.o", "stub.o", "-o", "case.elf"], work)
+
+    result = subprocess.run([os.path.join(work, "case.elf")], cwd=work,
+                            capture_output=True, timeout=10)
+    if result.returncode < 0:
+        raise RuntimeError("killed by signal %d" % -result.returncode)
+    return screen_lines(result.stdout)
+
+
+# Returns the lines of the -O1 listing that contain text the case rules out
+def check_listing(compiler, case, lacks, work):
+    listing = os.path.join(work, "case.asm")
+    run([compiler, case, "-o", listing, "-O1"], work)
+    found = []
+    with open(listing) as f:
+        for line in f:
+            if any(text in line for text in lacks):
+                found.append(line.strip())
+    return found
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip())
+        return 2
+
+    with open("/proc/sys/vm/mmap_min_addr") as f:
+        if int(f.read()) > IMAGE_BASE:
+            print("vm.mmap_min_addr is above 0x%x; see the note at the top of this script" % IMAGE_BASE)
+            return 2
+
+    compiler = os.path.abspath(sys.argv[1])
+    cases = [os.path.abspath(c) for c in sys.argv[2:]]
+    if not cases:
+        cases = sorted(glob.glob(os.path.join(HERE, "Cases", "*.c")))
+
+    failures = 0
+    for case in cases:
+        name = os.path.splitext(os.path.basename(case))[0]
+        expected = directive_lines(case, "// expect:")
+        asm_lacks = directive_lines(case, "// asm-O1-lacks:")
+        for opt_level in OPT_LEVELS:
+            with tempfile.TemporaryDirectory() as work:
+                try:
+                    actual = run_case(compiler, case, opt_level, work)
+                except (RuntimeError, subprocess.TimeoutExpired) as error:
+                    actual = None
+                    reason = str(error)
+            if actual == expected:
+                print("PASS %s %s" % (name, opt_level))
+                continue
+            failures += 1
+            print("FAIL %s %s" % (name, opt_level))
+            if actual is None:
+                print("  " + reason.strip().replace("\n", "\n  "))
+            else:
+                print("  expected: %r" % expected)
+                print("  got:      %r" % actual)
+
+        if not asm_lacks:
+            continue
+        with tempfile.TemporaryDirectory() as work:
+            try:
+                found = check_listing(compiler, case, asm_lacks, work)
+            except RuntimeError as error:
+                found = [str(error).strip()]
+        if not found:
+            print("PASS %s listing" % name)
+            continue
+        failures += 1
+        print("FAIL %s listing" % name)
+        for text in found:
+            print("  found: %s" % text)
+
+    print("%d failed" % failures if failures else "all passed")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -2,10 +2,16 @@
 #define PREPROCESSOR_H
 
 #include "../../Includes.h"
+#include "../../Memory/Interner/Interner.h"
+#include "../../Diagnostics/Diagnostics.h"
 
-// Preprocesses source code, handling #include and #define
+// Preprocesses source code, handling #include, #define and conditional
+// compilation; excluded branches are skipped line by line, unexpanded
 // Returns newly allocated string with preprocessed content
 // base_dir: directory to search for include files (use "." for current dir)
-char* preprocess(const char* source, const char* base_dir);
+// names: interner the macro names are stored in
+// diag: receives warnings and the error that stops preprocessing; NULL
+// prints them to stderr and exits on the error
+char* preprocess(const char* source, const char* base_dir, Interner* names, Diagnostics* diag);
 
 #endif // PREPROCESSOR_H
\ No newline at end of file
@@ -1,25 +1,63 @@
 #include "../Preprocessor.h"
+#include "../../../Memory/NameTable/NameTable.h"
 #include <stdio.h>
 #include <ctype.h>
+#include <limits.h>
 
-#define MAX_DEFINES 256
 #define MAX_INCLUDE_DEPTH 32
 
 typedef struct {
-    char* name;
+    const char* name;     // Interned, so defines are matched by pointer
     char* value;
+    size_t value_len;
 } Define;
 
+// A header seen by this compilation. Its text is read from disk once; it
+// is skipped entirely when #pragma once or its include guard says so
 typedef struct {
-    Define defines[MAX_DEFINES];
+    char* path;           // Canonical, the key in include_index
+    char* text;
+    const char* guard;    // Interned macro of an #ifndef/#define/#endif guard
+    int pragma_once;
+    int included;
+} IncludeFile;
+
+// Defines in order of first definition; index maps each name to its entry
+typedef struct {
+    Define* defines;
     int define_count;
+    int define_capacity;
+    NameTable index;
+    IncludeFile* includes;
+    int include_count;
+    int include_capacity;
+    NameTable include_index;
+    int current_include;  // File being preprocessed, -1 for the main source
     int include_depth;
     char* base_dir;
+    Interner* names;
+    Diagnostics* diag;
+    char* output;         // Every file writes its expansion here in turn
+    size_t output_len;
+    size_t output_capacity;
 } PreprocessorState;
 
-static PreprocessorState* pp_state_create(const char* base_dir) {
+static PreprocessorState* pp_state_create(const char* base_dir, Interner* names, Diagnostics* diag) {
     PreprocessorState* state = malloc(sizeof(PreprocessorState));
+    state->names = names;
+    state->diag = diag;
+    state->output = NULL;
+    state->output_len = 0;
+    state->output_capacity = 0;
+    state->defines = NULL;
     state->define_count = 0;
+    state->define_capacity = 0;
+    name_table_init(&state->index);
+    state->includes = NULL;
+    state->include_count = 0;
+    state->include_capacity = 0;
+    name_table_init(&state->include_index);
+    state->current_include = -1;
     state->include_depth = 0;
     state->base_dir = base_dir ? _strdup(base_dir) : _strdup(".");
     return state;
@@ -27,40 +65,64 @@ static PreprocessorState* pp_state_create(const char* base_dir) {
 
 static void pp_state_free(PreprocessorState* state) {
     for (int i = 0; i < state->define_count; i++) {
-        free(state->defines[i].name);
         free(state->defines[i].value);
     }
+    free(state->defines);
+    name_table_free(&state->index);
+    for (int i = 0; i < state->include_count; i++) {
+        free(state->includes[i].path);
+        free(state->includes[i].text);
+    }
+    free(state->includes);
+    name_table_free(&state->include_index);
     free(state->base_dir);
+    free(state->output);
     free(state);
 }
 
-static void add_define(PreprocessorState* state, const char* name, const char* value) {
-    if (state->define_count >= MAX_DEFINES) {
-        fprintf(stderr, "Too many #defines\n");
-        return;
+// Keeps room for the terminating NUL
+static void output_append(PreprocessorState* state, const char* text, size_t len) {
+    if (state->output_len + len + 1 > state->output_capacity) {
+        size_t capacity = state->output_capacity ? state->output_capacity : 4096;
+        while (state->output_len + len + 1 > capacity) capacity *= 2;
+        state->output = realloc(state->output, capacity);
+        state->output_capacity = capacity;
     }
+    memcpy(state->output + state->output_len, text, len);
+    state->output_len += len;
+}
+
+static void add_define(PreprocessorState* state, const char* name, const char* value) {
+    name = intern_cstr(state->names, name);
+    if (!value) value = "";
 
     // Check if already defined, if so update it
-    for (int i = 0; i < state->define_count; i++) {
-        if (strcmp(state->defines[i].name, name) == 0) {
-            free(state->defines[i].value);
-            state->defines[i].value = value ? _strdup(value) : _strdup("");
-            return;
+    int index = name_table_get(&state->index, name, -1);
+    if (index < 0) {
+        if (state->define_count >= state->define_capacity) {
+            state->define_capacity = state->define_capacity == 0 ? 64 : state->define_capacity * 2;
+            state->defines = realloc(state->defines, sizeof(Define) * state->define_capacity);
         }
+        index = state->define_count++;
+        state->defines[index].name = name;
+        name_table_put(&state->index, name, index);
+    }
+    else {
+        free(state->defines[index].value);
     }
 
-    state->defines[state->define_count].name = _strdup(name);
-    state->defines[state->define_count].value = value ? _strdup(value) : _strdup("");
-    state->define_count++;
+    state->defines[index].value = _strdup(value);
+    state->defines[index].value_len = strlen(value);
 }
 
-static const char* get_define(PreprocessorState* state, const char* name) {
-    for (int i = 0; i < state->define_count; i++) {
-        if (strcmp(state->defines[i].name, name) == 0) {
-            return state->defines[i].value;
-        }
-    }
-    return NULL;
+// An identifier that was never interned cannot name a define
+static const Define* get_define(PreprocessorState* state, const char* text, size_t len) {
+    if (state->define_count == 0) return NULL;
+    const char* name = interner_find(state->names, text, len);
+    if (!name) return NULL;
+
+    int index = name_table_get(&state->index, name, -1);
+    return index >= 0 ? &state->defines[index] : NULL;
 }
 
 static char* read_file(const char* filename) {
@@ -81,12 +143,172 @@ static char* read_file(const char* filename) {
     return content;
 }
 
-static char* preprocess_internal(PreprocessorState* state, const char* source);
+static void preprocess_internal(PreprocessorState* state, const char* source);
 
 static void skip_whitespace_inline(const char** p) {
     while (**p == ' ' || **p == '\t') (*p)++;
 }
 
+// The end of the comment, string or character literal starting at p, or p
+// itself if none starts there. Quotes and line comments end with the line;
+// nothing inside a line comment opens another comment.
+static const char* skip_comment_or_literal(const char* p) {
+    if (p[0] == '/' && p[1] == '/') {
+        while (*p && *p != '\n') p++;
+    }
+    else if (p[0] == '/' && p[1] == '*') {
+        const char* end = strstr(p + 2, "*/");
+        p = end ? end + 2 : p + strlen(p);
+    }
+    else if (*p == '"' || *p == '\'') {
+        char quote = *p++;
+        while (*p && *p != quote && *p != '\n') {
+            if (*p == '\\' && p[1] && p[1] != '\n') p++;
+            p++;
+        }
+        if (*p == quote) p++;
+    }
+    return p;
+}
+
+// The newline ending the line p is on, or the end of the text. A block
+// comment carries the line on, so directive lines inside it are passed over.
+static const char* skip_line_rest(const char* p) {
+    while (*p && *p != '\n') {
+        const char* end = skip_comment_or_literal(p);
+        p = end != p ? end : p + 1;
+    }
+    return p;
+}
+
+/* ====================== Include Cache ====================== */
+
+// Absolute path with links, "." and ".." resolved, so a header reached by
+// two spellings is one entry. NULL if the file does not exist.
+static char* canonical_path(const char* path) {
+#ifdef _WIN32
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    fclose(f);
+    return _fullpath(NULL, path, 0);
+#else
+    return realpath(path, NULL);
+#endif
+}
+
+// Skips whitespace, newlines and comments
+static const char* skip_blank(const char* p) {
+    while (1) {
+        if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        else if (p[0] == '/' && p[1] == '/') {
+            while (*p && *p != '\n') p++;
+        }
+        else if (p[0] == '/' && p[1] == '*') {
+            const char* end = strstr(p + 2, "*/");
+            p = end ? end + 2 : p + strlen(p);
+        }
+        else return p;
+    }
+}
+
+// Whether the directive word at p is exactly word
+static int word_at(const char* p, const char* word) {
+    size_t len = strlen(word);
+    return strncmp(p, word, len) == 0 && !isalnum((unsigned char)p[len]) && p[len] != '_';
+}
+
+// Reads "#word name" at p; name_len is 0 when the directive has no name
+static int match_directive(const char** p, const char* word, const char** name, size_t* name_len) {
+    const char* s = *p;
+    if (*s != '#') return 0;
+    s++;
+    while (*s == ' ' || *s == '\t') s++;
+    size_t len = strlen(word);
+    if (strncmp(s, word, len) != 0 || isalnum((unsigned char)s[len]) || s[len] == '_') return 0;
+    s += len;
+    while (*s == ' ' || *s == '\t') s++;
+    *name = s;
+    while (isalnum((unsigned char)*s) || *s == '_') s++;
+    *name_len = (size_t)(s - *name);
+    while (*s && *s != '\n') s++;
+    *p = s;
+    return 1;
+}
+
+// The macro of a classic include guard: the file opens with #ifndef X and
+// #define X, and the #endif matching that #ifndef is its last directive.
+// Returns NULL if the file has any other shape, including an #else or #elif
+// of the guard itself, whose lines a second include would still add.
+static const char* detect_guard(PreprocessorState* state, const char* text) {
+    const char* p = skip_blank(text);
+    const char *guard, *defined;
+    size_t guard_len, defined_len;
+
+    if (!match_directive(&p, "ifndef", &guard, &guard_len) || guard_len == 0) return NULL;
+    p = skip_blank(p);
+    if (!match_directive(&p, "define", &defined, &defined_len) ||
+        defined_len != guard_len || strncmp(guard, defined, guard_len) != 0) {
+        return NULL;
+    }
+
+    // Follow conditional nesting line by line to the matching #endif,
+    // passing over comments the way preprocess_internal does
+    int depth = 1;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        if (*p == '#') {
+            p++;
+            skip_whitespace_inline(&p);
+            if (word_at(p, "if") || word_at(p, "ifdef") || word_at(p, "ifndef")) depth++;
+            else if (depth == 1 && (word_at(p, "else") || word_at(p, "elif"))) return NULL;
+            else if (word_at(p, "endif") && --depth == 0) {
+                return *skip_blank(skip_line_rest(p)) ? NULL : intern(state->names, guard, guard_len);
+            }
+        }
+        p = skip_line_rest(p);
+    }
+    return NULL;
+}
+
+// The cache entry for the file at path, reading it on first use; -1 if
+// it cannot be opened
+static int include_lookup(PreprocessorState* state, const char* path) {
+    char* canonical = canonical_path(path);
+    if (!canonical) return -1;
+
+    int index = name_table_get(&state->include_index, canonical, -1);
+    if (index >= 0) {
+        free(canonical);
+        return index;
+    }
+
+    char* text = read_file(canonical);
+    if (!text) {
+        free(canonical);
+        return -1;
+    }
+
+    if (state->include_count >= state->include_capacity) {
+        state->include_capacity = state->include_capacity == 0 ? 16 : state->include_capacity * 2;
+        state->includes = realloc(state->includes, sizeof(IncludeFile) * state->include_capacity);
+    }
+    index = state->include_count++;
+    IncludeFile* file = &state->includes[index];
+    file->path = canonical;
+    file->text = text;
+    file->guard = detect_guard(state, text);
+    file->pragma_once = 0;
+    file->included = 0;
+    name_table_put(&state->include_index, file->path, index);
+    return index;
+}
+
+// Whether including the file again would add nothing
+static int include_is_redundant(PreprocessorState* state, const IncludeFile* file) {
+    if (file->pragma_once && file->included) return 1;
+    return file->guard && name_table_get(&state->index, file->guard, -1) >= 0;
+}
+
 static void extract_word(const char** p, char* buf, int max_len) {
     int i = 0;
     while ((isalnum(**p) || **p == '_' || **p == '.' || **p == '/' || **p == '\\') && i < max_len - 1) {
@@ -104,22 +326,398 @@ static int is_identifier_char(char c) {
     return isalnum(c) || c == '_';
 }
 
-static char* preprocess_internal(PreprocessorState* state, const char* source) {
+/* ====================== Conditional Compilation ====================== */
+
+#define MAX_CONDITIONAL_DEPTH 64
+#define MAX_CONDITION_EXPANSION 32
+
+// One open #if group of the file being preprocessed. Groups are only
+// pushed while their enclosing branch is kept; nested groups of a skipped
+// branch are counted by skip_excluded instead.
+typedef struct {
+    int active;           // Lines of the current branch are kept
+    int taken;            // Some branch of the group was kept already
+    int seen_else;
+    const char* start;    // The opening directive, for error reports
+} Conditional;
+
+static void pp_error(PreprocessorState* state, const char* source, const char* at, const char* message) {
+    int line = 1;
+    for (const char* s = source; s < at && *s; s++) {
+        if (*s == '\n') line++;
+    }
+    if (state->current_include >= 0) {
+        const char* path = state->includes[state->current_include].path;
+        diag_fatal(state->diag, DIAG_PREPROCESS, path, line, 0, "Error: %s at %s:%d", message, path, line);
+    }
+    diag_fatal(state->diag, DIAG_PREPROCESS, NULL, line, 0, "Error: %s at line %d", message, line);
+}
+
+// Steps over the lines of a branch that is not compiled without expanding
+// or copying them; nested groups are only counted. Returns the '#' of the
+// #elif, #else or #endif that ends the branch, or the end of the text.
+static const char* skip_excluded(const char* p) {
+    int depth = 0;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+        if (*p == '#') {
+            const char* hash = p++;
+            skip_whitespace_inline(&p);
+            if (word_at(p, "if") || word_at(p, "ifdef") || word_at(p, "ifndef")) {
+                depth++;
+            }
+            else if (word_at(p, "endif")) {
+                if (depth == 0) return hash;
+                depth--;
+            }
+            else if (depth == 0 && (word_at(p, "elif") || word_at(p, "else"))) {
+                return hash;
+            }
+        }
+
+        p = skip_line_rest(p);
+        if (*p) p++;
+    }
+    return p;
+}
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} CondText;
+
+static void cond_append(CondText* text, const char* s, size_t len) {
+    while (text->len + len + 1 >= text->capacity) {
+        text->capacity = text->capacity == 0 ? 128 : text->capacity * 2;
+        text->data = realloc(text->data, text->capacity);
+    }
+    memcpy(text->data + text->len, s, len);
+    text->len += len;
+    text->data[text->len] = '\0';
+}
+
+// Expands the text of an #if line up to end: defined X and defined(X) become
+// 1 or 0, macros are replaced by their expanded values and any identifier
+// left over is 0. Returns 0 if a defined operand is not an identifier.
+static int expand_condition(PreprocessorState* state, const char* p, const char* end,
+    CondText* out, int depth) {
+    while (p < end) {
+        if (p[0] == '/' && p + 1 < end && p[1] == '/') break;
+        if (p[0] == '/' && p + 1 < end && p[1] == '*') {
+            const char* close = strstr(p + 2, "*/");
+            p = close && close + 2 <= end ? close + 2 : end;
+            cond_append(out, " ", 1);
+        }
+        else if (isdigit((unsigned char)*p)) {
+            // Numbers with suffixes such as 10UL are copied whole
+            const char* start = p;
+            while (p < end && (isalnum((unsigned char)*p) || *p == '_')) p++;
+            cond_append(out, start, (size_t)(p - start));
+        }
+        else if (*p == '\'') {
+            const char* start = p++;
+            while (p < end && *p != '\'') {
+                if (*p == '\\' && p + 1 < end) p++;
+                p++;
+            }
+            if (p < end) p++;
+            cond_append(out, start, (size_t)(p - start));
+        }
+        else if (is_identifier_start(*p)) {
+            const char* start = p;
+            while (p < end && is_identifier_char(*p)) p++;
+            size_t len = (size_t)(p - start);
+
+            if (len == 7 && strncmp(start, "defined", 7) == 0) {
+                while (p < end && (*p == ' ' || *p == '\t')) p++;
+                int paren = p < end && *p == '(';
+                if (paren) {
+                    p++;
+                    while (p < end && (*p == ' ' || *p == '\t')) p++;
+                }
+                const char* name = p;
+                while (p < end && is_identifier_char(*p)) p++;
+                if (p == name || !is_identifier_start(*name)) return 0;
+                int is_defined = get_define(state, name, (size_t)(p - name)) != NULL;
+                if (paren) {
+                    while (p < end && (*p == ' ' || *p == '\t')) p++;
+                    if (p >= end || *p != ')') return 0;
+                    p++;
+                }
+                cond_append(out, is_defined ? " 1 " : " 0 ", 3);
+                continue;
+            }
+
+            const Define* define = get_define(state, start, len);
+            if (define && depth < MAX_CONDITION_EXPANSION) {
+                // Parenthesized nowhere, as if the text had been written out
+                cond_append(out, " ", 1);
+                if (!expand_condition(state, define->value, define->value + define->value_len, out, depth + 1)) {
+                    return 0;
+                }
+                cond_append(out, " ", 1);
+            }
+            else {
+                cond_append(out, " 0 ", 3);
+            }
+        }
+        else {
+            cond_append(out, p, 1);
+            p++;
+        }
+    }
+    return 1;
+}
+
+// Recursive descent over an expanded #if expression. As in C, values are
+// intmax_t or uintmax_t (long long here): a u suffix, or a literal too big
+// for long long, makes a value unsigned, and a binary operator converts both
+// sides to unsigned when either is. ok is cleared on the first error.
+typedef struct {
+    const char* p;
+    int ok;
+    int unevaluated;      // Inside an operand short-circuiting discards
+} CondParser;
+
+typedef struct {
+    long long value;      // The bits; read as unsigned long long if is_unsigned
+    int is_unsigned;
+} CondValue;
+
+static CondValue cond_signed(long long value) {
+    CondValue v = { value, 0 };
+    return v;
+}
+
+static CondValue cond_expression(CondParser* c);
+
+static void cond_skip(CondParser* c) {
+    while (*c->p == ' ' || *c->p == '\t' || *c->p == '\r') c->p++;
+}
+
+static int cond_accept(CondParser* c, const char* op) {
+    cond_skip(c);
+    size_t len = strlen(op);
+    if (strncmp(c->p, op, len) != 0) return 0;
+    // Keep < from matching the start of << or <=, & of &&, and so on
+    if (len == 1 && ((c->p[1] == op[0] && strchr("|&<>=", op[0])) ||
+        (c->p[1] == '=' && strchr("<>!=", op[0])))) {
+        return 0;
+    }
+    c->p += len;
+    return 1;
+}
+
+static CondValue cond_char(CondParser* c) {
+    c->p++;
+    long long value = (unsigned char)*c->p;
+    if (*c->p == '\\') {
+        c->p++;
+        switch (*c->p) {
+        case 'n':  value = '\n'; break;
+        case 't':  value = '\t'; break;
+        case 'r':  value = '\r'; break;
+        case '0':  value = 0;    break;
+        default:   value = (unsigned char)*c->p; break;
+        }
+    }
+    if (*c->p) c->p++;
+    if (*c->p != '\'') c->ok = 0;
+    else c->p++;
+    return cond_signed(value);
+}
+
+static CondValue cond_primary(CondParser* c) {
+    cond_skip(c);
+    if (cond_accept(c, "(")) {
+        CondValue value = cond_expression(c);
+        if (!cond_accept(c, ")")) c->ok = 0;
+        return value;
+    }
+    if (*c->p == '\'') return cond_char(c);
+    if (isdigit((unsigned char)*c->p)) {
+        char* end;
+        unsigned long long bits = strtoull(c->p, &end, 0);
+        CondValue value = { (long long)bits, bits > (unsigned long long)LLONG_MAX };
+        c->p = end;
+        while (*c->p == 'u' || *c->p == 'U' || *c->p == 'l' || *c->p == 'L') {
+            if (*c->p == 'u' || *c->p == 'U') value.is_unsigned = 1;
+            c->p++;
+        }
+        if (isalnum((unsigned char)*c->p) || *c->p == '_') c->ok = 0;
+        return value;
+    }
+    c->ok = 0;
+    return cond_signed(0);
+}
+
+// Negation and complement keep the operand's signedness; arithmetic goes
+// through unsigned long long so overflow wraps instead of being undefined
+static CondValue cond_unary(CondParser* c) {
+    CondValue v;
+    if (cond_accept(c, "!")) {
+        v = cond_unary(c);
+        return cond_signed(!v.value);
+    }
+    if (cond_accept(c, "~")) {
+        v = cond_unary(c);
+        v.value = (long long)~(unsigned long long)v.value;
+        return v;
+    }
+    if (cond_accept(c, "-")) {
+        v = cond_unary(c);
+        v.value = (long long)(0ULL - (unsigned long long)v.value);
+        return v;
+    }
+    if (cond_accept(c, "+")) return cond_unary(c);
+    return cond_primary(c);
+}
+
+// Binary operators by precedence, loosest first
+static const char* cond_levels[][5] = {
+    { "||" },
+    { "&&" },
+    { "|" },
+    { "^" },
+    { "&" },
+    { "==", "!=" },
+    { "<=", ">=", "<", ">" },
+    { "<<", ">>" },
+    { "+", "-" },
+    { "*", "/", "%" },
+};
+
+#define COND_LEVEL_COUNT ((int)(sizeof(cond_levels) / sizeof(cond_levels[0])))
+
+// Comparisons, && and || give a signed 0 or 1; shifts keep the type of their
+// left operand; everything else has the converted type of both operands
+static CondValue cond_apply(CondParser* c, const char* op, CondValue left, CondValue right) {
+    int is_unsigned = left.is_unsigned || right.is_unsigned;
+    unsigned long long ua = (unsigned long long)left.value;
+    unsigned long long ub = (unsigned long long)right.value;
+    long long a = left.value;
+    long long b = right.value;
+    CondValue result = { 0, is_unsigned };
+
+    if (strcmp(op, "||") == 0)      return cond_signed(a || b);
+    if (strcmp(op, "&&") == 0)      return cond_signed(a && b);
+    if (strcmp(op, "==") == 0)      return cond_signed(a == b);
+    if (strcmp(op, "!=") == 0)      return cond_signed(a != b);
+    if (strcmp(op, "<=") == 0)      return cond_signed(is_unsigned ? ua <= ub : a <= b);
+    if (strcmp(op, ">=") == 0)      return cond_signed(is_unsigned ? ua >= ub : a >= b);
+    if (strcmp(op, "<") == 0)       return cond_signed(is_unsigned ? ua < ub : a < b);
+    if (strcmp(op, ">") == 0)       return cond_signed(is_unsigned ? ua > ub : a > b);
+
+    if (strcmp(op, "<<") == 0) {
+        result.value = (long long)(ua << (ub & 63));
+        result.is_unsigned = left.is_unsigned;
+    }
+    else if (strcmp(op, ">>") == 0) {
+        result.value = left.is_unsigned ? (long long)(ua >> (ub & 63)) : a >> (ub & 63);
+        result.is_unsigned = left.is_unsigned;
+    }
+    else if (strcmp(op, "|") == 0)  result.value = a | b;
+    else if (strcmp(op, "^") == 0)  result.value = a ^ b;
+    else if (strcmp(op, "&") == 0)  result.value = a & b;
+    else if (strcmp(op, "+") == 0)  result.value = (long long)(ua + ub);
+    else if (strcmp(op, "-") == 0)  result.value = (long long)(ua - ub);
+    else if (strcmp(op, "*") == 0)  result.value = (long long)(ua * ub);
+    else if (b == 0) {
+        if (!c->unevaluated) c->ok = 0;
+    }
+    else if (is_unsigned) {
+        result.value = (long long)(op[0] == '/' ? ua / ub : ua % ub);
+    }
+    else if (a == LLONG_MIN && b == -1) {
+        // Wraps like the unsigned arithmetic above rather than trapping
+        result.value = op[0] == '/' ? a : 0;
+    }
+    else {
+        result.value = op[0] == '/' ? a / b : a % b;
+    }
+    return result;
+}
+
+static CondValue cond_binary(CondParser* c, int level) {
+    if (level == COND_LEVEL_COUNT) return cond_unary(c);
+
+    CondValue left = cond_binary(c, level + 1);
+    while (c->ok) {
+        const char* op = NULL;
+        for (int i = 0; i < 5 && cond_levels[level][i]; i++) {
+            if (cond_accept(c, cond_levels[level][i])) {
+                op = cond_levels[level][i];
+                break;
+            }
+        }
+        if (!op) break;
+
+        // The discarded side of || and && is still parsed, but cannot fail
+        int discarded = (strcmp(op, "||") == 0 && left.value) ||
+            (strcmp(op, "&&") == 0 && !left.value);
+        c->unevaluated += discarded;
+        CondValue right = cond_binary(c, level + 1);
+        c->unevaluated -= discarded;
+
+        left = cond_apply(c, op, left, right);
+    }
+    return left;
+}
+
+// The result has the converted type of both branches, as for any operator
+static CondValue cond_expression(CondParser* c) {
+    CondValue condition = cond_binary(c, 0);
+    if (!cond_accept(c, "?")) return condition;
+    c->unevaluated += !condition.value;
+    CondValue then_value = cond_expression(c);
+    c->unevaluated -= !condition.value;
+    if (!cond_accept(c, ":")) c->ok = 0;
+    c->unevaluated += condition.value != 0;
+    CondValue else_value = cond_expression(c);
+    c->unevaluated -= condition.value != 0;
+
+    CondValue result = condition.value ? then_value : else_value;
+    result.is_unsigned = then_value.is_unsigned || else_value.is_unsigned;
+    return result;
+}
+
+// Value of the #if or #elif expression from p to the end of its line
+static int eval_condition(PreprocessorState* state, const char* source, const char* p) {
+    const char* end = p;
+    while (*end && *end != '\n') end++;
+
+    CondText text = { NULL, 0, 0 };
+    cond_append(&text, "", 0);
+    int expanded = expand_condition(state, p, end, &text, 0);
+
+    CondParser c = { text.data, 1, 0 };
+    CondValue value = expanded ? cond_expression(&c) : cond_signed(0);
+    cond_skip(&c);
+    int ok = expanded && c.ok && *c.p == '\0';
+    free(text.data);
+
+    if (!ok) pp_error(state, source, p, "Invalid #if expression");
+    return value.value != 0;
+}
+
+// Appends the expansion of source to the output
+static void preprocess_internal(PreprocessorState* state, const char* source) {
     if (state->include_depth >= MAX_INCLUDE_DEPTH) {
-        fprintf(stderr, "Include depth too deep\n");
-        return _strdup("");
+        diag_report(state->diag, DIAG_WARNING, DIAG_PREPROCESS, NULL, 0, 0, "Include depth too deep");
+        return;
     }
     state->include_depth++;
 
-    size_t capacity = strlen(source) * 2 + 4096;
-    char* result = malloc(capacity);
-    size_t result_len = 0;
-
     const char* p = source;
+    Conditional conditionals[MAX_CONDITIONAL_DEPTH];
+    int conditional_depth = 0;
+    int line_start = 1;   // Only blanks and comments precede p on its line
 
     while (*p) {
         // Handle preprocessor directives
-        if (*p == '#') {
+        if (*p == '#' && line_start) {
+            const char* hash = p;
             p++;
             skip_whitespace_inline(&p);
 
@@ -149,22 +747,15 @@ static char* preprocess_internal(PreprocessorState* state, const char* source) {
                         snprintf(fullpath, sizeof(fullpath), "%s/%s", state->base_dir, filename);
                     }
 
-                    char* included = read_file(fullpath);
-                    if (included) {
-                        char* processed = preprocess_internal(state, included);
-                        free(included);
-
-                        size_t proc_len = strlen(processed);
-                        while (result_len + proc_len + 2 >= capacity) {
-                            capacity *= 2;
-                            result = realloc(result, capacity);
-                        }
-
-                        memcpy(result + result_len, processed, proc_len);
-                        result_len += proc_len;
-                        result[result_len++] = '\n';
-
-                        free(processed);
+                    int index = include_lookup(state, fullpath);
+                    if (index >= 0 && !include_is_redundant(state, &state->includes[index])) {
+                        int parent = state->current_include;
+                        state->includes[index].included = 1;
+                        state->current_include = index;
+                        // By index: nested includes may grow the cache
+                        preprocess_internal(state, state->includes[index].text);
+                        state->current_include = parent;
+                        output_append(state, "\n", 1);
                     }
                 }
             }
@@ -186,69 +777,152 @@ static char* preprocess_internal(PreprocessorState* state, const char* source) {
 
                 add_define(state, name, value);
             }
-            else if (strcmp(directive, "pragma") == 0 ||
-                strcmp(directive, "ifndef") == 0 ||
+            else if (strcmp(directive, "pragma") == 0) {
+                char pragma[64];
+                extract_word(&p, pragma, sizeof(pragma));
+                if (strcmp(pragma, "once") == 0 && state->current_include >= 0) {
+                    state->includes[state->current_include].pragma_once = 1;
+                }
+            }
+            else if (strcmp(directive, "undef") == 0) {
+                char name[128];
+                extract_word(&p, name, sizeof(name));
+                name_table_remove(&state->index, intern_cstr(state->names, name));
+            }
+            else if (strcmp(directive, "error") == 0) {
+                const char* end = p;
+                while (*end && *end != '\n' && *end != '\r') end++;
+                char message[256];
+                snprintf(message, sizeof(message), "#error %.*s", (int)(end - p), p);
+                pp_error(state, source, hash, message);
+            }
+            else if (strcmp(directive, "if") == 0 ||
                 strcmp(directive, "ifdef") == 0 ||
-                strcmp(directive, "endif") == 0) {
-                // Skip these directives entirely
+                strcmp(directive, "ifndef") == 0) {
+                if (conditional_depth >= MAX_CONDITIONAL_DEPTH) {
+                    pp_error(state, source, hash, "Conditionals nested too deep");
+                }
+
+                int keep;
+                if (directive[2] == '\0') {
+                    keep = eval_condition(state, source, p);
+                }
+                else {
+                    const char* name = p;
+                    while (is_identifier_char(*p)) p++;
+                    if (p == name) pp_error(state, source, hash, "Missing macro name");
+                    int is_defined = get_define(state, name, (size_t)(p - name)) != NULL;
+                    keep = directive[2] == 'd' ? is_defined : !is_defined;
+                }
+
+                Conditional* group = &conditionals[conditional_depth++];
+                group->active = keep;
+                group->taken = keep;
+                group->seen_else = 0;
+                group->start = hash;
+            }
+            else if (strcmp(directive, "elif") == 0 || strcmp(directive, "else") == 0) {
+                if (conditional_depth == 0) {
+                    pp_error(state, source, hash, directive[2] == 'i' ? "#elif without #if" : "#else without #if");
+                }
+                Conditional* group = &conditionals[conditional_depth - 1];
+                if (group->seen_else) pp_error(state, source, hash, "Branch after #else");
+
+                // The expression of an #elif is only evaluated if no branch was kept
+                if (directive[2] == 'i') {
+                    group->active = !group->taken && eval_condition(state, source, p);
+                }
+                else {
+                    group->active = !group->taken;
+                    group->seen_else = 1;
+                }
+                group->taken |= group->active;
+            }
+            else if (strcmp(directive, "endif") == 0) {
+                if (conditional_depth == 0) pp_error(state, source, hash, "#endif without #if");
+                conditional_depth--;
             }
 
             // Skip to end of line
             while (*p && *p != '\n') p++;
             if (*p == '\n') p++;
+
+            if (conditional_depth > 0 && !conditionals[conditional_depth - 1].active) {
+                p = skip_excluded(p);
+            }
+            continue;
+        }
+
+        // Comments and literals are copied whole, as skip_excluded steps
+        // over them: nothing inside one is a directive or a macro
+        const char* end = skip_comment_or_literal(p);
+        if (end != p) {
+            if (*p == '"' || *p == '\'') line_start = 0;
+            output_append(state, p, (size_t)(end - p));
+            p = end;
             continue;
         }
 
         // Handle identifier - check for macro expansion
         if (is_identifier_start(*p)) {
             const char* start = p;
-            char ident[128];
-            int i = 0;
-            while (is_identifier_char(*p) && i < sizeof(ident) - 1) {
-                ident[i++] = *p++;
-            }
-            ident[i] = '\0';
+            while (is_identifier_char(*p)) p++;
+            line_start = 0;
 
-            const char* replacement = get_define(state, ident);
-            if (replacement && strlen(replacement) > 0) {
+            const Define* define = get_define(state, start, (size_t)(p - start));
+            if (define && define->value_len > 0) {
                 // Expand the macro
-                size_t rep_len = strlen(replacement);
-                while (result_len + rep_len + 1 >= capacity) {
-                    capacity *= 2;
-                    result = realloc(result, capacity);
-                }
-                memcpy(result + result_len, replacement, rep_len);
-                result_len += rep_len;
+                output_append(state, define->value, define->value_len);
             }
             else {
                 // Keep original identifier
-                size_t ident_len = p - start;
-                while (result_len + ident_len + 1 >= capacity) {
-                    capacity *= 2;
-                    result = realloc(result, capacity);
-                }
-                memcpy(result + result_len, start, ident_len);
-                result_len += ident_len;
+                output_append(state, start, (size_t)(p - start));
             }
             continue;
         }
 
-        // Copy character as-is
-        if (result_len >= capacity - 1) {
-            capacity *= 2;
-            result = realloc(result, capacity);
+        // Copy plain text up to the next directive, identifier, comment or
+        // literal as-is
+        const char* run = p;
+        while (*p && !is_identifier_start(*p) && skip_comment_or_literal(p) == p) {
+            if (*p == '\n') line_start = 1;
+            else if (*p == '#' && line_start) break;
+            else if (*p != ' ' && *p != '\t' && *p != '\r') line_start = 0;
+            p++;
         }
-        result[result_len++] = *p++;
+        output_append(state, run, (size_t)(p - run));
+    }
+
+    if (conditional_depth > 0) {
+        pp_error(state, source, conditionals[conditional_depth - 1].start, "Unterminated conditional");
     }
 
-    result[result_len] = '\0';
     state->include_depth--;
-    return result;
 }
 
-char* preprocess(const char* source, const char* base_dir) {
-    PreprocessorState* state = pp_state_create(base_dir);
-    char* result = preprocess_internal(state, source);
+char* preprocess(const char* source, const char* base_dir, Interner* names, Diagnostics* diag) {
+    PreprocessorState* state = pp_state_create(base_dir, names, diag);
+
+    // An error leaves through here first, so the state is not leaked
+    jmp_buf cleanup;
+    jmp_buf* bailout = diag ? diag->bailout : NULL;
+    if (bailout) {
+        if (setjmp(cleanup)) {
+            pp_state_free(state);
+            diag->bailout = bailout;
+            longjmp(*bailout, 1);
+        }
+        diag->bailout = &cleanup;
+    }
+
+    state->output_capacity = strlen(source) * 2 + 4096;
+    state->output = malloc(state->output_capacity);
+    preprocess_internal(state, source);
+    state->output[state->output_len] = '\0';
+    if (bailout) diag->bailout = bailout;
+
+    char* result = state->output;
+    state->output = NULL;
     pp_state_free(state);
     return result;
 }
\ No newline at end of file
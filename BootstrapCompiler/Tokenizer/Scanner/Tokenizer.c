@@ -4,6 +4,14 @@
 #include <string.h>
 #include <ctype.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCAN_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 Scanner* scanner_create(char* source)
 {
     Scanner* s = (Scanner*)malloc(sizeof(Scanner));
@@ -11,7 +19,6 @@ Scanner* scanner_create(char* source)
     s->offset = 0;
     s->len = strlen(source);
     s->line = 1;
-    s->column = 1;
     return s;
 }
 
@@ -36,31 +43,163 @@ char advance(Scanner* s)
 {
     if (s->offset >= s->len) return '\0';
     char c = s->src[s->offset++];
-    if (c == '\n')
+    if (c == '\n') s->line++;
+    return c;
+}
+
+/* ====================== Bulk Scanning ====================== */
+
+/* Runs of whitespace, comment text and identifier characters are skipped
+   with raw pointer loops rather than peek/advance, 16 bytes per step where
+   SSE2 is available. Each helper returns the offset of the first byte at
+   or after from that ends the run (len if none does) and adds the newlines
+   it passed to *line. The vector loops stop 16 bytes short of len, since
+   the source buffer is not padded, and leave the tail to the scalar loop. */
+
+#ifdef SCAN_SSE2
+static int lowest_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static int count_bits(unsigned int mask)
+{
+    mask = mask - ((mask >> 1) & 0x55555555u);
+    mask = (mask & 0x33333333u) + ((mask >> 2) & 0x33333333u);
+    return (int)((((mask + (mask >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+}
+
+static unsigned int byte_mask(__m128i bytes, char c)
+{
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+}
+
+// Bytes lo..hi inclusive; both bounds below 0x80
+static __m128i in_range(__m128i bytes, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8((char)(lo - 1))),
+        _mm_cmplt_epi8(bytes, _mm_set1_epi8((char)(hi + 1))));
+}
+#endif
+
+static int is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int is_ident_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static size_t span_whitespace(const char* src, size_t from, size_t len, int* line)
+{
+#ifdef SCAN_SSE2
+    while (from + 16 <= len)
     {
-        s->line++;
-        s->column = 1;
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(src + from));
+        unsigned int newlines = byte_mask(bytes, '\n');
+        unsigned int spaces = newlines | byte_mask(bytes, ' ') |
+            byte_mask(bytes, '\t') | byte_mask(bytes, '\r');
+        unsigned int stop = ~spaces & 0xFFFF;
+        if (stop)
+        {
+            int index = lowest_bit(stop);
+            *line += count_bits(newlines & ((1u << index) - 1));
+            return from + index;
+        }
+        *line += count_bits(newlines);
+        from += 16;
     }
-    else
+#endif
+    while (from < len && is_space(src[from]))
     {
-        s->column++;
+        if (src[from] == '\n') (*line)++;
+        from++;
     }
-    return c;
+    return from;
+}
+
+// No newlines can be passed, so there is no line to update
+static size_t find_newline(const char* src, size_t from, size_t len)
+{
+#ifdef SCAN_SSE2
+    while (from + 16 <= len)
+    {
+        unsigned int newlines = byte_mask(_mm_loadu_si128((const __m128i*)(src + from)), '\n');
+        if (newlines) return from + lowest_bit(newlines);
+        from += 16;
+    }
+#endif
+    while (from < len && src[from] != '\n')
+        from++;
+    return from;
+}
+
+// Offset of the "*/" closing a block comment
+static size_t find_comment_end(const char* src, size_t from, size_t len, int* line)
+{
+#ifdef SCAN_SSE2
+    while (from + 17 <= len)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(src + from));
+        __m128i next = _mm_loadu_si128((const __m128i*)(src + from + 1));
+        unsigned int newlines = byte_mask(bytes, '\n');
+        unsigned int ends = byte_mask(bytes, '*') & byte_mask(next, '/');
+        if (ends)
+        {
+            int index = lowest_bit(ends);
+            *line += count_bits(newlines & ((1u << index) - 1));
+            return from + index;
+        }
+        *line += count_bits(newlines);
+        from += 16;
+    }
+#endif
+    while (from < len && !(src[from] == '*' && from + 1 < len && src[from + 1] == '/'))
+    {
+        if (src[from] == '\n') (*line)++;
+        from++;
+    }
+    return from;
+}
+
+static size_t span_identifier(const char* src, size_t from, size_t len)
+{
+#ifdef SCAN_SSE2
+    while (from + 16 <= len)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(src + from));
+        __m128i letters = in_range(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z');
+        __m128i digits = in_range(bytes, '0', '9');
+        unsigned int ident = (unsigned int)_mm_movemask_epi8(_mm_or_si128(letters, digits)) |
+            byte_mask(bytes, '_');
+        unsigned int stop = ~ident & 0xFFFF;
+        if (stop) return from + lowest_bit(stop);
+        from += 16;
+    }
+#endif
+    while (from < len && is_ident_char(src[from]))
+        from++;
+    return from;
 }
 
-void skip_line_comment(Scanner* s);
-void skip_block_comment(Scanner* s);
+/* ====================== Skipping ====================== */
 
 void skip_whitespace(Scanner* s)
 {
     while (1)
     {
+        s->offset = span_whitespace(s->src, s->offset, s->len, &s->line);
+
         char c = peek(s);
-        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
-        {
-            advance(s);
-        }
-        else if (c == '/' && peek_next(s) == '/')
+        if (c == '/' && peek_next(s) == '/')
         {
             skip_line_comment(s);
         }
@@ -77,8 +216,7 @@ void skip_whitespace(Scanner* s)
 
 void skip_line_comment(Scanner* s)
 {
-    while (peek(s) != '\n' && peek(s) != '\0')
-        advance(s);
+    s->offset = find_newline(s->src, s->offset, s->len);
     if (peek(s) == '\n') advance(s);
 }
 
@@ -87,103 +225,192 @@ void skip_block_comment(Scanner* s)
     advance(s); // '/'
     advance(s); // '*'
 
-    while (peek(s) != '\0')
+    s->offset = find_comment_end(s->src, s->offset, s->len, &s->line);
+    if (s->offset < s->len)
     {
-        if (peek(s) == '*' && peek_next(s) == '/')
-        {
-            advance(s); // '*'
-            advance(s); // '/'
-            return;
-        }
-        advance(s);
+        advance(s); // '*'
+        advance(s); // '/'
     }
 }
 
 void skip_preprocessor_line(Scanner* s)
 {
-    while (peek(s) != '\n' && peek(s) != '\0')
-        advance(s);
-    if (peek(s) == '\n') advance(s);
+    skip_line_comment(s);
+}
+
+/* ====================== Token Stream ====================== */
+
+void token_stream_init(TokenStream* ts, const char* source)
+{
+    memset(ts, 0, sizeof(*ts));
+    ts->source = source;
+}
+
+void token_stream_free(TokenStream* ts)
+{
+    free(ts->types);
+    free(ts->offsets);
+    free(ts->lengths);
+    free(ts->lines);
+    memset(ts, 0, sizeof(*ts));
+}
+
+void token_stream_push(TokenStream* ts, Tokens type, size_t offset, size_t length, int line)
+{
+    if (ts->count >= ts->capacity)
+    {
+        ts->capacity = ts->capacity == 0 ? 1024 : ts->capacity * 2;
+        ts->types = (unsigned char*)realloc(ts->types, ts->capacity);
+        ts->offsets = (unsigned int*)realloc(ts->offsets, ts->capacity * sizeof(unsigned int));
+        ts->lengths = (unsigned int*)realloc(ts->lengths, ts->capacity * sizeof(unsigned int));
+        ts->lines = (int*)realloc(ts->lines, ts->capacity * sizeof(int));
+    }
+    ts->types[ts->count] = (unsigned char)type;
+    ts->offsets[ts->count] = (unsigned int)offset;
+    ts->lengths[ts->count] = (unsigned int)length;
+    ts->lines[ts->count] = line;
+    ts->count++;
 }
 
-Token* token_create(Tokens type, char* word, int line, int column)
+int token_stream_column(const TokenStream* ts, size_t index)
 {
-    Token* t = (Token*)malloc(sizeof(Token));
-    t->type = type;
-    t->word = word;
-    t->line = line;
-    t->column = column;
-    return t;
+    size_t offset = ts->offsets[index];
+    size_t line_start = offset;
+    while (line_start > 0 && ts->source[line_start - 1] != '\n')
+        line_start--;
+    return (int)(offset - line_start) + 1;
 }
 
-void token_free(Token* t)
+/* ====================== Literal Values ====================== */
+
+// Decimal or 0x-prefixed hex, wrapping to 32 bits like the target does
+int token_int_value(const char* text, size_t len)
 {
-    if (t->word) free(t->word);
-    free(t);
+    unsigned int value = 0;
+    size_t i = 0;
+
+    if (len >= 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+    {
+        for (i = 2; i < len && isxdigit((unsigned char)text[i]); i++)
+        {
+            char c = text[i];
+            int digit = isdigit((unsigned char)c) ? c - '0' : (tolower((unsigned char)c) - 'a' + 10);
+            value = value * 16 + (unsigned int)digit;
+        }
+        return (int)value;
+    }
+
+    for (i = 0; i < len && isdigit((unsigned char)text[i]); i++)
+        value = value * 10 + (unsigned int)(text[i] - '0');
+    return (int)value;
 }
 
-Tokens check_keyword(const char* word)
+// Text between the quotes of a character literal
+char token_char_value(const char* text, size_t len)
 {
-    if (strcmp(word, "int") == 0) return TOKEN_INT;
-    if (strcmp(word, "char") == 0) return TOKEN_CHAR_KW;
-    if (strcmp(word, "void") == 0) return TOKEN_VOID;
-    if (strcmp(word, "struct") == 0) return TOKEN_STRUCT;
-    if (strcmp(word, "typedef") == 0) return TOKEN_TYPEDEF;
-    if (strcmp(word, "enum") == 0) return TOKEN_ENUM;
-    if (strcmp(word, "if") == 0) return TOKEN_IF;
-    if (strcmp(word, "else") == 0) return TOKEN_ELSE;
-    if (strcmp(word, "while") == 0) return TOKEN_WHILE;
-    if (strcmp(word, "for") == 0) return TOKEN_FOR;
-    if (strcmp(word, "return") == 0) return TOKEN_RETURN;
-    if (strcmp(word, "sizeof") == 0) return TOKEN_SIZEOF;
-    if (strcmp(word, "break") == 0) return TOKEN_BREAK;
-    if (strcmp(word, "continue") == 0) return TOKEN_CONTINUE;
+    if (len == 0) return 0;
+    if (text[0] != '\\') return text[0];
+    if (len < 2) return 0;
+
+    switch (text[1]) {
+    case 'n': return 10;
+    case 'r': return 13;
+    case 't': return 9;
+    case 'b': return 8;
+    case '0': return 0;
+    default: return text[1];
+    }
+}
+
+/* ====================== Scanning ====================== */
+
+/* Keywords are found with a perfect hash of an identifier's first and last
+   characters and its length, all known once scan_identifier has walked it,
+   so each identifier costs one table probe and at most one memcmp. The
+   multipliers were searched for offline to give every keyword its own slot;
+   the table is filled at compile time through KEYWORD_HASH, so adding a
+   keyword only needs a new KEYWORD line (rerun the search on a collision:
+   the compiler keeps the later entry, GCC warns with -Woverride-init). */
+
+#define KEYWORD_SLOTS 64
+#define KEYWORD_MAX_LEN 8   // Longest keyword other than the __ spellings
+#define KEYWORD_HASH(first, last, len) \
+    (((unsigned)(first) * 49 + (unsigned)(last) * 34 + (unsigned)(len)) & (KEYWORD_SLOTS - 1))
+
+typedef struct {
+    const char* word;
+    unsigned char len;
+    unsigned char type;
+} KeywordSlot;
+
+#define KEYWORD(text, first, last, token) \
+    [KEYWORD_HASH(first, last, sizeof(text) - 1)] = { text, sizeof(text) - 1, token }
+
+static const KeywordSlot keyword_table[KEYWORD_SLOTS] = {
+    KEYWORD("int", 'i', 't', TOKEN_INT),
+    KEYWORD("char", 'c', 'r', TOKEN_CHAR_KW),
+    KEYWORD("void", 'v', 'd', TOKEN_VOID),
+    KEYWORD("struct", 's', 't', TOKEN_STRUCT),
+    KEYWORD("typedef", 't', 'f', TOKEN_TYPEDEF),
+    KEYWORD("enum", 'e', 'm', TOKEN_ENUM),
+    KEYWORD("if", 'i', 'f', TOKEN_IF),
+    KEYWORD("else", 'e', 'e', TOKEN_ELSE),
+    KEYWORD("while", 'w', 'e', TOKEN_WHILE),
+    KEYWORD("for", 'f', 'r', TOKEN_FOR),
+    KEYWORD("return", 'r', 'n', TOKEN_RETURN),
+    KEYWORD("sizeof", 's', 'f', TOKEN_SIZEOF),
+    KEYWORD("break", 'b', 'k', TOKEN_BREAK),
+    KEYWORD("continue", 'c', 'e', TOKEN_CONTINUE),
 
     // NEW: Kernel keywords
-    if (strcmp(word, "inline") == 0) return TOKEN_INLINE;
-    if (strcmp(word, "static") == 0) return TOKEN_STATIC;
-    if (strcmp(word, "extern") == 0) return TOKEN_EXTERN;
-    if (strcmp(word, "volatile") == 0) return TOKEN_VOLATILE;
-    if (strcmp(word, "const") == 0) return TOKEN_CONST;
-    if (strcmp(word, "unsigned") == 0) return TOKEN_UNSIGNED;
-    if (strcmp(word, "signed") == 0) return TOKEN_SIGNED;
-    if (strcmp(word, "long") == 0) return TOKEN_LONG;
-    if (strcmp(word, "short") == 0) return TOKEN_SHORT;
-    if (strcmp(word, "register") == 0) return TOKEN_REGISTER;
-    if (strcmp(word, "asm") == 0) return TOKEN_ASM;
-    if (strcmp(word, "__asm__") == 0) return TOKEN_ASM;
-    if (strcmp(word, "__packed") == 0) return TOKEN_PACKED;
-    if (strcmp(word, "__attribute__") == 0) return TOKEN_IDENTIFIER;
+    KEYWORD("inline", 'i', 'e', TOKEN_INLINE),
+    KEYWORD("static", 's', 'c', TOKEN_STATIC),
+    KEYWORD("extern", 'e', 'n', TOKEN_EXTERN),
+    KEYWORD("volatile", 'v', 'e', TOKEN_VOLATILE),
+    KEYWORD("const", 'c', 't', TOKEN_CONST),
+    KEYWORD("unsigned", 'u', 'd', TOKEN_UNSIGNED),
+    KEYWORD("signed", 's', 'd', TOKEN_SIGNED),
+    KEYWORD("long", 'l', 'g', TOKEN_LONG),
+    KEYWORD("short", 's', 't', TOKEN_SHORT),
+    KEYWORD("register", 'r', 'r', TOKEN_REGISTER),
+    KEYWORD("asm", 'a', 'm', TOKEN_ASM),
+    KEYWORD("__asm__", '_', '_', TOKEN_ASM),
+    KEYWORD("__packed", '_', 'd', TOKEN_PACKED),
+    // __attribute__ scans as a plain identifier
+};
+
+#undef KEYWORD
+
+// Identifier text is not NUL-terminated in the stream
+Tokens check_keyword(const char* word, size_t len)
+{
+    if (len < 2 || (len > KEYWORD_MAX_LEN && word[0] != '_'))
+        return TOKEN_IDENTIFIER;
+
+    const KeywordSlot* slot = &keyword_table[KEYWORD_HASH(word[0], word[len - 1], len)];
+    if (slot->len == len && memcmp(word, slot->word, len) == 0)
+        return (Tokens)slot->type;
 
     return TOKEN_IDENTIFIER;
 }
 
-Token* scan_identifier(Scanner* s)
+Tokens scan_identifier(Scanner* s, TokenStream* out)
 {
-    int start = s->offset;
+    size_t start = s->offset;
     int line = s->line;
-    int column = s->column;
 
-    while (isalnum(peek(s)) || peek(s) == '_')
-        advance(s);
+    s->offset = span_identifier(s->src, s->offset, s->len);
 
-    int len = s->offset - start;
-    char* word = (char*)malloc(len + 1);
-    memcpy(word, s->src + start, len);
-    word[len] = '\0';
-
-    Tokens type = check_keyword(word);
-    return token_create(type, word, line, column);
+    size_t len = s->offset - start;
+    Tokens type = check_keyword(s->src + start, len);
+    token_stream_push(out, type, start, len, line);
+    return type;
 }
 
-Token* scan_number(Scanner* s)
+Tokens scan_number(Scanner* s, TokenStream* out)
 {
-    int start = s->offset;
+    size_t start = s->offset;
     int line = s->line;
-    int column = s->column;
-    char num_buffer[64] = { 0 };
-    int num_idx = 0;
-    int value = 0;
 
     if (peek(s) == '0' && (peek_next(s) == 'x' || peek_next(s) == 'X'))
     {
@@ -191,38 +418,25 @@ Token* scan_number(Scanner* s)
         advance(s); // 'x' or 'X'
 
         while (isxdigit(peek(s)))
-        {
-            num_buffer[num_idx++] = advance(s);
-        }
-        num_buffer[num_idx] = '\0';
-
-        value = (int)strtol(num_buffer, NULL, 16);
-
-        char* word = (char*)malloc(32);
-        sprintf(word, "%d", value);
-        return token_create(TOKEN_NUMBER, word, line, column);
+            advance(s);
     }
     else
     {
         while (isdigit(peek(s)))
             advance(s);
-
-        int len = s->offset - start;
-        char* word = (char*)malloc(len + 1);
-        memcpy(word, s->src + start, len);
-        word[len] = '\0';
-
-        return token_create(TOKEN_NUMBER, word, line, column);
     }
+
+    token_stream_push(out, TOKEN_NUMBER, start, s->offset - start, line);
+    return TOKEN_NUMBER;
 }
 
-Token* scan_string(Scanner* s)
+// The token text is what lies between the quotes, escapes included
+Tokens scan_string(Scanner* s, TokenStream* out)
 {
     int line = s->line;
-    int column = s->column;
     advance(s); // opening "
 
-    int start = s->offset;
+    size_t start = s->offset;
 
     while (peek(s) != '"' && peek(s) != '\0' && peek(s) != '\n')
     {
@@ -237,196 +451,139 @@ Token* scan_string(Scanner* s)
         }
     }
 
-    int len = s->offset - start;
-    char* word = (char*)malloc(len + 1);
-    memcpy(word, s->src + start, len);
-    word[len] = '\0';
+    size_t len = s->offset - start;
 
     if (peek(s) != '"')
     {
-        return token_create(TOKEN_ERROR, word, line, column);
+        token_stream_push(out, TOKEN_ERROR, start, len, line);
+        return TOKEN_ERROR;
     }
 
     advance(s); // closing "
-    return token_create(TOKEN_STRING, word, line, column);
+    token_stream_push(out, TOKEN_STRING, start, len, line);
+    return TOKEN_STRING;
 }
 
-Token* scan_char(Scanner* s)
+Tokens scan_char(Scanner* s, TokenStream* out)
 {
     int line = s->line;
-    int column = s->column;
     advance(s); // opening '
 
-    char char_value;
+    size_t start = s->offset;
 
     if (peek(s) == '\\')
     {
         advance(s); // backslash
-        char escaped = advance(s);
-        switch (escaped) {
-        case 'n': char_value = 10; break;
-        case 'r': char_value = 13; break;
-        case 't': char_value = 9; break;
-        case 'b': char_value = 8; break;
-        case '0': char_value = 0; break;
-        case '\\': char_value = '\\'; break;
-        case '\'': char_value = '\''; break;
-        case '"': char_value = '"'; break;
-        default: char_value = escaped; break;
-        }
+        advance(s); // escaped char
     }
     else if (peek(s) != '\0' && peek(s) != '\n' && peek(s) != '\'')
     {
-        char_value = advance(s);
-    }
-    else
-    {
-        char_value = 0;
+        advance(s);
     }
 
+    size_t len = s->offset - start;
+
     if (peek(s) != '\'')
     {
-        char* word = (char*)malloc(2);
-        word[0] = char_value;
-        word[1] = '\0';
-        return token_create(TOKEN_ERROR, word, line, column);
+        token_stream_push(out, TOKEN_ERROR, start, len, line);
+        return TOKEN_ERROR;
     }
 
     advance(s); // closing '
+    token_stream_push(out, TOKEN_CHAR, start, len, line);
+    return TOKEN_CHAR;
+}
 
-    char* word = (char*)malloc(2);
-    word[0] = char_value;
-    word[1] = '\0';
-    return token_create(TOKEN_CHAR, word, line, column);
+// Operators and delimiters; TOKEN_ERROR for a character that starts no token
+static Tokens scan_punctuator(Scanner* s, char c)
+{
+    advance(s);
+    switch (c)
+    {
+    case '+':
+        if (peek(s) == '+') { advance(s); return TOKEN_PLUS_PLUS; }
+        if (peek(s) == '=') { advance(s); return TOKEN_PLUS_ASSIGN; }
+        return TOKEN_PLUS;
+    case '-':
+        if (peek(s) == '-') { advance(s); return TOKEN_MINUS_MINUS; }
+        if (peek(s) == '=') { advance(s); return TOKEN_MINUS_ASSIGN; }
+        if (peek(s) == '>') { advance(s); return TOKEN_ARROW; }
+        return TOKEN_MINUS;
+    case '*':
+        if (peek(s) == '=') { advance(s); return TOKEN_STAR_ASSIGN; }
+        return TOKEN_STAR;
+    case '/':
+        if (peek(s) == '=') { advance(s); return TOKEN_SLASH_ASSIGN; }
+        return TOKEN_SLASH;
+    case '=':
+        if (peek(s) == '=') { advance(s); return TOKEN_EQUAL; }
+        return TOKEN_ASSIGN;
+    case '!':
+        if (peek(s) == '=') { advance(s); return TOKEN_NOT_EQUAL; }
+        return TOKEN_EXCLAIM;
+    case '<':
+        if (peek(s) == '=') { advance(s); return TOKEN_LESS_EQUAL; }
+        if (peek(s) == '<') { advance(s); return TOKEN_LSHIFT; }
+        return TOKEN_LESS;
+    case '>':
+        if (peek(s) == '=') { advance(s); return TOKEN_GREATER_EQUAL; }
+        if (peek(s) == '>') { advance(s); return TOKEN_RSHIFT; }
+        return TOKEN_GREATER;
+    case '&':
+        if (peek(s) == '&') { advance(s); return TOKEN_AND; }
+        return TOKEN_AMPERSAND;
+    case '|':
+        if (peek(s) == '|') { advance(s); return TOKEN_OR; }
+        return TOKEN_PIPE;
+    case '(': return TOKEN_LPAREN;
+    case ')': return TOKEN_RPAREN;
+    case '{': return TOKEN_LBRACE;
+    case '}': return TOKEN_RBRACE;
+    case '[': return TOKEN_LBRACKET;
+    case ']': return TOKEN_RBRACKET;
+    case ';': return TOKEN_SEMICOLON;
+    case ',': return TOKEN_COMMA;
+    case '.': return TOKEN_DOT;
+    case ':': return TOKEN_COLON;
+    case '?': return TOKEN_QUESTION;
+    case '%': return TOKEN_PERCENT;
+    case '^': return TOKEN_CARET;
+    case '~': return TOKEN_TILDE;
+    default: return TOKEN_ERROR;
+    }
 }
 
-Token* tokenize(Scanner* s)
+Tokens tokenize(Scanner* s, TokenStream* out)
 {
-    skip_whitespace(s);
+    while (1)
+    {
+        skip_whitespace(s);
+        if (peek(s) != '#') break;
+        skip_preprocessor_line(s);
+    }
 
     char c = peek(s);
     if (c == '\0')
-        return token_create(TOKEN_EOF, NULL, s->line, s->column);
-
-    int line = s->line;
-    int column = s->column;
-
-    if (c == '#')
     {
-        skip_preprocessor_line(s);
-        return tokenize(s);
+        token_stream_push(out, TOKEN_EOF, s->offset, 0, s->line);
+        return TOKEN_EOF;
     }
 
     if (isalpha(c) || c == '_')
-        return scan_identifier(s);
+        return scan_identifier(s, out);
 
     if (isdigit(c))
-        return scan_number(s);
+        return scan_number(s, out);
 
     if (c == '"')
-        return scan_string(s);
+        return scan_string(s, out);
 
     if (c == '\'')
-        return scan_char(s);
-
-    if (c == '+')
-    {
-        advance(s);
-        if (peek(s) == '+') { advance(s); return token_create(TOKEN_PLUS_PLUS, _strdup("++"), line, column); }
-        if (peek(s) == '=') { advance(s); return token_create(TOKEN_PLUS_ASSIGN, _strdup("+="), line, column); }
-        return token_create(TOKEN_PLUS, _strdup("+"), line, column);
-    }
-
-    if (c == '-')
-    {
-        advance(s);
-        if (peek(s) == '-') { advance(s); return token_create(TOKEN_MINUS_MINUS, _strdup("--"), line, column); }
-        if (peek(s) == '=') { advance(s); return token_create(TOKEN_MINUS_ASSIGN, _strdup("-="), line, column); }
-        if (peek(s) == '>') { advance(s); return token_create(TOKEN_ARROW, _strdup("->"), line, column); }
-        return token_create(TOKEN_MINUS, _strdup("-"), line, column);
-    }
+        return scan_char(s, out);
 
-    if (c == '*')
-    {
-        advance(s);
-        if (peek(s) == '=') { advance(s); return token_create(TOKEN_STAR_ASSIGN, _strdup("*="), line, column); }
-        return token_create(TOKEN_STAR, _strdup("*"), line, column);
-    }
-
-    if (c == '/')
-    {
-        advance(s);
-        if (peek(s) == '=') { advance(s); return token_create(TOKEN_SLASH_ASSIGN, _strdup("/="), line, column); }
-        return token_create(TOKEN_SLASH, _strdup("/"), line, column);
-    }
-
-    if (c == '=')
-    {
-        advance(s);
-        if (peek(s) == '=') { advance(s); return token_create(TOKEN_EQUAL, _strdup("=="), line, column); }
-        return token_create(TOKEN_ASSIGN, _strdup("="), line, column);
-    }
-
-    if (c == '!')
-    {
-        advance(s);
-        if (peek(s) == '=') { advance(s); return token_create(TOKEN_NOT_EQUAL, _strdup("!="), line, column); }
-        return token_create(TOKEN_EXCLAIM, _strdup("!"), line, column);
-    }
-
-    if (c == '<')
-    {
-        advance(s);
-        if (peek(s) == '=') { advance(s); return token_create(TOKEN_LESS_EQUAL, _strdup("<="), line, column); }
-        if (peek(s) == '<') { advance(s); return token_create(TOKEN_LSHIFT, _strdup("<<"), line, column); }
-        return token_create(TOKEN_LESS, _strdup("<"), line, column);
-    }
-
-    if (c == '>')
-    {
-        advance(s);
-        if (peek(s) == '=') { advance(s); return token_create(TOKEN_GREATER_EQUAL, _strdup(">="), line, column); }
-        if (peek(s) == '>') { advance(s); return token_create(TOKEN_RSHIFT, _strdup(">>"), line, column); }
-        return token_create(TOKEN_GREATER, _strdup(">"), line, column);
-    }
-
-    if (c == '&')
-    {
-        advance(s);
-        if (peek(s) == '&') { advance(s); return token_create(TOKEN_AND, _strdup("&&"), line, column); }
-        return token_create(TOKEN_AMPERSAND, _strdup("&"), line, column);
-    }
-
-    if (c == '|')
-    {
-        advance(s);
-        if (peek(s) == '|') { advance(s); return token_create(TOKEN_OR, _strdup("||"), line, column); }
-        return token_create(TOKEN_PIPE, _strdup("|"), line, column);
-    }
-
-    advance(s);
-    switch (c)
-    {
-    case '(': return token_create(TOKEN_LPAREN, _strdup("("), line, column);
-    case ')': return token_create(TOKEN_RPAREN, _strdup(")"), line, column);
-    case '{': return token_create(TOKEN_LBRACE, _strdup("{"), line, column);
-    case '}': return token_create(TOKEN_RBRACE, _strdup("}"), line, column);
-    case '[': return token_create(TOKEN_LBRACKET, _strdup("["), line, column);
-    case ']': return token_create(TOKEN_RBRACKET, _strdup("]"), line, column);
-    case ';': return token_create(TOKEN_SEMICOLON, _strdup(";"), line, column);
-    case ',': return token_create(TOKEN_COMMA, _strdup(","), line, column);
-    case '.': return token_create(TOKEN_DOT, _strdup("."), line, column);
-    case ':': return token_create(TOKEN_COLON, _strdup(":"), line, column);
-    case '?': return token_create(TOKEN_QUESTION, _strdup("?"), line, column);
-    case '%': return token_create(TOKEN_PERCENT, _strdup("%"), line, column);
-    case '^': return token_create(TOKEN_CARET, _strdup("^"), line, column);
-    case '~': return token_create(TOKEN_TILDE, _strdup("~"), line, column);
-    default:
-    {
-        char* bad = (char*)malloc(2);
-        bad[0] = c;
-        bad[1] = '\0';
-        return token_create(TOKEN_ERROR, bad, line, column);
-    }
-    }
-}
\ No newline at end of file
+    size_t start = s->offset;
+    int line = s->line;
+    Tokens type = scan_punctuator(s, c);
+    token_stream_push(out, type, start, s->offset - start, line);
+    return type;
+}
@@ -93,13 +93,20 @@ typedef enum
 	TOKEN_ERROR
 } Tokens;
 
+// Tokens as parallel arrays over the preprocessed source. A token's text
+// is the span [offset, offset + length) of source and is not copied; for
+// strings and characters the span excludes the quotes. Columns are not
+// stored and are recomputed from the offset when a diagnostic needs one.
 typedef struct
 {
-	Tokens type;
-	char* word;
-	int    line;
-	int    column;
-} Token;
+	const char* source;
+	unsigned char* types;
+	unsigned int* offsets;
+	unsigned int* lengths;
+	int* lines;
+	size_t count;
+	size_t capacity;
+} TokenStream;
 
 typedef struct
 {
@@ -107,7 +114,6 @@ typedef struct
 	size_t offset;
 	size_t len;
 	int line;
-	int column;
 } Scanner;
 
 Scanner* scanner_create(char* source);
@@ -119,13 +125,21 @@ char advance(Scanner* s);
 void skip_whitespace(Scanner* s);
 void skip_line_comment(Scanner* s);
 void skip_block_comment(Scanner* s);
-Token* token_create(Tokens type, char* word, int line, int column);
-void token_free(Token* t);
-Token* tokenize(Scanner* s);
-Token* scan_identifier(Scanner* s);
-Token* scan_number(Scanner* s);
-Token* scan_string(Scanner* s);
-Token* scan_char(Scanner* s);
-Tokens check_keyword(const char* word);
+
+void token_stream_init(TokenStream* ts, const char* source);
+void token_stream_free(TokenStream* ts);
+void token_stream_push(TokenStream* ts, Tokens type, size_t offset, size_t length, int line);
+int token_stream_column(const TokenStream* ts, size_t index);
+
+int token_int_value(const char* text, size_t len);
+char token_char_value(const char* text, size_t len);
+
+// Appends the next token to out and returns its type
+Tokens tokenize(Scanner* s, TokenStream* out);
+Tokens scan_identifier(Scanner* s, TokenStream* out);
+Tokens scan_number(Scanner* s, TokenStream* out);
+Tokens scan_string(Scanner* s, TokenStream* out);
+Tokens scan_char(Scanner* s, TokenStream* out);
+Tokens check_keyword(const char* word, size_t len);
 
 #endif // TOKENIZER_H
\ No newline at end of file